@@ -7,6 +7,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "bg_job.h"
 #include "utils.h"
@@ -14,10 +15,30 @@
 // (us)
 #define INFQ_LOG_THRESHOLD      10000
 
+// state of an executor served by a pool
+#define BG_EXEC_IDLE            0
+#define BG_EXEC_QUEUED          1
+#define BG_EXEC_RUNNING         2
+
+// a dedicated thread checks its preemptors every BG_YIELD_WAIT_US, and delays a job
+//  for BG_YIELD_MAX_US at most so that it doesn't starve (us)
+#define BG_YIELD_WAIT_US        1000
+#define BG_YIELD_MAX_US         100000
+
 void* bg_exec_run(void *);
+static void* bg_pool_run(void *);
+static int32_t bg_exec_run_job(bg_exec_t *exec, bg_job_t *job);
+static void bg_exec_give_way(bg_exec_t *exec);
+static void bg_pool_schedule(bg_exec_t *exec);
 
 int32_t
 bg_exec_init(bg_exec_t *exec, const char *name)
+{
+    return bg_exec_init_with_pool(exec, name, NULL);
+}
+
+int32_t
+bg_exec_init_with_pool(bg_exec_t *exec, const char *name, bg_pool_t *pool)
 {
     if (exec == NULL) {
         INFQ_ERROR_LOG("invalid param");
@@ -45,6 +66,14 @@ bg_exec_init(bg_exec_t *exec, const char *name)
         goto failed;
     }
 
+    if (pool != NULL) {
+        // jobs will be executed by the workers of pool, no thread is needed
+        exec->pool = pool;
+        exec->state = BG_EXEC_IDLE;
+        INFQ_DEBUG_LOG("successful to init pooled backgroud executor, name: %s", exec->name);
+        return INFQ_OK;
+    }
+
     // use to init thread
     if ((err = pthread_attr_init(&attr)) != 0) {
         INFQ_ERROR_LOG("failed to init mutex attr, err: %s", strerror(err));
@@ -111,6 +140,7 @@ bg_exec_continue(bg_exec_t *exec)
     }
     pthread_mutex_lock(&exec->mu);
     exec->suspended = 0;
+    bg_pool_schedule(exec);
     pthread_mutex_unlock(&exec->mu);
     pthread_cond_signal(&exec->cond);
     return INFQ_OK;
@@ -127,6 +157,7 @@ bg_exec_continue_if_suspended(bg_exec_t *exec)
     if (exec->suspended == 1) {
         INFQ_INFO_LOG("continue a suspended bg executor, name: %s", exec->name);
         exec->suspended = 0;
+        bg_pool_schedule(exec);
     }
     pthread_mutex_unlock(&exec->mu);
     pthread_cond_signal(&exec->cond);
@@ -169,6 +200,7 @@ bg_exec_add_job(
     }
     exec->job_count++;
 
+    bg_pool_schedule(exec);
     pthread_cond_signal(&exec->cond);
     pthread_mutex_unlock(&exec->mu);
 
@@ -191,7 +223,50 @@ bg_exec_destroy(bg_exec_t *exec)
         INFQ_ERROR_LOG("job list is not empty, name: %s, job count: %d", exec->name, exec->job_count);
     }
 
-    if (!exec->stopped) {
+    if (exec->pool != NULL) {
+        pthread_mutex_lock(&exec->mu);
+        exec->stopped = 1;
+        pthread_mutex_lock(&exec->pool->mu);
+        if (exec->state == BG_EXEC_QUEUED) {
+            bg_pool_t   *pool = exec->pool;
+            bg_exec_t   **p;
+
+            // unlink from the run queue of pool
+            for (p = &pool->ready_head[exec->priority]; *p != exec; p = &(*p)->ready_next);
+            *p = exec->ready_next;
+            if (pool->ready_tail[exec->priority] == exec) {
+                pool->ready_tail[exec->priority] = NULL;
+                for (p = &pool->ready_head[exec->priority]; *p != NULL; p = &(*p)->ready_next) {
+                    pool->ready_tail[exec->priority] = *p;
+                }
+            }
+            pool->ready_num[exec->priority]--;
+            exec->ready_next = NULL;
+            exec->state = BG_EXEC_IDLE;
+        }
+        pthread_mutex_unlock(&exec->pool->mu);
+
+        // wait for the worker which is executing a job of this executor
+        ts = time_us();
+        while (exec->state == BG_EXEC_RUNNING) {
+            pthread_cond_wait(&exec->cond, &exec->mu);
+        }
+        pthread_mutex_unlock(&exec->mu);
+        INFQ_INFO_LOG("detach from pool cost %lld us, name: %s", time_us() - ts, exec->name);
+
+        // clear job queue
+        while (exec->jobs_head != NULL) {
+            job = exec->jobs_head;
+            exec->jobs_head = job->next;
+            if (job->destory != NULL) {
+                job->destory(job->arg);
+            }
+            free(job);
+        }
+        exec->jobs_head = exec->jobs_tail = NULL;
+        exec->job_count = 0;
+        exec->pool = NULL;
+    } else if (!exec->stopped) {
         bg_exec_stop(exec);
         ts = time_us();
         if ((err = pthread_join(exec->tid, NULL)) != 0) {
@@ -210,6 +285,7 @@ bg_exec_destroy(bg_exec_t *exec)
             free(job);
         }
         exec->jobs_head = exec->jobs_tail = NULL;
+        exec->job_count = 0;
     }
 
     // NOTICE: 允许重复destroy，在mutex被destroy后，再次destroy会报错invalid
@@ -231,7 +307,8 @@ bg_exec_run(void *arg)
 {
     bg_job_t    *job;
     bg_exec_t   *exec;
-    long long   s;
+
+    int32_t     delayed = 0, ret;
 
     exec = (bg_exec_t *)arg;
     pthread_mutex_lock(&exec->mu);
@@ -243,37 +320,29 @@ bg_exec_run(void *arg)
             continue;
         }
 
+        // the jobs of preemptors get I/O first
+        if (!delayed && bg_exec_should_yield(exec)) {
+            bg_exec_give_way(exec);
+            delayed = 1;
+            continue;
+        }
+        delayed = 0;
+
         job = exec->jobs_head;
+        exec->running = job;
 
         pthread_mutex_unlock(&exec->mu);
 
-        // execute job
-        s = time_us();
-        if (job->runnable(job->arg) == INFQ_ERR) {
-            INFQ_ERROR_LOG("failed to execute background job, name: %s", exec->name);
-        }
-        s = time_us() - s;
-
-        if (job->tostr != NULL) {
-            if (s > INFQ_LOG_THRESHOLD) {
-                char    buf[INFQ_MAX_BUF_SIZE];
-                if (job->tostr(job->arg, buf, INFQ_MAX_BUF_SIZE) == INFQ_OK) {
-                    INFQ_INFO_LOG("finish job, job info: %s, elapse: %lldms, name: %s",
-                            buf,
-                            s / 1000,
-                            exec->name);
-                } else {
-                    INFQ_INFO_LOG("finish job, elapse: %lldms, name: %s", s / 1000, exec->name);
-                }
-            }
-        }
+        ret = bg_exec_run_job(exec, job);
 
-        // destory job
-        if (job->destory != NULL) {
-            job->destory(job->arg);
+        pthread_mutex_lock(&exec->mu);
+        exec->running = NULL;
+        if (ret == BG_JOB_YIELD) {
+            // keep the job at head, it's continued after the preemptors
+            exec->yield_count++;
+            continue;
         }
 
-        pthread_mutex_lock(&exec->mu);
         // remove job
         exec->jobs_head = job->next;
         exec->job_count--;
@@ -281,6 +350,8 @@ bg_exec_run(void *arg)
         if (exec->jobs_head == NULL) {
             exec->jobs_tail = NULL;
         }
+        // notify the drainer waiting for this executor
+        pthread_cond_broadcast(&exec->cond);
     }
 
     if (exec->stopped) {
@@ -305,7 +376,9 @@ bg_exec_distinct_job(bg_exec_t *exec, job_dup_check_t dup_checker, void *job, in
 
     pthread_mutex_lock(&exec->mu);
     last_job = exec->jobs_tail;
-    if (last_job != NULL) {
+    // NOTICE: the running job may have passed the blocks of the new job, so
+    //      it's never regarded as a dup
+    if (last_job != NULL && last_job != exec->running) {
         if (dup_checker(job, last_job->arg)) {
             *is_dup = INFQ_TRUE;
         }
@@ -332,3 +405,363 @@ bg_exec_pending_task_num(bg_exec_t *exec)
 
     return n;
 }
+
+int32_t
+bg_exec_drain(bg_exec_t *exec)
+{
+    if (exec == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     ret = INFQ_OK;
+
+    pthread_mutex_lock(&exec->mu);
+    while (!exec->stopped && exec->jobs_head != NULL) {
+        if (exec->suspended && exec->running == NULL) {
+            INFQ_ERROR_LOG("bg executor is suspended with pending jobs, name: %s, job count: %d",
+                    exec->name,
+                    exec->job_count);
+            ret = INFQ_ERR;
+            break;
+        }
+
+        // NOTICE: the dedicated thread waits on the same condition variable, so pass on
+        //      the wakeup which may be taken from it
+        pthread_cond_signal(&exec->cond);
+        pthread_cond_wait(&exec->cond, &exec->mu);
+    }
+    pthread_mutex_unlock(&exec->mu);
+
+    return ret;
+}
+
+int32_t
+bg_exec_set_priority(bg_exec_t *exec, int32_t priority, bg_exec_t *preemptor)
+{
+    if (exec == NULL || priority < 0 || priority >= BG_PRIO_NUM || preemptor == exec) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    pthread_mutex_lock(&exec->mu);
+    if (exec->jobs_head != NULL) {
+        pthread_mutex_unlock(&exec->mu);
+        INFQ_ERROR_LOG("can't change priority with pending jobs, name: %s", exec->name);
+        return INFQ_ERR;
+    }
+    exec->priority = priority;
+    exec->preemptor = preemptor;
+    pthread_mutex_unlock(&exec->mu);
+
+    return INFQ_OK;
+}
+
+int32_t
+bg_exec_should_yield(bg_exec_t *exec)
+{
+    if (exec == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_FALSE;
+    }
+
+    bg_exec_t   *p;
+
+    // NOTICE: read without the mutex of preemptors, a stale value only delays or
+    //      hastens a job a little
+    for (p = exec->preemptor; p != NULL; p = p->preemptor) {
+        if (p->pool != NULL) {
+            // a running executor doesn't wait for a worker
+            if (p->state == BG_EXEC_QUEUED) {
+                return INFQ_TRUE;
+            }
+        } else if (p->job_count > 0 && !p->suspended) {
+            return INFQ_TRUE;
+        }
+    }
+
+    return INFQ_FALSE;
+}
+
+int32_t
+bg_exec_ready_num(bg_exec_t *exec)
+{
+    if (exec == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return 0;
+    }
+
+    if (exec->pool == NULL) {
+        return 0;
+    }
+
+    return exec->pool->ready_num[exec->priority];
+}
+
+/**
+ * @brief Wait for the preemptors of a dedicated executor to finish their jobs, but
+ *  no longer than BG_YIELD_MAX_US. Must be called with the mutex of executor held.
+ */
+static void
+bg_exec_give_way(bg_exec_t *exec)
+{
+    struct timespec     ts;
+    long long           start;
+
+    exec->yield_count++;
+    start = time_us();
+    while (!exec->stopped && bg_exec_should_yield(exec)
+            && time_us() - start < BG_YIELD_MAX_US) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += BG_YIELD_WAIT_US * 1000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&exec->cond, &exec->mu, &ts);
+    }
+}
+
+/**
+ * @brief Execute a job, the job is destroyed unless it returns BG_JOB_YIELD.
+ */
+static int32_t
+bg_exec_run_job(bg_exec_t *exec, bg_job_t *job)
+{
+    long long   s;
+    int32_t     ret;
+
+    // execute job
+    s = time_us();
+    ret = job->runnable(job->arg);
+    if (ret == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to execute background job, name: %s", exec->name);
+    }
+    s = time_us() - s;
+
+    if (ret == BG_JOB_YIELD) {
+        INFQ_DEBUG_LOG("job yields to preemptors, elapse: %lldms, name: %s", s / 1000, exec->name);
+        return BG_JOB_YIELD;
+    }
+
+    if (job->tostr != NULL) {
+        if (s > INFQ_LOG_THRESHOLD) {
+            char    buf[INFQ_MAX_BUF_SIZE];
+            if (job->tostr(job->arg, buf, INFQ_MAX_BUF_SIZE) == INFQ_OK) {
+                INFQ_INFO_LOG("finish job, job info: %s, elapse: %lldms, name: %s",
+                        buf,
+                        s / 1000,
+                        exec->name);
+            } else {
+                INFQ_INFO_LOG("finish job, elapse: %lldms, name: %s", s / 1000, exec->name);
+            }
+        }
+    }
+
+    // destory job
+    if (job->destory != NULL) {
+        job->destory(job->arg);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Put a pooled executor into the run queue of its pool if it has jobs
+ *  to do and isn't queued or running yet. Must be called with the mutex of
+ *  executor held.
+ */
+static void
+bg_pool_schedule(bg_exec_t *exec)
+{
+    bg_pool_t   *pool = exec->pool;
+
+    if (pool == NULL || exec->stopped || exec->suspended || exec->jobs_head == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mu);
+    if (exec->state == BG_EXEC_IDLE) {
+        exec->state = BG_EXEC_QUEUED;
+        exec->ready_next = NULL;
+        if (pool->ready_tail[exec->priority] == NULL) {
+            pool->ready_head[exec->priority] = pool->ready_tail[exec->priority] = exec;
+        } else {
+            pool->ready_tail[exec->priority]->ready_next = exec;
+            pool->ready_tail[exec->priority] = exec;
+        }
+        pool->ready_num[exec->priority]++;
+        pthread_cond_signal(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mu);
+}
+
+int32_t
+bg_pool_init(bg_pool_t *pool, int32_t thread_num)
+{
+    if (pool == NULL || thread_num <= 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     err;
+
+    memset(pool, 0, sizeof(bg_pool_t));
+    if ((err = pthread_mutex_init(&pool->mu, NULL)) != 0) {
+        INFQ_ERROR_LOG("failed to init mutex, err: %s", strerror(err));
+        return INFQ_ERR;
+    }
+    if ((err = pthread_cond_init(&pool->cond, NULL)) != 0) {
+        INFQ_ERROR_LOG("failed to init conditin variable, err: %s", strerror(err));
+        pthread_mutex_destroy(&pool->mu);
+        return INFQ_ERR;
+    }
+
+    pool->tids = (pthread_t *)malloc(sizeof(pthread_t) * thread_num);
+    if (pool->tids == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for worker threads, count: %d", thread_num);
+        goto failed;
+    }
+
+    for (; pool->thread_num < thread_num; pool->thread_num++) {
+        if ((err = pthread_create(&pool->tids[pool->thread_num], NULL, bg_pool_run, pool)) != 0) {
+            INFQ_ERROR_LOG("failed to create worker thread, err: %s", strerror(err));
+            goto failed;
+        }
+    }
+
+    INFQ_INFO_LOG("successful to init backgroud pool, worker count: %d", thread_num);
+
+    return INFQ_OK;
+
+failed:
+    bg_pool_destroy(pool);
+    return INFQ_ERR;
+}
+
+int32_t
+bg_pool_destroy(bg_pool_t *pool)
+{
+    if (pool == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     err;
+
+    for (int32_t i = 0; i < BG_PRIO_NUM; i++) {
+        if (pool->ready_head[i] != NULL) {
+            INFQ_ERROR_LOG("run queue of pool is not empty, some executors are still alive, "
+                    "priority: %d", i);
+        }
+    }
+
+    pthread_mutex_lock(&pool->mu);
+    pool->stopped = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mu);
+
+    for (int32_t i = 0; i < pool->thread_num; i++) {
+        if ((err = pthread_join(pool->tids[i], NULL)) != 0) {
+            INFQ_ERROR_LOG("failed to join worker thread, err: %s", strerror(err));
+        }
+    }
+    free(pool->tids);
+    pool->tids = NULL;
+    pool->thread_num = 0;
+
+    if ((err = pthread_mutex_destroy(&pool->mu)) != 0 && err != EINVAL) {
+        INFQ_ERROR_LOG("failed to destory mutex, err: %s", strerror(err));
+        return INFQ_ERR;
+    }
+
+    if ((err = pthread_cond_destroy(&pool->cond)) != 0 && err != EINVAL) {
+        INFQ_ERROR_LOG("failed to destory condition variable, err: %s", strerror(err));
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+static void*
+bg_pool_run(void *arg)
+{
+    bg_pool_t   *pool;
+    bg_exec_t   *exec;
+    bg_job_t    *job;
+    int32_t     prio, ret;
+
+    pool = (bg_pool_t *)arg;
+
+    for (;;) {
+        // fetch the first executor from the run queue of the highest priority
+        pthread_mutex_lock(&pool->mu);
+        for (;;) {
+            for (prio = 0; prio < BG_PRIO_NUM && pool->ready_head[prio] == NULL; prio++);
+            if (pool->stopped || prio < BG_PRIO_NUM) {
+                break;
+            }
+            pthread_cond_wait(&pool->cond, &pool->mu);
+        }
+        if (pool->stopped) {
+            pthread_mutex_unlock(&pool->mu);
+            break;
+        }
+        exec = pool->ready_head[prio];
+        pool->ready_head[prio] = exec->ready_next;
+        if (pool->ready_head[prio] == NULL) {
+            pool->ready_tail[prio] = NULL;
+        }
+        pool->ready_num[prio]--;
+        exec->ready_next = NULL;
+        exec->state = BG_EXEC_RUNNING;
+        pthread_mutex_unlock(&pool->mu);
+
+        // NOTICE: the executor can't be destroyed while it's RUNNING, so it's
+        //  safe to access it without the mutex of pool.
+        pthread_mutex_lock(&exec->mu);
+        job = NULL;
+        if (!exec->stopped && !exec->suspended) {
+            job = exec->jobs_head;
+            exec->running = job;
+        }
+        pthread_mutex_unlock(&exec->mu);
+
+        // only one job each turn, so that executors are served fairly
+        ret = INFQ_OK;
+        if (job != NULL) {
+            ret = bg_exec_run_job(exec, job);
+        }
+
+        pthread_mutex_lock(&exec->mu);
+        if (job != NULL && ret == BG_JOB_YIELD) {
+            // keep the job at head, the executors of higher priority are fetched
+            //  before it's requeued
+            exec->running = NULL;
+            exec->yield_count++;
+        } else if (job != NULL) {
+            exec->running = NULL;
+            // remove job
+            exec->jobs_head = job->next;
+            exec->job_count--;
+            free(job);
+            if (exec->jobs_head == NULL) {
+                exec->jobs_tail = NULL;
+            }
+        }
+
+        pthread_mutex_lock(&pool->mu);
+        exec->state = BG_EXEC_IDLE;
+        pthread_mutex_unlock(&pool->mu);
+        // requeue to the tail if there are more jobs
+        bg_pool_schedule(exec);
+
+        // notify the destroyer waiting for this executor
+        pthread_cond_broadcast(&exec->cond);
+        pthread_mutex_unlock(&exec->mu);
+    }
+
+    INFQ_INFO_LOG("bg_pool worker exit");
+
+    return NULL;
+}
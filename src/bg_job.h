@@ -12,6 +12,16 @@
 
 #include "infq.h"
 
+// priorities of executors, a smaller value is served first
+#define BG_PRIO_HIGH            0
+#define BG_PRIO_NORMAL          1
+#define BG_PRIO_LOW             2
+#define BG_PRIO_NUM             3
+
+// returned by a runnable to give up the executor before it's finished. The job is
+//  kept at the head of job list, and executed again later with the same arg.
+#define BG_JOB_YIELD            1
+
 typedef int32_t (*runnable_t)(void *arg);
 typedef void (*destroy_t)(void *arg);
 typedef int32_t (*tostr_t)(void *arg, char *buf, int32_t size);
@@ -25,6 +35,8 @@ typedef struct _bg_job_t {
     tostr_t             tostr;
 } bg_job_t;
 
+struct _bg_pool_t;
+
 typedef struct _bg_exec_t {
     pthread_t           tid;
     char                name[INFQ_MAX_PATH_SIZE];
@@ -34,12 +46,73 @@ typedef struct _bg_exec_t {
     pthread_cond_t      cond;
 
     bg_job_t            *jobs_head, *jobs_tail;
+    // the job being executed, it stays at the head of job list until finished
+    bg_job_t            *running;
     volatile int32_t    job_count;
     volatile int8_t     stopped;
     volatile int8_t     suspended;
+
+    // set when the executor is served by a shared pool instead of its own thread
+    struct _bg_pool_t   *pool;
+    // next executor in the run queue of the pool
+    struct _bg_exec_t   *ready_next;
+    // BG_EXEC_IDLE/BG_EXEC_QUEUED/BG_EXEC_RUNNING, protected by the mutex of pool
+    volatile int8_t     state;
+
+    // BG_PRIO_*
+    int8_t              priority;
+    // the executor with higher priority which this one yields to, it may also
+    //  have a preemptor
+    struct _bg_exec_t   *preemptor;
+    // count of jobs yielded or delayed for the preemptors
+    volatile int32_t    yield_count;
 } bg_exec_t;
 
+/**
+ * @brief A pool of worker threads shared by many executors. Executors which
+ *  have pending jobs are linked in a FIFO run queue of their priority. A worker
+ *  takes the first executor of the highest priority, runs one job of it and
+ *  appends it to the tail again if it still has jobs, so executors of the same
+ *  priority get served in round robin. An executor is handled by at most one
+ *  worker at a time, so its jobs are executed in order.
+ */
+typedef struct _bg_pool_t {
+    pthread_t           *tids;
+    int32_t             thread_num;
+
+    // used to protect the run queue
+    pthread_mutex_t     mu;
+    pthread_cond_t      cond;
+
+    // a run queue for each priority
+    bg_exec_t           *ready_head[BG_PRIO_NUM], *ready_tail[BG_PRIO_NUM];
+    volatile int32_t    ready_num[BG_PRIO_NUM];
+    volatile int8_t     stopped;
+} bg_pool_t;
+
 int32_t bg_exec_init(bg_exec_t *exec, const char *name);
+/**
+ * @brief Init an executor which runs its jobs on the worker threads of 'pool'.
+ *  If 'pool' is NULL, a dedicated thread is created as bg_exec_init does.
+ */
+int32_t bg_exec_init_with_pool(bg_exec_t *exec, const char *name, bg_pool_t *pool);
+/**
+ * @brief Set the priority of executor and the executor it yields to. It should be
+ *  called before any job is added. A dedicated thread delays the jobs while the
+ *  preemptors have pending jobs, and a pool serves the executors of higher priority
+ *  first.
+ */
+int32_t bg_exec_set_priority(bg_exec_t *exec, int32_t priority, bg_exec_t *preemptor);
+/**
+ * @brief Check whether any preemptor of the executor is waiting for I/O. It's used
+ *  by long jobs to return BG_JOB_YIELD at a safe point.
+ */
+int32_t bg_exec_should_yield(bg_exec_t *exec);
+/**
+ * @brief Number of executors with the same priority waiting for the workers of
+ *  pool, 0 for an executor with a dedicated thread.
+ */
+int32_t bg_exec_ready_num(bg_exec_t *exec);
 int32_t bg_exec_start(bg_exec_t *exec);
 int32_t bg_exec_stop(bg_exec_t *exec);
 int32_t bg_exec_suspend(bg_exec_t *exec);
@@ -50,5 +123,17 @@ int32_t bg_exec_destroy(bg_exec_t *exec);
 int32_t bg_exec_add_job(bg_exec_t *exec, runnable_t runnable, void *arg, destroy_t destory, tostr_t tostr);
 int32_t bg_exec_distinct_job(bg_exec_t *exec, job_dup_check_t distinctor, void *job, int32_t *is_dup);
 int32_t bg_exec_pending_task_num(bg_exec_t *exec);
+/**
+ * @brief Wait until all the jobs added are finished. It fails if the executor is
+ *  suspended with pending jobs.
+ */
+int32_t bg_exec_drain(bg_exec_t *exec);
+
+int32_t bg_pool_init(bg_pool_t *pool, int32_t thread_num);
+/**
+ * @brief Stop and join all workers. All executors of the pool must have been
+ *  destroyed before.
+ */
+int32_t bg_pool_destroy(bg_pool_t *pool);
 
 #endif
@@ -0,0 +1,164 @@
+/**
+ *
+ * @file    block_pool
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "block_pool.h"
+#include "infq.h"
+
+#define BLOCK_POOL_INIT_CAPACITY    16
+
+typedef struct _block_pool_t {
+    pthread_mutex_t     mu;
+    volatile int64_t    budget;         /* Max bytes of all blocks, 0 means no limit */
+    volatile int64_t    used;           /* Bytes of blocks allocated, including free ones */
+    mem_block_t         **free_blocks;  /* Cached free blocks */
+    int32_t             free_num;
+    int32_t             capacity;       /* Capacity of 'free_blocks' */
+} block_pool_t;
+
+static block_pool_t g_block_pool = {PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL, 0, 0};
+
+static void block_pool_shrink_cache(block_pool_t *pool, int64_t need);
+
+void
+block_pool_set_budget(int64_t budget)
+{
+    pthread_mutex_lock(&g_block_pool.mu);
+    g_block_pool.budget = budget < 0 ? 0 : budget;
+    block_pool_shrink_cache(&g_block_pool, 0);
+    pthread_mutex_unlock(&g_block_pool.mu);
+}
+
+int64_t
+block_pool_budget(void)
+{
+    return g_block_pool.budget;
+}
+
+int64_t
+block_pool_used(void)
+{
+    return g_block_pool.used;
+}
+
+int32_t
+block_pool_over_budget(void)
+{
+    return g_block_pool.budget > 0 && g_block_pool.used > g_block_pool.budget;
+}
+
+mem_block_t*
+block_pool_get(int32_t block_size)
+{
+    block_pool_t    *pool = &g_block_pool;
+    mem_block_t     *block;
+    int32_t         i;
+
+    pthread_mutex_lock(&pool->mu);
+    // reuse a cached block of the same size
+    for (i = pool->free_num - 1; i >= 0; i--) {
+        block = pool->free_blocks[i];
+        if (block->mem_size == block_size) {
+            pool->free_blocks[i] = pool->free_blocks[--pool->free_num];
+            pthread_mutex_unlock(&pool->mu);
+            return block;
+        }
+    }
+
+    // make room for the new block by freeing cached blocks of other sizes
+    block_pool_shrink_cache(pool, block_size);
+    pool->used += block_size;
+    pthread_mutex_unlock(&pool->mu);
+
+    block = mem_block_init(block_size);
+    if (block == NULL) {
+        pthread_mutex_lock(&pool->mu);
+        pool->used -= block_size;
+        pthread_mutex_unlock(&pool->mu);
+        INFQ_ERROR_LOG("failed to alloc memory block from pool, size: %d", block_size);
+        return NULL;
+    }
+
+    return block;
+}
+
+void
+block_pool_put(mem_block_t *block)
+{
+    if (block == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return;
+    }
+
+    block_pool_t    *pool = &g_block_pool;
+    mem_block_t     **blocks;
+    int32_t         capacity;
+
+    pthread_mutex_lock(&pool->mu);
+    // NOTICE: cache the block only when the budget is set and not exceeded,
+    //      otherwise the memory is returned to the system
+    if (pool->budget > 0 && pool->used <= pool->budget) {
+        if (pool->free_num == pool->capacity) {
+            capacity = pool->capacity == 0 ? BLOCK_POOL_INIT_CAPACITY : pool->capacity * 2;
+            blocks = (mem_block_t **)realloc(pool->free_blocks, sizeof(mem_block_t *) * capacity);
+            if (blocks != NULL) {
+                pool->free_blocks = blocks;
+                pool->capacity = capacity;
+            }
+        }
+
+        if (pool->free_num < pool->capacity) {
+            mem_block_reset(block, INFQ_UNDEF);
+            pool->free_blocks[pool->free_num++] = block;
+            pthread_mutex_unlock(&pool->mu);
+            return;
+        }
+    }
+    pool->used -= block->mem_size;
+    pthread_mutex_unlock(&pool->mu);
+
+    mem_block_destroy(block);
+}
+
+mem_block_t*
+block_pool_resize(mem_block_t *block, int32_t block_size)
+{
+    if (block == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return NULL;
+    }
+
+    int32_t         old_size = block->mem_size;
+    mem_block_t     *new_block;
+
+    new_block = mem_block_resize(block, block_size);
+    if (new_block == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_block_pool.mu);
+    g_block_pool.used += block_size - old_size;
+    pthread_mutex_unlock(&g_block_pool.mu);
+
+    return new_block;
+}
+
+/**
+ * Free cached blocks until 'need' more bytes fit in the budget.
+ * The caller should hold the mutex of pool.
+ */
+static void
+block_pool_shrink_cache(block_pool_t *pool, int64_t need)
+{
+    mem_block_t     *block;
+
+    while (pool->free_num > 0 && pool->budget > 0 && pool->used + need > pool->budget) {
+        block = pool->free_blocks[--pool->free_num];
+        pool->used -= block->mem_size;
+        mem_block_destroy(block);
+    }
+}
@@ -0,0 +1,42 @@
+/**
+ *
+ * A process-wide pool of memory blocks shared by all the infQs, which bounds
+ * the total memory of blocks by a budget.
+ *
+ * @file    block_pool
+ */
+
+#ifndef COM_MOMO_INFQ_BLOCK_POOL_H
+#define COM_MOMO_INFQ_BLOCK_POOL_H
+
+#include <stdint.h>
+
+#include "mem_block.h"
+
+/**
+ * Set the budget of the memory of all blocks in bytes, 0 means no limit.
+ * Free blocks are cached by the pool for reuse only when a budget is set.
+ */
+void block_pool_set_budget(int64_t budget);
+int64_t block_pool_budget(void);
+
+/**
+ * Bytes of the blocks allocated by the pool, including the cached free blocks.
+ */
+int64_t block_pool_used(void);
+
+/**
+ * The budget is soft, blocks are still allocated when it's exceeded. The infQs
+ *      check this to dump and release blocks earlier.
+ */
+int32_t block_pool_over_budget(void);
+
+mem_block_t* block_pool_get(int32_t block_size);
+void block_pool_put(mem_block_t *block);
+
+/**
+ * Resize a block allocated by the pool, see 'mem_block_resize'.
+ */
+mem_block_t* block_pool_resize(mem_block_t *block, int32_t block_size);
+
+#endif
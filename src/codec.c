@@ -0,0 +1,286 @@
+/**
+ *
+ * @file    codec
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef INFQ_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef INFQ_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "codec.h"
+
+/**
+ * The built-in codec is a byte-oriented LZ77 in the way of lz4 block format. The
+ *      input is encoded as sequences:
+ *
+ *  |-- token(1B) --|-- literal length+ --|-- literals --|-- offset(2B) --|-- match length+ --|
+ *
+ *      The high 4 bits of token are the literal length and the low 4 bits are the
+ *      match length minus 4, 15 means more bytes of length follow until one isn't 255.
+ *      The last sequence only has literals.
+ */
+#define LZ_HASH_LOG         12
+#define LZ_MIN_MATCH        4
+#define LZ_MAX_OFFSET       65535
+#define LZ_LAST_LITERALS    8       // the tail is always encoded as literals
+#define LZ_SKIP_TRIGGER     6       // steps are enlarged when no match is found for long
+
+static int64_t
+lz_bound(int64_t len)
+{
+    return len + len / 255 + 16;
+}
+
+static uint32_t
+lz_read32(const uint8_t *p)
+{
+    uint32_t    v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint8_t *
+lz_put_len(uint8_t *op, int64_t len)
+{
+    for (len -= 15; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t)len;
+
+    return op;
+}
+
+static int32_t
+lz_get_len(const uint8_t **ip, const uint8_t *iend, int64_t *len)
+{
+    uint8_t     b;
+
+    do {
+        if (*ip >= iend) {
+            return INFQ_ERR;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+
+    return INFQ_OK;
+}
+
+static int64_t
+lz_compress(const char *src, int64_t len, char *dst, int64_t cap)
+{
+    uint32_t        table[1 << LZ_HASH_LOG];
+    const uint8_t   *base = (const uint8_t *)src, *ip = base, *anchor = base;
+    const uint8_t   *limit = base + len - LZ_LAST_LITERALS, *ref, *m, *r;
+    uint8_t         *op = (uint8_t *)dst, *token;
+    int64_t         lit, mlen;
+    uint32_t        seq, h;
+
+    if (len < 0 || cap < lz_bound(len) || len > (int64_t)UINT32_MAX) {
+        return -1;
+    }
+
+    memset(table, 0, sizeof(table));
+    while (len > LZ_LAST_LITERALS + LZ_MIN_MATCH && ip + LZ_MIN_MATCH <= limit) {
+        seq = lz_read32(ip);
+        h = (seq * 2654435761U) >> (32 - LZ_HASH_LOG);
+        ref = base + table[h];
+        table[h] = (uint32_t)(ip - base);
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || lz_read32(ref) != seq) {
+            ip += 1 + ((ip - anchor) >> LZ_SKIP_TRIGGER);
+            continue;
+        }
+
+        for (m = ip + LZ_MIN_MATCH, r = ref + LZ_MIN_MATCH; m < limit && *m == *r; m++, r++);
+
+        lit = ip - anchor;
+        mlen = m - ip - LZ_MIN_MATCH;
+        token = op++;
+        *token = (uint8_t)((lit >= 15 ? 15 : lit) << 4 | (mlen >= 15 ? 15 : mlen));
+        if (lit >= 15) {
+            op = lz_put_len(op, lit);
+        }
+        memcpy(op, anchor, lit);
+        op += lit;
+        *op++ = (uint8_t)(ip - ref);
+        *op++ = (uint8_t)((ip - ref) >> 8);
+        if (mlen >= 15) {
+            op = lz_put_len(op, mlen);
+        }
+        ip = anchor = m;
+    }
+
+    lit = base + len - anchor;
+    token = op++;
+    *token = (uint8_t)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) {
+        op = lz_put_len(op, lit);
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return op - (uint8_t *)dst;
+}
+
+static int64_t
+lz_decompress(const char *src, int64_t len, char *dst, int64_t cap)
+{
+    const uint8_t   *ip = (const uint8_t *)src, *iend = ip + len;
+    uint8_t         *op = (uint8_t *)dst, *oend = op + cap, *ref;
+    int64_t         lit, mlen, off;
+    uint8_t         token;
+
+    while (ip < iend) {
+        token = *ip++;
+        lit = token >> 4;
+        if (lit == 15 && lz_get_len(&ip, iend, &lit) == INFQ_ERR) {
+            return -1;
+        }
+        if (lit > iend - ip || lit > oend - op) {
+            return -1;
+        }
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        // the last sequence has no match
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        off = ip[0] | ip[1] << 8;
+        ip += 2;
+        mlen = token & 15;
+        if (mlen == 15 && lz_get_len(&ip, iend, &mlen) == INFQ_ERR) {
+            return -1;
+        }
+        mlen += LZ_MIN_MATCH;
+        if (off == 0 || off > op - (uint8_t *)dst || mlen > oend - op) {
+            return -1;
+        }
+
+        // NOTICE: the match may overlap the output, e.g. a run of bytes
+        ref = op - off;
+        if (off >= mlen) {
+            memcpy(op, ref, mlen);
+            op += mlen;
+        } else {
+            while (mlen-- > 0) {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    return op - (uint8_t *)dst;
+}
+
+static const infq_codec_t lz_codec = {
+    INFQ_CODEC_LZ, "lz", lz_bound, lz_compress, lz_decompress
+};
+
+#ifdef INFQ_HAVE_LZ4
+
+static int64_t
+lz4_bound(int64_t len)
+{
+    return LZ4_compressBound((int)len);
+}
+
+static int64_t
+lz4_compress(const char *src, int64_t len, char *dst, int64_t cap)
+{
+    int     n = LZ4_compress_default(src, dst, (int)len, (int)cap);
+
+    return n > 0 ? n : -1;
+}
+
+static int64_t
+lz4_decompress(const char *src, int64_t len, char *dst, int64_t cap)
+{
+    int     n = LZ4_decompress_safe(src, dst, (int)len, (int)cap);
+
+    return n >= 0 ? n : -1;
+}
+
+static const infq_codec_t lz4_codec = {
+    INFQ_CODEC_LZ4, "lz4", lz4_bound, lz4_compress, lz4_decompress
+};
+
+#endif
+
+#ifdef INFQ_HAVE_ZSTD
+
+#define ZSTD_LEVEL  1       // spilling is on the way of pushers, prefer speed to ratio
+
+static int64_t
+zstd_bound(int64_t len)
+{
+    return ZSTD_compressBound(len);
+}
+
+static int64_t
+zstd_compress(const char *src, int64_t len, char *dst, int64_t cap)
+{
+    size_t  n = ZSTD_compress(dst, cap, src, len, ZSTD_LEVEL);
+
+    return ZSTD_isError(n) ? -1 : (int64_t)n;
+}
+
+static int64_t
+zstd_decompress(const char *src, int64_t len, char *dst, int64_t cap)
+{
+    size_t  n = ZSTD_decompress(dst, cap, src, len);
+
+    return ZSTD_isError(n) ? -1 : (int64_t)n;
+}
+
+static const infq_codec_t zstd_codec = {
+    INFQ_CODEC_ZSTD, "zstd", zstd_bound, zstd_compress, zstd_decompress
+};
+
+#endif
+
+static const infq_codec_t *codecs[INFQ_MAX_CODECS] = {
+    [INFQ_CODEC_LZ] = &lz_codec,
+#ifdef INFQ_HAVE_LZ4
+    [INFQ_CODEC_LZ4] = &lz4_codec,
+#endif
+#ifdef INFQ_HAVE_ZSTD
+    [INFQ_CODEC_ZSTD] = &zstd_codec,
+#endif
+};
+
+const infq_codec_t *
+codec_find(int32_t id)
+{
+    if (id <= INFQ_CODEC_NONE || id >= INFQ_MAX_CODECS) {
+        return NULL;
+    }
+
+    return codecs[id];
+}
+
+int32_t
+codec_register(const infq_codec_t *codec)
+{
+    if (codec == NULL || codec->id <= INFQ_CODEC_NONE || codec->id >= INFQ_MAX_CODECS
+            || codec->bound == NULL || codec->compress == NULL || codec->decompress == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    codecs[codec->id] = codec;
+
+    return INFQ_OK;
+}
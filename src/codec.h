@@ -0,0 +1,48 @@
+/**
+ *
+ * Codecs compressing the data of file blocks. A codec is identified by the id
+ * recorded in the blocks it compresses, so blocks are decoded by the right codec
+ * whatever the config is when they're loaded. 'INFQ_CODEC_LZ' is built in, lz4 and
+ * zstd are available when they're found at build time, and more codecs can be
+ * registered by 'infq_config_codec'.
+ *
+ * @file    codec
+ */
+
+#ifndef COM_MOMO_INFQ_CODEC_H
+#define COM_MOMO_INFQ_CODEC_H
+
+#include <stdint.h>
+
+#include "infq.h"
+
+#define INFQ_MAX_CODECS     32
+
+struct _infq_codec_t {
+    int32_t     id;                     /* INFQ_CODEC_*, or an id in [INFQ_CODEC_USER, INFQ_MAX_CODECS) */
+    const char  *name;
+
+    /* Max bytes compressed from 'len' bytes */
+    int64_t     (*bound)(int64_t len);
+
+    /* Compress 'len' bytes of 'src' to 'dst' of 'cap' bytes, and return the bytes
+       compressed, -1 on failure */
+    int64_t     (*compress)(const char *src, int64_t len, char *dst, int64_t cap);
+
+    /* Decompress 'len' bytes of 'src' to 'dst' of 'cap' bytes, and return the bytes
+       decompressed, -1 if the data is corrupted or 'dst' isn't big enough */
+    int64_t     (*decompress)(const char *src, int64_t len, char *dst, int64_t cap);
+};
+
+/**
+ * @brief Find the codec by id, NULL is returned if it isn't built or registered.
+ */
+const infq_codec_t *codec_find(int32_t id);
+
+/**
+ * @brief Register a codec, an existing one of the id is replaced. The codec must be
+ *      valid until the process exits.
+ */
+int32_t codec_register(const infq_codec_t *codec);
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ *
+ * @file    crc32c
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC32C_HW_SSE42
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32C_HW_ARM
+#include <arm_acle.h>
+#endif
+
+#define CRC32C_POLY         0x82f63b78  // reversed polynomial of Castagnoli
+#define CRC32C_STREAM_LEN   8192        // bytes of a stream interleaved by the instruction
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t *p, size_t len);
+
+static pthread_once_t   crc32c_once = PTHREAD_ONCE_INIT;
+static crc32c_fn        crc32c_impl;
+static uint32_t         crc32c_table[8][256];
+static uint32_t         crc32c_zeros[4][256];     // shift a CRC over a stream of zeros
+
+/**
+ * Multiply the 32x32 matrix over GF(2) by the vector, a row per bit.
+ */
+static uint32_t
+gf2_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t    sum = 0;
+
+    for (; vec != 0; vec >>= 1, mat++) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+    }
+
+    return sum;
+}
+
+static void
+gf2_square(uint32_t *square, const uint32_t *mat)
+{
+    for (int32_t i = 0; i < 32; i++) {
+        square[i] = gf2_times(mat, mat[i]);
+    }
+}
+
+/**
+ * Build the tables applying the operator which feeds 'len' zero bytes to a CRC,
+ *      'len' is a power of 2. The operator of a zero bit is squared to double
+ *      the zeros it feeds.
+ */
+static void
+crc32c_zeros_init(size_t len)
+{
+    uint32_t    op[32], sq[32];
+    int32_t     i;
+
+    op[0] = CRC32C_POLY;
+    for (i = 1; i < 32; i++) {
+        op[i] = 1U << (i - 1);
+    }
+
+    // 8 zero bits make a zero byte
+    for (len *= 8; len > 1; len >>= 1) {
+        gf2_square(sq, op);
+        memcpy(op, sq, sizeof(op));
+    }
+
+    for (i = 0; i < 256; i++) {
+        crc32c_zeros[0][i] = gf2_times(op, i);
+        crc32c_zeros[1][i] = gf2_times(op, i << 8);
+        crc32c_zeros[2][i] = gf2_times(op, i << 16);
+        crc32c_zeros[3][i] = gf2_times(op, (uint32_t)i << 24);
+    }
+}
+
+static uint32_t
+crc32c_shift(uint32_t crc)
+{
+    return crc32c_zeros[0][crc & 0xff] ^ crc32c_zeros[1][(crc >> 8) & 0xff]
+        ^ crc32c_zeros[2][(crc >> 16) & 0xff] ^ crc32c_zeros[3][crc >> 24];
+}
+
+/**
+ * Slicing-by-8, 8 bytes are folded by 8 table lookups.
+ */
+static uint32_t
+crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t    v;
+
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+
+    // NOTICE: the bytes are loaded in little endian
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&v, p, sizeof(v));
+        v ^= crc;
+        crc = crc32c_table[7][v & 0xff]
+            ^ crc32c_table[6][(v >> 8) & 0xff]
+            ^ crc32c_table[5][(v >> 16) & 0xff]
+            ^ crc32c_table[4][(v >> 24) & 0xff]
+            ^ crc32c_table[3][(v >> 32) & 0xff]
+            ^ crc32c_table[2][(v >> 40) & 0xff]
+            ^ crc32c_table[1][(v >> 48) & 0xff]
+            ^ crc32c_table[0][v >> 56];
+    }
+
+    while (len-- > 0) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#if defined(CRC32C_HW_SSE42) || defined(CRC32C_HW_ARM)
+
+#ifdef CRC32C_HW_SSE42
+#define crc32c_u8(crc, b)   _mm_crc32_u8((crc), (b))
+#define crc32c_u64(crc, v)  (uint32_t)_mm_crc32_u64((crc), (v))
+#define CRC32C_HW_TARGET    __attribute__((target("sse4.2")))
+#else
+#define crc32c_u8(crc, b)   __crc32cb((crc), (b))
+#define crc32c_u64(crc, v)  __crc32cd((crc), (v))
+#define CRC32C_HW_TARGET
+#endif
+
+/**
+ * The instruction has a latency of 3 cycles and a throughput of 1, so long buffers
+ *      are checksummed as 3 interleaved streams, which are combined by shifting
+ *      the CRCs over the zeros of a stream.
+ *
+ * NOTICE: compiled for SSE4.2 whatever the flags are, it's only called after the
+ *      support of CPU is checked
+ */
+CRC32C_HW_TARGET
+static uint32_t
+crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint32_t    crc1, crc2;
+    uint64_t    v;
+    const uint8_t *end;
+
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = crc32c_u8(crc, *p++);
+        len--;
+    }
+
+    for (; len >= CRC32C_STREAM_LEN * 3; len -= CRC32C_STREAM_LEN * 3) {
+        crc1 = crc2 = 0;
+        for (end = p + CRC32C_STREAM_LEN; p < end; p += 8) {
+            memcpy(&v, p, sizeof(v));
+            crc = crc32c_u64(crc, v);
+            memcpy(&v, p + CRC32C_STREAM_LEN, sizeof(v));
+            crc1 = crc32c_u64(crc1, v);
+            memcpy(&v, p + CRC32C_STREAM_LEN * 2, sizeof(v));
+            crc2 = crc32c_u64(crc2, v);
+        }
+        crc = crc32c_shift(crc) ^ crc1;
+        crc = crc32c_shift(crc) ^ crc2;
+        p += CRC32C_STREAM_LEN * 2;
+    }
+
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&v, p, sizeof(v));
+        crc = crc32c_u64(crc, v);
+    }
+
+    while (len-- > 0) {
+        crc = crc32c_u8(crc, *p++);
+    }
+
+    return crc;
+}
+
+#endif
+
+static void
+crc32c_init(void)
+{
+    uint32_t    crc;
+    int32_t     i, j;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        crc = crc32c_table[0][i];
+        for (j = 1; j < 8; j++) {
+            crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+            crc32c_table[j][i] = crc;
+        }
+    }
+
+    crc32c_zeros_init(CRC32C_STREAM_LEN);
+
+    crc32c_impl = crc32c_sw;
+#if defined(CRC32C_HW_SSE42)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = crc32c_hw;
+    }
+#elif defined(CRC32C_HW_ARM)
+    crc32c_impl = crc32c_hw;
+#endif
+}
+
+uint32_t
+crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+
+    return ~crc32c_impl(~crc, (const uint8_t *)buf, len);
+}
+
+uint32_t
+crc32c_soft(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+
+    return ~crc32c_sw(~crc, (const uint8_t *)buf, len);
+}
@@ -0,0 +1,29 @@
+/**
+ *
+ * CRC32C(Castagnoli) checksums of file blocks. The SSE4.2 'crc32' instruction is
+ * used when the CPU supports it, which is detected at runtime, and a table driven
+ * implementation otherwise.
+ *
+ * @file    crc32c
+ */
+
+#ifndef COM_MOMO_INFQ_CRC32C_H
+#define COM_MOMO_INFQ_CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Extend 'crc' by 'len' bytes of 'buf'. 0 is the CRC of no bytes, so a checksum
+ *      can be computed piece by piece:
+ *          crc32c(crc32c(0, a, n), b, m) == CRC of 'a' followed by 'b'
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/**
+ * @brief 'crc32c' by the table driven implementation whatever the CPU supports, used to
+ *      check the one by the instruction.
+ */
+uint32_t crc32c_soft(uint32_t crc, const void *buf, size_t len);
+
+#endif
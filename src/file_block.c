@@ -9,21 +9,342 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "file_block.h"
+#include "block_pool.h"
+#include "codec.h"
+#include "crc32c.h"
 #include "utils.h"
 
 char *INFQ_FILE_BLOCK_PREFIX = "file_block";
+char *INFQ_SEGMENT_PREFIX = "segment";
 
 #define INFQ_META_INFO_LEN      32      // Magic Number(8B) + Version(8B) + Start index(8B) + Element count(8B)
 #define INFQ_IO_BUF_UNIT        4096
 #define infq_header_len(fb)     (int32_t)(INFQ_META_INFO_LEN + (fb)->offset_array.size * sizeof(uint32_t))
 #define infq_offset_empty(fb)   fb->offset_array.offsets == NULL
 
-static int32_t write_header(file_block_t *file_block, mem_block_t *mem_block);
-static int32_t write_data(file_block_t *file_block, mem_block_t *mem_block);
+#define INFQ_DIRECT_ALIGN       4096
+#define INFQ_DIRECT_BUF_SIZE    (1024 * 1024)
+#define INFQ_DIRECT_UNSUPPORTED 1
+#define infq_direct_align(n)    (((n) + INFQ_DIRECT_ALIGN - 1) & ~((int64_t)INFQ_DIRECT_ALIGN - 1))
+
+#define INFQ_DEFAULT_MAX_OPEN_FILES 1024
+
+#define INFQ_RECORD_PREFIX_LEN  8       // Length of the block record in a segment
+#define infq_record_start(fb)   ((fb)->file_offset - ((fb)->segment != NULL ? INFQ_RECORD_PREFIX_LEN : 0))
+#define infq_record_len(fb)     ((fb)->file_size + ((fb)->segment != NULL ? INFQ_RECORD_PREFIX_LEN : 0))
+
+#define INFQ_FRAME_VERSION      "v0.2.0"    // Version of the blocks whose data is a frame of chunks
+#define INFQ_FRAME_HEADER_LEN   16      // Data size(4B) + Chunk size(4B) + Chunk count(4B) + Codec(4B)
+#define INFQ_CHUNK_SIZE         (64 * 1024)
+#define infq_frame_len(fb)      ((fb)->file_size - infq_header_len(fb) - INFQ_SIGNATURE_LEN)
+#define infq_chunk_table_len(fb)    (int32_t)(INFQ_FRAME_HEADER_LEN + (fb)->chunk_num * sizeof(uint32_t))
+#define infq_chunk_start(fb, i) ((i) == 0 ? 0 : (fb)->chunk_ends[(i) - 1])
+#define infq_chunk_raw_len(fb, i)   ((fb)->data_size - (i) * (fb)->chunk_size < (fb)->chunk_size ? \
+        (fb)->data_size - (i) * (fb)->chunk_size : (fb)->chunk_size)
+
+static int32_t copy_header(file_block_t *file_block, mem_block_t *mem_block);
+static int32_t block_file_path(const file_block_t *file_block, char *buf, int32_t size);
+static int32_t fit_file(int32_t fd, int64_t size);
+static int32_t direct_transfer(file_block_io_t *io, int32_t is_write);
+static int32_t compress_data(file_block_io_t *io, file_block_t *file_block, const mem_block_t *mem_block);
+static int32_t load_chunk_table(file_block_t *file_block);
+static int32_t decode_chunk(const file_block_t *file_block, int32_t idx, const char *src, char *dst);
+static int32_t read_chunks(file_block_t *file_block, int64_t pos, char *dst, int64_t len,
+        char *chunk, int32_t *chunk_idx);
+static int32_t chunked_at(file_block_t *file_block, int32_t offset, void *buf, int32_t buf_size,
+        int32_t *sizeptr);
+static int32_t restore_checksum(file_block_t *file_block, mem_block_t *mem_block);
+static int32_t load_header(file_block_t *file_block);
+static int32_t map_block(file_block_t *file_block, mem_block_t *mem_block);
+static int32_t read_at(file_block_t *file_block, int64_t global_idx, void *buf, int32_t buf_size,
+        int32_t *sizeptr);
+static void track_fd(file_block_t *file_block);
+static void close_fd(file_block_t *file_block);
+static void unpin_io(file_block_io_t *io);
+static void close_lru_files(void);
+
+// the max bytes of a read or write syscall, 0 means the whole block at once
+static int32_t io_unit = 0;
+// transfer file blocks by O_DIRECT, bypassing the page cache
+static int32_t direct_io = INFQ_FALSE;
+// check the loaded data against the checksums in the signature
+static int32_t verify_checksum = INFQ_FALSE;
+
+// the files opened by file blocks, the most recently used one is at the head
+static pthread_mutex_t  lru_mu = PTHREAD_MUTEX_INITIALIZER;
+static file_block_t     *lru_head = NULL, *lru_tail = NULL;
+static int32_t          open_files = 0;
+static int32_t          max_open_files = INFQ_DEFAULT_MAX_OPEN_FILES;
+
+void
+file_block_set_io_unit(int32_t unit)
+{
+    io_unit = unit > 0 ? unit : 0;
+}
+
+void
+file_block_set_direct_io(int32_t enable)
+{
+    direct_io = enable ? INFQ_TRUE : INFQ_FALSE;
+}
+
+void
+file_block_set_verify_checksum(int32_t enable)
+{
+    verify_checksum = enable ? INFQ_TRUE : INFQ_FALSE;
+}
+
+void
+file_block_set_max_open_files(int32_t max_files)
+{
+    pthread_mutex_lock(&lru_mu);
+    max_open_files = max_files > 0 ? max_files : 0;
+    close_lru_files();
+    pthread_mutex_unlock(&lru_mu);
+}
+
+static void
+lru_remove(file_block_t *file_block)
+{
+    if (file_block->fd_prev != NULL) {
+        file_block->fd_prev->fd_next = file_block->fd_next;
+    } else {
+        lru_head = file_block->fd_next;
+    }
+    if (file_block->fd_next != NULL) {
+        file_block->fd_next->fd_prev = file_block->fd_prev;
+    } else {
+        lru_tail = file_block->fd_prev;
+    }
+    file_block->fd_prev = file_block->fd_next = NULL;
+}
+
+static void
+lru_push(file_block_t *file_block)
+{
+    file_block->fd_prev = NULL;
+    file_block->fd_next = lru_head;
+    if (lru_head != NULL) {
+        lru_head->fd_prev = file_block;
+    } else {
+        lru_tail = file_block;
+    }
+    lru_head = file_block;
+}
+
+/**
+ * Close the least recently used files beyond the limit, the pinned ones are skipped.
+ * The caller should hold 'lru_mu'.
+ */
+static void
+close_lru_files(void)
+{
+    file_block_t    *file_block, *prev;
+
+    for (file_block = lru_tail; max_open_files > 0 && open_files > max_open_files
+            && file_block != NULL; file_block = prev) {
+        prev = file_block->fd_prev;
+        if (file_block->fd_pins > 0) {
+            continue;
+        }
+
+        lru_remove(file_block);
+        open_files--;
+        if (close(file_block->fd) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to close file, path: %s, prefix: %s, suffix: %d",
+                    file_block->file_path,
+                    file_block->file_prefix,
+                    file_block->suffix);
+        }
+        file_block->fd = INFQ_UNDEF;
+    }
+}
+
+/**
+ * Put the file just opened to the LRU, it's pinned.
+ */
+static void
+track_fd(file_block_t *file_block)
+{
+    pthread_mutex_lock(&lru_mu);
+    lru_push(file_block);
+    open_files++;
+    file_block->fd_pins++;
+    close_lru_files();
+    pthread_mutex_unlock(&lru_mu);
+}
+
+/**
+ * Close the file of the block itself, the file of a segment is closed with the segment.
+ */
+static void
+close_fd(file_block_t *file_block)
+{
+    if (file_block->segment != NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&lru_mu);
+    if (file_block->fd != INFQ_UNDEF) {
+        lru_remove(file_block);
+        open_files--;
+        if (close(file_block->fd) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to close file, path: %s, prefix: %s, suffix: %d",
+                    file_block->file_path,
+                    file_block->file_prefix,
+                    file_block->suffix);
+        }
+        file_block->fd = INFQ_UNDEF;
+    }
+    file_block->fd_pins = 0;
+    pthread_mutex_unlock(&lru_mu);
+}
+
+int32_t
+file_block_pin_fd(file_block_t *file_block)
+{
+    char    buf[INFQ_MAX_BUF_SIZE];
+    int32_t fd;
+
+    // the file of a segment is always opened
+    if (file_block->segment != NULL) {
+        return INFQ_OK;
+    }
+
+    pthread_mutex_lock(&lru_mu);
+    if (file_block->fd != INFQ_UNDEF) {
+        lru_remove(file_block);
+        lru_push(file_block);
+        file_block->fd_pins++;
+        pthread_mutex_unlock(&lru_mu);
+        return INFQ_OK;
+    }
+    pthread_mutex_unlock(&lru_mu);
+
+    // NOTICE: only the file of a block in use is opened again, which is written already
+    if (block_file_path(file_block, buf, INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to generate file path, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return INFQ_ERR;
+    }
+
+    fd = open(buf, O_RDONLY);
+    if (fd == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to open file, file path: %s", buf);
+        return INFQ_ERR;
+    }
+
+    // the file may be opened by others meanwhile
+    pthread_mutex_lock(&lru_mu);
+    if (file_block->fd != INFQ_UNDEF) {
+        lru_remove(file_block);
+        lru_push(file_block);
+        file_block->fd_pins++;
+        pthread_mutex_unlock(&lru_mu);
+        close(fd);
+        return INFQ_OK;
+    }
+    file_block->fd = fd;
+    lru_push(file_block);
+    open_files++;
+    file_block->fd_pins++;
+    close_lru_files();
+    pthread_mutex_unlock(&lru_mu);
+
+    return INFQ_OK;
+}
+
+void
+file_block_unpin_fd(file_block_t *file_block)
+{
+    if (file_block->segment != NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&lru_mu);
+    if (file_block->fd_pins > 0) {
+        file_block->fd_pins--;
+    }
+    close_lru_files();
+    pthread_mutex_unlock(&lru_mu);
+}
+
+static void
+unpin_io(file_block_io_t *io)
+{
+    if (io->pinned) {
+        io->pinned = INFQ_FALSE;
+        file_block_unpin_fd(io->file_block);
+    }
+}
+
+void
+file_block_drop_cache(file_block_t *file_block, int32_t written)
+{
+    if (!direct_io || file_block == NULL || file_block->fd == INFQ_UNDEF) {
+        return;
+    }
+
+    off_t   start = infq_record_start(file_block);
+    off_t   len = infq_record_len(file_block);
+
+    // NOTICE: dirty pages can't be dropped, so write them back first
+#ifdef SYNC_FILE_RANGE_WRITE
+    if (written && sync_file_range(file_block->fd, start, len, SYNC_FILE_RANGE_WAIT_BEFORE
+                | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to write back file block, suffix: %d",
+                file_block->suffix);
+    }
+#else
+    if (written && fdatasync(file_block->fd) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to write back file block, suffix: %d",
+                file_block->suffix);
+    }
+#endif
+
+#ifdef POSIX_FADV_DONTNEED
+    if ((errno = posix_fadvise(file_block->fd, start, len, POSIX_FADV_DONTNEED)) != 0) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to drop page cache of file block, suffix: %d",
+                file_block->suffix);
+    }
+#endif
+}
+
+void
+file_block_prefetch(file_block_t *file_block)
+{
+    if (direct_io || file_block == NULL || file_block->file_offset == INFQ_UNDEF
+            || file_block->file_size <= 0) {
+        return;
+    }
+
+#ifdef POSIX_FADV_WILLNEED
+    if (file_block_pin_fd(file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to open file block to prefetch, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return;
+    }
+
+    // NOTICE: the readahead is started asynchronously, it doesn't wait for the pages
+    if ((errno = posix_fadvise(file_block->fd, infq_record_start(file_block),
+                    infq_record_len(file_block), POSIX_FADV_WILLNEED)) != 0) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to prefetch file block, suffix: %d",
+                file_block->suffix);
+    }
+    file_block_unpin_fd(file_block);
+#endif
+}
 
 int32_t
 file_block_init(file_block_t *file_block, const char *file_path, const char *file_prefix)
@@ -33,115 +354,651 @@ file_block_init(file_block_t *file_block, const char *file_path, const char *fil
         return INFQ_ERR;
     }
 
-    memset(file_block, 0, sizeof(file_block_t));
-    file_block->fd = INFQ_UNDEF;
-    file_block->start_index = INFQ_UNDEF;
-    file_block->suffix = INFQ_UNDEF;
+    memset(file_block, 0, sizeof(file_block_t));
+    file_block->fd = INFQ_UNDEF;
+    file_block->start_index = INFQ_UNDEF;
+    file_block->suffix = INFQ_UNDEF;
+
+    file_block->file_path = file_path;
+    if (file_prefix != NULL) {
+        file_block->file_prefix = file_prefix;
+    } else {
+        file_block->file_prefix = INFQ_FILE_BLOCK_PREFIX;
+    }
+
+    return INFQ_OK;
+}
+
+file_segment_t *
+file_segment_open(const char *file_path, int32_t no, int32_t create, int64_t prealloc)
+{
+    if (file_path == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return NULL;
+    }
+
+    char            buf[INFQ_MAX_BUF_SIZE];
+    file_segment_t  *segment;
+
+    if (gen_file_path(file_path, INFQ_SEGMENT_PREFIX, no, buf, INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to generate file path, path: %s, segment: %d", file_path, no);
+        return NULL;
+    }
+
+    segment = (file_segment_t *)malloc(sizeof(file_segment_t));
+    if (segment == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for segment");
+        return NULL;
+    }
+
+    segment->fd = open(buf, O_CREAT | O_RDWR | (create ? O_TRUNC : 0), 0644);
+    if (segment->fd == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to open segment, file path: %s", buf);
+        free(segment);
+        return NULL;
+    }
+
+    // NOTICE: allocate the extents ahead but keep the file size, so the file isn't
+    //      extended and its metadata isn't updated by every append
+#ifdef FALLOC_FL_KEEP_SIZE
+    if (create && prealloc > 0
+            && fallocate(segment->fd, FALLOC_FL_KEEP_SIZE, 0, prealloc) == -1) {
+        INFQ_DEBUG_LOG("failed to preallocate segment, file path: %s, errno: %d", buf, errno);
+    }
+#else
+    (void)prealloc;
+#endif
+
+    segment->no = no;
+    segment->ref = 1;
+    segment->tail = 0;
+    segment->tail_idx = create ? 0 : INFQ_UNDEF;
+
+    return segment;
+}
+
+void
+file_segment_ref(file_segment_t *segment)
+{
+    __sync_add_and_fetch(&segment->ref, 1);
+}
+
+void
+file_segment_release(file_segment_t *segment)
+{
+    if (segment == NULL || __sync_sub_and_fetch(&segment->ref, 1) > 0) {
+        return;
+    }
+
+    if (close(segment->fd) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to close segment: %d", segment->no);
+    }
+    free(segment);
+}
+
+int32_t
+file_segment_seek(file_segment_t *segment, int32_t idx)
+{
+    if (segment == NULL || idx < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int64_t     offset = 0, len;
+
+    if (segment->tail_idx == idx) {
+        return INFQ_OK;
+    }
+
+    for (int32_t i = 0; i < idx; i++) {
+        if (infq_pread(segment->fd, &len, sizeof(len), offset) == INFQ_ERR || len <= 0) {
+            INFQ_ERROR_LOG("failed to read record length, segment: %d, record: %d, offset: %lld",
+                    segment->no, i, (long long)offset);
+            return INFQ_ERR;
+        }
+        offset = infq_direct_align(offset + INFQ_RECORD_PREFIX_LEN + len);
+    }
+
+    segment->tail = offset;
+    segment->tail_idx = idx;
+
+    return INFQ_OK;
+}
+
+int32_t
+file_block_attach_segment(file_block_t *file_block, file_segment_t *segment)
+{
+    if (file_block == NULL || segment == NULL || file_block->segment != NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    file_segment_ref(segment);
+    file_block->segment = segment;
+    file_block->fd = segment->fd;
+    // placed at the tail when the block is written or its header is loaded
+    file_block->file_offset = INFQ_UNDEF;
+
+    return INFQ_OK;
+}
+
+/**
+ * Place the block at the tail of its segment, and move the tail after the block.
+ */
+static void
+place_in_segment(file_block_t *file_block)
+{
+    file_segment_t  *segment = file_block->segment;
+
+    file_block->file_offset = segment->tail + INFQ_RECORD_PREFIX_LEN;
+    segment->tail = infq_direct_align(file_block->file_offset + file_block->file_size);
+    segment->tail_idx++;
+}
+
+void
+file_block_place_in_segment(file_block_t *file_block, int64_t file_offset, int32_t idx)
+{
+    file_segment_t  *segment = file_block->segment;
+
+    file_block->file_offset = file_offset;
+    segment->tail = infq_direct_align(file_offset + file_block->file_size);
+    segment->tail_idx = idx + 1;
+}
+
+/**
+ * Fit the file opened to be overwritten by 'size' bytes. A reused file is cut if it's
+ *      longer, and the extents are allocated at once if the file hasn't got enough.
+ */
+static int32_t
+fit_file(int32_t fd, int64_t size)
+{
+    struct stat     finfo;
+
+    if (fstat(fd, &finfo) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to fstat");
+        return INFQ_ERR;
+    }
+
+    if (finfo.st_size > size && ftruncate(fd, size) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to truncate file, size: %lld", (long long)size);
+        return INFQ_ERR;
+    }
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    if ((int64_t)finfo.st_blocks * 512 < size
+            && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) == -1) {
+        INFQ_DEBUG_LOG("failed to preallocate file, size: %lld, errno: %d", (long long)size, errno);
+    }
+#endif
+
+    return INFQ_OK;
+}
+
+/**
+ * Path of the file holding the block, it's the segment file if the block is in a segment.
+ */
+static int32_t
+block_file_path(const file_block_t *file_block, char *buf, int32_t size)
+{
+    if (file_block->segment != NULL) {
+        return gen_file_path(
+                file_block->file_path,
+                INFQ_SEGMENT_PREFIX,
+                file_block->segment->no,
+                buf, size);
+    }
+
+    return gen_file_path(
+            file_block->file_path,
+            file_block->file_prefix,
+            file_block->suffix,
+            buf, size);
+}
+
+/**
+ * dump memory block to disk, and copy meta data from memory block to file block
+ *
+ * |-- Header --|-- Data --|-- Signature(20bit) --|
+ *
+ */
+int32_t
+file_block_write(file_block_t *file_block, int32_t suffix, mem_block_t *mem_block)
+{
+    file_block_io_t     io;
+    int32_t             ret = INFQ_DIRECT_UNSUPPORTED;
+
+    if (file_block_prepare_write(&io, file_block, suffix, mem_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to prepare to write file block");
+        return INFQ_ERR;
+    }
+
+    if (direct_io) {
+        ret = direct_transfer(&io, INFQ_TRUE);
+    }
+    if (ret == INFQ_DIRECT_UNSUPPORTED) {
+        ret = infq_pwritev(file_block->fd, io.iov, io.iovcnt, io.offset, io_unit);
+        if (ret == INFQ_OK) {
+            file_block_drop_cache(file_block, INFQ_TRUE);
+        }
+    }
+
+    if (ret == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to write file block, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        file_block_abort_write(&io);
+        return INFQ_ERR;
+    }
+    file_block_finish_write(&io);
+
+    return INFQ_OK;
+}
+
+int32_t
+file_block_prepare_write(
+        file_block_io_t *io,
+        file_block_t *file_block,
+        int32_t suffix,
+        mem_block_t *mem_block)
+{
+    if (io == NULL || file_block == NULL || mem_block == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    // open file
+    char            buf[INFQ_MAX_BUF_SIZE];
+    offset_array_t  *offset_array = &mem_block->offset_array;
+    struct iovec    *iov = io->iov;
+
+    io->file_block = file_block;
+    io->mem_block = mem_block;
+    io->frame = NULL;
+    io->pinned = INFQ_FALSE;
+
+    file_block->suffix = suffix;
+    // full file path
+    if (gen_file_path(
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix,
+                buf, INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to generate file path, path: %s, prefix: %s, suffix: %lld",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return INFQ_ERR;
+    }
+
+    // fetch signature
+    if (mem_block_signature(mem_block, file_block->signature) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to fetch signature");
+        return INFQ_ERR;
+    }
+
+    // the block is appended to the segment file which is opened already
+    //
+    // NOTICE: the file may be a reused one, which isn't truncated but overwritten
+    //      to keep its extents, see 'fit_file'
+    if (file_block->segment == NULL) {
+        file_block->fd = open(buf, O_CREAT | O_RDWR, 0644);
+        if (file_block->fd == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to open file, file path: %s", buf);
+            file_block->fd = INFQ_UNDEF;
+            return INFQ_ERR;
+        }
+        track_fd(file_block);
+        io->pinned = INFQ_TRUE;
+    }
+
+    // meta data, magic number and version
+    strcpy(io->meta_buf, INFQ_MAGIC_NUMBER);
+    strcpy(io->meta_buf + 8, INFQ_VERSION);
+
+    // copy header to file block
+    if (copy_header(file_block, mem_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to copy header");
+        file_block_abort_write(io);
+        return INFQ_ERR;
+    }
+    io->header_buf[0] = mem_block->start_index;
+    io->header_buf[1] = mem_block->ele_count;
+    file_block->data_size = mem_block->last_offset;
+
+    // the data is written plain if it doesn't shrink, and the codec is reset
+    if (file_block->codec != INFQ_CODEC_NONE
+            && compress_data(io, file_block, mem_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to compress data, path: %s, suffix: %d",
+                file_block->file_path,
+                file_block->suffix);
+        file_block_abort_write(io);
+        return INFQ_ERR;
+    }
+    if (io->frame != NULL) {
+        strcpy(io->meta_buf + 8, INFQ_FRAME_VERSION);
+    }
+
+    /**
+     * NOTICE: the whole block is written by one 'pwritev' unless the io unit is set.
+     *      [0, last_offset) of the memory block is written instead of
+     *      [first_offset, last_offset) to keep the offset array consistent with data.
+     *      Only the blocks of push queue and pop queue which have been popped waste
+     *      some space.
+     */
+    file_block->file_size = INFQ_META_INFO_LEN
+        + sizeof(uint32_t) * offset_array_size(offset_array)
+        + (io->frame != NULL ? infq_chunk_table_len(file_block)
+                + (int32_t)file_block->chunk_ends[file_block->chunk_num - 1]
+            : mem_block->last_offset)
+        + INFQ_SIGNATURE_LEN;
+    io->offset = 0;
+    io->iovcnt = 0;
+
+    if (file_block->segment == NULL && fit_file(file_block->fd, file_block->file_size) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to fit file, path: %s", buf);
+        file_block_abort_write(io);
+        return INFQ_ERR;
+    }
+
+    if (file_block->segment != NULL) {
+        place_in_segment(file_block);
+        io->record_len = file_block->file_size;
+        io->offset = infq_record_start(file_block);
+        iov[io->iovcnt].iov_base = &io->record_len;
+        iov[io->iovcnt++].iov_len = sizeof(io->record_len);
+    }
+
+    iov[io->iovcnt].iov_base = io->meta_buf;
+    iov[io->iovcnt++].iov_len = sizeof(io->meta_buf);
+    iov[io->iovcnt].iov_base = io->header_buf;
+    iov[io->iovcnt++].iov_len = sizeof(io->header_buf);
+    iov[io->iovcnt].iov_base = offset_array->offsets + offset_array->start_idx;
+    iov[io->iovcnt++].iov_len = sizeof(uint32_t) * offset_array_size(offset_array);
+    if (io->frame != NULL) {
+        iov[io->iovcnt].iov_base = io->frame;
+        iov[io->iovcnt++].iov_len = infq_frame_len(file_block);
+    } else {
+        iov[io->iovcnt].iov_base = mem_block->mem;
+        iov[io->iovcnt++].iov_len = mem_block->last_offset;
+    }
+    iov[io->iovcnt].iov_base = file_block->signature;
+    iov[io->iovcnt++].iov_len = INFQ_SIGNATURE_LEN;
+
+    return INFQ_OK;
+}
+
+void
+file_block_abort_write(file_block_io_t *io)
+{
+    if (io == NULL || io->file_block == NULL) {
+        return;
+    }
+
+    char            buf[INFQ_MAX_BUF_SIZE];
+    file_block_t    *file_block = io->file_block;
+    file_segment_t  *segment = file_block->segment;
+
+    file_block_finish_write(io);
+
+    // cut the record off the segment, the records after it are aborted together
+    if (segment != NULL) {
+        if (file_block->file_offset != INFQ_UNDEF && io->offset < segment->tail) {
+            segment->tail = io->offset;
+            segment->tail_idx = INFQ_UNDEF;
+            if (ftruncate(segment->fd, io->offset) == -1) {
+                INFQ_ERROR_LOG_BY_ERRNO("failed to truncate segment: %d", segment->no);
+            }
+        }
+        return;
+    }
+
+    close_fd(file_block);
+
+    // remove temp file
+    if (gen_file_path(
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix,
+                buf, INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to generate file path, suffix: %d", file_block->suffix);
+        return;
+    }
+
+    if (unlink(buf) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to remove file, path: %s", buf);
+    }
+}
 
-    file_block->file_path = file_path;
-    if (file_prefix != NULL) {
-        file_block->file_prefix = file_prefix;
-    } else {
-        file_block->file_prefix = INFQ_FILE_BLOCK_PREFIX;
+void
+file_block_finish_write(file_block_io_t *io)
+{
+    if (io == NULL) {
+        return;
     }
 
-    return INFQ_OK;
+    free(io->frame);
+    io->frame = NULL;
+    unpin_io(io);
 }
 
 /**
- * dump memory block to disk, and copy meta data from memory block to file block
+ * Compress the data of the memory block into a frame of chunks, which are decoded
+ *      one by one, so a random access only decompresses the chunks it reads. A chunk
+ *      which doesn't shrink is stored plain.
  *
- * |-- Header --|-- Data --|-- Signature(20bit) --|
+ *  |-- Data size | Chunk size | Chunk count | Codec --|-- Chunk ends --|-- Chunk 0 --|-- ... --|
  *
+ *      The ends of chunks are offsets from the first chunk. 'io->frame' is left NULL
+ *      and the codec of the file block is reset if the frame is bigger than the data.
  */
-int32_t
-file_block_write(file_block_t *file_block, int32_t suffix, mem_block_t *mem_block)
+static int32_t
+compress_data(file_block_io_t *io, file_block_t *file_block, const mem_block_t *mem_block)
 {
-    if (file_block == NULL || mem_block == NULL) {
-        INFQ_ERROR_LOG("invalid param");
+    const infq_codec_t  *codec = codec_find(file_block->codec);
+    uint32_t            *ends, header[4];
+    int64_t             cap, len, pos = 0;
+    int32_t             i, raw, table_len;
+    char                *chunks;
+
+    if (codec == NULL) {
+        INFQ_ERROR_LOG("codec isn't available, codec: %d", file_block->codec);
         return INFQ_ERR;
     }
 
-    // open file
-    char        buf[INFQ_MAX_BUF_SIZE];
-    char        meta_buf[16];
+    file_block->chunk_size = INFQ_CHUNK_SIZE;
+    file_block->chunk_num = (file_block->data_size + INFQ_CHUNK_SIZE - 1) / INFQ_CHUNK_SIZE;
+    if (file_block->chunk_num == 0) {
+        file_block->codec = INFQ_CODEC_NONE;
+        return INFQ_OK;
+    }
 
-    file_block->suffix = suffix;
-    // full file path
-    if (gen_file_path(
+    ends = (uint32_t *)realloc(file_block->chunk_ends, sizeof(uint32_t) * file_block->chunk_num);
+    if (ends == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for chunk ends, count: %d", file_block->chunk_num);
+        return INFQ_ERR;
+    }
+    file_block->chunk_ends = ends;
+
+    cap = codec->bound(INFQ_CHUNK_SIZE);
+    cap = cap > INFQ_CHUNK_SIZE ? cap : INFQ_CHUNK_SIZE;
+    table_len = infq_chunk_table_len(file_block);
+    io->frame = (char *)malloc(table_len + cap * file_block->chunk_num);
+    if (io->frame == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for compressed data, size: %lld",
+                table_len + cap * file_block->chunk_num);
+        return INFQ_ERR;
+    }
+
+    chunks = io->frame + table_len;
+    for (i = 0; i < file_block->chunk_num; i++) {
+        raw = infq_chunk_raw_len(file_block, i);
+        len = codec->compress(mem_block->mem + (int64_t)i * INFQ_CHUNK_SIZE, raw, chunks + pos, cap);
+        if (len < 0 || len >= raw) {
+            memcpy(chunks + pos, mem_block->mem + (int64_t)i * INFQ_CHUNK_SIZE, raw);
+            len = raw;
+        }
+        pos += len;
+        ends[i] = (uint32_t)pos;
+    }
+
+    if (table_len + pos >= file_block->data_size) {
+        free(io->frame);
+        io->frame = NULL;
+        file_block->codec = INFQ_CODEC_NONE;
+        file_block->chunk_num = 0;
+        return INFQ_OK;
+    }
+
+    header[0] = file_block->data_size;
+    header[1] = file_block->chunk_size;
+    header[2] = file_block->chunk_num;
+    header[3] = file_block->codec;
+    memcpy(io->frame, header, INFQ_FRAME_HEADER_LEN);
+    memcpy(io->frame + INFQ_FRAME_HEADER_LEN, ends, sizeof(uint32_t) * file_block->chunk_num);
+
+    return INFQ_OK;
+}
+
+/**
+ * Decode the 'idx'th chunk from 'src' which holds its compressed bytes, 'dst' should
+ *      have the room of a chunk.
+ */
+static int32_t
+decode_chunk(const file_block_t *file_block, int32_t idx, const char *src, char *dst)
+{
+    const infq_codec_t  *codec;
+    int32_t             raw = infq_chunk_raw_len(file_block, idx);
+    int64_t             len = file_block->chunk_ends[idx] - infq_chunk_start(file_block, idx);
+
+    if (len == raw) {
+        memcpy(dst, src, raw);
+        return INFQ_OK;
+    }
+
+    codec = codec_find(file_block->codec);
+    if (codec == NULL || codec->decompress(src, len, dst, raw) != raw) {
+        INFQ_ERROR_LOG("failed to decompress chunk, path: %s, prefix: %s, suffix: %d, chunk: %d",
                 file_block->file_path,
                 file_block->file_prefix,
                 file_block->suffix,
-                buf, INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to generate file path, path: %s, prefix: %s, suffix: %lld",
+                idx);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+/**
+ * Load the frame header and chunk ends of a compressed block, which follow the offsets.
+ */
+static int32_t
+load_chunk_table(file_block_t *file_block)
+{
+    uint32_t    header[4], *ends;
+    int64_t     offset = file_block->file_offset + infq_header_len(file_block);
+
+    if (infq_pread(file_block->fd, header, INFQ_FRAME_HEADER_LEN, offset) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read frame header, path: %s, prefix: %s, suffix: %d",
                 file_block->file_path,
                 file_block->file_prefix,
                 file_block->suffix);
         return INFQ_ERR;
     }
 
-    // fetch signature
-    if (mem_block_signature(mem_block, file_block->signature) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to fetch signature");
+    file_block->data_size = header[0];
+    file_block->chunk_size = header[1];
+    file_block->chunk_num = header[2];
+    file_block->codec = header[3];
+    if (codec_find(file_block->codec) == NULL || file_block->chunk_size <= 0
+            || file_block->chunk_num <= 0
+            || (int64_t)file_block->chunk_num * file_block->chunk_size < file_block->data_size
+            || (int64_t)(file_block->chunk_num - 1) * file_block->chunk_size >= file_block->data_size) {
+        INFQ_ERROR_LOG("invalid frame or codec isn't available, path: %s, prefix: %s, suffix: %d, "
+                "codec: %d, data size: %d, chunk size: %d, chunk count: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix,
+                file_block->codec,
+                file_block->data_size,
+                file_block->chunk_size,
+                file_block->chunk_num);
         return INFQ_ERR;
     }
 
-    file_block->fd = open(buf, O_CREAT | O_RDWR | O_TRUNC, 0644);
-    if (file_block->fd == -1) {
-        INFQ_ERROR_LOG_BY_ERRNO("failed to open file, file path: %s", buf);
+    ends = (uint32_t *)realloc(file_block->chunk_ends, sizeof(uint32_t) * file_block->chunk_num);
+    if (ends == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for chunk ends, count: %d", file_block->chunk_num);
         return INFQ_ERR;
     }
+    file_block->chunk_ends = ends;
 
-    // meta data, magic number and version
-    strcpy(meta_buf, INFQ_MAGIC_NUMBER);
-    strcpy(meta_buf + 8, INFQ_VERSION);
-
-    // write magic number and version
-    if (infq_pwrite(file_block->fd, meta_buf, sizeof(meta_buf), file_block->file_size) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to write meta info, path: %s, prefix: %s, suffix: %d",
+    if (infq_pread(file_block->fd, ends, sizeof(uint32_t) * file_block->chunk_num,
+                offset + INFQ_FRAME_HEADER_LEN) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read chunk ends, path: %s, prefix: %s, suffix: %d",
                 file_block->file_path,
                 file_block->file_prefix,
                 file_block->suffix);
-        goto failed;
-    }
-    file_block->file_size += sizeof(meta_buf);
-
-    // write header
-    if (write_header(file_block, mem_block) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to write header");
-        goto failed;
-    }
-
-    // write data
-    if (write_data(file_block, mem_block) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to write data");
-        goto failed;
+        return INFQ_ERR;
     }
 
-    // write signature
-    if (infq_pwrite(
-                file_block->fd,
-                file_block->signature,
-                INFQ_SIGNATURE_LEN,
-                file_block->file_size) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to write signature");
-        goto failed;
+    if (infq_chunk_table_len(file_block) + (int64_t)ends[file_block->chunk_num - 1]
+            != infq_frame_len(file_block)) {
+        INFQ_ERROR_LOG("chunk ends don't match file size, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return INFQ_ERR;
     }
-    file_block->file_size += INFQ_SIGNATURE_LEN;
 
     return INFQ_OK;
+}
 
-failed:
-    if (close(file_block->fd) == -1) {
-        INFQ_ERROR_LOG_BY_ERRNO("failed to close file, path: %s", buf);
-    }
+/**
+ * Read 'len' plain bytes at 'pos' of a compressed block by decoding the chunks holding
+ *      them. 'chunk' has the room of two chunks, the first one keeps the chunk decoded
+ *      last, whose index is '*chunk_idx'.
+ */
+static int32_t
+read_chunks(file_block_t *file_block, int64_t pos, char *dst, int64_t len,
+        char *chunk, int32_t *chunk_idx)
+{
+    int32_t     idx, raw;
+    int64_t     clen, n, in;
+    char        *src = chunk + file_block->chunk_size;
+
+    while (len > 0) {
+        idx = pos / file_block->chunk_size;
+        if (idx >= file_block->chunk_num) {
+            INFQ_ERROR_LOG("read beyond the data, pos: %lld, data size: %d",
+                    pos, file_block->data_size);
+            return INFQ_ERR;
+        }
 
-    // remove temp file
-    if (unlink(buf) == -1) {
-        INFQ_ERROR_LOG_BY_ERRNO("failed to remove file, path: %s", buf);
+        if (idx != *chunk_idx) {
+            clen = file_block->chunk_ends[idx] - infq_chunk_start(file_block, idx);
+            if (infq_pread(file_block->fd, src, clen, file_block->file_offset
+                        + infq_header_len(file_block) + infq_chunk_table_len(file_block)
+                        + infq_chunk_start(file_block, idx)) == INFQ_ERR
+                    || decode_chunk(file_block, idx, src, chunk) == INFQ_ERR) {
+                *chunk_idx = INFQ_UNDEF;
+                INFQ_ERROR_LOG("failed to read chunk, suffix: %d, chunk: %d",
+                        file_block->suffix, idx);
+                return INFQ_ERR;
+            }
+            *chunk_idx = idx;
+        }
+
+        raw = infq_chunk_raw_len(file_block, idx);
+        in = pos - (int64_t)idx * file_block->chunk_size;
+        n = raw - in < len ? raw - in : len;
+        memcpy(dst, chunk + in, n);
+        pos += n;
+        dst += n;
+        len -= n;
     }
 
-    return INFQ_ERR;
+    return INFQ_OK;
 }
 
 /**
@@ -169,42 +1026,59 @@ file_block_load_header(file_block_t *file_block)
         return INFQ_ERR;
     }
 
-    char            buf[INFQ_IO_BUF_UNIT];
-    int32_t         rlen, *offset;
-    int64_t         *meta_array;
-    struct stat     finfo;
+    int32_t     ret;
 
-    // open file when file isn't opened
-    if (file_block->fd == INFQ_UNDEF) {
-        if (gen_file_path(
+    if (file_block_pin_fd(file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to open file block, path: %s, prefix: %s, suffix: %d",
                 file_block->file_path,
                 file_block->file_prefix,
-                file_block->suffix,
-                buf,
-                INFQ_IO_BUF_UNIT)) {
-            INFQ_ERROR_LOG("failed to generate file path, path: %s, prefix: %s, suffix: %d",
+                file_block->suffix);
+        return INFQ_ERR;
+    }
+    ret = load_header(file_block);
+    file_block_unpin_fd(file_block);
+
+    return ret;
+}
+
+/**
+ * Load the header by the file pinned already.
+ */
+static int32_t
+load_header(file_block_t *file_block)
+{
+    char            buf[INFQ_IO_BUF_UNIT];
+    int64_t         *meta_array, record_len;
+    int32_t         framed;
+    struct stat     finfo;
+    struct iovec    iov;
+
+    // read file size, a block in segment is sized by the prefix of its record
+    if (file_block->segment != NULL) {
+        if (file_block->file_offset == INFQ_UNDEF) {
+            if (infq_pread(file_block->fd, &record_len, sizeof(record_len),
+                        file_block->segment->tail) == INFQ_ERR) {
+                INFQ_ERROR_LOG("failed to read record length, segment: %d, suffix: %d",
+                        file_block->segment->no,
+                        file_block->suffix);
+                return INFQ_ERR;
+            }
+            file_block->file_size = (int32_t)record_len;
+            place_in_segment(file_block);
+        }
+    } else {
+        if (fstat(file_block->fd, &finfo) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to fstat, path: %s, prefix: %s, suffix: %d",
                     file_block->file_path,
                     file_block->file_prefix,
                     file_block->suffix);
             return INFQ_ERR;
         }
-
-        file_block->fd = open(buf, O_RDONLY);
-        if (file_block->fd == -1) {
-            INFQ_ERROR_LOG_BY_ERRNO("failed to open file, file path: %s", buf);
-            return INFQ_ERR;
-        }
-    }
-
-    // read file size
-    if (fstat(file_block->fd, &finfo) == -1) {
-        INFQ_ERROR_LOG_BY_ERRNO("failed to fstat, file path: %s", buf);
-        return INFQ_ERR;
+        file_block->file_size = finfo.st_size;
     }
-    file_block->file_size = finfo.st_size;
 
     // read meta info
-    if (infq_read(file_block->fd, buf, INFQ_META_INFO_LEN) == INFQ_ERR) {
+    if (infq_pread(file_block->fd, buf, INFQ_META_INFO_LEN, file_block->file_offset) == INFQ_ERR) {
         INFQ_ERROR_LOG("failed to read meta info, path: %s, prefix: %s, suffix: %d",
                 file_block->file_path,
                 file_block->file_prefix,
@@ -225,6 +1099,7 @@ file_block_load_header(file_block_t *file_block)
     meta_array = (int64_t *)(buf + 16);
     file_block->start_index = meta_array[0];
     file_block->ele_count = (int32_t)meta_array[1];
+    framed = strncmp(buf + 8, INFQ_FRAME_VERSION, strlen(INFQ_FRAME_VERSION) + 1) == 0;
 
     // read offset array
     if (infq_offset_empty(file_block)) {
@@ -235,56 +1110,314 @@ file_block_load_header(file_block_t *file_block)
         }
     }
 
-    for (int rest = file_block->ele_count * sizeof(int32_t); rest > 0; rest -= rlen) {
-        rlen = rest > INFQ_IO_BUF_UNIT ? INFQ_IO_BUF_UNIT : rest;
-        if (infq_read(file_block->fd, buf, rlen) == INFQ_ERR) {
-            INFQ_ERROR_LOG("failed to read offset array, path: %s, prefix: %s, suffix: %d",
-                    file_block->file_path,
-                    file_block->file_prefix,
-                    file_block->suffix);
-            goto failed;
-        }
+    // read offset array directly to its memory
+    offset_array_reset(&file_block->offset_array);
+    if (offset_array_reserve(&file_block->offset_array, file_block->ele_count) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to reserve offset array, path: %s, suffix: %d, count: %d",
+                file_block->file_path,
+                file_block->suffix,
+                file_block->ele_count);
+        goto failed;
+    }
+
+    iov.iov_base = file_block->offset_array.offsets;
+    iov.iov_len = file_block->ele_count * sizeof(int32_t);
+    if (infq_preadv(file_block->fd, &iov, 1, file_block->file_offset + INFQ_META_INFO_LEN,
+                io_unit) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read offset array, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        goto failed;
+    }
+    file_block->offset_array.size = file_block->ele_count;
+
+    // the data is plain, or a frame of compressed chunks
+    if (framed) {
+        if (load_chunk_table(file_block) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to load chunk table, path: %s, prefix: %s, suffix: %d",
+                    file_block->file_path,
+                    file_block->file_prefix,
+                    file_block->suffix);
+            goto failed;
+        }
+    } else {
+        file_block->codec = INFQ_CODEC_NONE;
+        file_block->chunk_num = 0;
+        file_block->data_size = infq_frame_len(file_block);
+    }
+
+    INFQ_INFO_LOG("successful to load header, path: %s, prefix: %s, suffix: %d, start index: %lld"
+            ", ele count: %d",
+            file_block->file_path,
+            file_block->file_prefix,
+            file_block->suffix,
+            file_block->start_index,
+            file_block->ele_count);
+
+    return INFQ_OK;
+
+failed:
+    // reset file block
+    // indicates the block loading is failed
+    offset_array_destroy(&file_block->offset_array);
+
+    return INFQ_ERR;
+}
+
+int32_t
+file_block_load(file_block_t *file_block, mem_block_t **mem_block_ptr)
+{
+    file_block_io_t     io;
+    int32_t             ret = INFQ_DIRECT_UNSUPPORTED;
+
+    if (file_block_prepare_load(&io, file_block, mem_block_ptr) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to prepare to load file block");
+        return INFQ_ERR;
+    }
+
+    if (direct_io) {
+        ret = direct_transfer(&io, INFQ_FALSE);
+    }
+    if (ret == INFQ_DIRECT_UNSUPPORTED) {
+        ret = infq_preadv(file_block->fd, io.iov, io.iovcnt, io.offset, io_unit);
+    }
+    // the header has been read through the page cache in any case
+    file_block_drop_cache(file_block, INFQ_FALSE);
+
+    if (ret == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read data block, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        file_block_abort_load(&io);
+        return INFQ_ERR;
+    }
+
+    return file_block_finish_load(&io);
+}
+
+int32_t
+file_block_prepare_load(file_block_io_t *io, file_block_t *file_block, mem_block_t **mem_block_ptr)
+{
+    if (io == NULL || file_block == NULL || mem_block_ptr == NULL || *mem_block_ptr == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t         total_size;
+    mem_block_t     *mem_block = *mem_block_ptr;
+
+    // the memory block may be a view of another file block, which is read-only
+    mem_block_unmap(mem_block);
+
+    // the file is kept open until the load is finished or aborted
+    io->file_block = file_block;
+    io->frame = NULL;
+    io->pinned = INFQ_FALSE;
+    if (file_block_pin_fd(file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to open file block, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return INFQ_ERR;
+    }
+    io->pinned = INFQ_TRUE;
+
+    // load header if needed
+    if (infq_offset_empty(file_block)) {
+        if (load_header(file_block) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to load file block header, path: %s, prefix: %s, suffix: %d",
+                    file_block->file_path,
+                    file_block->file_prefix,
+                    file_block->suffix);
+            unpin_io(io);
+            return INFQ_ERR;
+        }
+    }
+
+    // copy meta data
+    mem_block->start_index = file_block->start_index;
+    mem_block->ele_count = file_block->ele_count;
+    if (offset_array_cp(
+                &mem_block->offset_array,
+                &file_block->offset_array) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to copy offset array");
+        unpin_io(io);
+        return INFQ_ERR;
+    }
+
+    // load memory block, grow it if the file block holds a jumbo element
+    total_size = file_block->data_size;
+    if (mem_block->mem_size < total_size) {
+        mem_block->last_offset = 0;
+        mem_block = block_pool_resize(mem_block, (total_size + 7) & (~INFQ_PADDING_MASK));
+        if (mem_block == NULL) {
+            INFQ_ERROR_LOG("mem block isn't big enough, path: %s, prefix: %s, suffix: %d,"
+                    " file size: %d, mem size: %d",
+                    file_block->file_path,
+                    file_block->file_prefix,
+                    file_block->suffix,
+                    file_block->file_size,
+                    (*mem_block_ptr)->mem_size);
+            unpin_io(io);
+            return INFQ_ERR;
+        }
+        *mem_block_ptr = mem_block;
+    }
+
+    // read data block and signature at once, the compressed data is decoded after
+    io->mem_block = mem_block;
+    if (file_block->codec != INFQ_CODEC_NONE) {
+        io->frame = (char *)malloc(infq_frame_len(file_block));
+        if (io->frame == NULL) {
+            INFQ_ERROR_LOG("failed to alloc mem for compressed data, size: %d",
+                    infq_frame_len(file_block));
+            unpin_io(io);
+            return INFQ_ERR;
+        }
+        io->iov[0].iov_base = io->frame;
+        io->iov[0].iov_len = infq_frame_len(file_block);
+    } else {
+        io->iov[0].iov_base = mem_block->mem;
+        io->iov[0].iov_len = total_size;
+    }
+    io->iov[1].iov_base = file_block->signature;
+    io->iov[1].iov_len = INFQ_SIGNATURE_LEN;
+    io->iovcnt = 2;
+    io->offset = file_block->file_offset + infq_header_len(file_block);
+
+    return INFQ_OK;
+}
+
+int32_t
+file_block_finish_load(file_block_io_t *io)
+{
+    if (io == NULL || io->mem_block == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    mem_block_t     *mem_block = io->mem_block;
+    file_block_t    *file_block = io->file_block;
+    int32_t         i, table_len;
+
+    if (io->frame != NULL) {
+        table_len = infq_chunk_table_len(file_block);
+        for (i = 0; i < file_block->chunk_num; i++) {
+            if (decode_chunk(
+                        file_block,
+                        i,
+                        io->frame + table_len + infq_chunk_start(file_block, i),
+                        mem_block->mem + (int64_t)i * file_block->chunk_size) == INFQ_ERR) {
+                file_block_abort_load(io);
+                return INFQ_ERR;
+            }
+        }
+        file_block_abort_load(io);
+    }
+
+    /**
+     * NOTICE: To make sure the consistency of offset array and memory block,
+     *      [0, last_offset) of the memory block is dumped. There are some unused bytes at
+     *      the beginning of the block.
+     */
+    mem_block->first_offset = mem_block->offset_array.offsets[0];
+    mem_block->last_offset = file_block->data_size;
+    unpin_io(io);
+
+    return restore_checksum(file_block, mem_block);
+}
+
+/**
+ * Restore the CRC32C of the data loaded or mapped to the memory block from the
+ *      signature, so it can be extended or dumped again. When checksums are verified,
+ *      the data and header are checked against the signature at the cost of a pass
+ *      over the data. Blocks written before checksums have a SHA1 digest of their
+ *      meta info instead, their CRC32C is computed and can't be verified.
+ */
+static int32_t
+restore_checksum(file_block_t *file_block, mem_block_t *mem_block)
+{
+    unsigned char   digest[INFQ_SIGNATURE_LEN];
+    int32_t         tagged;
+
+    tagged = memcmp(file_block->signature, INFQ_SIGNATURE_TAG, INFQ_SIGNATURE_TAG_LEN) == 0;
+    if (tagged && !verify_checksum) {
+        memcpy(&mem_block->crc, file_block->signature + INFQ_SIGNATURE_TAG_LEN, sizeof(uint32_t));
+        return INFQ_OK;
+    }
 
-        for (int j = 0; j < rlen; j += sizeof(int32_t)) {
-            offset = (int32_t *)(buf + j);
-            if (offset_array_push(&file_block->offset_array, *offset) == INFQ_ERR) {
-                INFQ_ERROR_LOG("failed to push offset");
-                goto failed;
-            }
-        }
+    mem_block->crc = crc32c(0, mem_block->mem, mem_block->last_offset);
+    if (!tagged) {
+        return INFQ_OK;
     }
 
-    INFQ_INFO_LOG("successful to load header, path: %s, prefix: %s, suffix: %d, start index: %lld"
-            ", ele count: %d",
-            file_block->file_path,
-            file_block->file_prefix,
-            file_block->suffix,
+    mem_block_make_signature(
             file_block->start_index,
-            file_block->ele_count);
+            file_block->ele_count,
+            file_block->offset_array.offsets + file_block->offset_array.start_idx,
+            mem_block->crc,
+            file_block->data_size,
+            digest);
+    if (memcmp(digest, file_block->signature, INFQ_SIGNATURE_LEN) != 0) {
+        INFQ_ERROR_LOG("checksum mismatch, file block is corrupted, path: %s, prefix: %s, "
+                "suffix: %d, start index: %lld",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix,
+                file_block->start_index);
+        return INFQ_ERR;
+    }
 
     return INFQ_OK;
+}
 
-failed:
-    // reset file block
-    // indicates the block loading is failed
-    offset_array_destroy(&file_block->offset_array);
+void
+file_block_abort_load(file_block_io_t *io)
+{
+    if (io == NULL) {
+        return;
+    }
 
-    return INFQ_ERR;
+    free(io->frame);
+    io->frame = NULL;
+    unpin_io(io);
 }
 
 int32_t
-file_block_load(file_block_t *file_block, mem_block_t *mem_block)
+file_block_map(file_block_t *file_block, mem_block_t *mem_block)
 {
     if (file_block == NULL || mem_block == NULL) {
         INFQ_ERROR_LOG("invalid param");
         return INFQ_ERR;
     }
 
-    int32_t     idx, rlen, total_size;
+    int32_t     ret;
+
+    if (file_block_pin_fd(file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to open file block, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return INFQ_ERR;
+    }
+    ret = map_block(file_block, mem_block);
+    file_block_unpin_fd(file_block);
+
+    return ret;
+}
+
+static int32_t
+map_block(file_block_t *file_block, mem_block_t *mem_block)
+{
+    int32_t     header_len, total_size;
+    int64_t     map_offset, map_size;
+    char        *addr, *block;
 
     // load header if needed
-    if (infq_offset_empty(file_block) || file_block->fd == INFQ_UNDEF) {
-        if (file_block_load_header(file_block) == INFQ_ERR) {
+    if (infq_offset_empty(file_block)) {
+        if (load_header(file_block) == INFQ_ERR) {
             INFQ_ERROR_LOG("failed to load file block header, path: %s, prefix: %s, suffix: %d",
                     file_block->file_path,
                     file_block->file_prefix,
@@ -293,72 +1426,68 @@ file_block_load(file_block_t *file_block, mem_block_t *mem_block)
         }
     }
 
-    // copy meta data
-    mem_block->start_index = file_block->start_index;
-    mem_block->ele_count = file_block->ele_count;
-    if (offset_array_cp(
-                &mem_block->offset_array,
-                &file_block->offset_array) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to copy offset array");
+    if (file_block->codec != INFQ_CODEC_NONE) {
+        INFQ_ERROR_LOG("compressed block can't be mapped, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
         return INFQ_ERR;
     }
 
-    // load memory block
-    total_size = file_block->file_size - infq_header_len(file_block) - INFQ_SIGNATURE_LEN;
-    if (mem_block->mem_size < total_size) {
-        INFQ_ERROR_LOG("mem block isn't big enough, path: %s, prefix: %s, suffix: %d,"
-                " file size: %d, mem size: %d",
+    header_len = infq_header_len(file_block);
+    total_size = file_block->file_size - header_len - INFQ_SIGNATURE_LEN;
+    if (total_size < 0) {
+        INFQ_ERROR_LOG("invalid file size, path: %s, prefix: %s, suffix: %d, file size: %d",
                 file_block->file_path,
                 file_block->file_prefix,
                 file_block->suffix,
-                file_block->file_size,
-                mem_block->mem_size);
+                file_block->file_size);
         return INFQ_ERR;
     }
 
-    // seek to start of data block
-    if (lseek(file_block->fd, infq_header_len(file_block), SEEK_SET) == -1) {
-        INFQ_ERROR_LOG_BY_ERRNO("failed to seek, path: %s, prefix: %s, suffix: %d",
+    // the mapping starts at a page boundary, which is before the block in a segment
+    map_offset = file_block->file_offset & ~((int64_t)sysconf(_SC_PAGESIZE) - 1);
+    map_size = file_block->file_offset - map_offset + file_block->file_size;
+    addr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, file_block->fd, map_offset);
+    if (addr == MAP_FAILED) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to mmap file block, path: %s, prefix: %s, suffix: %d",
                 file_block->file_path,
                 file_block->file_prefix,
                 file_block->suffix);
         return INFQ_ERR;
     }
 
-    // read data block at 4KB/op
-    idx = 0;
-    while (idx < total_size) {
-        rlen = total_size - idx > INFQ_IO_BUF_UNIT ? INFQ_IO_BUF_UNIT : total_size - idx;
-        if (infq_read(file_block->fd, mem_block->mem + idx, rlen) == INFQ_ERR) {
-            INFQ_ERROR_LOG("failed to read data block, path: %s, prefix: %s, suffix: %d"
-                    ", already read: %d, total: %d",
-                    file_block->file_path,
-                    file_block->file_prefix,
-                    file_block->suffix,
-                    idx,
-                    total_size);
-            return INFQ_ERR;
-        }
-
-        idx += rlen;
-    }
+    block = addr + (file_block->file_offset - map_offset);
 
-    // read signature
-    if (infq_read(file_block->fd, file_block->signature, INFQ_SIGNATURE_LEN) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to read signature, path: %s, prefix: %s, suffix: %d",
+    // the whole block will be consumed sequentially
+    if (madvise(addr, map_size, MADV_WILLNEED) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to madvise, path: %s, prefix: %s, suffix: %d",
                 file_block->file_path,
                 file_block->file_prefix,
                 file_block->suffix);
+    }
+
+    mem_block_reset(mem_block, file_block->start_index);
+    mem_block->ele_count = file_block->ele_count;
+    if (offset_array_cp(
+                &mem_block->offset_array,
+                &file_block->offset_array) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to copy offset array");
+        munmap(addr, map_size);
+        mem_block_reset(mem_block, INFQ_UNDEF);
         return INFQ_ERR;
     }
 
-    /**
-     * NOTICE: To make sure the consistency of offset array and memory block,
-     *      [0, last_offset) of the memory block is dumped. There are some unused bytes at
-     *      the beginning of the block.
-     */
+    memcpy(file_block->signature, block + header_len + total_size, INFQ_SIGNATURE_LEN);
+
+    // NOTICE: the mapping is still valid after the file is closed and unlinked.
+    mem_block_map(mem_block, addr, map_size, block + header_len, total_size);
     mem_block->first_offset = mem_block->offset_array.offsets[0];
-    mem_block->last_offset = total_size;
+
+    if (restore_checksum(file_block, mem_block) == INFQ_ERR) {
+        mem_block_reset(mem_block, INFQ_UNDEF);
+        return INFQ_ERR;
+    }
 
     return INFQ_OK;
 }
@@ -376,8 +1505,109 @@ file_block_at(
         return INFQ_ERR;
     }
 
+    int32_t     ret;
+
+    if (file_block_pin_fd(file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to open file block, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return INFQ_ERR;
+    }
+    ret = read_at(file_block, global_idx, buf, buf_size, sizeptr);
+    file_block_unpin_fd(file_block);
+
+    return ret;
+}
+
+int32_t
+file_block_offset(const file_block_t *file_block, int64_t global_idx, int32_t *offset)
+{
+    if (file_block == NULL || offset == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int64_t     local_idx = global_idx - file_block->start_index;
+
+    if (local_idx < 0 || local_idx >= file_block->ele_count) {
+        INFQ_ERROR_LOG("idx is invalid, idx: %lld, valid index: [%lld, %lld)",
+                global_idx,
+                file_block->start_index,
+                file_block->start_index + file_block->ele_count);
+        return INFQ_ERR;
+    }
+
+    if (offset_array_get(&file_block->offset_array, local_idx, offset) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to get offset, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+int32_t
+file_block_read(file_block_t *file_block, int64_t pos, void *buf, int32_t len)
+{
+    if (file_block == NULL || buf == NULL || len < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    char        *chunk;
+    int32_t     chunk_idx = INFQ_UNDEF, ret = INFQ_ERR;
+
+    if (file_block_pin_fd(file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to open file block, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        return INFQ_ERR;
+    }
+
+    if (infq_offset_empty(file_block) && load_header(file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to load file block header, path: %s, prefix: %s, suffix: %d",
+                file_block->file_path,
+                file_block->file_prefix,
+                file_block->suffix);
+        goto done;
+    }
+
+    if (pos < 0 || pos + len > file_block->data_size) {
+        INFQ_ERROR_LOG("read beyond the data, pos: %lld, len: %d, data size: %d",
+                pos, len, file_block->data_size);
+        goto done;
+    }
+
+    if (file_block->codec == INFQ_CODEC_NONE) {
+        ret = infq_pread(file_block->fd, buf, len,
+                file_block->file_offset + infq_header_len(file_block) + pos);
+        goto done;
+    }
+
+    chunk = (char *)malloc((int64_t)file_block->chunk_size * 2);
+    if (chunk == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for chunks, chunk size: %d", file_block->chunk_size);
+        goto done;
+    }
+    ret = read_chunks(file_block, pos, (char *)buf, len, chunk, &chunk_idx);
+    free(chunk);
+
+done:
+    file_block_unpin_fd(file_block);
+
+    return ret;
+}
+
+static int32_t
+read_at(file_block_t *file_block, int64_t global_idx, void *buf, int32_t buf_size,
+        int32_t *sizeptr)
+{
     int32_t     offset;
-    int64_t     local_idx;
+    int64_t     pos;
 
 #ifdef D_ASSERT
     INFQ_ASSERT(file_block->ele_count == offset_size(&file_block->offset_array),
@@ -389,8 +1619,8 @@ file_block_at(
 #endif
 
     // load header if needed
-    if (infq_offset_empty(file_block) || file_block->fd == INFQ_UNDEF) {
-        if (file_block_load_header(file_block) == INFQ_ERR) {
+    if (infq_offset_empty(file_block)) {
+        if (load_header(file_block) == INFQ_ERR) {
             INFQ_ERROR_LOG("failed to load file block header, path: %s, prefix: %s, suffix: %d",
                     file_block->file_path,
                     file_block->file_prefix,
@@ -400,35 +1630,20 @@ file_block_at(
     }
 
     // fetch offset of the element
-    local_idx = global_idx - file_block->start_index;
-    if (local_idx < 0 || local_idx >= file_block->ele_count) {
-        INFQ_ERROR_LOG("idx is invalid, idx: %lld, valid index: [%lld, %lld)",
-                global_idx,
-                file_block->start_index,
-                file_block->start_index + file_block->ele_count);
+    if (file_block_offset(file_block, global_idx, &offset) == INFQ_ERR) {
         return INFQ_ERR;
     }
 
-    if (offset_array_get(&file_block->offset_array, local_idx, &offset) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to get offset, path: %s, prefix: %s, suffix: %d",
-                file_block->file_path,
-                file_block->file_prefix,
-                file_block->suffix);
-        return INFQ_ERR;
+    if (file_block->codec != INFQ_CODEC_NONE) {
+        return chunked_at(file_block, offset, buf, buf_size, sizeptr);
     }
 
-    // seek to the element
-    offset += infq_header_len(file_block);
-    if (lseek(file_block->fd, offset, SEEK_SET) == -1) {
-        INFQ_ERROR_LOG_BY_ERRNO("failed to seek, path: %s, prefix: %s, suffix: %d",
-                file_block->file_path,
-                file_block->file_prefix,
-                file_block->suffix);
-        return INFQ_ERR;
-    }
+    // NOTICE: the file may be shared by the blocks of a segment, so the offset of
+    //      the file isn't used
+    pos = file_block->file_offset + infq_header_len(file_block) + offset;
 
     // read data size
-    if (infq_read(file_block->fd, sizeptr, sizeof(int32_t)) == INFQ_ERR) {
+    if (infq_pread(file_block->fd, sizeptr, sizeof(int32_t), pos) == INFQ_ERR) {
         INFQ_ERROR_LOG("failed to read data len");
         return INFQ_ERR;
     }
@@ -441,7 +1656,7 @@ file_block_at(
     }
 
     // read data
-    if (infq_read(file_block->fd, buf, *sizeptr) == INFQ_ERR) {
+    if (infq_pread(file_block->fd, buf, *sizeptr, pos + sizeof(int32_t)) == INFQ_ERR) {
         INFQ_ERROR_LOG("failed to read data");
         return INFQ_ERR;
     }
@@ -449,23 +1664,66 @@ file_block_at(
     return INFQ_OK;
 }
 
+/**
+ * Read the element at 'offset' of a compressed block, only the chunks holding it
+ *      are decoded.
+ */
+static int32_t
+chunked_at(file_block_t *file_block, int32_t offset, void *buf, int32_t buf_size, int32_t *sizeptr)
+{
+    char        *chunk;
+    int32_t     chunk_idx = INFQ_UNDEF, ret = INFQ_ERR;
+
+    chunk = (char *)malloc((int64_t)file_block->chunk_size * 2);
+    if (chunk == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for chunks, chunk size: %d", file_block->chunk_size);
+        return INFQ_ERR;
+    }
+
+    if (read_chunks(file_block, offset, (char *)sizeptr, sizeof(int32_t), chunk, &chunk_idx)
+            == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read data len");
+        goto done;
+    }
+
+    if (*sizeptr > buf_size) {
+        INFQ_ERROR_LOG("buffer isn't big enough, buf size: %d, need size: %d",
+                buf_size,
+                *sizeptr);
+        goto done;
+    }
+
+    if (read_chunks(file_block, offset + sizeof(int32_t), buf, *sizeptr, chunk, &chunk_idx)
+            == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read data");
+        goto done;
+    }
+    ret = INFQ_OK;
+
+done:
+    free(chunk);
+
+    return ret;
+}
+
 void file_block_destroy(file_block_t *file_block)
 {
     if (file_block == NULL) {
         return;
     }
 
-    if (file_block->fd != INFQ_UNDEF) {
-        if (close(file_block->fd) == -1) {
-            INFQ_ERROR_LOG_BY_ERRNO("failed to close file, path: %s, prefix: %s, suffix: %d",
-                    file_block->file_path,
-                    file_block->file_prefix,
-                    file_block->suffix);
-        }
+    // the file is closed with the segment
+    if (file_block->segment != NULL) {
+        file_segment_release(file_block->segment);
+        file_block->segment = NULL;
         file_block->fd = INFQ_UNDEF;
     }
 
+    close_fd(file_block);
+
     offset_array_destroy(&file_block->offset_array);
+    free(file_block->chunk_ends);
+    file_block->chunk_ends = NULL;
 }
 
 int32_t file_block_file_delete(file_block_t *file_block)
@@ -477,24 +1735,13 @@ int32_t file_block_file_delete(file_block_t *file_block)
 
     char    buf[INFQ_MAX_BUF_SIZE];
 
-    if (gen_file_path(
-                file_block->file_path,
-                file_block->file_prefix,
-                file_block->suffix,
-                buf,
-                INFQ_MAX_BUF_SIZE)) {
+    if (block_file_path(file_block, buf, INFQ_MAX_BUF_SIZE)) {
         INFQ_ERROR_LOG("failed to generate file path");
         return INFQ_ERR;
     }
 
-    // try to close the file
-    if (file_block->fd != INFQ_UNDEF) {
-        if (close(file_block->fd) == -1) {
-            INFQ_ERROR_LOG_BY_ERRNO("failed to close file, file path: %s", buf);
-            return INFQ_ERR;
-        }
-        file_block->fd = INFQ_UNDEF;
-    }
+    // try to close the file, the file of a segment is closed with the segment
+    close_fd(file_block);
 
     if (unlink(buf) == -1) {
         INFQ_ERROR_LOG_BY_ERRNO("failed to unlink file, file path: %s", buf);
@@ -505,20 +1752,18 @@ int32_t file_block_file_delete(file_block_t *file_block)
 }
 
 /**
- * | start index | element count | offset array |
+ * Copy the header of the memory block to the file block.
  */
 int32_t
-write_header(file_block_t *file_block, mem_block_t *mem_block)
+copy_header(file_block_t *file_block, mem_block_t *mem_block)
 {
     if (file_block == NULL || mem_block == NULL) {
         INFQ_ERROR_LOG("invalid param");
         return INFQ_ERR;
     }
 
-    int64_t         buf[2];
-    int32_t         offset_size, wlen, total_wlen = 0;
+    int32_t         offset_size;
     offset_array_t  *offset_array;
-    char            *start;
 
     offset_array = &mem_block->offset_array;
     offset_size = offset_array_size(offset_array);
@@ -532,33 +1777,6 @@ write_header(file_block_t *file_block, mem_block_t *mem_block)
             offset_array->start_idx,
             offset_array->size);
 
-    // collect meta data to buffer, and then write to file
-    buf[0] = mem_block->start_index;
-    buf[1] = mem_block->ele_count;
-
-    if (infq_pwrite(file_block->fd, buf, sizeof(buf), file_block->file_size) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to write meta of header");
-        return INFQ_ERR;
-    }
-    file_block->file_size += sizeof(buf);
-
-    // write the offset array to file 4KB/op
-    start = (char *)(offset_array->offsets + offset_array->start_idx);
-    for (int32_t rest = sizeof(uint32_t) * offset_size; rest > 0; rest -= wlen) {
-        wlen = rest > INFQ_IO_BUF_UNIT ? INFQ_IO_BUF_UNIT : rest;
-        if (infq_pwrite(
-                    file_block->fd,
-                    start + total_wlen,
-                    wlen,
-                    file_block->file_size) == INFQ_ERR) {
-            INFQ_ERROR_LOG("failed to write offset array");
-            return INFQ_ERR;
-        }
-        total_wlen += wlen;
-        file_block->file_size += wlen;
-    }
-
-    // copy meta data to file block
     file_block->start_index = mem_block->start_index;
     file_block->ele_count = mem_block->ele_count;
     if (offset_array_cp(&file_block->offset_array, offset_array) == INFQ_ERR) {
@@ -571,67 +1789,196 @@ write_header(file_block_t *file_block, mem_block_t *mem_block)
     return INFQ_OK;
 }
 
-int32_t
-write_data(file_block_t *file_block, mem_block_t *mem_block)
+/**
+ * Copy 'len' bytes between 'buf' and the iov from the '*pos'th byte, which is advanced.
+ */
+static void
+copy_iov(const struct iovec *iov, int32_t iovcnt, int64_t *pos, char *buf, int64_t len,
+        int32_t to_iov)
 {
-    if (file_block == NULL || mem_block == NULL) {
-        INFQ_ERROR_LOG("invalid param");
+    int64_t     skip = *pos, n;
+    int32_t     i;
+
+    *pos += len;
+    for (i = 0; i < iovcnt && len > 0; i++) {
+        if (skip >= (int64_t)iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+
+        n = iov[i].iov_len - skip;
+        n = n < len ? n : len;
+        if (to_iov) {
+            memcpy((char *)iov[i].iov_base + skip, buf, n);
+        } else {
+            memcpy(buf, (char *)iov[i].iov_base + skip, n);
+        }
+        buf += n;
+        len -= n;
+        skip = 0;
+    }
+}
+
+static int64_t
+direct_rw(int32_t fd, char *buf, int64_t len, off_t offset, int32_t is_write)
+{
+    int64_t     done = 0, n;
+
+    while (done < len) {
+        n = is_write ? pwrite(fd, buf + done, len - done, offset + done)
+            : pread(fd, buf + done, len - done, offset + done);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            // EOF
+            break;
+        }
+        done += n;
+    }
+
+    return done;
+}
+
+/**
+ * Transfer the iov of 'io' by O_DIRECT through an aligned bounce buffer, so the
+ *      layout of file blocks is kept. Reads and writes are aligned to 4KB, the
+ *      written file is truncated to the real size. INFQ_DIRECT_UNSUPPORTED is
+ *      returned if O_DIRECT isn't supported by the file system.
+ */
+static int32_t
+direct_transfer(file_block_io_t *io, int32_t is_write)
+{
+#ifdef O_DIRECT
+    char            path[INFQ_MAX_BUF_SIZE];
+    char            *buf = NULL;
+    file_block_t    *file_block = io->file_block;
+    int64_t         total = 0, pos = 0, n, len, done;
+    off_t           offset;
+    int32_t         fd, skip, i, first = INFQ_TRUE, ret = INFQ_ERR;
+
+    for (i = 0; i < io->iovcnt; i++) {
+        total += io->iov[i].iov_len;
+    }
+
+    if (block_file_path(file_block, path, INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to generate file path, suffix: %d", file_block->suffix);
         return INFQ_ERR;
     }
 
-    int32_t     wlen, total_wlen = 0;
+    // NOTICE: the file keeps being accessed by 'file_block->fd' with the page cache
+    fd = open(path, (is_write ? O_WRONLY : O_RDONLY) | O_DIRECT);
+    if (fd == -1) {
+        if (errno == EINVAL) {
+            INFQ_INFO_LOG("O_DIRECT isn't supported, fall back to buffered IO, path: %s", path);
+            return INFQ_DIRECT_UNSUPPORTED;
+        }
+        INFQ_ERROR_LOG_BY_ERRNO("failed to open file, file path: %s", path);
+        return INFQ_ERR;
+    }
 
-    // copy [0, last_offset) of memory block
-    // write memory block data to file 4KB/op
-    //
-    // Notice: 这里拷贝整个内存块，而不是[first_offset, last_offset)。
-    //      这样做的原因是，保证offset array和内存块的一致性。
-    //      另一种替代方案是，遍历offset array，对于每个元素都减掉
-    //      mem_block->first_offset。这样做比较低效。
-    //      在整个infQ中，最多只有push queue和pop queue中，两个被pop
-    //      过的memory block会存在浪费。
-    for (int32_t rest = mem_block->last_offset; rest > 0; rest -= wlen) {
-        wlen = rest > INFQ_IO_BUF_UNIT ? INFQ_IO_BUF_UNIT : rest;
-        if (infq_pwrite(
-                    file_block->fd,
-                    mem_block->mem + total_wlen,
-                    wlen,
-                    file_block->file_size) == INFQ_ERR) {
-            INFQ_ERROR_LOG("failed to write data, path: %s, suffix: %d");
-            return INFQ_ERR;
+    if ((errno = posix_memalign((void **)&buf, INFQ_DIRECT_ALIGN, INFQ_DIRECT_BUF_SIZE)) != 0) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to alloc aligned buffer");
+        buf = NULL;
+        goto done;
+    }
+
+    offset = io->offset & ~((off_t)INFQ_DIRECT_ALIGN - 1);
+    skip = io->offset - offset;
+    while (pos < total) {
+        n = INFQ_DIRECT_BUF_SIZE - skip;
+        n = n < total - pos ? n : total - pos;
+        len = infq_direct_align(skip + n);
+
+        if (is_write) {
+            copy_iov(io->iov, io->iovcnt, &pos, buf + skip, n, INFQ_FALSE);
+            memset(buf + skip + n, 0, len - skip - n);
         }
-        total_wlen += wlen;
-        file_block->file_size += wlen;
+
+        done = direct_rw(fd, buf, len, offset, is_write);
+        if (done == -1) {
+            // some file systems accept O_DIRECT on open but not on IO
+            if (errno == EINVAL && first) {
+                INFQ_INFO_LOG("O_DIRECT isn't supported, fall back to buffered IO, path: %s", path);
+                ret = INFQ_DIRECT_UNSUPPORTED;
+            } else {
+                INFQ_ERROR_LOG_BY_ERRNO("failed to %s file block by O_DIRECT, path: %s, offset: %lld",
+                        is_write ? "write" : "read", path, (long long)offset);
+            }
+            goto done;
+        }
+        if (done < (is_write ? len : skip + n)) {
+            INFQ_ERROR_LOG("unexpected EOF of file block, path: %s, offset: %lld",
+                    path, (long long)offset);
+            goto done;
+        }
+
+        if (!is_write) {
+            copy_iov(io->iov, io->iovcnt, &pos, buf + skip, n, INFQ_TRUE);
+        }
+        offset += len;
+        skip = 0;
+        first = INFQ_FALSE;
     }
 
-    return INFQ_OK;
+    // drop the zero padding of the last write, records in a segment are padded anyway
+    if (is_write && file_block->segment == NULL
+            && ftruncate(file_block->fd, io->offset + total) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to truncate file, path: %s", path);
+        goto done;
+    }
+    ret = INFQ_OK;
+
+done:
+    free(buf);
+    if (close(fd) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to close file, path: %s", path);
+    }
+
+    return ret;
+#else
+    (void)io;
+    (void)is_write;
+
+    return INFQ_DIRECT_UNSUPPORTED;
+#endif
 }
 
 int32_t
-file_block_sync(const file_block_t *file_block)
+file_block_sync(file_block_t *file_block)
 {
     if (file_block == NULL) {
         INFQ_ERROR_LOG("invalid param");
         return INFQ_ERR;
     }
 
-    if (file_block->fd == INFQ_UNDEF) {
-        INFQ_ERROR_LOG("invalid fd, path: %s, prefix: %s, suffix: %d",
+    int32_t     ret = INFQ_OK;
+
+    // NOTICE: a file closed by the LRU is opened again, 'fdatasync' of any fd flushes
+    //      the dirty pages of the file
+    if (file_block_pin_fd(file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to open file block, path: %s, prefix: %s, suffix: %d",
                 file_block->file_path,
                 file_block->file_prefix,
                 file_block->suffix);
         return INFQ_ERR;
     }
 
-    if (fsync(file_block->fd) == -1) {
+    // NOTICE: the size of file is synced by 'fdatasync' too, other metadata isn't
+    //      needed to read the block back
+    if (fdatasync(file_block->fd) == -1) {
         INFQ_ERROR_LOG_BY_ERRNO("failed to sync data to disk, path: %s, prefix: %s, suffix: %d",
                 file_block->file_path,
                 file_block->file_prefix,
                 file_block->suffix);
-        return INFQ_ERR;
+        ret = INFQ_ERR;
     }
+    file_block_unpin_fd(file_block);
 
-    return INFQ_OK;
+    return ret;
 }
 
 int32_t
@@ -686,8 +2033,10 @@ file_fetch_signature(const char *file_path, unsigned char digest[20])
 
     if (infq_pread(fd, digest, INFQ_SIGNATURE_LEN, finfo.st_size - INFQ_SIGNATURE_LEN) == INFQ_ERR) {
         INFQ_ERROR_LOG_BY_ERRNO("failed to read file, path: %s", file_path);
+        close(fd);
         return INFQ_ERR;
     }
+    close(fd);
 
     return INFQ_OK;
 }
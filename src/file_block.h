@@ -10,15 +10,31 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #include "offset_array.h"
 #include "mem_block.h"
 #include "infq.h"
 
 #define MAX_FILENAME_CHARS      100
-#define INFQ_SIGNATURE_LEN      20
 
 extern char *INFQ_FILE_BLOCK_PREFXI;
+extern char *INFQ_SEGMENT_PREFIX;
+
+/**
+ * A segment file holds a series of file blocks appended one after another. Each block
+ *      is a record prefixed by its length, and records start at 4KB boundaries.
+ */
+typedef struct _file_segment_t {
+    int32_t                 no;                 /* Suffix of the segment file */
+    int32_t                 fd;
+    volatile int32_t        ref;                /* Number of file blocks and the file queue
+                                                   referring to the segment */
+    int64_t                 tail;               /* Offset of the record to append */
+    int32_t                 tail_idx;           /* Index in the segment of the record at 'tail',
+                                                   INFQ_UNDEF means unknown */
+} file_segment_t;
 
 typedef struct _file_block_t {
     int64_t                 start_index;        /* Global index of the first element */
@@ -31,15 +47,46 @@ typedef struct _file_block_t {
     int32_t                 suffix;             /* Suffix of the file's name of the file block.
                                                    It's a number sequence. */
     int32_t                 fd;                 /* File descriptor of the file block.
-                                                   If the file isn't opened, it's -1. */
+                                                   If the file isn't opened, it's -1. It may be
+                                                   closed by the LRU unless it's pinned, see
+                                                   'file_block_pin_fd' */
     int32_t                 file_size;          /* Size of the file */
+    file_segment_t          *segment;           /* The segment holding the block, NULL if the block
+                                                   has its own file. 'fd' is shared with the segment */
+    int64_t                 file_offset;        /* Offset of the block in the file */
+    int32_t                 codec;              /* Codec compressing the data, INFQ_CODEC_NONE if the data
+                                                   is plain. It's set to write the block, and loaded with
+                                                   the header */
+    int32_t                 data_size;          /* Size of the plain data */
+    int32_t                 chunk_size;         /* Plain bytes of a compressed chunk */
+    int32_t                 chunk_num;
+    uint32_t                *chunk_ends;        /* End offsets of the compressed chunks */
     offset_array_t          offset_array;       /* Mapping the offset of element by index */
+    int32_t                 lazy;               /* The header isn't loaded yet, only the meta data
+                                                   restored from the manifest is known */
+    int32_t                 fd_pins;            /* Number of users of 'fd' */
+    struct _file_block_t    *fd_prev, *fd_next; /* LRU list of the files opened by blocks */
     struct _file_block_t    *next;              /* All the blocks in a file queue are organized into a
                                                    linked-list. 'next' is a pointer points to the next block */
-    unsigned char           signature[INFQ_SIGNATURE_LEN];  /* The signature of the content, used to match the
-                                                               content of memory block and file block */
+    unsigned char           signature[INFQ_SIGNATURE_LEN];  /* The trailer holding the checksums of the content,
+                                                               used to match the content of memory block and
+                                                               file block, see 'mem_block_signature' */
 } file_block_t;
 
+/* A read or write of a file block, the buffers must be kept until the IO is done */
+typedef struct _file_block_io_t {
+    file_block_t            *file_block;
+    mem_block_t             *mem_block;
+    char                    meta_buf[16];       /* Magic number and version */
+    int64_t                 header_buf[2];      /* Start index and element count */
+    int64_t                 record_len;         /* Length prefix of the record in a segment */
+    char                    *frame;             /* Buffer of the compressed data */
+    struct iovec            iov[6];
+    int32_t                 iovcnt;
+    off_t                   offset;             /* Offset in the file */
+    int32_t                 pinned;             /* 'fd' is pinned until the IO is finished */
+} file_block_io_t;
+
 /**
  * @brief Init the file block.
  * @param file_path: The directory which the file block locates
@@ -50,9 +97,149 @@ typedef struct _file_block_t {
  */
 int32_t file_block_init(file_block_t *file_block, const char *file_path, const char *file_prefix);
 
+/**
+ * @brief Set the max bytes of a read or write syscall of file blocks, 0 means a block
+ *      is written by one 'pwritev' and read by one 'preadv'.
+ */
+void file_block_set_io_unit(int32_t unit);
+
+/**
+ * @brief Write and load file blocks by O_DIRECT through aligned bounce buffers, so
+ *      spilled blocks don't evict the page cache. When O_DIRECT isn't supported by
+ *      the file system, the buffered IO is used and the cached pages of file blocks
+ *      are dropped after the IO.
+ */
+void file_block_set_direct_io(int32_t enable);
+
+/**
+ * @brief Verify the CRC32C checksums of file blocks when they're loaded or mapped,
+ *      a corrupted block fails to load. Otherwise the checksum of data is taken from
+ *      the signature without reading the data.
+ */
+void file_block_set_verify_checksum(int32_t enable);
+
+/**
+ * @brief Limit the number of files opened by the file blocks of all infQs in the
+ *      process, 0 means no limit. The least recently used files are closed beyond
+ *      it, and opened again when they're accessed. A file in use isn't closed, so
+ *      the limit may be exceeded by them. The files of segments aren't counted.
+ */
+void file_block_set_max_open_files(int32_t max_files);
+
+/**
+ * @brief Make sure 'fd' of the file block is opened, the file is opened again if
+ *      it's closed by the LRU. It isn't closed by the LRU until it's unpinned.
+ */
+int32_t file_block_pin_fd(file_block_t *file_block);
+void file_block_unpin_fd(file_block_t *file_block);
+
+/**
+ * @brief Drop the cached pages of the file block in direct IO mode, dirty pages are
+ *      written back first if 'written'. It's a no-op otherwise.
+ */
+void file_block_drop_cache(file_block_t *file_block, int32_t written);
+
+/**
+ * @brief Start to read the file block into the page cache ahead of loading it. It's
+ *      a no-op in direct IO mode, or if the position of the block isn't known yet.
+ */
+void file_block_prefetch(file_block_t *file_block);
+
+/**
+ * @brief Open the segment file suffixed by 'no', the file is truncated if 'create'. Extents
+ *      of 'prealloc' bytes are allocated ahead without changing the file size.
+ *      The segment is referred by the caller once.
+ */
+file_segment_t *file_segment_open(const char *file_path, int32_t no, int32_t create, int64_t prealloc);
+void file_segment_ref(file_segment_t *segment);
+void file_segment_release(file_segment_t *segment);
+
+/**
+ * @brief Move the tail of the segment to the 'idx'th record, the records before are
+ *      walked through by their length prefixes unless the tail is already there.
+ */
+int32_t file_segment_seek(file_segment_t *segment, int32_t idx);
+
+/**
+ * @brief Place the file block at the tail of the segment, which is referred by the
+ *      block until it's destroyed. It's done before writing the block or loading
+ *      its header, and 'file_segment_seek' should be called first.
+ */
+int32_t file_block_attach_segment(file_block_t *file_block, file_segment_t *segment);
+
+/**
+ * @brief Place the file block attached at 'file_offset' known already, e.g. restored from
+ *      the manifest, instead of reading the length prefix at the tail. The block is the
+ *      'idx'th record of the segment, the tail is moved after it. 'file_size' should be set.
+ */
+void file_block_place_in_segment(file_block_t *file_block, int64_t file_offset, int32_t idx);
+
 int32_t file_block_write(file_block_t *file_block, int32_t suffix, mem_block_t *mem_block);
 int32_t file_block_load_header(file_block_t *file_block);
-int32_t file_block_load(file_block_t *file_block, mem_block_t *mem_block);
+
+/**
+ * @brief Split 'file_block_write' for asynchronous IO. The file is opened and 'io'
+ *      is filled to write all the content, the meta data is copied to the file block.
+ *      The data is compressed by the codec of the file block if it's set, and written
+ *      plain if it doesn't shrink.
+ *      The memory block mustn't be changed until the IO is done, otherwise
+ *      'file_block_abort_write' closes and removes the file.
+ */
+int32_t file_block_prepare_write(
+        file_block_io_t *io,
+        file_block_t *file_block,
+        int32_t suffix,
+        mem_block_t *mem_block);
+void file_block_abort_write(file_block_io_t *io);
+
+/**
+ * @brief Release the buffer of 'io' after the write is done.
+ */
+void file_block_finish_write(file_block_io_t *io);
+
+/**
+ * @brief Load the file block to a memory block. When the memory block isn't big
+ *      enough, e.g. the file block holds a jumbo element, it's resized and
+ *      '*mem_block_ptr' is updated.
+ */
+int32_t file_block_load(file_block_t *file_block, mem_block_t **mem_block_ptr);
+
+/**
+ * @brief Split 'file_block_load' for asynchronous IO. The header is loaded and 'io'
+ *      is filled to read the data and signature, '*mem_block_ptr' may be resized.
+ *      'file_block_finish_load' completes the memory block after the IO is done, the
+ *      compressed data is decompressed and the checksums are verified by it.
+ */
+int32_t file_block_prepare_load(
+        file_block_io_t *io,
+        file_block_t *file_block,
+        mem_block_t **mem_block_ptr);
+int32_t file_block_finish_load(file_block_io_t *io);
+
+/**
+ * @brief Release the buffer of 'io' when the read fails.
+ */
+void file_block_abort_load(file_block_io_t *io);
+
+/**
+ * @brief Map the file block read-only and make the memory block a view of it, so
+ *      elements are served from the page cache without being copied. The mapping
+ *      is released when the memory block is reset. A compressed block can't be mapped.
+ */
+int32_t file_block_map(file_block_t *file_block, mem_block_t *mem_block);
+
+/**
+ * @brief Fetch the offset of the element in the data of the file block, the
+ *      header should be loaded.
+ */
+int32_t file_block_offset(const file_block_t *file_block, int64_t global_idx, int32_t *offset);
+
+/**
+ * @brief Read 'len' bytes at 'pos' of the data by positional reads, the chunks
+ *      holding them are decoded for a compressed block. It's safe to be called
+ *      concurrently.
+ */
+int32_t file_block_read(file_block_t *file_block, int64_t pos, void *buf, int32_t len);
 int32_t file_block_at(
         file_block_t *file_block,
         int64_t global_idx,
@@ -61,7 +248,7 @@ int32_t file_block_at(
         int32_t *sizeptr);
 void file_block_destroy(file_block_t *file_block);
 int32_t file_block_file_delete(file_block_t *file_block);
-int32_t file_block_sync(const file_block_t *file_block);
+int32_t file_block_sync(file_block_t *file_block);
 int32_t file_block_debug_info(const file_block_t *file_block, char *buf, int32_t size);
 int32_t file_fetch_signature(const char *file_path, unsigned char digest[20]);
 void fetch_readable_signatrue(unsigned char digest[20], char *buf, int32_t len);
@@ -70,7 +70,7 @@ main(int argc, char* argv[])
             printf("failed to init mem block\n");
             return 1;
         }
-        if (file_block_load(&fblock, mblock) == INFQ_ERR) {
+        if (file_block_load(&fblock, &mblock) == INFQ_ERR) {
             printf("failed to load block\n");
             return 1;
         }
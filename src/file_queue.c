@@ -5,12 +5,46 @@
  * @date    2015/02/25 16:01:57
  */
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "file_queue.h"
+#include "codec.h"
 #include "utils.h"
 
+#define INFQ_MANIFEST_COMPACT_RECORDS   4096
+
+// blocks written outside of file queue are adopted with their own prefixes
+#define adopted(block)  ((block)->file_prefix != INFQ_FILE_BLOCK_PREFIX)
+
+static char *INFQ_RECYCLE_PREFIX = "recycle";
+
+static int32_t pop_head_block(file_queue_t *file_queue, mem_block_t **mem_block_ptr, int32_t map);
+static int32_t append_block(file_queue_t *file_queue, file_block_t *block);
+static int32_t pop_head(file_queue_t *file_queue, mem_block_t *mem_block);
+static int32_t attach_segment(file_queue_t *file_queue, file_block_t *block, int32_t suffix,
+        int32_t append);
+static void reuse_block_file(file_queue_t *file_queue, int32_t suffix);
+static void remove_leftover_recycled(file_queue_t *file_queue);
+static void destroy_recycled(file_queue_t *file_queue);
+static int32_t commit_due(const file_queue_t *file_queue);
+static int32_t sync_dir(const char *path);
+static void destroy_unsynced(file_queue_t *file_queue);
+static int32_t switch_segment(file_queue_t *file_queue, int32_t no, int32_t create);
+static int32_t ensure_header(file_block_t *block);
+static file_block_t *restore_block(file_queue_t *file_queue, const manifest_record_t *record);
+static int32_t records_contiguous(const manifest_record_t *records, int32_t n);
+static void compact_manifest_if_need(file_queue_t *file_queue);
+static int32_t add_block_by_file(file_queue_t *file_queue, const char *file_prefix,
+        int32_t file_suffix);
+static int32_t cached_at(file_queue_t *file_queue, file_block_t *file_block, int64_t global_idx,
+        void *buf, int32_t buf_size, int32_t *size);
+
 int32_t
 file_queue_init(file_queue_t *file_queue, const char *data_path)
 {
@@ -55,6 +89,59 @@ file_queue_init(file_queue_t *file_queue, const char *data_path)
         goto failed;
     }
 
+    if (pthread_mutex_init(&file_queue->recycle_mu, NULL) != 0) {
+        INFQ_ERROR_LOG("failed to init recycle mu for file queue");
+        pthread_mutex_destroy(&file_queue->mu);
+        goto failed;
+    }
+
+    if (pthread_mutex_init(&file_queue->sync_mu, NULL) != 0) {
+        INFQ_ERROR_LOG("failed to init sync mu for file queue");
+        pthread_mutex_destroy(&file_queue->recycle_mu);
+        pthread_mutex_destroy(&file_queue->mu);
+        goto failed;
+    }
+
+    if (pthread_mutex_init(&file_queue->commit_mu, NULL) != 0) {
+        INFQ_ERROR_LOG("failed to init commit mu for file queue");
+        pthread_mutex_destroy(&file_queue->sync_mu);
+        pthread_mutex_destroy(&file_queue->recycle_mu);
+        pthread_mutex_destroy(&file_queue->mu);
+        goto failed;
+    }
+
+    if (pthread_rwlock_init(&file_queue->at_lock, NULL) != 0) {
+        INFQ_ERROR_LOG("failed to init at lock for file queue");
+        pthread_mutex_destroy(&file_queue->commit_mu);
+        pthread_mutex_destroy(&file_queue->sync_mu);
+        pthread_mutex_destroy(&file_queue->recycle_mu);
+        pthread_mutex_destroy(&file_queue->mu);
+        goto failed;
+    }
+
+    if (page_cache_init(&file_queue->page_cache, 0) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to init page cache for file queue");
+        pthread_rwlock_destroy(&file_queue->at_lock);
+        pthread_mutex_destroy(&file_queue->commit_mu);
+        pthread_mutex_destroy(&file_queue->sync_mu);
+        pthread_mutex_destroy(&file_queue->recycle_mu);
+        pthread_mutex_destroy(&file_queue->mu);
+        goto failed;
+    }
+
+    if (manifest_open(&file_queue->manifest, file_queue->file_path) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to open manifest of file queue, path: %s", file_queue->file_path);
+        page_cache_destroy(&file_queue->page_cache);
+        pthread_rwlock_destroy(&file_queue->at_lock);
+        pthread_mutex_destroy(&file_queue->commit_mu);
+        pthread_mutex_destroy(&file_queue->sync_mu);
+        pthread_mutex_destroy(&file_queue->recycle_mu);
+        pthread_mutex_destroy(&file_queue->mu);
+        goto failed;
+    }
+    file_queue->manifest_pin = INFQ_UNDEF;
+    file_queue->unsynced_segment = INFQ_UNDEF;
+
     return INFQ_OK;
 
 failed:
@@ -76,6 +163,473 @@ failed:
     return INFQ_ERR;
 }
 
+void
+file_queue_set_segment(file_queue_t *file_queue, int32_t segment_blocks, int64_t prealloc)
+{
+    file_queue->segment_blocks = segment_blocks > 0 ? segment_blocks : 0;
+    file_queue->segment_prealloc = prealloc;
+}
+
+int32_t
+file_queue_set_codec(file_queue_t *file_queue, int32_t codec)
+{
+    if (file_queue == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (codec != INFQ_CODEC_NONE && codec_find(codec) == NULL) {
+        INFQ_ERROR_LOG("codec isn't available, codec: %d", codec);
+        return INFQ_ERR;
+    }
+    file_queue->codec = codec;
+
+    return INFQ_OK;
+}
+
+int32_t
+file_queue_set_page_cache(file_queue_t *file_queue, int32_t pages)
+{
+    if (file_queue == NULL || pages < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    page_cache_destroy(&file_queue->page_cache);
+    if (page_cache_init(&file_queue->page_cache, pages) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to init page cache, pages: %d", pages);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+int32_t
+file_queue_set_recycle(file_queue_t *file_queue, int32_t max_files)
+{
+    if (file_queue == NULL || max_files < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    // NOTICE: the sequence of recycled files restarts from 0, the files kept by a
+    //      crashed run aren't tracked and would never be removed
+    remove_leftover_recycled(file_queue);
+
+    if (max_files > 0) {
+        file_queue->recycled = (int32_t *)malloc(sizeof(int32_t) * max_files);
+        if (file_queue->recycled == NULL) {
+            INFQ_ERROR_LOG("failed to alloc mem for recycled files");
+            return INFQ_ERR;
+        }
+    }
+    file_queue->recycle_max = max_files;
+
+    return INFQ_OK;
+}
+
+int32_t
+file_queue_recycle_file(file_queue_t *file_queue, const char *path)
+{
+    if (file_queue == NULL || path == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    char            buf[INFQ_MAX_BUF_SIZE];
+    struct stat     finfo;
+    int32_t         ret = INFQ_ERR;
+
+    if (file_queue->recycle_max == 0) {
+        return INFQ_ERR;
+    }
+
+    // NOTICE: a file linked by a pop block is still referred by the dump meta
+    if (stat(path, &finfo) == -1 || finfo.st_nlink != 1) {
+        return INFQ_ERR;
+    }
+
+    pthread_mutex_lock(&file_queue->recycle_mu);
+    if (file_queue->recycle_num < file_queue->recycle_max
+            && gen_file_path(
+                file_queue->file_path,
+                INFQ_RECYCLE_PREFIX,
+                file_queue->recycle_seq,
+                buf, INFQ_MAX_BUF_SIZE) == INFQ_OK) {
+        if (rename(path, buf) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to rename file %s to %s", path, buf);
+        } else {
+            file_queue->recycled[file_queue->recycle_num++] = file_queue->recycle_seq++;
+            ret = INFQ_OK;
+        }
+    }
+    pthread_mutex_unlock(&file_queue->recycle_mu);
+
+    return ret;
+}
+
+int32_t
+file_queue_reuse_file(file_queue_t *file_queue, const char *path)
+{
+    if (file_queue == NULL || path == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    char            buf[INFQ_MAX_BUF_SIZE];
+    int32_t         ret = INFQ_ERR;
+
+    pthread_mutex_lock(&file_queue->recycle_mu);
+    if (file_queue->recycle_num > 0
+            && gen_file_path(
+                file_queue->file_path,
+                INFQ_RECYCLE_PREFIX,
+                file_queue->recycled[--file_queue->recycle_num],
+                buf, INFQ_MAX_BUF_SIZE) == INFQ_OK) {
+        if (rename(buf, path) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to rename file %s to %s", buf, path);
+            unlink(buf);
+        } else {
+            ret = INFQ_OK;
+        }
+    }
+    pthread_mutex_unlock(&file_queue->recycle_mu);
+
+    return ret;
+}
+
+/**
+ * Reuse a file kept for the file block of 'suffix' if any.
+ */
+static void
+reuse_block_file(file_queue_t *file_queue, int32_t suffix)
+{
+    char    buf[INFQ_MAX_BUF_SIZE];
+
+    if (file_queue->recycle_num == 0 || file_queue->segment_blocks > 0) {
+        return;
+    }
+
+    if (gen_file_path(
+                file_queue->file_path,
+                INFQ_FILE_BLOCK_PREFIX,
+                suffix,
+                buf, INFQ_MAX_BUF_SIZE) == INFQ_OK) {
+        file_queue_reuse_file(file_queue, buf);
+    }
+}
+
+/**
+ * Remove the recycled files left in the file path, which aren't tracked by the file queue.
+ */
+static void
+remove_leftover_recycled(file_queue_t *file_queue)
+{
+    char            buf[INFQ_MAX_BUF_SIZE];
+    char            prefix[INFQ_MAX_BUF_SIZE];
+    DIR             *dir;
+    struct dirent   *entry;
+    int32_t         prefix_len;
+
+    if ((dir = opendir(file_queue->file_path)) == NULL) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to open dir, file path: %s", file_queue->file_path);
+        return;
+    }
+
+    prefix_len = snprintf(prefix, sizeof(prefix), "%s_", INFQ_RECYCLE_PREFIX);
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, prefix, prefix_len) != 0) {
+            continue;
+        }
+
+        snprintf(buf, sizeof(buf), "%s/%s", file_queue->file_path, entry->d_name);
+        if (unlink(buf) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to unlink leftover recycled file, file path: %s", buf);
+        } else {
+            INFQ_INFO_LOG("unlink leftover recycled file, file path: %s", buf);
+        }
+    }
+    closedir(dir);
+}
+
+/**
+ * Remove the files kept, they hold nothing useful.
+ */
+static void
+destroy_recycled(file_queue_t *file_queue)
+{
+    char    buf[INFQ_MAX_BUF_SIZE];
+
+    pthread_mutex_lock(&file_queue->recycle_mu);
+    while (file_queue->recycle_num > 0) {
+        if (gen_file_path(
+                    file_queue->file_path,
+                    INFQ_RECYCLE_PREFIX,
+                    file_queue->recycled[--file_queue->recycle_num],
+                    buf, INFQ_MAX_BUF_SIZE) == INFQ_OK
+                && unlink(buf) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to unlink file, file path: %s", buf);
+        }
+    }
+    free(file_queue->recycled);
+    file_queue->recycled = NULL;
+    file_queue->recycle_max = 0;
+    pthread_mutex_unlock(&file_queue->recycle_mu);
+
+    pthread_mutex_destroy(&file_queue->recycle_mu);
+}
+
+void
+file_queue_set_durability(file_queue_t *file_queue, int32_t durability,
+        int32_t sync_blocks, int32_t sync_interval_ms)
+{
+    file_queue->durability = durability;
+    file_queue->sync_blocks = sync_blocks > 0 ? sync_blocks : 0;
+    file_queue->sync_interval_us = sync_interval_ms > 0 ? (int64_t)sync_interval_ms * 1000 : 0;
+}
+
+int32_t
+file_queue_sync_block(file_queue_t *file_queue, file_block_t *block)
+{
+    if (file_queue == NULL || block == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     *fds, fd, segment;
+
+    if (file_queue->durability == INFQ_DURABILITY_NONE) {
+        return INFQ_OK;
+    }
+
+    if (file_queue->durability == INFQ_DURABILITY_BLOCK) {
+        if (file_block_sync(block) == INFQ_ERR) {
+            return INFQ_ERR;
+        }
+        // NOTICE: the entry of a new file must be synced too, a segment is created
+        //      by its first block
+        if (block->segment != NULL && block->suffix % file_queue->segment_blocks != 0) {
+            return INFQ_OK;
+        }
+        return sync_dir(file_queue->file_path);
+    }
+
+    // group commit, the descriptor is duplicated since the block may be consumed
+    // and closed before it's synced
+    segment = block->segment != NULL ? block->segment->no : INFQ_UNDEF;
+    pthread_mutex_lock(&file_queue->sync_mu);
+    if (segment == INFQ_UNDEF || segment != file_queue->unsynced_segment) {
+        if (file_queue->unsynced_num == file_queue->unsynced_cap) {
+            fds = (int32_t *)realloc(file_queue->unsynced_fds,
+                    sizeof(int32_t) * (file_queue->unsynced_cap * 2 + 8));
+            if (fds == NULL) {
+                pthread_mutex_unlock(&file_queue->sync_mu);
+                INFQ_ERROR_LOG("failed to alloc mem for unsynced files");
+                return INFQ_ERR;
+            }
+            file_queue->unsynced_fds = fds;
+            file_queue->unsynced_cap = file_queue->unsynced_cap * 2 + 8;
+        }
+
+        // the file may have been closed by the LRU of open files
+        if (file_block_pin_fd(block) == INFQ_ERR) {
+            pthread_mutex_unlock(&file_queue->sync_mu);
+            INFQ_ERROR_LOG("failed to open file block, suffix: %d", block->suffix);
+            return INFQ_ERR;
+        }
+        fd = dup(block->fd);
+        file_block_unpin_fd(block);
+        if (fd == -1) {
+            pthread_mutex_unlock(&file_queue->sync_mu);
+            INFQ_ERROR_LOG_BY_ERRNO("failed to dup fd of file block, suffix: %d", block->suffix);
+            return INFQ_ERR;
+        }
+        file_queue->unsynced_fds[file_queue->unsynced_num++] = fd;
+        file_queue->unsynced_segment = segment;
+    }
+
+    if (file_queue->unsynced_blocks++ == 0) {
+        file_queue->unsynced_since = time_us();
+    }
+    pthread_mutex_unlock(&file_queue->sync_mu);
+
+    return INFQ_OK;
+}
+
+int32_t
+file_queue_sync(file_queue_t *file_queue, int32_t force)
+{
+    if (file_queue == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     *fds, num, blocks, i, ret = INFQ_OK;
+    long long   t1;
+
+    // NOTICE: a forced commit syncs the directory even if no block is left, the
+    //      files may be linked or renamed without being written
+    if (file_queue->durability == INFQ_DURABILITY_NONE
+            || (file_queue->durability == INFQ_DURABILITY_BLOCK && !force)) {
+        return INFQ_OK;
+    }
+
+    // NOTICE: commits are serialized, so a forced commit returns after the blocks
+    //      taken by a commit in progress are synced too. The blocks written while
+    //      committing go to the next one.
+    pthread_mutex_lock(&file_queue->commit_mu);
+    pthread_mutex_lock(&file_queue->sync_mu);
+    if (!force && !commit_due(file_queue)) {
+        pthread_mutex_unlock(&file_queue->sync_mu);
+        pthread_mutex_unlock(&file_queue->commit_mu);
+        return INFQ_OK;
+    }
+    fds = file_queue->unsynced_fds;
+    num = file_queue->unsynced_num;
+    blocks = file_queue->unsynced_blocks;
+    file_queue->unsynced_fds = NULL;
+    file_queue->unsynced_num = file_queue->unsynced_cap = 0;
+    file_queue->unsynced_blocks = 0;
+    file_queue->unsynced_segment = INFQ_UNDEF;
+    pthread_mutex_unlock(&file_queue->sync_mu);
+
+    t1 = time_us();
+    for (i = 0; i < num; i++) {
+        if (fdatasync(fds[i]) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to sync file of file queue, path: %s",
+                    file_queue->file_path);
+            ret = INFQ_ERR;
+        }
+        close(fds[i]);
+    }
+    free(fds);
+
+    // the records of the blocks restored by a dump meta must be on disk with it
+    if (manifest_sync(&file_queue->manifest) == INFQ_ERR) {
+        ret = INFQ_ERR;
+    }
+
+    if (sync_dir(file_queue->file_path) == INFQ_ERR) {
+        ret = INFQ_ERR;
+    }
+    pthread_mutex_unlock(&file_queue->commit_mu);
+
+    INFQ_DEBUG_LOG("group commit of file queue, blocks: %d, files: %d, cost: %lldus",
+            blocks, num, time_us() - t1);
+
+    return ret;
+}
+
+/**
+ * Check whether the blocks not synced should be committed, by the number of them or
+ *      the time since the first of them. Without both, they're committed at once.
+ */
+static int32_t
+commit_due(const file_queue_t *file_queue)
+{
+    if (file_queue->unsynced_blocks == 0) {
+        return INFQ_FALSE;
+    }
+
+    if (file_queue->sync_blocks == 0 && file_queue->sync_interval_us == 0) {
+        return INFQ_TRUE;
+    }
+
+    return (file_queue->sync_blocks > 0
+                && file_queue->unsynced_blocks >= file_queue->sync_blocks)
+            || (file_queue->sync_interval_us > 0
+                && time_us() - file_queue->unsynced_since >= file_queue->sync_interval_us);
+}
+
+/**
+ * Sync the directory, so the files created or renamed in it survive a crash.
+ */
+static int32_t
+sync_dir(const char *path)
+{
+    int32_t     fd;
+
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY)) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to open directory, path: %s", path);
+        return INFQ_ERR;
+    }
+
+    if (fsync(fd) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to sync directory, path: %s", path);
+        close(fd);
+        return INFQ_ERR;
+    }
+    close(fd);
+
+    return INFQ_OK;
+}
+
+static void
+destroy_unsynced(file_queue_t *file_queue)
+{
+    for (int32_t i = 0; i < file_queue->unsynced_num; i++) {
+        close(file_queue->unsynced_fds[i]);
+    }
+    free(file_queue->unsynced_fds);
+    file_queue->unsynced_fds = NULL;
+    file_queue->unsynced_num = file_queue->unsynced_cap = 0;
+    file_queue->unsynced_blocks = 0;
+
+    pthread_mutex_destroy(&file_queue->sync_mu);
+    pthread_mutex_destroy(&file_queue->commit_mu);
+}
+
+/**
+ * Place the block of 'suffix' in its segment, the segment is switched when the block
+ *      is the first one of the next segment.
+ */
+static int32_t
+attach_segment(file_queue_t *file_queue, file_block_t *block, int32_t suffix, int32_t append)
+{
+    int32_t     no = suffix / file_queue->segment_blocks;
+    int32_t     idx = suffix % file_queue->segment_blocks;
+
+    // NOTICE: a segment is truncated only when its first block is appended, otherwise
+    //      it's reopened to append or restore the blocks after the existing ones
+    if (switch_segment(file_queue, no, append && idx == 0) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+
+    if (file_segment_seek(file_queue->segment, idx) == INFQ_ERR
+            || file_block_attach_segment(block, file_queue->segment) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to attach block to segment, path: %s, segment: %d, suffix: %d",
+                file_queue->file_path, no, suffix);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+/**
+ * Make the segment 'no' the one which blocks are appended to or restored in.
+ */
+static int32_t
+switch_segment(file_queue_t *file_queue, int32_t no, int32_t create)
+{
+    if (file_queue->segment != NULL && file_queue->segment->no == no) {
+        return INFQ_OK;
+    }
+
+    file_segment_release(file_queue->segment);
+    file_queue->segment = file_segment_open(
+            file_queue->file_path,
+            no,
+            create,
+            file_queue->segment_prealloc);
+    if (file_queue->segment == NULL) {
+        INFQ_ERROR_LOG("failed to open segment, path: %s, segment: %d",
+                file_queue->file_path, no);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
 // push
 int32_t file_queue_dump_block(file_queue_t *file_queue, mem_block_t *mem_block)
 {
@@ -93,15 +647,157 @@ int32_t file_queue_dump_block(file_queue_t *file_queue, mem_block_t *mem_block)
         INFQ_ERROR_LOG("failed to init file block");
         return INFQ_ERR;
     }
+    block->codec = file_queue->codec;
+
+    reuse_block_file(file_queue, file_queue->block_suffix);
+
+    // dump to file block
+    if ((file_queue->segment_blocks > 0
+                && attach_segment(file_queue, block, file_queue->block_suffix, INFQ_TRUE) == INFQ_ERR)
+            || file_block_write(block, file_queue->block_suffix, mem_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to dump mem block to file block, path: %s, suffix: %d",
+                file_queue->file_path,
+                file_queue->block_suffix);
+        file_block_destroy(block);
+        free(block);
+        return INFQ_ERR;
+    }
+
+    if (file_queue_sync_block(file_queue, block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to sync file block, path: %s, suffix: %d",
+                file_queue->file_path,
+                file_queue->block_suffix);
+        file_block_destroy(block);
+        free(block);
+        return INFQ_ERR;
+    }
+
+    return append_block(file_queue, block);
+}
+
+int32_t
+file_queue_dump_blocks(file_queue_t *file_queue, mem_block_t **mem_blocks, int32_t n,
+        io_engine_t *engine)
+{
+    if (file_queue == NULL || mem_blocks == NULL || n < 1) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    file_block_io_t     *ios;
+    file_block_t        *block;
+    int32_t             prepared = 0, i;
+
+    if (engine == NULL) {
+        for (i = 0; i < n; i++) {
+            if (file_queue_dump_block(file_queue, mem_blocks[i]) == INFQ_ERR) {
+                return INFQ_ERR;
+            }
+        }
+        return INFQ_OK;
+    }
+
+    ios = (file_block_io_t *)malloc(sizeof(file_block_io_t) * n);
+    if (ios == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for file block io");
+        return INFQ_ERR;
+    }
+
+    // open the files of the blocks and submit the writes together
+    for (; prepared < n; prepared++) {
+        block = (file_block_t *)malloc(sizeof(file_block_t));
+        if (block == NULL) {
+            INFQ_ERROR_LOG("failed to alloc mem for file block");
+            goto failed;
+        }
+        reuse_block_file(file_queue, file_queue->block_suffix + prepared);
+        if (file_block_init(block, file_queue->file_path, NULL) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to init file block");
+            free(block);
+            goto failed;
+        }
+        block->codec = file_queue->codec;
+
+        if ((file_queue->segment_blocks > 0
+                    && attach_segment(
+                        file_queue,
+                        block,
+                        file_queue->block_suffix + prepared,
+                        INFQ_TRUE) == INFQ_ERR)
+                || file_block_prepare_write(
+                    &ios[prepared],
+                    block,
+                    file_queue->block_suffix + prepared,
+                    mem_blocks[prepared]) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to prepare file block, path: %s, suffix: %d",
+                    file_queue->file_path,
+                    file_queue->block_suffix + prepared);
+            file_block_destroy(block);
+            free(block);
+            goto failed;
+        }
+
+        if (io_engine_add(
+                    engine,
+                    block->fd,
+                    ios[prepared].iov,
+                    ios[prepared].iovcnt,
+                    ios[prepared].offset,
+                    INFQ_TRUE) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to add write to io engine, suffix: %d", block->suffix);
+            prepared++;
+            goto failed;
+        }
+    }
+
+    if (io_engine_wait(engine) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to write file blocks, path: %s, suffix: [%d, %d)",
+                file_queue->file_path,
+                file_queue->block_suffix,
+                file_queue->block_suffix + n);
+        goto failed;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (file_queue_sync_block(file_queue, ios[i].file_block) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to sync file block, path: %s, suffix: %d",
+                    file_queue->file_path,
+                    ios[i].file_block->suffix);
+            goto failed;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        // NOTICE: the engine always transfers by the page cache
+        file_block_drop_cache(ios[i].file_block, INFQ_TRUE);
+        file_block_finish_write(&ios[i]);
+        if (append_block(file_queue, ios[i].file_block) == INFQ_ERR) {
+            free(ios);
+            return INFQ_ERR;
+        }
+    }
+    free(ios);
 
-    // dump to file block
-    if (file_block_write(block, file_queue->block_suffix, mem_block) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to dump mem block to file block, path: %s, suffix: %d",
-                file_queue->file_path,
-                file_queue->block_suffix);
-        return INFQ_ERR;
+    return INFQ_OK;
+
+failed:
+    io_engine_reset(engine);
+    for (i = 0; i < prepared; i++) {
+        file_block_abort_write(&ios[i]);
+        file_block_destroy(ios[i].file_block);
+        free(ios[i].file_block);
     }
+    free(ios);
+
+    return INFQ_ERR;
+}
 
+/**
+ * Append a file block written to the tail of file queue.
+ */
+static int32_t
+append_block(file_queue_t *file_queue, file_block_t *block)
+{
     pthread_mutex_lock(&file_queue->mu);
     // update file block chain
     if (file_queue->block_head == NULL || file_queue->block_tail == NULL) {
@@ -121,16 +817,74 @@ int32_t file_queue_dump_block(file_queue_t *file_queue, mem_block_t *mem_block)
     file_queue->block_suffix++;
     file_queue->block_num++;
     file_queue->total_fsize += block->file_size;
-    file_queue->ele_count += mem_block->ele_count;
+    file_queue->ele_count += block->ele_count;
     pthread_mutex_unlock(&file_queue->mu);
 
+    // NOTICE: the block is appended whatever happens to the manifest, a manifest
+    //      failed is dropped and the headers are read to restore instead
+    if (manifest_append(&file_queue->manifest, block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to append block to manifest, path: %s, suffix: %d",
+                file_queue->file_path, block->suffix);
+    }
+    compact_manifest_if_need(file_queue);
+
     return INFQ_OK;
 }
 
+/**
+ * Compact the manifest when most of its records are of the blocks consumed. The
+ *      records pinned by the dump metas of infQ are kept, so it waits for the records
+ *      doubled since the last compaction, otherwise a pin far behind leads to
+ *      compacting again and again.
+ */
+static void
+compact_manifest_if_need(file_queue_t *file_queue)
+{
+    manifest_t      *manifest = &file_queue->manifest;
+    file_block_t    *block;
+    int32_t         keep_from, pin = file_queue->manifest_pin, records, kept;
+
+    pthread_mutex_lock(&manifest->mu);
+    records = manifest->records;
+    kept = manifest->kept;
+    pthread_mutex_unlock(&manifest->mu);
+
+    if (records < INFQ_MANIFEST_COMPACT_RECORDS
+            || records < file_queue->block_num * 2
+            || records < kept * 2) {
+        return;
+    }
+
+    pthread_mutex_lock(&file_queue->mu);
+    for (block = file_queue->block_head; block != NULL && adopted(block); block = block->next);
+    keep_from = block != NULL ? block->suffix : file_queue->block_suffix;
+    pthread_mutex_unlock(&file_queue->mu);
+    if (pin != INFQ_UNDEF && pin < keep_from) {
+        keep_from = pin;
+    }
+
+    manifest_compact(manifest, keep_from);
+}
+
+
 // pop
-int32_t file_queue_load_block(file_queue_t *file_queue, mem_block_t *mem_block)
+int32_t file_queue_load_block(file_queue_t *file_queue, mem_block_t **mem_block_ptr)
 {
-    if (file_queue == NULL || mem_block == NULL) {
+    return pop_head_block(file_queue, mem_block_ptr, INFQ_FALSE);
+}
+
+int32_t file_queue_map_block(file_queue_t *file_queue, mem_block_t **mem_block_ptr)
+{
+    return pop_head_block(file_queue, mem_block_ptr, INFQ_TRUE);
+}
+
+/**
+ * Read or map the head block of file queue to the memory block, then pop it.
+ */
+static int32_t
+pop_head_block(file_queue_t *file_queue, mem_block_t **mem_block_ptr, int32_t map)
+{
+    if (file_queue == NULL || mem_block_ptr == NULL) {
         INFQ_ERROR_LOG("invalid param");
         return INFQ_ERR;
     }
@@ -143,15 +897,152 @@ int32_t file_queue_load_block(file_queue_t *file_queue, mem_block_t *mem_block)
     // NOTICE: 不需要加锁。对于head_block只有loader和dumper线程会访问，
     //      最坏情况是，此前head_block是NULL，dumper添加head_block，
     //      而loader只读到NULL
-    file_block_t *block = file_queue->block_head;
+    //      Consumers loading inline are serialized with the loader by infQ's 'load_mu'.
+    file_block_t    *block = file_queue->block_head;
+    int32_t         ret;
+
+    infq_pthread_mutex_lock(&file_queue->mu);
+    ret = ensure_header(block);
+    infq_pthread_mutex_unlock(&file_queue->mu);
+    if (ret == INFQ_ERR) {
+        return INFQ_ERR;
+    }
 
-    if (file_block_load(block, mem_block) == INFQ_ERR) {
+    // a compressed block is decompressed to the memory block instead
+    if (map && block->codec == INFQ_CODEC_NONE) {
+        if (file_block_map(block, *mem_block_ptr) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to map file block to mem block, path: %s, suffix: %d",
+                    block->file_path,
+                    block->suffix);
+            return INFQ_ERR;
+        }
+    } else if (file_block_load(block, mem_block_ptr) == INFQ_ERR) {
         INFQ_ERROR_LOG("failed to load file block to mem block, path: %s, suffix: %d",
                 block->file_path,
                 block->suffix);
         return INFQ_ERR;
     }
 
+    return pop_head(file_queue, *mem_block_ptr);
+}
+
+int32_t
+file_queue_load_blocks(file_queue_t *file_queue, mem_block_t **mem_blocks, int32_t n,
+        io_engine_t *engine)
+{
+    if (file_queue == NULL || mem_blocks == NULL || n < 1) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    file_block_io_t     *ios;
+    file_block_t        *block;
+    int32_t             i;
+
+    if (engine == NULL) {
+        for (i = 0; i < n; i++) {
+            if (file_queue_load_block(file_queue, &mem_blocks[i]) == INFQ_ERR) {
+                return INFQ_ERR;
+            }
+        }
+        return INFQ_OK;
+    }
+
+    ios = (file_block_io_t *)malloc(sizeof(file_block_io_t) * n);
+    if (ios == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for file block io");
+        return INFQ_ERR;
+    }
+
+    // NOTICE: the blocks from the head are only popped by the caller, see 'pop_head_block'
+    pthread_mutex_lock(&file_queue->mu);
+    block = file_queue->block_head;
+    pthread_mutex_unlock(&file_queue->mu);
+
+    for (i = 0; i < n; i++) {
+        if (block == NULL) {
+            INFQ_ERROR_LOG("file queue has less blocks than expected, expected: %d", n);
+            goto failed;
+        }
+
+        infq_pthread_mutex_lock(&file_queue->mu);
+        if (ensure_header(block) == INFQ_ERR) {
+            infq_pthread_mutex_unlock(&file_queue->mu);
+            goto failed;
+        }
+        infq_pthread_mutex_unlock(&file_queue->mu);
+
+        if (file_block_prepare_load(&ios[i], block, &mem_blocks[i]) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to prepare to load file block, path: %s, suffix: %d",
+                    block->file_path,
+                    block->suffix);
+            goto failed;
+        }
+
+        if (io_engine_add(
+                    engine,
+                    block->fd,
+                    ios[i].iov,
+                    ios[i].iovcnt,
+                    ios[i].offset,
+                    INFQ_FALSE) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to add read to io engine, path: %s, suffix: %d",
+                    block->file_path,
+                    block->suffix);
+            i++;
+            goto failed;
+        }
+
+        pthread_mutex_lock(&file_queue->mu);
+        block = block->next;
+        pthread_mutex_unlock(&file_queue->mu);
+    }
+
+    if (io_engine_wait(engine) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read file blocks, path: %s", file_queue->file_path);
+        goto failed;
+    }
+
+    // NOTICE: nothing is popped if any block fails to be decompressed or verified
+    for (i = 0; i < n; i++) {
+        file_block_drop_cache(ios[i].file_block, INFQ_FALSE);
+        if (file_block_finish_load(&ios[i]) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to finish loading file block, path: %s, suffix: %d",
+                    file_queue->file_path,
+                    ios[i].file_block->suffix);
+            i = n;
+            goto failed;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (pop_head(file_queue, mem_blocks[i]) == INFQ_ERR) {
+            free(ios);
+            return INFQ_ERR;
+        }
+    }
+    free(ios);
+
+    return INFQ_OK;
+
+failed:
+    io_engine_reset(engine);
+    while (i-- > 0) {
+        file_block_abort_load(&ios[i]);
+    }
+    free(ios);
+
+    return INFQ_ERR;
+}
+
+/**
+ * Pop the head block of file queue, which has been loaded to the memory block.
+ */
+static int32_t
+pop_head(file_queue_t *file_queue, mem_block_t *mem_block)
+{
+    file_block_t    *block = file_queue->block_head;
+
     pthread_mutex_lock(&file_queue->mu);
     if (file_block_index_pop(&file_queue->index) == INFQ_ERR) {
         pthread_mutex_unlock(&file_queue->mu);
@@ -166,9 +1057,16 @@ int32_t file_queue_load_block(file_queue_t *file_queue, mem_block_t *mem_block)
     }
     file_queue->total_fsize -= block->file_size;
     file_queue->ele_count -= block->ele_count;
-    mem_block->file_block_no = block->suffix;
+    file_queue->head_seq++;
+    // only a block of file queue can be linked by a pop block when infQ is dumped
+    mem_block->file_block_no = adopted(block) ? INFQ_UNDEF : block->suffix;
     pthread_mutex_unlock(&file_queue->mu);
 
+    // wait for the readers of 'file_queue_at' which have found the block
+    pthread_rwlock_wrlock(&file_queue->at_lock);
+    pthread_rwlock_unlock(&file_queue->at_lock);
+    page_cache_drop(&file_queue->page_cache, block->start_index, block->data_size);
+
     // free the file block
     file_block_destroy(block);
     free(block);
@@ -189,6 +1087,7 @@ int32_t file_queue_at(
     }
 
     file_block_t    *file_block;
+    int32_t         ret;
 
     infq_pthread_mutex_lock(&file_queue->mu);
     if (file_block_index_search(&file_queue->index, global_idx, &file_block) == INFQ_ERR) {
@@ -196,18 +1095,114 @@ int32_t file_queue_at(
         INFQ_ERROR_LOG("failed to search file block at %d", global_idx);
         return INFQ_ERR;
     }
-    infq_pthread_mutex_unlock(&file_queue->mu);
 
     if (file_block == NULL) {
+        infq_pthread_mutex_unlock(&file_queue->mu);
         INFQ_ERROR_LOG("failed to search file block by index, index: %d", global_idx);
         return INFQ_ERR;
     }
 
-    if (file_block_at(file_block, global_idx, buf, buf_size, size) == INFQ_ERR) {
+    if (ensure_header(file_block) == INFQ_ERR) {
+        infq_pthread_mutex_unlock(&file_queue->mu);
+        return INFQ_ERR;
+    }
+
+    // NOTICE: the block is read without the lock, it isn't freed by 'pop_head' until
+    //      the readers are done
+    pthread_rwlock_rdlock(&file_queue->at_lock);
+    infq_pthread_mutex_unlock(&file_queue->mu);
+
+    if (file_queue->page_cache.capacity > 0) {
+        ret = cached_at(file_queue, file_block, global_idx, buf, buf_size, size);
+    } else {
+        ret = file_block_at(file_block, global_idx, buf, buf_size, size);
+    }
+    if (ret == INFQ_ERR) {
         INFQ_ERROR_LOG("failed to call at of file block, index: %d, path: %s, suffix: %d",
                 global_idx,
                 file_block->file_path,
                 file_block->suffix);
+    }
+    pthread_rwlock_unlock(&file_queue->at_lock);
+
+    return ret;
+}
+
+int32_t
+file_queue_prefetch(file_queue_t *file_queue, int32_t from_seq, int32_t to_seq)
+{
+    file_block_t    *blocks[INFQ_MAX_PREFETCH_BLOCKS], *block;
+    int32_t         seq, n = 0, i;
+
+    infq_pthread_mutex_lock(&file_queue->mu);
+    seq = file_queue->head_seq;
+    if (from_seq < seq) {
+        from_seq = seq;
+    }
+    if (to_seq > from_seq + INFQ_MAX_PREFETCH_BLOCKS) {
+        to_seq = from_seq + INFQ_MAX_PREFETCH_BLOCKS;
+    }
+    for (block = file_queue->block_head; block != NULL && seq < to_seq; block = block->next, seq++) {
+        if (seq >= from_seq) {
+            blocks[n++] = block;
+        }
+    }
+
+    // NOTICE: the blocks are advised without the lock like 'file_queue_at'
+    pthread_rwlock_rdlock(&file_queue->at_lock);
+    infq_pthread_mutex_unlock(&file_queue->mu);
+
+    for (i = 0; i < n; i++) {
+        file_block_prefetch(blocks[i]);
+    }
+    pthread_rwlock_unlock(&file_queue->at_lock);
+
+    return from_seq + n;
+}
+
+static int32_t
+fill_page(void *arg, int64_t pos, char *page, int32_t len)
+{
+    return file_block_read((file_block_t *)arg, pos, page, len);
+}
+
+/**
+ * Read the element through the page cache, the length prefix and data of it are
+ *      served by the pages cached, which are keyed by the start index of the block.
+ */
+static int32_t
+cached_at(
+        file_queue_t *file_queue,
+        file_block_t *file_block,
+        int64_t global_idx,
+        void *buf,
+        int32_t buf_size,
+        int32_t *size)
+{
+    int32_t     offset;
+
+    if (file_block_offset(file_block, global_idx, &offset) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+
+    if (page_cache_read(&file_queue->page_cache, file_block->start_index,
+                file_block->data_size, offset, (char *)size, sizeof(int32_t),
+                fill_page, file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read data len");
+        return INFQ_ERR;
+    }
+
+    if (*size > buf_size) {
+        INFQ_ERROR_LOG("buffer isn't big enough, buf size: %d, need size: %d",
+                buf_size,
+                *size);
+        return INFQ_ERR;
+    }
+
+    if (page_cache_read(&file_queue->page_cache, file_block->start_index,
+                file_block->data_size, offset + sizeof(int32_t), (char *)buf, *size,
+                fill_page, file_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read data");
         return INFQ_ERR;
     }
 
@@ -240,13 +1235,22 @@ file_queue_destroy(file_queue_t *file_queue)
         file_queue->block_head = tmp;
     }
     file_queue_reset(file_queue);
+    file_segment_release(file_queue->segment);
+    file_queue->segment = NULL;
     infq_pthread_mutex_unlock(&file_queue->mu);
 
+    // the blocks dumped are committed before the queue is closed
+    file_queue_sync(file_queue, INFQ_TRUE);
+    manifest_close(&file_queue->manifest);
+    destroy_unsynced(file_queue);
+    destroy_recycled(file_queue);
     if (file_queue->file_path != NULL) {
         free(file_queue->file_path);
         file_queue->file_path = NULL;
     }
 
+    page_cache_destroy(&file_queue->page_cache);
+    pthread_rwlock_destroy(&file_queue->at_lock);
     pthread_mutex_destroy(&file_queue->mu);
     file_block_index_destroy(&file_queue->index);
 }
@@ -263,6 +1267,16 @@ file_queue_destroy_completely(file_queue_t *file_queue)
 
     infq_pthread_mutex_lock(&file_queue->mu);
     while (file_queue->block_head != NULL) {
+        tmp = file_queue->block_head->next;
+        // a segment is deleted with its last block
+        if (file_queue->block_head->segment != NULL && tmp != NULL
+                && tmp->segment == file_queue->block_head->segment) {
+            file_block_destroy(file_queue->block_head);
+            free(file_queue->block_head);
+            file_queue->block_head = tmp;
+            continue;
+        }
+
         if (file_block_file_delete(file_queue->block_head) ==INFQ_ERR) {
             INFQ_ERROR_LOG("failed to delete file");
             infq_pthread_mutex_unlock(&file_queue->mu);
@@ -274,9 +1288,17 @@ file_queue_destroy_completely(file_queue_t *file_queue)
         file_queue->block_head = tmp;
     }
     file_queue_reset(file_queue);
+    file_segment_release(file_queue->segment);
+    file_queue->segment = NULL;
     infq_pthread_mutex_unlock(&file_queue->mu);
 
+    manifest_drop(&file_queue->manifest);
+    manifest_close(&file_queue->manifest);
+    destroy_unsynced(file_queue);
+    destroy_recycled(file_queue);
     free(file_queue->file_path);
+    page_cache_destroy(&file_queue->page_cache);
+    pthread_rwlock_destroy(&file_queue->at_lock);
     pthread_mutex_destroy(&file_queue->mu);
     file_block_index_destroy(&file_queue->index);
 
@@ -303,6 +1325,27 @@ file_queue_add_block_by_file(file_queue_t *file_queue, int32_t file_suffix)
         return INFQ_ERR;
     }
 
+    return add_block_by_file(file_queue, NULL, file_suffix);
+}
+
+int32_t
+file_queue_adopt_block(file_queue_t *file_queue, const char *file_prefix, int32_t file_suffix)
+{
+    if (file_queue == NULL || file_prefix == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    return add_block_by_file(file_queue, file_prefix, file_suffix);
+}
+
+/**
+ * Append the block of the file to the file queue and load its header. A block of
+ *      the file queue is prefixed by NULL, it may be in a segment.
+ */
+static int32_t
+add_block_by_file(file_queue_t *file_queue, const char *file_prefix, int32_t file_suffix)
+{
     file_block_t    *block;
 
     block = (file_block_t *)malloc(sizeof(file_block_t));
@@ -310,7 +1353,7 @@ file_queue_add_block_by_file(file_queue_t *file_queue, int32_t file_suffix)
         INFQ_ERROR_LOG("failed to alloc mem for file block");
         return INFQ_ERR;
     }
-    if (file_block_init(block, file_queue->file_path, NULL) == INFQ_ERR) {
+    if (file_block_init(block, file_queue->file_path, file_prefix) == INFQ_ERR) {
         INFQ_ERROR_LOG("failed to init file block");
         return INFQ_ERR;
     }
@@ -327,7 +1370,9 @@ file_queue_add_block_by_file(file_queue_t *file_queue, int32_t file_suffix)
     file_queue->block_num++;
 
     // load header
-    if (file_block_load_header(block) == INFQ_ERR) {
+    if ((file_queue->segment_blocks > 0 && file_prefix == NULL
+                && attach_segment(file_queue, block, file_suffix, INFQ_FALSE) == INFQ_ERR)
+            || file_block_load_header(block) == INFQ_ERR) {
         infq_pthread_mutex_unlock(&file_queue->mu);
         INFQ_ERROR_LOG("failed to load block header");
         return INFQ_ERR;
@@ -346,3 +1391,202 @@ file_queue_add_block_by_file(file_queue_t *file_queue, int32_t file_suffix)
 
     return INFQ_OK;
 }
+
+int32_t
+file_queue_restore_blocks(file_queue_t *file_queue, int32_t start, int32_t end)
+{
+    if (file_queue == NULL || start > end) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    manifest_record_t   *records;
+    file_block_t        *block;
+    int32_t             n = end - start, found, i;
+    long long           t1 = time_us();
+
+    records = (manifest_record_t *)malloc(sizeof(manifest_record_t) * (n > 0 ? n : 1));
+    if (records == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for manifest records, blocks: %d", n);
+        return INFQ_ERR;
+    }
+
+    if ((found = manifest_read(&file_queue->manifest, start, end, records)) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read manifest, path: %s", file_queue->file_path);
+        found = 0;
+        for (i = 0; i < n; i++) {
+            records[i].suffix = INFQ_UNDEF;
+        }
+    }
+
+    // NOTICE: the records don't match the dumped blocks unless the indexes of them are
+    //      continuous, the manifest is ignored then
+    if (found > 0 && !records_contiguous(records, n)) {
+        INFQ_ERROR_LOG("records of manifest aren't contiguous, path: %s, blocks: [%d, %d)",
+                file_queue->file_path, start, end);
+        found = 0;
+        for (i = 0; i < n; i++) {
+            records[i].suffix = INFQ_UNDEF;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (records[i].suffix == INFQ_UNDEF) {
+            if (file_queue_add_block_by_file(file_queue, start + i) == INFQ_ERR) {
+                free(records);
+                return INFQ_ERR;
+            }
+            manifest_record_init(&records[i], file_queue->block_tail);
+            continue;
+        }
+
+        if ((block = restore_block(file_queue, &records[i])) == NULL) {
+            INFQ_ERROR_LOG("failed to restore block, path: %s, suffix: %d",
+                    file_queue->file_path, start + i);
+            free(records);
+            return INFQ_ERR;
+        }
+
+        infq_pthread_mutex_lock(&file_queue->mu);
+        if (file_queue->block_head == NULL || file_queue->block_tail == NULL) {
+            file_queue->block_head = file_queue->block_tail = block;
+        } else {
+            file_queue->block_tail->next = block;
+            file_queue->block_tail = block;
+        }
+        file_queue->block_num++;
+        file_queue->ele_count += block->ele_count;
+        file_queue->total_fsize += block->file_size;
+
+        if (file_block_index_push(&file_queue->index, block) == INFQ_ERR) {
+            infq_pthread_mutex_unlock(&file_queue->mu);
+            INFQ_ERROR_LOG("failed to push block to index, suffix: %d", block->suffix);
+            free(records);
+            return INFQ_ERR;
+        }
+        infq_pthread_mutex_unlock(&file_queue->mu);
+    }
+
+    // the records of other blocks are useless, they may be of an older dump
+    manifest_rewrite(&file_queue->manifest, records, n);
+    free(records);
+
+    INFQ_INFO_LOG("restore file queue, path: %s, blocks: %d, from manifest: %d, cost: %lldus",
+            file_queue->file_path, n, found, time_us() - t1);
+
+    return INFQ_OK;
+}
+
+/**
+ * Create a block by its record in the manifest, the file isn't opened. A block in
+ *      segment is placed by the record without reading the segment.
+ */
+static file_block_t *
+restore_block(file_queue_t *file_queue, const manifest_record_t *record)
+{
+    file_block_t    *block;
+
+    block = (file_block_t *)malloc(sizeof(file_block_t));
+    if (block == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for file block");
+        return NULL;
+    }
+    if (file_block_init(block, file_queue->file_path, NULL) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to init file block");
+        free(block);
+        return NULL;
+    }
+
+    block->suffix = record->suffix;
+    block->start_index = record->start_index;
+    block->ele_count = record->ele_count;
+    block->file_size = record->file_size;
+    block->lazy = INFQ_TRUE;
+
+    if (file_queue->segment_blocks > 0) {
+        if (switch_segment(
+                    file_queue,
+                    record->suffix / file_queue->segment_blocks,
+                    INFQ_FALSE) == INFQ_ERR
+                || file_block_attach_segment(block, file_queue->segment) == INFQ_ERR) {
+            file_block_destroy(block);
+            free(block);
+            return NULL;
+        }
+        file_block_place_in_segment(block, record->file_offset,
+                record->suffix % file_queue->segment_blocks);
+    }
+
+    return block;
+}
+
+/**
+ * Check the records found are continuous by global index, the records missing are skipped.
+ */
+static int32_t
+records_contiguous(const manifest_record_t *records, int32_t n)
+{
+    const manifest_record_t *prev = NULL;
+
+    for (int32_t i = 0; i < n; i++) {
+        if (records[i].suffix == INFQ_UNDEF) {
+            prev = NULL;
+            continue;
+        }
+        if (records[i].ele_count < 0 || records[i].file_size <= 0
+                || (prev != NULL && prev->start_index + prev->ele_count != records[i].start_index)) {
+            return INFQ_FALSE;
+        }
+        prev = &records[i];
+    }
+
+    return INFQ_TRUE;
+}
+
+/**
+ * Load the header of a block restored from the manifest when it's accessed first, it
+ *      must match the record. It's called with 'mu' of file queue held, so the header
+ *      is loaded once whoever accesses the block, e.g. the loader or 'file_queue_at'.
+ */
+static int32_t
+ensure_header(file_block_t *block)
+{
+    int64_t     start_index = block->start_index;
+    int32_t     ele_count = block->ele_count;
+    int32_t     file_size = block->file_size;
+
+    if (!block->lazy) {
+        return INFQ_OK;
+    }
+
+    if (file_block_load_header(block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to load header of block restored, path: %s, suffix: %d",
+                block->file_path, block->suffix);
+        return INFQ_ERR;
+    }
+
+    // NOTICE: the size recorded is kept, it's accounted by the file queue
+    block->file_size = file_size;
+    if (block->start_index != start_index || block->ele_count != ele_count) {
+        INFQ_ERROR_LOG("header of block isn't matched with manifest, path: %s, suffix: %d, "
+                "header: [%lld, +%d), manifest: [%lld, +%d)",
+                block->file_path,
+                block->suffix,
+                (long long)block->start_index,
+                block->ele_count,
+                (long long)start_index,
+                ele_count);
+        block->start_index = start_index;
+        block->ele_count = ele_count;
+        return INFQ_ERR;
+    }
+    block->lazy = INFQ_FALSE;
+
+    return INFQ_OK;
+}
+
+void
+file_queue_pin_manifest(file_queue_t *file_queue, int32_t suffix)
+{
+    file_queue->manifest_pin = suffix;
+}
@@ -14,6 +14,11 @@
 #include "file_block.h"
 #include "file_block_index.h"
 #include "mem_block.h"
+#include "io_engine.h"
+#include "manifest.h"
+#include "page_cache.h"
+
+#define INFQ_MAX_PREFETCH_BLOCKS    32
 
 typedef struct _file_queue_t {
     file_block_t        *block_head, *block_tail;   /* All the blocks in a file queue are organized into
@@ -23,20 +28,146 @@ typedef struct _file_queue_t {
     volatile int32_t    block_num;                  /* Number of the blocks in the file queue */
     volatile int32_t    ele_count;                  /* Element count */
     volatile int32_t    total_fsize;                /* Total file size of the file queue */
+    int32_t             head_seq;                   /* Sequence of the head block, increased by each block
+                                                       popped. Blocks are counted by it instead of suffixes,
+                                                       which aren't in order with the blocks adopted */
     file_block_index_t  index;                      /* An index used to search a file block by global index */
     char                *file_path;                 /* File path used to store files of InfQ */
+    int32_t             segment_blocks;             /* Number of blocks appended to a segment file,
+                                                       0 means a file per block */
+    int64_t             segment_prealloc;           /* Bytes preallocated for a segment file */
+    file_segment_t      *segment;                   /* The segment which blocks are appended to */
+    int32_t             recycle_max;                /* Max number of consumed files kept to be reused */
+    int32_t             recycle_num;                /* Number of the files kept */
+    int32_t             *recycled;                  /* Suffixes of the files kept, 'recycle_<N>' */
+    int32_t             recycle_seq;                /* Suffix of the next file kept */
+    pthread_mutex_t     recycle_mu;
+    int32_t             durability;                 /* INFQ_DURABILITY_* */
+    int32_t             sync_blocks;                /* Group commit when so many blocks aren't synced */
+    int64_t             sync_interval_us;           /*      or the first of them is written so long ago */
+    int32_t             *unsynced_fds;              /* Duplicated descriptors of the files written but
+                                                       not synced, closed by the group commit */
+    int32_t             unsynced_num;               /* Number of the descriptors */
+    int32_t             unsynced_cap;
+    int32_t             unsynced_blocks;            /* Number of the blocks not synced */
+    int32_t             unsynced_segment;           /* Segment of the last descriptor, it isn't
+                                                       duplicated again for the blocks in it */
+    long long           unsynced_since;
+    pthread_mutex_t     sync_mu;                    /* Protects the blocks not synced */
+    pthread_mutex_t     commit_mu;                  /* Serializes group commits */
+    int32_t             codec;                      /* Codec compressing the blocks dumped */
+    manifest_t          manifest;                   /* Records of the blocks dumped, see 'manifest.h' */
+    volatile int32_t    manifest_pin;               /* Records from the suffix are kept by compaction,
+                                                       INFQ_UNDEF means from the head block */
+    page_cache_t        page_cache;                 /* Pages read by 'file_queue_at' */
+    pthread_rwlock_t    at_lock;                    /* Held shared by 'file_queue_at' and the prefetch
+                                                       accessing blocks without 'mu', a popped block is
+                                                       freed after it's acquired exclusively */
     pthread_mutex_t     mu;
 } file_queue_t;
 
 int32_t file_queue_init(file_queue_t *file_queue, const char *data_path);
+
+/**
+ * @brief Append 'segment_blocks' blocks to a segment file 'segment_<N>' one after
+ *      another instead of a file per block, block 'i' is in segment 'i / segment_blocks'.
+ *      It should be set before any block is dumped or added.
+ */
+void file_queue_set_segment(file_queue_t *file_queue, int32_t segment_blocks, int64_t prealloc);
+
+/**
+ * @brief Compress the data of the blocks dumped by the codec, INFQ_CODEC_*. INFQ_ERR is
+ *      returned if the codec isn't available. The blocks are loaded by the codec
+ *      recorded in them whatever it is.
+ */
+int32_t file_queue_set_codec(file_queue_t *file_queue, int32_t codec);
+
+/**
+ * @brief Cache at most 'pages' pages read by 'file_queue_at', so the repeated and
+ *      neighbouring random accesses are served from memory. 0 disables it. It should
+ *      be set before any element is accessed.
+ */
+int32_t file_queue_set_page_cache(file_queue_t *file_queue, int32_t pages);
+
+/**
+ * @brief Keep at most 'max_files' consumed files to be reused by the blocks dumped
+ *      later, instead of removing them and creating new ones. 0 disables it.
+ *      The files kept and left by a crash are removed.
+ */
+int32_t file_queue_set_recycle(file_queue_t *file_queue, int32_t max_files);
+
+/**
+ * @brief Keep the consumed file to be reused. INFQ_ERR is returned if it isn't kept,
+ *      e.g. there are enough files kept or the file has other links, the caller
+ *      should remove it. The file mustn't be mapped or opened anymore.
+ */
+int32_t file_queue_recycle_file(file_queue_t *file_queue, const char *path);
+
+/**
+ * @brief Rename a file kept to 'path', which is overwritten by the block dumped.
+ *      INFQ_ERR is returned if no file is kept.
+ */
+int32_t file_queue_reuse_file(file_queue_t *file_queue, const char *path);
+
+/**
+ * @brief Set the durability of the blocks dumped, INFQ_DURABILITY_*. Under group
+ *      commit, the blocks are synced together by 'file_queue_sync' when 'sync_blocks'
+ *      blocks are written or the first of them is written 'sync_interval_ms' ago.
+ */
+void file_queue_set_durability(file_queue_t *file_queue, int32_t durability,
+        int32_t sync_blocks, int32_t sync_interval_ms);
+
+/**
+ * @brief Make a block written durable by the durability of file queue. It's synced
+ *      with its directory at once for INFQ_DURABILITY_BLOCK, or left to the next group
+ *      commit for INFQ_DURABILITY_GROUP. Blocks written outside the file queue, e.g.
+ *      pop blocks, can be committed with the file queue too.
+ */
+int32_t file_queue_sync_block(file_queue_t *file_queue, file_block_t *block);
+
+/**
+ * @brief Group commit. The files written since the last commit are synced, and then
+ *      the directory is synced once. Nothing is done unless it's due or 'force' is
+ *      set. It shouldn't be called with the locks of infQ held, since it may take long.
+ */
+int32_t file_queue_sync(file_queue_t *file_queue, int32_t force);
 int32_t file_queue_at(
         file_queue_t *file_queue,
         int64_t global_idx,
         void *buf,
         int32_t buf_size,
         int32_t *size);
+
+/**
+ * @brief Read the blocks [from_seq, to_seq) of the file queue into the OS page cache
+ *      ahead, at most INFQ_MAX_PREFETCH_BLOCKS blocks. Blocks are counted by
+ *      'head_seq'. The sequence next to the last block advised is returned.
+ */
+int32_t file_queue_prefetch(file_queue_t *file_queue, int32_t from_seq, int32_t to_seq);
 int32_t file_queue_dump_block(file_queue_t *file_queue, mem_block_t *mem_block);
-int32_t file_queue_load_block(file_queue_t *file_queue, mem_block_t *mem_block);
+int32_t file_queue_load_block(file_queue_t *file_queue, mem_block_t **mem_block_ptr);
+
+/**
+ * @brief Dump 'n' memory blocks to the tail of file queue in order, their writes are
+ *      in flight together in the io engine, and nothing is appended if it fails.
+ *      Without an engine they're dumped one by one.
+ */
+int32_t file_queue_dump_blocks(file_queue_t *file_queue, mem_block_t **mem_blocks, int32_t n,
+        io_engine_t *engine);
+
+/**
+ * @brief Load and pop 'n' blocks from the head of file queue, their reads are in flight
+ *      together in the io engine, and nothing is popped if it fails. Without an engine
+ *      they're loaded one by one. The memory blocks may be resized for jumbo blocks.
+ */
+int32_t file_queue_load_blocks(file_queue_t *file_queue, mem_block_t **mem_blocks, int32_t n,
+        io_engine_t *engine);
+
+/**
+ * @brief Pop the head block like 'file_queue_load_block', but the memory block becomes
+ *      a read-only view of the mapped file instead of a copy, see 'file_block_map'.
+ */
+int32_t file_queue_map_block(file_queue_t *file_queue, mem_block_t **mem_block_ptr);
 
 /**
  * @brief Load file blocks on the disk by the suffix of the file name, which is used
@@ -45,6 +176,27 @@ int32_t file_queue_load_block(file_queue_t *file_queue, mem_block_t *mem_block);
  * @param file_suffix: Suffix of the file name.
  */
 int32_t file_queue_add_block_by_file(file_queue_t *file_queue, int32_t file_suffix);
+
+/**
+ * @brief Append a block file written outside of the file queue, e.g. a pop block
+ *      dumped by infQ, its header is loaded at once. It's read in order with the other
+ *      blocks, but it isn't recorded by the manifest, and its file is never removed.
+ */
+int32_t file_queue_adopt_block(file_queue_t *file_queue, const char *file_prefix, int32_t file_suffix);
+
+/**
+ * @brief Restore the blocks suffixed by [start, end) from the manifest without opening
+ *      their files, the header of a block is loaded when it's accessed first. The blocks
+ *      missing in the manifest are added by 'file_queue_add_block_by_file'. Then the
+ *      manifest is rewritten with the blocks restored only.
+ */
+int32_t file_queue_restore_blocks(file_queue_t *file_queue, int32_t start, int32_t end);
+
+/**
+ * @brief Keep the records of the manifest from 'suffix' when it's compacted, since they
+ *      may be restored by a dump meta of infQ. INFQ_UNDEF unpins it.
+ */
+void file_queue_pin_manifest(file_queue_t *file_queue, int32_t suffix);
 void file_queue_destroy(file_queue_t *file_queue);
 
 /**
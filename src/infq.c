@@ -9,13 +9,17 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/mman.h>
 
 #include "infq.h"
 #include "mem_queue.h"
 #include "file_queue.h"
 #include "file_block.h"
+#include "io_engine.h"
 #include "bg_job.h"
+#include "block_pool.h"
+#include "codec.h"
 #include "infq_bg_jobs.h"
 #include "utils.h"
 
@@ -29,6 +33,9 @@
         (meta)->file_path_len + (meta)->infq_name_len)
 #define cur_dump_meta(infq)             ((infq)->dump_meta_double_buf[infq->cur_meta_idx])
 #define backup_dump_meta(infq)          ((infq)->dump_meta_double_buf[1 - infq->cur_meta_idx])
+// a pop block adopted by file queue for 'async_load', which isn't loaded yet
+#define restoring_block(blk)            ((blk) != NULL && (blk)->file_prefix == INFQ_POP_BLOCK_PREFIX)
+#define infq_ewma(avg, v)               ((avg) == 0 ? (v) : ((avg) * 3 + (v)) / 4)
 
 char *INFQ_VERSION = "v0.1.0";
 char *INFQ_POP_BLOCK_PREFIX = "pop_block";
@@ -38,9 +45,28 @@ infq_config_t default_conf = {
     10 * 1024 * 1024,
     20,
     20,
-    0.5
+    0.5,
+    INFQ_FALSE,
+    INFQ_OVERFLOW_FAIL,
+    0,
+    0,
+    INFQ_FALSE,
+    0,
+    0,
+    0,
+    INFQ_DURABILITY_NONE,
+    0,
+    0,
+    INFQ_CODEC_NONE,
+    INFQ_FALSE,
+    256,
+    8
 };
 
+// shared by all infQs initialized after infq_config_bg_pool, NULL for per-instance threads
+static bg_pool_t    shared_bg_pool_inst;
+static bg_pool_t    *shared_bg_pool = NULL;
+
 struct _infq_t {
     int64_t             global_ele_idx;         /* Index of the next element pushed */
     mem_queue_t         push_queue, pop_queue;
@@ -48,6 +74,13 @@ struct _infq_t {
     bg_exec_t           dump_exec, load_exec, unlink_exec; /* Background executor of dumper, loader
                                                               and unlinker */
     pthread_mutex_t     push_mu, pop_mu;        /* Mutexes for push queue and pop queue */
+    pthread_cond_t      push_cond;              /* Pushers wait on it for free blocks, with 'push_mu' */
+    pthread_mutex_t     dump_mu;                /* Serializes 'Dumper' and pushers spilling blocks */
+    pthread_mutex_t     load_mu;                /* Serializes the loader and consumers loading inline */
+    pthread_mutex_t     wait_mu;                /* Mutex for 'pop_cond', it's the innermost lock */
+    pthread_cond_t      pop_cond;               /* Consumers blocked in 'infq_pop_wait' wait on it */
+    int64_t             pop_seq;                /* Increased each time new data can be popped */
+    volatile int32_t    pop_waiters;            /* Number of consumers in 'infq_pop_wait' */
     mem_block_t         *tmp_mem_block;         /* A temporary memory block used to load file block */
     int32_t             mem_block_size;         /* The size of memory block  */
     infq_dump_meta_t    *dump_meta_double_buf;  /* Persistent status of a dumped InfQ.
@@ -57,6 +90,33 @@ struct _infq_t {
                                                      when redis is saving background(RDB), shared memory is
                                                      used. */
     int32_t             cur_meta_idx;           /* Index of current dump meta */
+    int32_t             overflow_policy;        /* Policy when the push queue is full */
+    int32_t             overflow_wait_us;       /* Timeout to wait for free blocks in push queue */
+    int32_t             idle_release_ms;        /* Free the unused blocks after the infQ is drained
+                                                   for such a long time, <= 0 disables it */
+    int64_t             idle_check_idx;         /* 'global_ele_idx' when the infQ is found drained */
+    int64_t             idle_since;             /* When the infQ is found drained, in microseconds */
+    volatile int32_t    reserved_size;          /* Size reserved by 'infq_push_reserve', INFQ_UNDEF
+                                                   if no reservation is open */
+    pthread_t           reserve_owner;          /*      and the thread holding 'push_mu' for it */
+    int32_t             reserve_notify;         /* Whether to wake up consumers when committing */
+    int32_t             inline_load;            /* Whether consumers load file block by themselves
+                                                   when the pop queue is empty */
+    int32_t             mmap_load;              /* Whether file blocks are mapped into pop queue
+                                                   instead of being read */
+    int32_t             async_load;             /* Whether the pop blocks dumped are loaded by the
+                                                   loader after 'infq_load' returns */
+    int32_t             max_prefetch;           /* Max number of file blocks read ahead into the page
+                                                   cache, 0 disables the prefetch */
+    int32_t             prefetch_lead;          /* Number of file blocks read ahead, see 'prefetch_blocks' */
+    int32_t             prefetch_seq;           /* Sequence of the next file block to read ahead */
+    int64_t             drained_idx;            /* Min index of pop queue when the last block is drained */
+    long long           drained_at;             /*      and when it's drained, in microseconds */
+    volatile int64_t    drain_us;               /* Average time to drain a block of pop queue */
+    volatile int64_t    consume_rate;           /* Average number of elements popped per second */
+    volatile int64_t    load_us;                /* Average time of the loader to load a file block */
+    io_engine_t         *dump_io;               /* IO engines of 'Dumper' and 'Loader' to keep several */
+    io_engine_t         *load_io;               /*      blocks in flight, NULL for synchronous IO */
     int32_t             pop_block_suffix;       /* The suffix of the next pop block when dumping */
     float               block_usage_to_dump;    /* When the percentage of used memory blocks in push queue
                                                    is greater than this value, 'Dumper' will try to dump the
@@ -69,6 +129,25 @@ int32_t dump_job(void *);
 int32_t load_job(void *);
 
 void swap_mem_block(infq_t *infq);
+void notify_pop_waiters(infq_t *infq);
+static int32_t infq_try_pop_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr,
+        void *buf, int32_t buf_size);
+static int32_t infq_pop_copy(infq_t *infq, const void **dataptr, int32_t *sizeptr, void *buf,
+        int32_t buf_size);
+static int32_t infq_pop_wait_copy(infq_t *infq, const void **dataptr, int32_t *sizeptr,
+        void *buf, int32_t buf_size, int64_t timeout_us);
+static int32_t infq_try_pop_batch_zero_cp(infq_t *infq, const void **ptrs, int32_t *sizes,
+        int32_t max, int32_t *n);
+static int32_t load_block_inline(infq_t *infq);
+static int32_t consumers_starved(infq_t *infq);
+static void init_io_engines(infq_t *infq, int32_t io_depth);
+static void destroy_io_engines(infq_t *infq);
+static void pin_manifest(infq_t *infq);
+static void track_consumption(infq_t *infq);
+static void prefetch_blocks(infq_t *infq);
+static int32_t link_to_pop_block(infq_t *infq, const char *path, int32_t blk_counter);
+static int32_t link_pop_block(infq_t *infq, int32_t suffix, int32_t blk_counter);
+static int32_t finish_restoring(infq_t *infq);
 int32_t check_and_trigger_loader(infq_t *infq);
 int32_t dump_push_queue(infq_t *infq);
 int32_t dump_pop_queue_if_need(infq_t *infq, popq_dump_meta_t *meta);
@@ -90,6 +169,7 @@ infq_init_by_conf(const infq_config_t *conf, const char *name)
     infq_t                  *infq;
     int32_t                 err;
     pthread_mutexattr_t     mu_attr;
+    pthread_condattr_t      cond_attr;
 
     if (strlen(name) + 1 > INFQ_NAME_MAX_LEN) {
         INFQ_ERROR_LOG("name is too long, %d chars at most, name: %s",
@@ -153,23 +233,53 @@ infq_init_by_conf(const infq_config_t *conf, const char *name)
         INFQ_ERROR_LOG("[%s]failed to init file queue", name);
         goto failed;
     }
+    file_queue_set_segment(
+            &infq->file_queue,
+            conf->segment_blocks,
+            (int64_t)conf->segment_blocks * conf->mem_block_size);
+    if (file_queue_set_recycle(&infq->file_queue, conf->recycle_files) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to set recycled files of file queue", name);
+        goto failed;
+    }
+    file_queue_set_durability(
+            &infq->file_queue,
+            conf->durability,
+            conf->sync_blocks,
+            conf->sync_interval_ms);
+    if (file_queue_set_codec(&infq->file_queue, conf->compression) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to set codec of file queue, codec: %d", name, conf->compression);
+        goto failed;
+    }
+    if (file_queue_set_page_cache(&infq->file_queue, conf->at_cache_pages) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to set page cache of file queue, pages: %d",
+                name, conf->at_cache_pages);
+        goto failed;
+    }
 
     // init background executor
-    if (bg_exec_init(&infq->dump_exec, "dumper") == INFQ_ERR) {
+    if (bg_exec_init_with_pool(&infq->dump_exec, "dumper", shared_bg_pool) == INFQ_ERR) {
         INFQ_ERROR_LOG("[%s]failed to init dumper", name);
         goto failed;
     }
 
-    if (bg_exec_init(&infq->load_exec, "loader") == INFQ_ERR) {
+    if (bg_exec_init_with_pool(&infq->load_exec, "loader", shared_bg_pool) == INFQ_ERR) {
         INFQ_ERROR_LOG("[%s]failed to init loader", name);
         goto failed;
     }
 
-    if (bg_exec_init(&infq->unlink_exec, "unlinker") == INFQ_ERR) {
+    if (bg_exec_init_with_pool(&infq->unlink_exec, "unlinker", shared_bg_pool) == INFQ_ERR) {
         INFQ_ERROR_LOG("[%s]failed to init unlinker", name);
         goto failed;
     }
 
+    // consumers wait for the loader, so it gets I/O ahead of the dumper and unlinker
+    if (bg_exec_set_priority(&infq->load_exec, BG_PRIO_HIGH, NULL) == INFQ_ERR
+            || bg_exec_set_priority(&infq->dump_exec, BG_PRIO_NORMAL, &infq->load_exec) == INFQ_ERR
+            || bg_exec_set_priority(&infq->unlink_exec, BG_PRIO_LOW, &infq->dump_exec) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to set priority of background executors", name);
+        goto failed;
+    }
+
     // init and set type of mutex attr
     if (pthread_mutexattr_init(&mu_attr) != 0) {
         INFQ_ERROR_LOG("[%s]failed to init mutex attr", name);
@@ -191,18 +301,69 @@ infq_init_by_conf(const infq_config_t *conf, const char *name)
         goto failed;
     }
 
+    if (pthread_mutex_init(&infq->dump_mu, &mu_attr) != 0) {
+        INFQ_ERROR_LOG("failed to init mutex of dumper");
+        goto failed;
+    }
+
+    if (pthread_mutex_init(&infq->load_mu, &mu_attr) != 0) {
+        INFQ_ERROR_LOG("failed to init mutex of loader");
+        goto failed;
+    }
+
+    if (pthread_mutex_init(&infq->wait_mu, &mu_attr) != 0) {
+        INFQ_ERROR_LOG("failed to init mutex of pop waiters");
+        goto failed;
+    }
+
     if (pthread_mutexattr_destroy(&mu_attr) != 0) {
         INFQ_ERROR_LOG("failed to destory mutex attr");
         goto failed;
     }
 
-    infq->tmp_mem_block = mem_block_init(conf->mem_block_size);
-    if (infq->tmp_mem_block == NULL) {
-        INFQ_ERROR_LOG("[%s]failed to init temp mem block", name);
+    // NOTICE: timeouts of waiting for push and pop are measured by monotonic clock
+    if (pthread_condattr_init(&cond_attr) != 0) {
+        INFQ_ERROR_LOG("[%s]failed to init cond attr", name);
+        goto failed;
+    }
+
+    if (pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC) != 0) {
+        INFQ_ERROR_LOG("failed to set clock of cond attr");
+        pthread_condattr_destroy(&cond_attr);
         goto failed;
     }
+
+    if (pthread_cond_init(&infq->push_cond, &cond_attr) != 0) {
+        INFQ_ERROR_LOG("failed to init cond of push waiters");
+        pthread_condattr_destroy(&cond_attr);
+        goto failed;
+    }
+
+    err = pthread_cond_init(&infq->pop_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    if (err != 0) {
+        INFQ_ERROR_LOG("failed to init cond of pop waiters");
+        goto failed;
+    }
+
+    // NOTICE: 'tmp_mem_block' is allocated when the first file block is loaded
+    infq->tmp_mem_block = NULL;
     infq->mem_block_size = conf->mem_block_size;
     infq->block_usage_to_dump = conf->block_usage_to_dump;
+    infq->inline_load = conf->inline_load;
+    infq->mmap_load = conf->mmap_load;
+    infq->async_load = conf->async_load;
+    infq->max_prefetch = conf->max_prefetch_blocks < 0 ? 0
+        : conf->max_prefetch_blocks > INFQ_MAX_PREFETCH_BLOCKS ? INFQ_MAX_PREFETCH_BLOCKS
+        : conf->max_prefetch_blocks;
+    infq->drained_at = INFQ_UNDEF;
+    infq->overflow_policy = conf->overflow_policy;
+    infq->overflow_wait_us = conf->overflow_wait_us;
+    infq->reserved_size = INFQ_UNDEF;
+    infq->idle_release_ms = conf->idle_release_ms;
+    infq->idle_check_idx = INFQ_UNDEF;
+    infq->idle_since = 0;
+    init_io_engines(infq, conf->io_depth);
 
     INFQ_DEBUG_LOG("[%s]successful to init InfQ, mem block size: %d,"
             "pushq blocks: %d, popq blocks: %d, block usage: %f, meta_idx: %d",
@@ -224,6 +385,18 @@ failed:
         INFQ_ERROR_LOG("failed to destroy pop mu");
     }
 
+    if ((err = pthread_mutex_destroy(&infq->dump_mu)) != 0 && err != EINVAL) {
+        INFQ_ERROR_LOG("failed to destroy dump mu");
+    }
+
+    if ((err = pthread_mutex_destroy(&infq->load_mu)) != 0 && err != EINVAL) {
+        INFQ_ERROR_LOG("failed to destroy load mu");
+    }
+
+    if ((err = pthread_mutex_destroy(&infq->wait_mu)) != 0 && err != EINVAL) {
+        INFQ_ERROR_LOG("failed to destroy wait mu");
+    }
+
     if ((err = pthread_mutexattr_destroy(&mu_attr)) != 0 && err != EINVAL) {
         INFQ_ERROR_LOG("failed to destroy mutex attr");
     }
@@ -244,62 +417,692 @@ infq_init(const char *data_path, const char *name)
     return infq_init_by_conf(&default_conf, name);
 }
 
+/**
+ * Compute the deadline of waiting for free blocks in push queue.
+ */
+static void
+push_wait_deadline(infq_t *infq, struct timespec *deadline)
+{
+    if (infq->overflow_wait_us < 0) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += infq->overflow_wait_us / 1000000;
+    deadline->tv_nsec += (infq->overflow_wait_us % 1000000) * 1000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/**
+ * Dump the first block of the full push queue to file queue on the caller thread.
+ * The caller should hold 'push_mu' and 'dump_mu'. 'push_mu' is released while
+ *      writing the file, pushers are still blocked because the queue is full.
+ */
+static int32_t
+spill_push_block(infq_t *infq)
+{
+    mem_queue_t     *queue = &infq->push_queue;
+    mem_block_t     *block;
+    int32_t         idx;
+
+    idx = queue->first_block;
+    block = queue->blocks[idx];
+
+    // NOTICE: don't block consumers and the callbacks of push queue while writing file
+    infq_pthread_mutex_unlock(&infq->push_mu);
+    if (file_queue_dump_block(&infq->file_queue, block) == INFQ_ERR) {
+        infq_pthread_mutex_lock(&infq->push_mu);
+        INFQ_ERROR_LOG("[%s]failed to spill memory block, index: %lld",
+                infq->name,
+                block->start_index);
+        return INFQ_ERR;
+    }
+    infq_pthread_mutex_lock(&infq->push_mu);
+
+    // 'dump_mu' is held, so no dumper moves the first block
+    INFQ_ASSERT(idx == queue->first_block,
+            "[%s]first block of push queue changed when spilling, expect: %d, actual: %d",
+            infq->name,
+            idx,
+            queue->first_block);
+    queue->first_block = (queue->first_block + 1) % queue->block_num;
+    queue->min_idx = first_block(queue)->start_index;
+    queue->ele_count -= block->ele_count;
+    pthread_cond_broadcast(&infq->push_cond);
+
+    INFQ_DEBUG_LOG("[%s]spill push block, start index: %lld, blk count: %d, f: %d, l: %d",
+            infq->name,
+            block->start_index,
+            block->ele_count,
+            queue->first_block,
+            queue->last_block);
+
+    if (block_pool_over_budget()) {
+        mem_queue_release_free_blocks(queue);
+    }
+
+    return INFQ_OK;
+}
+
+/**
+ * Make room in the full push queue according to the overflow policy. The caller
+ *      should hold 'push_mu'. INFQ_ERR is returned when the queue is still full.
+ */
+static int32_t
+make_room_for_push(infq_t *infq, const struct timespec *deadline)
+{
+    int32_t     err = 0, over_budget;
+
+    for (;;) {
+        // NOTICE: when the memory budget is exceeded, the full blocks are dumped
+        //      before the push queue grows
+        over_budget = infq->overflow_policy != INFQ_OVERFLOW_FAIL && block_pool_over_budget()
+            && mem_queue_has_full_block(&infq->push_queue);
+        if (!over_budget && !mem_queue_full(&infq->push_queue)) {
+            break;
+        }
+
+        // NOTICE: a full queue is only an error for the fail policy, the others wait
+        //      for the dumper, and a timeout is reported to the caller
+        if (infq->overflow_policy == INFQ_OVERFLOW_FAIL) {
+            INFQ_ERROR_LOG("[%s]push queue is full, block idx: [%d, %d], index: [%lld, %lld], "
+                    "dumper jobs: %d",
+                    infq->name,
+                    infq->push_queue.first_block,
+                    infq->push_queue.last_block,
+                    infq->push_queue.min_idx,
+                    infq->push_queue.max_idx,
+                    bg_exec_pending_task_num(&infq->dump_exec));
+            return INFQ_ERR;
+        }
+        if (err == ETIMEDOUT) {
+            INFQ_DEBUG_LOG("[%s]push queue is still full after waiting, block idx: [%d, %d], "
+                    "dumper jobs: %d",
+                    infq->name,
+                    infq->push_queue.first_block,
+                    infq->push_queue.last_block,
+                    bg_exec_pending_task_num(&infq->dump_exec));
+            return INFQ_ERR;
+        }
+
+        // spill by itself when no dumper is writing a block, otherwise wait for it
+        if (infq->overflow_policy == INFQ_OVERFLOW_SPILL
+                && pthread_mutex_trylock(&infq->dump_mu) == 0) {
+            err = spill_push_block(infq);
+            pthread_mutex_unlock(&infq->dump_mu);
+            if (err == INFQ_ERR) {
+                return INFQ_ERR;
+            }
+            notify_pop_waiters(infq);
+            err = 0;
+            continue;
+        }
+
+        // make sure the dumper is going to dump the full blocks
+        if (over_budget) {
+            full_block_push_callback(infq);
+        }
+
+        if (infq->overflow_wait_us < 0) {
+            err = pthread_cond_wait(&infq->push_cond, &infq->push_mu);
+        } else {
+            err = pthread_cond_timedwait(&infq->push_cond, &infq->push_mu, deadline);
+        }
+    }
+
+    return INFQ_OK;
+}
+
+int32_t
+infq_push(infq_t *infq, void *data, int32_t size)
+{
+    if (infq == NULL || data == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int                 ret, notify;
+    struct timespec     deadline;
+
+    if (infq->overflow_policy != INFQ_OVERFLOW_FAIL) {
+        push_wait_deadline(infq, &deadline);
+    }
+
+    ret = INFQ_OK;
+    infq_pthread_mutex_lock(&infq->push_mu);
+    // wake up the consumers when an element lands in the empty push queue
+    notify = infq->pop_waiters > 0 && mem_queue_empty(&infq->push_queue);
+    for (;;) {
+        if (make_room_for_push(infq, &deadline) == INFQ_ERR) {
+            ret = INFQ_ERR;
+            break;
+        }
+
+        if (mem_queue_push(&infq->push_queue, infq->global_ele_idx, data, size) == INFQ_ERR) {
+            // NOTICE: the queue becomes full when jumping to the next block, try again
+            if (mem_queue_full(&infq->push_queue)
+                    && infq->overflow_policy != INFQ_OVERFLOW_FAIL) {
+                continue;
+            }
+            INFQ_ERROR_LOG("[%s]failed to push data to push queue, index: %lld",
+                    infq->name,
+                    infq->global_ele_idx);
+            ret = INFQ_ERR;
+            break;
+        }
+        infq->global_ele_idx++;
+        break;
+    }
+    infq_pthread_mutex_unlock(&infq->push_mu);
+
+    if (notify && ret == INFQ_OK) {
+        notify_pop_waiters(infq);
+    }
+
+    return ret;
+}
+
+int32_t
+infq_push_batch(infq_t *infq, const struct iovec *elems, int32_t n, int32_t *pushed)
+{
+    if (infq == NULL || elems == NULL || n < 0 || pushed == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int                 ret, notify;
+    int32_t             count;
+    struct timespec     deadline;
+
+    if (infq->overflow_policy != INFQ_OVERFLOW_FAIL) {
+        push_wait_deadline(infq, &deadline);
+    }
+
+    ret = INFQ_OK;
+    *pushed = 0;
+    infq_pthread_mutex_lock(&infq->push_mu);
+    notify = infq->pop_waiters > 0 && mem_queue_empty(&infq->push_queue);
+    while (*pushed < n) {
+        if (make_room_for_push(infq, &deadline) == INFQ_ERR) {
+            INFQ_DEBUG_LOG("[%s]push queue is full, batch pushed: %d/%d", infq->name, *pushed, n);
+            break;
+        }
+
+        if (mem_queue_push_batch(&infq->push_queue, infq->global_ele_idx, elems + *pushed,
+                    n - *pushed, &count) == INFQ_ERR) {
+            INFQ_ERROR_LOG("[%s]failed to push batch to push queue, index: %lld, pushed: %d",
+                    infq->name,
+                    infq->global_ele_idx,
+                    *pushed);
+            ret = INFQ_ERR;
+            break;
+        }
+        infq->global_ele_idx += count;
+        *pushed += count;
+    }
+    if (*pushed == 0 && n > 0) {
+        ret = INFQ_ERR;
+    }
+    infq_pthread_mutex_unlock(&infq->push_mu);
+
+    if (notify && *pushed > 0) {
+        notify_pop_waiters(infq);
+    }
+
+    return ret;
+}
+
+/**
+ * Whether the reservation is opened by the calling thread. It's checked before a commit
+ *      or abort touches anything, since 'push_mu' held for the reservation can only be
+ *      unlocked by its owner.
+ */
+static int32_t
+own_reservation(infq_t *infq)
+{
+    if (infq->reserved_size == INFQ_UNDEF) {
+        return INFQ_FALSE;
+    }
+
+    // NOTICE: pairs with the barrier in 'infq_push_reserve', the owner is set before the size
+    __sync_synchronize();
+    return pthread_equal(infq->reserve_owner, pthread_self());
+}
+
+int32_t
+infq_push_reserve(infq_t *infq, int32_t size, void **dst)
+{
+    if (infq == NULL || size < 0 || dst == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (own_reservation(infq)) {
+        INFQ_ERROR_LOG("[%s]the last reservation isn't committed or aborted", infq->name);
+        return INFQ_ERR;
+    }
+
+    int                 notify;
+    struct timespec     deadline;
+
+    if (infq->overflow_policy != INFQ_OVERFLOW_FAIL) {
+        push_wait_deadline(infq, &deadline);
+    }
+
+    infq_pthread_mutex_lock(&infq->push_mu);
+    notify = infq->pop_waiters > 0 && mem_queue_empty(&infq->push_queue);
+    for (;;) {
+        if (make_room_for_push(infq, &deadline) == INFQ_ERR) {
+            goto failed;
+        }
+
+        if (mem_queue_push_reserve(&infq->push_queue, infq->global_ele_idx, size, dst) == INFQ_ERR) {
+            // NOTICE: the queue becomes full when jumping to the next block, try again
+            if (mem_queue_full(&infq->push_queue)
+                    && infq->overflow_policy != INFQ_OVERFLOW_FAIL) {
+                continue;
+            }
+            INFQ_ERROR_LOG("[%s]failed to reserve push queue, size: %d, index: %lld",
+                    infq->name,
+                    size,
+                    infq->global_ele_idx);
+            goto failed;
+        }
+        break;
+    }
+
+    // NOTICE: 'push_mu' is held until the reservation is committed or aborted
+    infq->reserve_owner = pthread_self();
+    __sync_synchronize();
+    infq->reserved_size = size;
+    infq->reserve_notify = notify;
+
+    return INFQ_OK;
+
+failed:
+    infq_pthread_mutex_unlock(&infq->push_mu);
+    return INFQ_ERR;
+}
+
+int32_t
+infq_push_commit(infq_t *infq, int32_t actual_size)
+{
+    if (infq == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int     notify;
+
+    if (!own_reservation(infq)) {
+        INFQ_ERROR_LOG("[%s]no reservation of the thread to commit", infq->name);
+        return INFQ_ERR;
+    }
+
+    if (actual_size < 0 || actual_size > infq->reserved_size) {
+        INFQ_ERROR_LOG("[%s]invalid commit size: %d, reserved size: %d",
+                infq->name,
+                actual_size,
+                infq->reserved_size);
+        return INFQ_ERR;
+    }
+
+    if (mem_queue_push_commit(&infq->push_queue, infq->global_ele_idx, actual_size) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to commit to push queue, index: %lld",
+                infq->name,
+                infq->global_ele_idx);
+        return INFQ_ERR;
+    }
+    infq->global_ele_idx++;
+    infq->reserved_size = INFQ_UNDEF;
+    notify = infq->reserve_notify;
+    infq_pthread_mutex_unlock(&infq->push_mu);
+
+    if (notify) {
+        notify_pop_waiters(infq);
+    }
+
+    return INFQ_OK;
+}
+
+int32_t
+infq_push_abort(infq_t *infq)
+{
+    if (infq == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (!own_reservation(infq)) {
+        INFQ_ERROR_LOG("[%s]no reservation of the thread to abort", infq->name);
+        return INFQ_ERR;
+    }
+
+    // nothing is recorded until committing, just release the lock
+    infq->reserved_size = INFQ_UNDEF;
+    infq_pthread_mutex_unlock(&infq->push_mu);
+
+    return INFQ_OK;
+}
+
+int32_t
+infq_pushv(infq_t *infq, const struct iovec *iov, int32_t iovcnt)
+{
+    if (infq == NULL || iov == NULL || iovcnt <= 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int64_t     size;
+    int32_t     i;
+    char        *dst;
+
+    size = 0;
+    for (i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
+    if (size > INT32_MAX - (int64_t)sizeof(int32_t)) {
+        INFQ_ERROR_LOG("[%s]element is too large, size: %lld", infq->name, size);
+        return INFQ_ERR;
+    }
+
+    if (infq_push_reserve(infq, (int32_t)size, (void **)&dst) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+
+    // gather the parts into one element
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+
+    return infq_push_commit(infq, (int32_t)size);
+}
+
+/**
+ * Copy the element just popped to 'buf'. The caller should still hold the lock of
+ *      the queue, otherwise the block may be reused by the loader or pushers after
+ *      being dumped.
+ */
+static int32_t
+copy_popped_element(infq_t *infq, const void *dataptr, int32_t size, void *buf, int32_t buf_size)
+{
+    if (size > buf_size) {
+        INFQ_ERROR_LOG("[%s]buffer is not enough, buf size: %d, expect: %d",
+                infq->name,
+                buf_size,
+                size);
+        return INFQ_ERR;
+    }
+
+    if (size > 0) {
+        memcpy(buf, dataptr, size);
+    }
+
+    return INFQ_OK;
+}
+
+/**
+ * Pop an element without blocking. INFQ_NO_RETURN is returned when the memory
+ *      queues are empty but the data in file queue hasn't been loaded yet.
+ *      The element is copied to 'buf' before the lock is released if 'buf' isn't NULL.
+ */
+static int32_t
+infq_try_pop_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr, void *buf,
+        int32_t buf_size)
+{
+    int32_t     ret, first;
+
+    // 1. try to pop from pop queue
+    infq_pthread_mutex_lock(&infq->pop_mu);
+    if (!mem_queue_empty(&infq->pop_queue)) {
+        if (mem_queue_pop_zero_cp(&infq->pop_queue, dataptr, sizeptr) == INFQ_ERR) {
+            infq_pthread_mutex_unlock(&infq->pop_mu);
+            INFQ_ERROR_LOG("[%s]failed to pop from pop queue", infq->name);
+            return INFQ_ERR;
+        }
+        ret = INFQ_OK;
+        if (buf != NULL) {
+            ret = copy_popped_element(infq, *dataptr, *sizeptr, buf, buf_size);
+        }
+        infq_pthread_mutex_unlock(&infq->pop_mu);
+
+        return ret;
+    }
+    infq_pthread_mutex_unlock(&infq->pop_mu);
+
+    // 2. try to pop from push queue
+    // NOTICE: lock order is push_mu -> file_queue.mu, the same as the callback of full
+    //      push block which checks file queue with push_mu held
+    pthread_mutex_lock(&infq->push_mu);
+    pthread_mutex_lock(&infq->file_queue.mu);
+    do {
+        ret = INFQ_ERR;
+        // file queue is empty
+        if (infq->file_queue.block_num == 0) {
+            // push queue is empty means the infQ is empty
+            if (mem_queue_empty(&infq->push_queue)) {
+                INFQ_DEBUG_LOG("[%s]queue is empty", infq->name);
+                *dataptr = NULL;
+                *sizeptr = 0;
+                ret = INFQ_OK;
+                break;
+            }
+
+            // NOTICE: the first block of push queue may be being dumped to file queue,
+            //      the data will be in file queue soon.
+            if (pthread_mutex_trylock(&infq->dump_mu) != 0) {
+                ret = INFQ_NO_RETURN;
+                break;
+            }
+
+            // NOTICE: the last block of file queue may be taken by the loader but not
+            //      appended to pop queue yet, or has been appended after pop queue was
+            //      checked. Both are excluded by 'load_mu' and checking pop queue again.
+            if (pthread_mutex_trylock(&infq->load_mu) != 0) {
+                pthread_mutex_unlock(&infq->dump_mu);
+                ret = INFQ_NO_RETURN;
+                break;
+            }
+            // appending to pop queue happens before 'load_mu' is released, and swapping
+            //      needs push_mu, so pop queue doesn't become non-empty after the check
+            if (!mem_queue_empty(&infq->pop_queue)) {
+                pthread_mutex_unlock(&infq->load_mu);
+                pthread_mutex_unlock(&infq->dump_mu);
+                pthread_mutex_unlock(&infq->file_queue.mu);
+                pthread_mutex_unlock(&infq->push_mu);
+
+                return infq_try_pop_zero_cp(infq, dataptr, sizeptr, buf, buf_size);
+            }
+            pthread_mutex_unlock(&infq->load_mu);
+
+            // try to pop from push queue when file queue is empty
+            first = infq->push_queue.first_block;
+            if (mem_queue_pop_zero_cp(&infq->push_queue, dataptr, sizeptr) == INFQ_ERR) {
+                pthread_mutex_unlock(&infq->dump_mu);
+                INFQ_ERROR_LOG("[%s]failed to pop from push queue", infq->name);
+                break;
+            }
+            pthread_mutex_unlock(&infq->dump_mu);
+
+            // wake up the pushers waiting for free blocks when a block is drained
+            if (infq->push_queue.first_block != first) {
+                pthread_cond_broadcast(&infq->push_cond);
+            }
+
+            // NOTICE: Poping data from push queue means that the pop queue is empty.
+            //      Update the index range of pop queue to make sure that the index
+            //      ranges of pop queue and push queue are continuous.
+            //      更新pop queue的index的逻辑必须在从push queue pop之后，否则push queue
+            //      和pop queue的index不连续，并且pop queue的min_idx与其第一个block的start_idx
+            //      不一致，popq->min_idx + 1 = first_block(popq)->start_idx
+            infq->pop_queue.min_idx = infq->push_queue.min_idx;
+            infq->pop_queue.max_idx = infq->push_queue.min_idx;
+
+            ret = INFQ_OK;
+            // the block is reused by pushers once it's dumped, copy with push_mu held
+            if (buf != NULL) {
+                ret = copy_popped_element(infq, *dataptr, *sizeptr, buf, buf_size);
+            }
+        } else {
+            // data in file queue is not loaded to memory
+            ret = INFQ_NO_RETURN;
+        }
+    } while (0);
+
+    pthread_mutex_unlock(&infq->file_queue.mu);
+    pthread_mutex_unlock(&infq->push_mu);
+
+    return ret;
+}
+
+int32_t
+infq_pop_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr)
+{
+    if (infq == NULL || dataptr == NULL || sizeptr == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    return infq_pop_copy(infq, dataptr, sizeptr, NULL, 0);
+}
+
+static int32_t
+infq_pop_copy(infq_t *infq, const void **dataptr, int32_t *sizeptr, void *buf, int32_t buf_size)
+{
+    int32_t     ret;
+
+    ret = infq_try_pop_zero_cp(infq, dataptr, sizeptr, buf, buf_size);
+    if (ret == INFQ_NO_RETURN && infq->inline_load && load_block_inline(infq) != INFQ_ERR) {
+        ret = infq_try_pop_zero_cp(infq, dataptr, sizeptr, buf, buf_size);
+    }
+
+    if (ret == INFQ_NO_RETURN) {
+        // NOTICE: just return error when data in file queue is not loaded to memory.
+        INFQ_ERROR_LOG("[%s]data is in file queue, need to load to memory queue",
+                infq->name);
+        return INFQ_ERR;
+    }
+
+    return ret;
+}
+
 int32_t
-infq_push(infq_t *infq, void *data, int32_t size)
+infq_pop_wait_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr, int64_t timeout_us)
 {
-    if (infq == NULL || data == NULL) {
+    if (infq == NULL || dataptr == NULL || sizeptr == NULL) {
         INFQ_ERROR_LOG("invalid param");
         return INFQ_ERR;
     }
 
-    int     ret;
+    return infq_pop_wait_copy(infq, dataptr, sizeptr, NULL, 0, timeout_us);
+}
 
-    ret = INFQ_OK;
-    infq_pthread_mutex_lock(&infq->push_mu);
-    do {
-        if (mem_queue_full(&infq->push_queue)) {
-            INFQ_DEBUG_LOG("[%s]push queue is full, block idx: [%d, %d], index: [%d, %d], "
-                    "dumper jobs: %d",
-                    infq->name,
-                    infq->push_queue.first_block,
-                    infq->push_queue.last_block,
-                    infq->push_queue.min_idx,
-                    infq->push_queue.max_idx,
-                    bg_exec_pending_task_num(&infq->dump_exec));
-            ret = INFQ_ERR;
+static int32_t
+infq_pop_wait_copy(infq_t *infq, const void **dataptr, int32_t *sizeptr, void *buf,
+        int32_t buf_size, int64_t timeout_us)
+{
+    int32_t             ret, err;
+    int64_t             seq;
+    struct timespec     deadline;
+
+    if (timeout_us > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_us / 1000000;
+        deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    // NOTICE: register as a waiter before trying to pop. Producers check 'pop_waiters'
+    //      under push_mu or notify unconditionally(loader), so the data published after
+    //      a failed try always increases 'pop_seq'.
+    infq_pthread_mutex_lock(&infq->wait_mu);
+    infq->pop_waiters++;
+    infq_pthread_mutex_unlock(&infq->wait_mu);
+
+    for (;;) {
+        infq_pthread_mutex_lock(&infq->wait_mu);
+        seq = infq->pop_seq;
+        infq_pthread_mutex_unlock(&infq->wait_mu);
+
+        ret = infq_try_pop_zero_cp(infq, dataptr, sizeptr, buf, buf_size);
+        if (ret == INFQ_ERR || (ret == INFQ_OK && *sizeptr > 0)) {
             break;
         }
 
-        if (mem_queue_push(&infq->push_queue, infq->global_ele_idx, data, size) == INFQ_ERR) {
-            INFQ_ERROR_LOG("[%s]failed to push data to push queue, index: %lld",
-                    infq->name,
-                    infq->global_ele_idx);
-            ret = INFQ_ERR;
+        *dataptr = NULL;
+        *sizeptr = 0;
+
+        if (timeout_us == 0) {
+            ret = INFQ_OK;
             break;
         }
-        infq->global_ele_idx++;
-    } while(0);
-    infq_pthread_mutex_unlock(&infq->push_mu);
+
+        // NOTICE: retry only if a block is loaded, otherwise wait like the others.
+        //      Nothing is loaded while the dumper is writing the blocks, spinning on
+        //      it would contend with the producers for the locks.
+        if (ret == INFQ_NO_RETURN && infq->inline_load) {
+            ret = load_block_inline(infq);
+            if (ret == INFQ_ERR) {
+                break;
+            }
+            if (ret == INFQ_OK) {
+                continue;
+            }
+        }
+
+        // the loader is only triggered by poping out a block, make sure that
+        // it's working when the pop queue is empty
+        if (ret == INFQ_NO_RETURN) {
+            infq_pthread_mutex_lock(&infq->pop_mu);
+            if (check_and_trigger_loader(infq) == INFQ_ERR) {
+                INFQ_ERROR_LOG("[%s]failed to check and trigger load task", infq->name);
+            }
+            infq_pthread_mutex_unlock(&infq->pop_mu);
+        }
+
+        err = 0;
+        infq_pthread_mutex_lock(&infq->wait_mu);
+        while (infq->pop_seq == seq && err != ETIMEDOUT) {
+            if (timeout_us < 0) {
+                err = pthread_cond_wait(&infq->pop_cond, &infq->wait_mu);
+            } else {
+                err = pthread_cond_timedwait(&infq->pop_cond, &infq->wait_mu, &deadline);
+            }
+        }
+        infq_pthread_mutex_unlock(&infq->wait_mu);
+
+        ret = INFQ_OK;
+        if (err == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    infq_pthread_mutex_lock(&infq->wait_mu);
+    infq->pop_waiters--;
+    infq_pthread_mutex_unlock(&infq->wait_mu);
 
     return ret;
 }
 
-int32_t
-infq_pop_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr)
+static int32_t
+infq_try_pop_batch_zero_cp(infq_t *infq, const void **ptrs, int32_t *sizes, int32_t max,
+        int32_t *n)
 {
-    if (infq == NULL || dataptr == NULL || sizeptr == NULL) {
-        INFQ_ERROR_LOG("invalid param");
-        return INFQ_ERR;
-    }
-
-    int32_t     ret;
+    int32_t     ret, first;
 
     // 1. try to pop from pop queue
     infq_pthread_mutex_lock(&infq->pop_mu);
     if (!mem_queue_empty(&infq->pop_queue)) {
-        if (mem_queue_pop_zero_cp(&infq->pop_queue, dataptr, sizeptr) == INFQ_ERR) {
+        if (mem_queue_pop_batch_zero_cp(&infq->pop_queue, ptrs, sizes, max, n) == INFQ_ERR) {
             infq_pthread_mutex_unlock(&infq->pop_mu);
-            INFQ_ERROR_LOG("[%s]failed to pop from pop queue", infq->name);
+            INFQ_ERROR_LOG("[%s]failed to pop batch from pop queue", infq->name);
             return INFQ_ERR;
         }
         infq_pthread_mutex_unlock(&infq->pop_mu);
@@ -309,51 +1112,87 @@ infq_pop_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr)
     infq_pthread_mutex_unlock(&infq->pop_mu);
 
     // 2. try to pop from push queue
-    pthread_mutex_lock(&infq->file_queue.mu);
+    // NOTICE: lock order is push_mu -> file_queue.mu, the same as the callback of full
+    //      push block which checks file queue with push_mu held
     pthread_mutex_lock(&infq->push_mu);
-    do {
-        ret = INFQ_ERR;
-        // file queue is empty
-        if (infq->file_queue.block_num == 0) {
-            // push queue is empty means the infQ is empty
-            if (mem_queue_empty(&infq->push_queue)) {
-                INFQ_DEBUG_LOG("[%s]queue is empty", infq->name);
-                *dataptr = NULL;
-                *sizeptr = 0;
-                ret = INFQ_OK;
-                break;
+    pthread_mutex_lock(&infq->file_queue.mu);
+    ret = INFQ_ERR;
+    if (infq->file_queue.block_num == 0 && mem_queue_empty(&infq->push_queue)) {
+        *n = 0;
+        ret = INFQ_OK;
+    } else if (infq->file_queue.block_num == 0
+            && pthread_mutex_trylock(&infq->dump_mu) != 0) {
+        // the first block of push queue is being dumped, see infq_try_pop_zero_cp
+        ret = INFQ_NO_RETURN;
+    } else if (infq->file_queue.block_num == 0
+            && pthread_mutex_trylock(&infq->load_mu) != 0) {
+        // the last file block is being loaded, see infq_try_pop_zero_cp
+        pthread_mutex_unlock(&infq->dump_mu);
+        ret = INFQ_NO_RETURN;
+    } else if (infq->file_queue.block_num == 0 && !mem_queue_empty(&infq->pop_queue)) {
+        // the last file block was loaded after pop queue was checked
+        pthread_mutex_unlock(&infq->load_mu);
+        pthread_mutex_unlock(&infq->dump_mu);
+        pthread_mutex_unlock(&infq->file_queue.mu);
+        pthread_mutex_unlock(&infq->push_mu);
+
+        return infq_try_pop_batch_zero_cp(infq, ptrs, sizes, max, n);
+    } else if (infq->file_queue.block_num == 0) {
+        pthread_mutex_unlock(&infq->load_mu);
+        first = infq->push_queue.first_block;
+        if (mem_queue_pop_batch_zero_cp(&infq->push_queue, ptrs, sizes, max, n) == INFQ_ERR) {
+            INFQ_ERROR_LOG("[%s]failed to pop batch from push queue", infq->name);
+        } else {
+            // wake up the pushers waiting for free blocks, see infq_try_pop_zero_cp
+            if (infq->push_queue.first_block != first) {
+                pthread_cond_broadcast(&infq->push_cond);
             }
-
-            // try to pop from push queue when file queue is empty
-            if (mem_queue_pop_zero_cp(&infq->push_queue, dataptr, sizeptr) == INFQ_ERR) {
-                INFQ_ERROR_LOG("[%s]failed to pop from push queue", infq->name);
-                break;
+            // NOTICE: keep the index ranges of pop queue and push queue continuous,
+            //      the same as infq_pop_zero_cp
+            if (*n > 0) {
+                infq->pop_queue.min_idx = infq->push_queue.min_idx;
+                infq->pop_queue.max_idx = infq->push_queue.min_idx;
             }
-
-            // NOTICE: Poping data from push queue means that the pop queue is empty.
-            //      Update the index range of pop queue to make sure that the index
-            //      ranges of pop queue and push queue are continuous.
-            //      更新pop queue的index的逻辑必须在从push queue pop之后，否则push queue
-            //      和pop queue的index不连续，并且pop queue的min_idx与其第一个block的start_idx
-            //      不一致，popq->min_idx + 1 = first_block(popq)->start_idx
-            infq->pop_queue.min_idx = infq->push_queue.min_idx;
-            infq->pop_queue.max_idx = infq->push_queue.min_idx;
-
             ret = INFQ_OK;
-        } else {
-            // NOTICE: just return error when data in file queue is not loaded to memory.
-            INFQ_ERROR_LOG("[%s]data is in file queue, need to load to memory queue",
-                    infq->name);
         }
-    } while (0);
+        pthread_mutex_unlock(&infq->dump_mu);
+    } else {
+        // data in file queue is not loaded to memory
+        ret = INFQ_NO_RETURN;
+    }
 
-    // NOTICE: 解锁顺序不同是否会死锁？
     pthread_mutex_unlock(&infq->file_queue.mu);
     pthread_mutex_unlock(&infq->push_mu);
 
     return ret;
 }
 
+int32_t
+infq_pop_batch_zero_cp(infq_t *infq, const void **ptrs, int32_t *sizes, int32_t max, int32_t *n)
+{
+    if (infq == NULL || ptrs == NULL || sizes == NULL || n == NULL || max < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     ret;
+
+    *n = 0;
+    ret = infq_try_pop_batch_zero_cp(infq, ptrs, sizes, max, n);
+    if (ret == INFQ_NO_RETURN && infq->inline_load && load_block_inline(infq) != INFQ_ERR) {
+        ret = infq_try_pop_batch_zero_cp(infq, ptrs, sizes, max, n);
+    }
+
+    if (ret == INFQ_NO_RETURN) {
+        // NOTICE: just return error when data in file queue is not loaded to memory.
+        INFQ_ERROR_LOG("[%s]data is in file queue, need to load to memory queue",
+                infq->name);
+        return INFQ_ERR;
+    }
+
+    return ret;
+}
+
 int32_t
 infq_pop(infq_t *infq, void *buf, int32_t buf_size, int32_t *sizeptr)
 {
@@ -364,20 +1203,30 @@ infq_pop(infq_t *infq, void *buf, int32_t buf_size, int32_t *sizeptr)
 
     const void  *dataptr;
 
-    if (infq_pop_zero_cp(infq, &dataptr, sizeptr) == INFQ_ERR) {
-        INFQ_ERROR_LOG("[%s]failed to pop zero copy", infq->name);
+    // NOTICE: copy before the lock is released, the block may be dumped and reused
+    //      by pushers as soon as the element is popped from push queue
+    if (infq_pop_copy(infq, &dataptr, sizeptr, buf, buf_size) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to pop", infq->name);
         return INFQ_ERR;
     }
 
-    if (*sizeptr > buf_size) {
-        INFQ_ERROR_LOG("[%s]buffer is not enough, buf size: %d, expect: %d",
-                infq->name,
-                buf_size,
-                *sizeptr);
+    return INFQ_OK;
+}
+
+int32_t
+infq_pop_wait(infq_t *infq, void *buf, int32_t buf_size, int32_t *sizeptr, int64_t timeout_us)
+{
+    if (infq == NULL || buf == NULL || sizeptr == NULL) {
+        INFQ_ERROR_LOG("invalid param");
         return INFQ_ERR;
     }
 
-    memcpy(buf, dataptr, *sizeptr);
+    const void  *dataptr;
+
+    if (infq_pop_wait_copy(infq, &dataptr, sizeptr, buf, buf_size, timeout_us) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to pop with waiting", infq->name);
+        return INFQ_ERR;
+    }
 
     return INFQ_OK;
 }
@@ -610,59 +1459,271 @@ infq_just_pop(infq_t *infq)
         return INFQ_ERR;
     }
 
-    return INFQ_OK;
-}
+    return INFQ_OK;
+}
+
+int32_t
+infq_push_queue_jump(infq_t *infq)
+{
+    if (infq == NULL) {
+       INFQ_ERROR_LOG("invalid param");
+       return INFQ_ERR;
+    }
+
+    if (mem_queue_jump(&infq->push_queue) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to make push queue jump to next block");
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+int32_t
+infq_size(infq_t *infq)
+{
+    if (infq == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return -1;
+    }
+
+    // TODO: need to synchronize
+    return infq->push_queue.ele_count + infq->pop_queue.ele_count + infq->file_queue.ele_count;
+}
+
+int32_t
+infq_msize(infq_t *infq)
+{
+    if (infq == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_UNDEF;
+    }
+
+    // TODO: need to include offset array, index block and jumbo blocks
+    return (infq->push_queue.alloc_block_num + infq->pop_queue.alloc_block_num
+            + (infq->tmp_mem_block != NULL)) * infq->mem_block_size + \
+            2 * sizeof(infq->push_queue) + infq->file_queue.block_num * sizeof(file_block_t);
+}
+
+void
+infq_config_mem_budget(int64_t budget)
+{
+    block_pool_set_budget(budget);
+}
+
+void
+infq_config_io_unit(int32_t io_unit)
+{
+    file_block_set_io_unit(io_unit);
+}
+
+void
+infq_config_direct_io(int32_t enable)
+{
+    file_block_set_direct_io(enable);
+}
+
+void
+infq_config_verify_checksum(int32_t enable)
+{
+    file_block_set_verify_checksum(enable);
+}
+
+void
+infq_config_max_open_files(int32_t max_files)
+{
+    file_block_set_max_open_files(max_files);
+}
+
+int32_t
+infq_config_codec(const infq_codec_t *codec)
+{
+    if (codec == NULL || codec->id < INFQ_CODEC_USER) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    return codec_register(codec);
+}
+
+int64_t
+infq_mem_used(void)
+{
+    return block_pool_used();
+}
+
+int32_t
+infq_config_bg_pool(int32_t thread_num)
+{
+    if (thread_num < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (shared_bg_pool != NULL) {
+        INFQ_ERROR_LOG("background pool has been configured, worker count: %d",
+                shared_bg_pool->thread_num);
+        return INFQ_ERR;
+    }
+
+    if (thread_num == 0) {
+        return INFQ_OK;
+    }
+
+    if (bg_pool_init(&shared_bg_pool_inst, thread_num) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to init background pool, worker count: %d", thread_num);
+        return INFQ_ERR;
+    }
+    shared_bg_pool = &shared_bg_pool_inst;
+
+    return INFQ_OK;
+}
+
+int32_t
+infq_destroy_bg_pool(void)
+{
+    if (shared_bg_pool == NULL) {
+        return INFQ_OK;
+    }
+
+    if (bg_pool_destroy(shared_bg_pool) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to destroy background pool");
+        return INFQ_ERR;
+    }
+    shared_bg_pool = NULL;
+
+    return INFQ_OK;
+}
+
+int32_t
+infq_sync(infq_t *infq)
+{
+    if (infq == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    return file_queue_sync(&infq->file_queue, INFQ_FALSE);
+}
+
+int32_t
+infq_release_idle_blocks(infq_t *infq)
+{
+    if (infq == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int64_t     now;
+    int32_t     drained, idle, released;
+
+    if (infq->idle_release_ms <= 0 && !block_pool_over_budget()) {
+        return INFQ_OK;
+    }
+
+    // NOTICE: lock order is load_mu -> push_mu -> pop_mu
+    infq_pthread_mutex_lock(&infq->load_mu);
+    infq_pthread_mutex_lock(&infq->push_mu);
+    infq_pthread_mutex_lock(&infq->pop_mu);
+
+    infq_pthread_mutex_lock(&infq->file_queue.mu);
+    drained = infq->file_queue.block_num == 0 && mem_queue_empty(&infq->push_queue)
+        && mem_queue_empty(&infq->pop_queue);
+    infq_pthread_mutex_unlock(&infq->file_queue.mu);
+
+    released = 0;
+    now = time_us();
+    if (!drained || infq->idle_check_idx != infq->global_ele_idx) {
+        // restart the idle clock when there are elements or new elements were pushed
+        infq->idle_check_idx = infq->global_ele_idx;
+        infq->idle_since = now;
+    }
+
+    // NOTICE: release the unused blocks immediately when the memory budget is exceeded
+    idle = drained && infq->idle_release_ms > 0
+        && now - infq->idle_since >= (int64_t)infq->idle_release_ms * 1000;
+    if (idle || block_pool_over_budget()) {
+        released = mem_queue_release_free_blocks(&infq->push_queue)
+            + mem_queue_release_free_blocks(&infq->pop_queue);
+        if (infq->tmp_mem_block != NULL) {
+            block_pool_put(infq->tmp_mem_block);
+            infq->tmp_mem_block = NULL;
+            released++;
+        }
+    }
 
-int32_t
-infq_push_queue_jump(infq_t *infq)
-{
-    if (infq == NULL) {
-       INFQ_ERROR_LOG("invalid param");
-       return INFQ_ERR;
+    // the current empty blocks are kept for a busy infQ, which is drained only for a moment
+    if (idle) {
+        released += mem_queue_release_empty_block(&infq->push_queue)
+            + mem_queue_release_empty_block(&infq->pop_queue);
     }
 
-    if (mem_queue_jump(&infq->push_queue) == INFQ_ERR) {
-        INFQ_ERROR_LOG("failed to make push queue jump to next block");
-        return INFQ_ERR;
+    infq_pthread_mutex_unlock(&infq->pop_mu);
+    infq_pthread_mutex_unlock(&infq->push_mu);
+    infq_pthread_mutex_unlock(&infq->load_mu);
+
+    if (released > 0) {
+        INFQ_INFO_LOG("[%s]release idle memory blocks, count: %d", infq->name, released);
     }
 
     return INFQ_OK;
 }
 
 int32_t
-infq_size(infq_t *infq)
+infq_fsize(infq_t *infq)
 {
     if (infq == NULL) {
         INFQ_ERROR_LOG("invalid param");
-        return -1;
+        return INFQ_UNDEF;
     }
 
-    // TODO: need to synchronize
-    return infq->push_queue.ele_count + infq->pop_queue.ele_count + infq->file_queue.ele_count;
+    return infq->file_queue.total_fsize;
 }
 
-int32_t
-infq_msize(infq_t *infq)
+/**
+ * Init the io engines of 'Dumper' and 'Loader' when more than one block can be in
+ *      flight, the synchronous IO is used if io_uring isn't available.
+ */
+static void
+init_io_engines(infq_t *infq, int32_t io_depth)
 {
-    if (infq == NULL) {
-        INFQ_ERROR_LOG("invalid param");
-        return INFQ_UNDEF;
+    io_engine_t     **engines[2] = {&infq->dump_io, &infq->load_io};
+
+    infq->dump_io = infq->load_io = NULL;
+    if (io_depth <= 1) {
+        return;
     }
 
-    // TODO: need to include offset array and index block
-    return (infq->push_queue.block_num + infq->pop_queue.block_num) * infq->mem_block_size + \
-            2 * sizeof(infq->push_queue) + infq->file_queue.block_num * sizeof(file_block_t);
+    for (int32_t i = 0; i < 2; i++) {
+        *engines[i] = (io_engine_t *)malloc(sizeof(io_engine_t));
+        if (*engines[i] == NULL) {
+            INFQ_ERROR_LOG("[%s]failed to alloc mem for io engine", infq->name);
+            break;
+        }
+        if (io_engine_init(*engines[i], io_depth) == INFQ_ERR) {
+            free(*engines[i]);
+            *engines[i] = NULL;
+            break;
+        }
+    }
+
+    if (infq->dump_io == NULL || infq->load_io == NULL) {
+        INFQ_INFO_LOG("[%s]io engine isn't available, use synchronous io", infq->name);
+        destroy_io_engines(infq);
+    }
 }
 
-int32_t
-infq_fsize(infq_t *infq)
+static void
+destroy_io_engines(infq_t *infq)
 {
-    if (infq == NULL) {
-        INFQ_ERROR_LOG("invalid param");
-        return INFQ_UNDEF;
-    }
+    io_engine_t     **engines[2] = {&infq->dump_io, &infq->load_io};
 
-    return infq->file_queue.total_fsize;
+    for (int32_t i = 0; i < 2; i++) {
+        if (*engines[i] != NULL) {
+            io_engine_destroy(*engines[i]);
+            free(*engines[i]);
+            *engines[i] = NULL;
+        }
+    }
 }
 
 void
@@ -682,6 +1743,7 @@ infq_destroy(infq_t *infq)
     if (bg_exec_destroy(&infq->unlink_exec) == INFQ_ERR) {
         INFQ_ERROR_LOG("[%s]failed to destroy unlinker", infq->name);
     }
+    destroy_io_engines(infq);
 
     mem_queue_destroy(&infq->push_queue);
     mem_queue_destroy(&infq->pop_queue);
@@ -689,8 +1751,13 @@ infq_destroy(infq_t *infq)
     file_queue_destroy(&infq->file_queue);
     pthread_mutex_destroy(&infq->push_mu);
     pthread_mutex_destroy(&infq->pop_mu);
+    pthread_mutex_destroy(&infq->dump_mu);
+    pthread_mutex_destroy(&infq->load_mu);
+    pthread_mutex_destroy(&infq->wait_mu);
+    pthread_cond_destroy(&infq->push_cond);
+    pthread_cond_destroy(&infq->pop_cond);
     if (infq->tmp_mem_block != NULL) {
-        mem_block_destroy(infq->tmp_mem_block);
+        block_pool_put(infq->tmp_mem_block);
     }
 
     if (infq->dump_meta_double_buf != NULL) {
@@ -721,6 +1788,7 @@ infq_destroy_completely(infq_t *infq)
     if (bg_exec_destroy(&infq->unlink_exec) == INFQ_ERR) {
         INFQ_ERROR_LOG("[%s]failed to destroy unlinker", infq->name);
     }
+    destroy_io_engines(infq);
 
     mem_queue_destroy(&infq->push_queue);
     mem_queue_destroy(&infq->pop_queue);
@@ -731,8 +1799,13 @@ infq_destroy_completely(infq_t *infq)
     }
     pthread_mutex_destroy(&infq->push_mu);
     pthread_mutex_destroy(&infq->pop_mu);
+    pthread_mutex_destroy(&infq->dump_mu);
+    pthread_mutex_destroy(&infq->load_mu);
+    pthread_mutex_destroy(&infq->wait_mu);
+    pthread_cond_destroy(&infq->push_cond);
+    pthread_cond_destroy(&infq->pop_cond);
     if (infq->tmp_mem_block != NULL) {
-        mem_block_destroy(infq->tmp_mem_block);
+        block_pool_put(infq->tmp_mem_block);
     }
 
     if (infq->dump_meta_double_buf != NULL) {
@@ -758,6 +1831,8 @@ infq_dump(infq_t *infq, char *buf, int32_t buf_size, int32_t *data_size) {
 
     long long           t1, t2, t3;
     unsigned long       file_path_len, infq_name_len;
+    file_block_t        *fblock, *last_restoring = NULL;
+    int32_t             restoring_num = 0, restoring_count = 0, restoring_size = 0;
 
     // 0. check whether the buffer is big enough
     file_path_len = strlen(infq->file_queue.file_path) + 1;
@@ -786,6 +1861,12 @@ infq_dump(infq_t *infq, char *buf, int32_t buf_size, int32_t *data_size) {
         INFQ_ERROR_LOG("[%s]failed to dump pop queue", infq->name);
         return INFQ_ERR;
     }
+
+    // the files referred by the meta must be on disk before the meta is saved
+    if (file_queue_sync(&infq->file_queue, INFQ_TRUE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to sync files of infq", infq->name);
+        return INFQ_ERR;
+    }
     t3 = time_us();
 
     // 3. meta data
@@ -794,23 +1875,39 @@ infq_dump(infq_t *infq, char *buf, int32_t buf_size, int32_t *data_size) {
     meta->file_path = infq->file_queue.file_path;
     meta->infq_name = infq->name;
     meta->global_ele_idx = infq->global_ele_idx;
-    meta->file_meta.block_num = infq->file_queue.block_num;
-    meta->file_meta.ele_count = infq->file_queue.ele_count;
-    if (!file_queue_empty(&infq->file_queue)) {
-        meta->file_meta.file_range.start = infq->file_queue.block_head->suffix;
+
+    // the pop blocks not loaded yet have been dumped with pop queue
+    for (fblock = infq->file_queue.block_head; restoring_block(fblock); fblock = fblock->next) {
+        restoring_num++;
+        restoring_count += fblock->ele_count;
+        restoring_size += fblock->file_size;
+        last_restoring = fblock;
+    }
+
+    meta->file_meta.block_num = infq->file_queue.block_num - restoring_num;
+    meta->file_meta.ele_count = infq->file_queue.ele_count - restoring_count;
+    if (fblock != NULL) {
+        meta->file_meta.file_range.start = fblock->suffix;
         // end means exclude boundary
         meta->file_meta.file_range.end = infq->file_queue.block_tail->suffix + 1;
     } else {
         meta->file_meta.file_range.start = INFQ_UNDEF;
         meta->file_meta.file_range.end = INFQ_UNDEF;
     }
-    meta->file_meta.file_size = infq->file_queue.total_fsize;
+    meta->file_meta.file_size = infq->file_queue.total_fsize - restoring_size;
+    pin_manifest(infq);
 
-    meta->popq_meta.ele_count = infq->pop_queue.ele_count;
+    meta->popq_meta.ele_count = infq->pop_queue.ele_count + restoring_count;
     meta->popq_meta.min_idx = infq->pop_queue.min_idx;
     meta->popq_meta.max_idx = infq->pop_queue.max_idx;
+    if (last_restoring != NULL) {
+        if (infq->pop_queue.ele_count == 0) {
+            meta->popq_meta.min_idx = infq->file_queue.block_head->start_index;
+        }
+        meta->popq_meta.max_idx = last_restoring->start_index + last_restoring->ele_count;
+    }
     meta->popq_meta.block_num = infq->pop_queue.block_num;
-    meta->popq_meta.block_size = first_block(&infq->pop_queue)->mem_size;
+    meta->popq_meta.block_size = infq->pop_queue.block_size;
 
     INFQ_INFO_LOG("[%s]successful to dump infq, total: %lldus, pushq: %lldus, popq: %lldus",
             infq->name,
@@ -872,7 +1969,7 @@ infq_load(infq_t *infq, const char *buf, int32_t buf_size) {
     strcpy(infq->name, meta->infq_name);
 
     // 1. reinit push queue, to clear the old data
-    blk_size = first_block(&infq->push_queue)->mem_size;
+    blk_size = infq->push_queue.block_size;
     mem_queue_destroy(&infq->push_queue);
     if (mem_queue_init(
                 &infq->push_queue,
@@ -919,6 +2016,23 @@ infq_load(infq_t *infq, const char *buf, int32_t buf_size) {
     return INFQ_OK;
 }
 
+/**
+ * Pin the records of manifest referred by the dump metas, both of them may be used
+ *      to restore until the dump is done. A meta never filled has no file path.
+ */
+static void
+pin_manifest(infq_t *infq)
+{
+    int32_t     pin = backup_dump_meta(infq).file_meta.file_range.start;
+    int32_t     cur = cur_dump_meta(infq).file_meta.file_range.start;
+
+    if (cur_dump_meta(infq).file_path_len > 0 && cur != INFQ_UNDEF
+            && (pin == INFQ_UNDEF || cur < pin)) {
+        pin = cur;
+    }
+    file_queue_pin_manifest(&infq->file_queue, pin);
+}
+
 int32_t
 infq_done_dump(infq_t *infq)
 {
@@ -931,6 +2045,13 @@ infq_done_dump(infq_t *infq)
     char*               prefixes[2];
     unlink_job_t        *job_info;
     int                 counter;
+    int32_t             segment_blocks = infq->file_queue.segment_blocks;
+
+    // 0. the pop blocks of the last load are removed below, load the rest of them
+    if (finish_restoring(infq) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to load pop blocks before the dump is done", infq->name);
+        return INFQ_ERR;
+    }
 
     // 1. add diff files to unlinker job queue
     to_rm_files_range(
@@ -953,6 +2074,12 @@ infq_done_dump(infq_t *infq)
     counter = 0;
     for (int i = 0; i < 2; i++) {
         for (int j = suffix_range[i].start; j < suffix_range[i].end; j++) {
+            // NOTICE: a segment is removed as a whole when its last block is released,
+            //      the blocks are always released in order
+            if (i == 0 && segment_blocks > 0 && (j + 1) % segment_blocks != 0) {
+                continue;
+            }
+
             job_info = (unlink_job_t *)malloc(sizeof(unlink_job_t));
             if (job_info == NULL) {
                 INFQ_ERROR_LOG("[%s]failed to alloc mem for unlink job info", infq->name);
@@ -961,6 +2088,14 @@ infq_done_dump(infq_t *infq)
 
             job_info->file_prefix = prefixes[i];
             job_info->file_block_no = j;
+            // NOTICE: the consumed files may be still mapped by the pop queue, they're
+            //      recycled only when it's impossible
+            job_info->file_queue = infq->mmap_load ? NULL : &infq->file_queue;
+            if (i == 0 && segment_blocks > 0) {
+                job_info->file_prefix = INFQ_SEGMENT_PREFIX;
+                job_info->file_block_no = j / segment_blocks;
+                job_info->file_queue = NULL;
+            }
             job_info->file_path = infq->file_queue.file_path;
             if (bg_exec_add_job(
                     &infq->unlink_exec,
@@ -978,6 +2113,7 @@ infq_done_dump(infq_t *infq)
 
     // 2. switch dump meta
     infq->cur_meta_idx = 1 - infq->cur_meta_idx;
+    file_queue_pin_manifest(&infq->file_queue, cur_dump_meta(infq).file_meta.file_range.start);
 
     // 3. update pop_block_suffix
     infq->pop_block_suffix += cur_dump_meta(infq).popq_meta.file_range.end
@@ -1014,7 +2150,7 @@ void
 swap_mem_block(infq_t *infq)
 {
     int32_t         free_block_num, i, counter;
-    mem_block_t     *block;
+    mem_block_t     *block, *empty;
     mem_queue_t     *pushq, *popq;
 
     pushq = &infq->push_queue;
@@ -1023,6 +2159,12 @@ swap_mem_block(infq_t *infq)
 
     free_block_num = mem_queue_free_block_num(popq);
 
+    // the last block of pop queue may be released when the infQ is idle
+    if (mem_queue_alloc_block(popq, popq->last_block) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to alloc last block of pop queue", infq->name);
+        return;
+    }
+
     // NOTICE: make sure last block in pop queue is empty
     if (!mem_block_empty(last_block(popq))) {
         // popq only has the last one block, and the block is not empty.
@@ -1033,6 +2175,10 @@ swap_mem_block(infq_t *infq)
 
         free_block_num--;
         if (!mem_queue_full(popq)) {
+            if (mem_queue_alloc_block(popq, (popq->last_block + 1) % popq->block_num) == INFQ_ERR) {
+                INFQ_ERROR_LOG("[%s]failed to alloc block of pop queue", infq->name);
+                return;
+            }
             popq->last_block = (popq->last_block + 1) % popq->block_num;
         }
     }
@@ -1053,12 +2199,23 @@ swap_mem_block(infq_t *infq)
             continue;
         }
 
-        first_block(pushq) = last_block(popq);
+        empty = last_block(popq);
+        first_block(pushq) = NULL;
         last_block(popq) = block;
 
         pushq->first_block = (pushq->first_block + 1) % pushq->block_num;
         popq->last_block = (popq->last_block + 1) % popq->block_num;
 
+        // the empty block fills the new last slot of pop queue if it isn't allocated,
+        //      otherwise it's returned to push queue
+        if (last_block(popq) == NULL) {
+            last_block(popq) = empty;
+            pushq->alloc_block_num--;
+            popq->alloc_block_num++;
+        } else {
+            pushq->blocks[(pushq->first_block - 1 + pushq->block_num) % pushq->block_num] = empty;
+        }
+
         mem_block_reset(last_block(popq), INFQ_UNDEF);
 
         // update max_idx and min_idx
@@ -1108,6 +2265,8 @@ swap_mem_block(infq_t *infq)
     }
 
     if (counter > 0) {
+        // the other pushers may be waiting for free blocks
+        pthread_cond_broadcast(&infq->push_cond);
         INFQ_DEBUG_LOG("[%s]successful to swap %d memory block between push and pop queue",
                 infq->name,
                 counter);
@@ -1123,11 +2282,11 @@ dump_job(void *arg)
     }
 
     struct dump_job_t   *job_info;
-    mem_block_t         *block;
+    mem_block_t         *block, *blocks[INFQ_MAX_IO_DEPTH];
     mem_queue_t         *queue;
 
     int64_t             min_sidx = INFQ_UNDEF, max_sidx = INFQ_UNDEF;
-    int32_t             idx, counter = 0;
+    int32_t             idx, next, stale, n, counter = 0;
 
     job_info = (struct dump_job_t *)arg;
     if (job_info->infq == NULL) {
@@ -1139,51 +2298,434 @@ dump_job(void *arg)
 
     idx = job_info->start_block;
     while (idx != job_info->end_block) {
+        // NOTICE: 'dump_mu' serializes the dumper and pushers spilling blocks. The
+        //      block isn't the first full block any more if it has been spilled by a
+        //      pusher or drained by consumers when the job is pending.
+        infq_pthread_mutex_lock(&job_info->infq->dump_mu);
+        infq_pthread_mutex_lock(&job_info->infq->push_mu);
+        stale = idx != queue->first_block || idx == queue->last_block;
         block = queue->blocks[idx];
+
+        // the following full blocks of the job are written together by the io engine
+        n = 1;
+        blocks[0] = block;
+        if (!stale && job_info->infq->dump_io != NULL) {
+            next = (idx + 1) % job_info->block_num;
+            while (n < job_info->infq->dump_io->depth && next != job_info->end_block
+                    && next != queue->last_block) {
+                blocks[n++] = queue->blocks[next];
+                next = (next + 1) % job_info->block_num;
+            }
+        }
+        infq_pthread_mutex_unlock(&job_info->infq->push_mu);
+        if (stale) {
+            infq_pthread_mutex_unlock(&job_info->infq->dump_mu);
+            // consumers may fail to pop from push queue while 'dump_mu' is held
+            notify_pop_waiters(job_info->infq);
+            idx = (idx + 1) % job_info->block_num;
+            continue;
+        }
+
         if (block == NULL) {
+            infq_pthread_mutex_unlock(&job_info->infq->dump_mu);
             INFQ_ERROR_LOG("[%s]mem block is NULL, block index: %d",
                     job_info->infq->name,
-                    job_info->start_block);
+                    idx);
+            return INFQ_ERR;
+        }
+
+        if (file_queue_dump_blocks(
+                    &job_info->infq->file_queue,
+                    blocks,
+                    n,
+                    job_info->infq->dump_io) == INFQ_ERR) {
+            infq_pthread_mutex_unlock(&job_info->infq->dump_mu);
+            INFQ_ERROR_LOG("[%s]failed to dump memory block in background, index: %lld, "
+                    "blocks: %d",
+                    job_info->infq->name,
+                    block->start_index,
+                    n);
             return INFQ_ERR;
         }
 
-        if (file_queue_dump_block(&job_info->infq->file_queue, block) == INFQ_ERR) {
-            INFQ_ERROR_LOG("[%s]failed to dump memory block in background, index: %lld",
-                    job_info->infq->name,
-                    block->start_index);
-            return INFQ_ERR;
-        }
+        if (min_sidx == INFQ_UNDEF) {
+            min_sidx = block->start_index;
+        }
+
+        block = blocks[n - 1];
+        if (max_sidx < block->start_index + block->ele_count) {
+            max_sidx = block->start_index + block->ele_count;
+        }
+
+        infq_pthread_mutex_lock(&job_info->infq->push_mu);
+        // NOTICE: first_block <= last_block
+        for (int32_t i = 0; i < n; i++) {
+            queue->first_block = (queue->first_block + 1) % queue->block_num;
+            queue->ele_count -= blocks[i]->ele_count;
+        }
+        queue->min_idx = first_block(queue)->start_index;
+        // return the dumped block to the shared pool when memory is tight
+        if (block_pool_over_budget()) {
+            mem_queue_release_free_blocks(queue);
+        }
+        // wake up the pushers waiting for free blocks
+        pthread_cond_broadcast(&job_info->infq->push_cond);
+        infq_pthread_mutex_unlock(&job_info->infq->push_mu);
+        infq_pthread_mutex_unlock(&job_info->infq->dump_mu);
+
+        // consumers may wait for the block being dumped
+        notify_pop_waiters(job_info->infq);
+
+        // NOTICE: group commit when it's due, no lock of infQ is held while syncing
+        if (file_queue_sync(&job_info->infq->file_queue, INFQ_FALSE) == INFQ_ERR) {
+            INFQ_ERROR_LOG("[%s]failed to commit the blocks dumped", job_info->infq->name);
+        }
+
+        counter += n;
+        idx = (idx + n) % job_info->block_num;
+
+        // NOTICE: consumers are starved when pop queue is empty and data is in file
+        //      queue, give up the I/O to the loader at block boundary. The job goes
+        //      on from the next block later.
+        if (idx != job_info->end_block && consumers_starved(job_info->infq)
+                && bg_exec_should_yield(&job_info->infq->dump_exec)) {
+            INFQ_DEBUG_LOG("[%s]dump job yields to loader, dumped: %d, next block: %d",
+                    job_info->infq->name,
+                    counter,
+                    idx);
+            job_info->start_block = idx;
+            return BG_JOB_YIELD;
+        }
+    }
+
+    // all the blocks of the job are stale
+    if (counter == 0) {
+        return INFQ_OK;
+    }
+
+    // NOTICE: the file queue may be drained by the loader, don't touch its head and tail
+    INFQ_INFO_LOG("[%s]succefully to dump %d blocks, next file block suffix: %d, "
+            "index range to dump: [%lld, %lld), file blocks: %d",
+            job_info->infq->name,
+            counter,
+            job_info->infq->file_queue.block_suffix,
+            min_sidx,
+            max_sidx,
+            job_info->infq->file_queue.block_num);
+
+    return INFQ_OK;
+}
+
+/**
+ * Check whether consumers are waiting for the loader, i.e. pop queue is empty
+ *      but data is in file queue.
+ */
+static int32_t
+consumers_starved(infq_t *infq)
+{
+    int32_t     popq_empty;
+
+    infq_pthread_mutex_lock(&infq->pop_mu);
+    popq_empty = mem_queue_empty(&infq->pop_queue);
+    infq_pthread_mutex_unlock(&infq->pop_mu);
+
+    return popq_empty && !file_queue_empty(&infq->file_queue);
+}
+
+/**
+ * Allocate 'tmp_mem_block' if it's released or moved to pop queue, and the last
+ *      block of pop queue which is swapped with it if it's released.
+ * The caller should hold 'load_mu'.
+ */
+static int32_t
+alloc_tmp_block(infq_t *infq)
+{
+    int32_t     ret;
+
+    infq_pthread_mutex_lock(&infq->pop_mu);
+    ret = mem_queue_alloc_block(&infq->pop_queue, infq->pop_queue.last_block);
+    infq_pthread_mutex_unlock(&infq->pop_mu);
+    if (ret == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to alloc last block of pop queue", infq->name);
+        return INFQ_ERR;
+    }
+
+    if (infq->tmp_mem_block != NULL) {
+        return INFQ_OK;
+    }
+
+    infq->tmp_mem_block = block_pool_get(infq->pop_queue.block_size);
+    if (infq->tmp_mem_block == NULL) {
+        INFQ_ERROR_LOG("[%s]failed to alloc temp mem block", infq->name);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+/**
+ * Take the head block of file queue to 'tmp_mem_block', by mapping the file if
+ *      'mmap_load' is enabled, otherwise by reading it.
+ * The caller should hold 'load_mu'.
+ */
+static int32_t
+load_head_block(infq_t *infq)
+{
+    if (alloc_tmp_block(infq) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+
+    if (infq->mmap_load) {
+        return file_queue_map_block(&infq->file_queue, &infq->tmp_mem_block);
+    }
+
+    return file_queue_load_block(&infq->file_queue, &infq->tmp_mem_block);
+}
+
+/**
+ * Number of blocks from 'head_blk' the loader reads together, limited by the depth
+ *      of the io engine, the free slots of pop queue and the end of the job. The
+ *      head block is the 'head_seq'th block of file queue.
+ * The caller should hold 'load_mu'.
+ */
+static int32_t
+blocks_to_load(infq_t *infq, file_block_t *head_blk, int32_t head_seq, int32_t end_seq)
+{
+    file_block_t    *blk;
+    int32_t         n = 1, max;
+
+    if (infq->load_io == NULL || infq->mmap_load || block_pool_over_budget()) {
+        return 1;
+    }
+
+    infq_pthread_mutex_lock(&infq->pop_mu);
+    max = mem_queue_free_block_num(&infq->pop_queue);
+    infq_pthread_mutex_unlock(&infq->pop_mu);
+    if (max > infq->load_io->depth) {
+        max = infq->load_io->depth;
+    }
+
+    infq_pthread_mutex_lock(&infq->file_queue.mu);
+    for (blk = head_blk->next; n < max && blk != NULL && head_seq + n < end_seq; blk = blk->next) {
+        n++;
+    }
+    infq_pthread_mutex_unlock(&infq->file_queue.mu);
+
+    return n;
+}
+
+/**
+ * Take 'n' blocks from the head of file queue by the io engine, 'blocks[0]' is
+ *      'tmp_mem_block' and the others are drawn from the pool.
+ * The caller should hold 'load_mu'.
+ */
+static int32_t
+load_head_blocks(infq_t *infq, mem_block_t **blocks, int32_t n)
+{
+    int32_t     i, ret;
+
+    if (n == 1) {
+        ret = load_head_block(infq);
+        blocks[0] = infq->tmp_mem_block;
+        return ret;
+    }
+
+    if (alloc_tmp_block(infq) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+    blocks[0] = infq->tmp_mem_block;
+    for (i = 1; i < n; i++) {
+        blocks[i] = block_pool_get(infq->pop_queue.block_size);
+        if (blocks[i] == NULL) {
+            INFQ_ERROR_LOG("[%s]failed to alloc mem block to load", infq->name);
+            break;
+        }
+    }
+
+    ret = i < n ? INFQ_ERR : file_queue_load_blocks(&infq->file_queue, blocks, n, infq->load_io);
+
+    // blocks may be resized for jumbo file blocks
+    infq->tmp_mem_block = blocks[0];
+    if (ret == INFQ_ERR) {
+        while (--i > 0) {
+            block_pool_put(blocks[i]);
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Append the block loaded to 'tmp_mem_block' to the tail of pop queue, and the
+ *      last block of pop queue becomes the new 'tmp_mem_block'.
+ * The caller should hold 'load_mu' and 'pop_mu'.
+ */
+static mem_block_t*
+append_loaded_block(infq_t *infq)
+{
+    mem_queue_t     *queue = &infq->pop_queue;
+    mem_block_t     *block, *tmp;
+
+    // swap the loaded file block with last block
+    tmp = last_block(queue);
+    last_block(queue) = infq->tmp_mem_block;
+    block = last_block(queue);
+
+    queue->last_block = (queue->last_block + 1) % queue->block_num;
+
+    // the empty block fills the new last slot if it isn't allocated,
+    //      otherwise it becomes the new 'tmp_mem_block'
+    if (last_block(queue) == NULL) {
+        last_block(queue) = tmp;
+        infq->tmp_mem_block = NULL;
+        queue->alloc_block_num++;
+    } else {
+        infq->tmp_mem_block = tmp;
+
+        // release the memory of a consumed jumbo block
+        if (tmp->mem_size > queue->block_size) {
+            mem_block_reset(tmp, INFQ_UNDEF);
+            tmp = block_pool_resize(tmp, queue->block_size);
+            if (tmp != NULL) {
+                infq->tmp_mem_block = tmp;
+            }
+        }
+    }
+    mem_block_reset(last_block(queue), INFQ_UNDEF);
+
+    if (queue->min_idx == INFQ_UNDEF) {
+        queue->min_idx = block->start_index;
+    }
+
+    if (queue->max_idx != INFQ_UNDEF) {
+        INFQ_ASSERT(block->start_index == queue->max_idx,
+                "[%s]max idx of pop queue not match, min: %lld, max: %lld, start idx of "
+                "blk: %lld, ele count of blk: %d",
+                infq->name,
+                queue->min_idx,
+                queue->max_idx,
+                block->start_index,
+                block->ele_count);
+    }
+    queue->max_idx = block->start_index + block->ele_count;
+    queue->ele_count += block->ele_count;
+
+    return block;
+}
+
+/**
+ * @brief Load the head block of file queue to pop queue on the caller thread. It's
+ *      used by consumers when 'inline_load' is enabled and the pop queue is empty,
+ *      so the latency of pop is bounded by one block read instead of the loader.
+ *      The load job in the loader skips the blocks loaded inline.
+ * @return INFQ_NO_RETURN if no block is loaded, e.g. the pop queue isn't empty or the
+ *      blocks are still being dumped.
+ */
+static int32_t
+load_block_inline(infq_t *infq)
+{
+    mem_block_t     *block;
+    file_block_t    *head_blk;
+    int32_t         popq_empty, suffix;
+
+    infq_pthread_mutex_lock(&infq->load_mu);
+
+    // the loader may have loaded a block while waiting for 'load_mu'
+    infq_pthread_mutex_lock(&infq->pop_mu);
+    popq_empty = mem_queue_empty(&infq->pop_queue);
+    infq_pthread_mutex_unlock(&infq->pop_mu);
+
+    infq_pthread_mutex_lock(&infq->file_queue.mu);
+    head_blk = infq->file_queue.block_head;
+    infq_pthread_mutex_unlock(&infq->file_queue.mu);
+
+    if (!popq_empty || head_blk == NULL) {
+        infq_pthread_mutex_unlock(&infq->load_mu);
+        return INFQ_NO_RETURN;
+    }
+    suffix = head_blk->suffix;
+
+    if (load_head_block(infq) == INFQ_ERR) {
+        infq_pthread_mutex_unlock(&infq->load_mu);
+        INFQ_ERROR_LOG("[%s]failed to load file block to memory inline, suffix: %d",
+                infq->name,
+                suffix);
+        return INFQ_ERR;
+    }
+
+    infq_pthread_mutex_lock(&infq->pop_mu);
+    block = append_loaded_block(infq);
+    INFQ_DEBUG_LOG("[%s]load block inline, suffix: %d, start index: %lld, blk count: %d, "
+            "f: %d, l: %d",
+            infq->name,
+            suffix,
+            block->start_index,
+            block->ele_count,
+            infq->pop_queue.first_block,
+            infq->pop_queue.last_block);
+    infq_pthread_mutex_unlock(&infq->pop_mu);
+    infq_pthread_mutex_unlock(&infq->load_mu);
+
+    notify_pop_waiters(infq);
 
-        infq_pthread_mutex_lock(&job_info->infq->push_mu);
-        // NOTICE: first_block <= last_block
-        queue->first_block = (queue->first_block + 1) % queue->block_num;
-        queue->min_idx = first_block(queue)->start_index;
-        queue->ele_count -= block->ele_count;
-        infq_pthread_mutex_unlock(&job_info->infq->push_mu);
+    return INFQ_OK;
+}
 
-        if (min_sidx == INFQ_UNDEF) {
-            min_sidx = block->start_index;
+/**
+ * Load the pop blocks adopted by 'async_load' which are still at the head of file
+ *      queue. Their files are removed when a newer dump is done, which has linked them
+ *      to its own pop blocks. They always fit in pop queue, since blocks are loaded in
+ *      order and pop queue is sized by the meta they're dumped with.
+ */
+static int32_t
+finish_restoring(infq_t *infq)
+{
+    file_block_t    *head_blk;
+    int32_t         full, loaded = 0, ret = INFQ_OK;
+
+    infq_pthread_mutex_lock(&infq->load_mu);
+    for (;;) {
+        infq_pthread_mutex_lock(&infq->file_queue.mu);
+        head_blk = infq->file_queue.block_head;
+        infq_pthread_mutex_unlock(&infq->file_queue.mu);
+        if (!restoring_block(head_blk)) {
+            break;
         }
 
-        if (max_sidx < block->start_index + block->ele_count) {
-            max_sidx = block->start_index + block->ele_count;
+        infq_pthread_mutex_lock(&infq->pop_mu);
+        full = mem_queue_full(&infq->pop_queue);
+        infq_pthread_mutex_unlock(&infq->pop_mu);
+        if (full) {
+            INFQ_ERROR_LOG("[%s]pop queue is full, pop block isn't loaded, suffix: %d",
+                    infq->name,
+                    head_blk->suffix);
+            ret = INFQ_ERR;
+            break;
         }
 
-        counter++;
-        idx = (idx + 1) % job_info->block_num;
+        if (load_head_block(infq) == INFQ_ERR) {
+            INFQ_ERROR_LOG("[%s]failed to load pop block, suffix: %d",
+                    infq->name,
+                    head_blk->suffix);
+            ret = INFQ_ERR;
+            break;
+        }
+
+        infq_pthread_mutex_lock(&infq->pop_mu);
+        append_loaded_block(infq);
+        infq_pthread_mutex_unlock(&infq->pop_mu);
+        loaded++;
     }
+    infq_pthread_mutex_unlock(&infq->load_mu);
 
-    INFQ_INFO_LOG("[%s]succefully to dump %d blocks, file block suffix: [%d, %d], "
-            "index range to dump: [%lld, %lld), file blocks: %d",
-            job_info->infq->name,
-            counter,
-            job_info->infq->file_queue.block_head->suffix,
-            job_info->infq->file_queue.block_tail->suffix,
-            min_sidx,
-            max_sidx,
-            job_info->infq->file_queue.block_num);
+    if (loaded > 0) {
+        notify_pop_waiters(infq);
+        INFQ_INFO_LOG("[%s]finish loading pop blocks of infq_load, blocks: %d",
+                infq->name,
+                loaded);
+    }
 
-    return INFQ_OK;
+    return ret;
 }
 
 int32_t
@@ -1195,13 +2737,15 @@ load_job(void *arg)
     }
 
     struct load_job_t   *job_info;
-    mem_block_t         *block;
+    mem_block_t         *block, *blocks[INFQ_MAX_IO_DEPTH];
     mem_queue_t         *queue;
     file_queue_t        *file_queue;
     file_block_t        *head_blk;
-    int32_t             i;
+    infq_t              *infq;
+    int32_t             i, n, blk_count, head_seq, loaded = 0;
+    long long           t;
 
-    int64_t             min_sidx = INFQ_UNDEF, max_sidx = INFQ_UNDEF;
+    int64_t             min_sidx = INFQ_UNDEF, max_sidx = INFQ_UNDEF, blk_start;
 
     job_info = (struct load_job_t *)arg;
     if (job_info->infq == NULL) {
@@ -1212,99 +2756,115 @@ load_job(void *arg)
     queue = &job_info->infq->pop_queue;
     file_queue = &job_info->infq->file_queue;
 
+    infq = job_info->infq;
     for (i = job_info->file_start_block; ; i++) {
-        infq_pthread_mutex_lock(&job_info->infq->pop_mu);
-        if (mem_queue_full(queue)) {
-            infq_pthread_mutex_unlock(&job_info->infq->pop_mu);
+        // NOTICE: 'load_mu' serializes the loader and consumers loading inline,
+        //      both of them use 'tmp_mem_block' and pop the head of file queue
+        infq_pthread_mutex_lock(&infq->load_mu);
+        infq_pthread_mutex_lock(&infq->pop_mu);
+        // only one block is loaded ahead when the memory budget is exceeded
+        if (mem_queue_full(queue) || (loaded > 0 && block_pool_over_budget())) {
+            infq_pthread_mutex_unlock(&infq->pop_mu);
+            infq_pthread_mutex_unlock(&infq->load_mu);
             break;
         }
-        infq_pthread_mutex_unlock(&job_info->infq->pop_mu);
+        infq_pthread_mutex_unlock(&infq->pop_mu);
 
+        // NOTICE: blocks of the job are counted by the sequence of file queue, the
+        //      suffixes of pop blocks restored asynchronously aren't in order
         infq_pthread_mutex_lock(&file_queue->mu);
         head_blk = file_queue->block_head;
+        head_seq = file_queue->head_seq;
         infq_pthread_mutex_unlock(&file_queue->mu);
-        if (head_blk == NULL || head_blk->suffix == job_info->file_end_block) {
+        if (head_blk == NULL || head_seq >= job_info->file_end_block) {
+            infq_pthread_mutex_unlock(&infq->load_mu);
             break;
         }
 
-        if (head_blk->suffix != i) {
+        if (head_seq < i) {
+            infq_pthread_mutex_unlock(&infq->load_mu);
             INFQ_ERROR_LOG("[%s]failed to load job. job and file queue isn't matched, "
-                    "job suffix: %d, queue suffix: %d",
-                    job_info->infq->name,
+                    "job block: %d, queue block: %d",
+                    infq->name,
                     i,
-                    file_queue->block_head->suffix);
+                    head_seq);
             return INFQ_ERR;
         }
 
-        // load file block to temporary memory block, then swap it with last block
-        if (file_queue_load_block(file_queue, job_info->infq->tmp_mem_block) == INFQ_ERR) {
-            INFQ_ERROR_LOG("[%s]failed to load file block to memory", job_info->infq->name);
-            return INFQ_ERR;
+        // the blocks before the head have been loaded by consumers inline
+        if (head_seq > i) {
+            INFQ_DEBUG_LOG("[%s]load job, skip blocks loaded inline, blocks: [%d, %d)",
+                    infq->name,
+                    i,
+                    head_seq);
+            i = head_seq;
         }
 
-        block = job_info->infq->tmp_mem_block;
-        INFQ_DEBUG_LOG("[%s]load job, block info, count: %d, start: %lld",
-                job_info->infq->name,
-                block->ele_count,
-                block->start_index);
-
-        infq_pthread_mutex_lock(&job_info->infq->pop_mu);
-        // swap the loaded file block with last block
-        block = last_block(queue);
-        last_block(queue) = job_info->infq->tmp_mem_block;
-        job_info->infq->tmp_mem_block = block;
-        block = last_block(queue);
-
-        queue->last_block = (queue->last_block + 1) % queue->block_num;
-        mem_block_reset(last_block(queue), INFQ_UNDEF);
-
-        if (queue->min_idx == INFQ_UNDEF) {
-            queue->min_idx = block->start_index;
+        // load file blocks to temporary memory blocks, then swap them with last block
+        n = blocks_to_load(infq, head_blk, head_seq, job_info->file_end_block);
+        t = time_us();
+        if (load_head_blocks(infq, blocks, n) == INFQ_ERR) {
+            infq_pthread_mutex_unlock(&infq->load_mu);
+            INFQ_ERROR_LOG("[%s]failed to load file block to memory", infq->name);
+            return INFQ_ERR;
         }
+        infq->load_us = infq_ewma(infq->load_us, (time_us() - t) / n);
 
-        if (queue->max_idx != INFQ_UNDEF) {
-            INFQ_ASSERT(block->start_index == queue->max_idx,
-                    "[%s]max idx of pop queue not match, min: %lld, max: %lld, start idx of "
-                    "blk: %lld, ele count of blk: %d",
-                    job_info->infq->name,
-                    queue->min_idx,
-                    queue->max_idx,
-                    block->start_index,
-                    block->ele_count);
+        INFQ_DEBUG_LOG("[%s]load job, block info, count: %d, start: %lld, blocks: %d",
+                infq->name,
+                blocks[0]->ele_count,
+                blocks[0]->start_index,
+                n);
+
+        infq_pthread_mutex_lock(&infq->pop_mu);
+        blk_count = 0;
+        for (int32_t k = 0; k < n; k++) {
+            // the empty block swapped out by the previous one goes back to the pool
+            if (k > 0) {
+                if (infq->tmp_mem_block != NULL) {
+                    block_pool_put(infq->tmp_mem_block);
+                }
+                infq->tmp_mem_block = blocks[k];
+            }
+            block = append_loaded_block(infq);
+            if (k == 0) {
+                blk_start = block->start_index;
+            }
+            blk_count += block->ele_count;
         }
-        queue->max_idx = block->start_index + block->ele_count;
-        queue->ele_count += block->ele_count;
+        infq_pthread_mutex_unlock(&infq->pop_mu);
+        infq_pthread_mutex_unlock(&infq->load_mu);
 
-        infq_pthread_mutex_unlock(&job_info->infq->pop_mu);
+        notify_pop_waiters(infq);
+        prefetch_blocks(infq);
+        loaded += n;
+        i += n - 1;
 
         if (min_sidx == INFQ_UNDEF) {
-            min_sidx = block->start_index;
+            min_sidx = blk_start;
         }
 
-        if (max_sidx == INFQ_UNDEF ||
-                max_sidx < block->start_index + block->ele_count) {
-            max_sidx = block->start_index + block->ele_count;
+        if (max_sidx == INFQ_UNDEF || max_sidx < blk_start + blk_count) {
+            max_sidx = blk_start + blk_count;
         }
 
         INFQ_DEBUG_LOG("[%s]load block, start index: %lld, blk count: %d, f: %d, l: %d, "
-                "count: %d, min: %lld, max: %lld, last count: %d, last start: %lld",
-                job_info->infq->name,
-                block->start_index,
-                block->ele_count,
+                "count: %d, min: %lld, max: %lld",
+                infq->name,
+                blk_start,
+                blk_count,
                 queue->first_block,
                 queue->last_block,
                 queue->ele_count,
                 queue->min_idx,
-                queue->max_idx,
-                last_block(queue)->ele_count,
-                last_block(queue)->start_index);
+                queue->max_idx);
     }
 
-    if (i > job_info->file_start_block) {
-        INFQ_INFO_LOG("[%s]successful to load %d file blocks, block suffix: [%d, %d), path: %s, "
+    if (loaded > 0) {
+        INFQ_INFO_LOG("[%s]successful to load %d file blocks, blocks: [%d, %d), path: %s, "
                 "idx range: [%lld, %lld), f: %d, l: %d, file blocks: %d",
                 job_info->infq->name,
-                i - job_info->file_start_block,
+                loaded,
                 job_info->file_start_block,
                 i,
                 job_info->infq->file_queue.file_path,
@@ -1318,6 +2878,77 @@ load_job(void *arg)
     return INFQ_OK;
 }
 
+/**
+ * @brief Measure how fast consumers drain the pop queue when a block of it is drained.
+ *      The caller should hold 'pop_mu'.
+ */
+static void
+track_consumption(infq_t *infq)
+{
+    long long   now = time_us();
+    int64_t     popped = infq->pop_queue.min_idx - infq->drained_idx;
+
+    if (infq->drained_at != INFQ_UNDEF && now > infq->drained_at && popped > 0) {
+        infq->drain_us = infq_ewma(infq->drain_us, now - infq->drained_at);
+        infq->consume_rate = infq_ewma(infq->consume_rate,
+                popped * 1000000 / (now - infq->drained_at));
+    }
+    infq->drained_at = now;
+    infq->drained_idx = infq->pop_queue.min_idx;
+}
+
+/**
+ * @brief Read the file blocks to be loaded next into the page cache ahead, so they're
+ *      loaded from memory once the pop queue has room for them instead of waiting for
+ *      the disk while the pop queue runs dry. The lead is the number of blocks drained
+ *      by consumers while the loader loads one, plus one for the block being drained.
+ *      It's called by the loader.
+ */
+static void
+prefetch_blocks(infq_t *infq)
+{
+    int32_t     lead = 1, head_seq;
+    int64_t     drain_us = infq->drain_us;
+
+    if (infq->max_prefetch == 0) {
+        return;
+    }
+
+    if (drain_us > 0) {
+        lead = (int32_t)((infq->load_us + drain_us - 1) / drain_us) + 1;
+    }
+    if (lead > infq->max_prefetch) {
+        lead = infq->max_prefetch;
+    }
+    infq->prefetch_lead = lead;
+
+    infq_pthread_mutex_lock(&infq->file_queue.mu);
+    head_seq = infq->file_queue.head_seq;
+    infq_pthread_mutex_unlock(&infq->file_queue.mu);
+
+    // the blocks advised already are skipped
+    if (infq->prefetch_seq < head_seq + lead) {
+        infq->prefetch_seq = file_queue_prefetch(&infq->file_queue,
+                infq->prefetch_seq > head_seq ? infq->prefetch_seq : head_seq,
+                head_seq + lead);
+    }
+}
+
+/**
+ * @brief Wake up the consumers blocked in 'infq_pop_wait'. It must not be called
+ *      with 'wait_mu' held.
+ */
+void
+notify_pop_waiters(infq_t *infq)
+{
+    infq_pthread_mutex_lock(&infq->wait_mu);
+    infq->pop_seq++;
+    if (infq->pop_waiters > 0) {
+        pthread_cond_broadcast(&infq->pop_cond);
+    }
+    infq_pthread_mutex_unlock(&infq->wait_mu);
+}
+
 /**
  * @brief When there are blocks in file queue and free blocks in pop queue,
  *      load jobs will be added to the job queue of loader.
@@ -1339,13 +2970,14 @@ check_and_trigger_loader(infq_t *infq)
         return INFQ_OK;
     }
 
+    // only prefetch one block when the memory budget is exceeded
+    if (block_pool_over_budget()) {
+        free_block_num = 1;
+    }
+
     // fetch file blocks to load
     infq_pthread_mutex_lock(&infq->file_queue.mu);
-    if (infq->file_queue.block_head == NULL) {
-        start_fblock = 0;
-    } else {
-        start_fblock = infq->file_queue.block_head->suffix;
-    }
+    start_fblock = infq->file_queue.head_seq;
     fblock_num = infq->file_queue.block_num;
     infq_pthread_mutex_unlock(&infq->file_queue.mu);
 
@@ -1369,24 +3001,29 @@ check_and_trigger_loader(infq_t *infq)
 
     if (bg_exec_distinct_job(&infq->load_exec, load_job_dup_checker, job_info, &job_dup) == INFQ_ERR) {
         INFQ_ERROR_LOG("[%s]failed to check dup for load job", infq->name);
+        free(job_info);
         return INFQ_ERR;
     }
 
-    if (job_dup == INFQ_FALSE) {
-        if (bg_exec_add_job(
-                    &infq->load_exec,
-                    load_job,
-                    job_info,
-                    job_info_destroy,
-                    load_job_tostr) == INFQ_ERR) {
-            INFQ_ERROR_LOG("[%s]failed to add job to background loader", infq->name);
-            return INFQ_ERR;
-        }
+    if (job_dup == INFQ_TRUE) {
+        free(job_info);
+        return INFQ_OK;
+    }
 
-        INFQ_DEBUG_LOG("[%s]add load job, blocks: [%d, %d)",
-                infq->name,
-                job_info->file_start_block,
-                job_info->file_end_block);
+    // NOTICE: the job may be done and freed by the loader once it's added
+    INFQ_DEBUG_LOG("[%s]add load job, blocks: [%d, %d)",
+            infq->name,
+            job_info->file_start_block,
+            job_info->file_end_block);
+    if (bg_exec_add_job(
+                &infq->load_exec,
+                load_job,
+                job_info,
+                job_info_destroy,
+                load_job_tostr) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to add job to background loader", infq->name);
+        free(job_info);
+        return INFQ_ERR;
     }
 
     return INFQ_OK;
@@ -1451,7 +3088,7 @@ dump_push_queue(infq_t *infq)
     idx = infq->push_queue.first_block;
     while (1) {
         block = infq->push_queue.blocks[idx];
-        if (!mem_block_empty(block)) {
+        if (block != NULL && !mem_block_empty(block)) {
             if (file_queue_dump_block(&infq->file_queue, block) == INFQ_ERR) {
                 INFQ_ERROR_LOG("[%s]failed to dump push mem block, idx: %d", infq->name, idx);
                 return INFQ_ERR;
@@ -1479,11 +3116,82 @@ dump_push_queue(infq_t *infq)
     return INFQ_OK;
 }
 
+/**
+ * Link the file to the pop block suffixed by 'blk_counter', the pop block file left
+ *      by an older dump is removed first.
+ */
+static int32_t
+link_to_pop_block(infq_t *infq, const char *path, int32_t blk_counter)
+{
+    char    pop_block_path[INFQ_MAX_BUF_SIZE];
+
+    if (gen_file_path(
+                infq->file_queue.file_path,
+                INFQ_POP_BLOCK_PREFIX,
+                blk_counter,
+                pop_block_path,
+                INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to generate pop block file path", infq->name);
+        return INFQ_ERR;
+    }
+    // check the pop block file path to see if it exists, remove it
+    // if it exists
+    if (access(pop_block_path, F_OK) != -1) {
+        INFQ_DEBUG_LOG("pop block file already exits, file path: %s", pop_block_path);
+        if (unlink(pop_block_path) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("[%s]failed to unlink file, file path: %s",
+                    infq->name,
+                    pop_block_path);
+            return INFQ_ERR;
+        }
+        INFQ_DEBUG_LOG("pop block file unlinked, file path: %s", pop_block_path);
+    }
+
+    if (link(path, pop_block_path) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("[%s]failed to link file %s to %s",
+                infq->name,
+                path,
+                pop_block_path);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+/**
+ * Link the pop block of the last load which isn't loaded yet to the pop block of
+ *      this dump, the file is shared instead of being read and dumped again.
+ */
+static int32_t
+link_pop_block(infq_t *infq, int32_t suffix, int32_t blk_counter)
+{
+    char    path[INFQ_MAX_BUF_SIZE];
+
+    if (gen_file_path(
+                infq->file_queue.file_path,
+                INFQ_POP_BLOCK_PREFIX,
+                suffix,
+                path,
+                INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to generate pop block file path", infq->name);
+        return INFQ_ERR;
+    }
+
+    if (link_to_pop_block(infq, path, blk_counter) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+    INFQ_INFO_LOG("[%s]infq persistent dump, pop queue, link pop block: %d, pop suffix: %d",
+            infq->name,
+            suffix,
+            blk_counter);
+
+    return INFQ_OK;
+}
+
 int32_t
 link_pop_block_to_file(infq_t *infq, mem_block_t *block, int32_t blk_counter)
 {
     char            file_block_path[INFQ_MAX_BUF_SIZE];
-    char            pop_block_path[INFQ_MAX_BUF_SIZE];
     unsigned char   file_sign[20], blk_sign[20];
 
     if (gen_file_path(
@@ -1515,33 +3223,7 @@ link_pop_block_to_file(infq_t *infq, mem_block_t *block, int32_t blk_counter)
         return INFQ_ERR;
     }
 
-    if (gen_file_path(
-                infq->file_queue.file_path,
-                INFQ_POP_BLOCK_PREFIX,
-                blk_counter,
-                pop_block_path,
-                INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
-        INFQ_ERROR_LOG("[%s]failed to generate pop block file path", infq->name);
-        return INFQ_ERR;
-    }
-    // check the pop block file path to see if it exists, remove it
-    // if it exists
-    if (access(pop_block_path, F_OK) != -1) {
-        INFQ_DEBUG_LOG("pop block file already exits, file path: %s", pop_block_path);
-        if (unlink(pop_block_path) == -1) {
-            INFQ_ERROR_LOG_BY_ERRNO("[%s]failed to unlink file, file path: %s",
-                    infq->name,
-                    pop_block_path);
-            return INFQ_ERR;
-        }
-        INFQ_DEBUG_LOG("pop block file unlinked, file path: %s", pop_block_path);
-    }
-
-    if (link(file_block_path, pop_block_path) == -1) {
-        INFQ_ERROR_LOG_BY_ERRNO("[%s]failed to link file %s to %s",
-                infq->name,
-                file_block_path,
-                pop_block_path);
+    if (link_to_pop_block(infq, file_block_path, blk_counter) == INFQ_ERR) {
         return INFQ_ERR;
     }
     INFQ_INFO_LOG("[%s]infq persistent dump, pop queue, link file block: %d, "
@@ -1565,7 +3247,8 @@ dump_pop_queue_if_need(infq_t *infq, popq_dump_meta_t *meta)
 
     int32_t         idx, blk_counter;
     mem_block_t     *block;
-    file_block_t    fblock;
+    file_block_t    fblock, *fblock_ptr;
+    char            pop_block_path[INFQ_MAX_BUF_SIZE];
 
     idx = infq->pop_queue.first_block;
     blk_counter = infq->pop_block_suffix;
@@ -1585,7 +3268,8 @@ dump_pop_queue_if_need(infq_t *infq, popq_dump_meta_t *meta)
         // check the mem block to see if it's loaded from file queue, link
         // the file block file to pop block file instead of dumping the mem
         // block again
-        if (block->file_block_no != INFQ_UNDEF) {
+        // a block in segment can't be linked, it's dumped again
+        if (block->file_block_no != INFQ_UNDEF && infq->file_queue.segment_blocks == 0) {
             if (link_pop_block_to_file(infq, block, blk_counter) == INFQ_OK) {
                 blk_counter++;
                 idx = (idx + 1) % infq->pop_queue.block_num;
@@ -1606,8 +3290,27 @@ dump_pop_queue_if_need(infq_t *infq, popq_dump_meta_t *meta)
             return INFQ_ERR;
         }
 
+        fblock.codec = infq->file_queue.codec;
+        if (infq->file_queue.recycle_num > 0
+                && gen_file_path(
+                    infq->file_queue.file_path,
+                    INFQ_POP_BLOCK_PREFIX,
+                    blk_counter,
+                    pop_block_path,
+                    INFQ_MAX_BUF_SIZE) == INFQ_OK) {
+            file_queue_reuse_file(&infq->file_queue, pop_block_path);
+        }
+
         if (file_block_write(&fblock, blk_counter, block) == INFQ_ERR) {
             INFQ_ERROR_LOG("[%s]failed to write file block", infq->name);
+            file_block_destroy(&fblock);
+            return INFQ_ERR;
+        }
+
+        // NOTICE: the pop block is committed together with the file queue
+        if (file_queue_sync_block(&infq->file_queue, &fblock) == INFQ_ERR) {
+            INFQ_ERROR_LOG("[%s]failed to sync pop block, suffix: %d", infq->name, blk_counter);
+            file_block_destroy(&fblock);
             return INFQ_ERR;
         }
 
@@ -1623,6 +3326,19 @@ dump_pop_queue_if_need(infq_t *infq, popq_dump_meta_t *meta)
         idx = (idx + 1) % infq->pop_queue.block_num;
     }
 
+    // 3. the pop blocks of the last load which aren't loaded by 'async_load' yet, they
+    //      follow the pop queue and their files are linked
+    for (fblock_ptr = infq->file_queue.block_head; restoring_block(fblock_ptr);
+            fblock_ptr = fblock_ptr->next) {
+        if (link_pop_block(infq, fblock_ptr->suffix, blk_counter) == INFQ_ERR) {
+            INFQ_ERROR_LOG("[%s]failed to link pop block not loaded, suffix: %d",
+                    infq->name,
+                    fblock_ptr->suffix);
+            return INFQ_ERR;
+        }
+        blk_counter++;
+    }
+
     meta->file_range.start = infq->pop_block_suffix;
     meta->file_range.end = blk_counter;
 
@@ -1637,28 +3353,77 @@ load_file_queue(infq_t *infq, infq_dump_meta_t *meta)
         return INFQ_ERR;
     }
 
+    int32_t     segment_blocks = infq->file_queue.segment_blocks;
+    int64_t     segment_prealloc = infq->file_queue.segment_prealloc;
+    int32_t     recycle_max = infq->file_queue.recycle_max;
+    int32_t     durability = infq->file_queue.durability;
+    int32_t     sync_blocks = infq->file_queue.sync_blocks;
+    int64_t     sync_interval_us = infq->file_queue.sync_interval_us;
+    int32_t     codec = infq->file_queue.codec;
+    int32_t     cache_pages = infq->file_queue.page_cache.capacity;
+    int32_t     block_num = meta->file_meta.block_num;
+    int32_t     ele_count = meta->file_meta.ele_count;
+
+    // NOTICE: the pending unlink jobs refer to the file queue, finish them before
+    //      it's reinited
+    if (bg_exec_drain(&infq->unlink_exec) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to finish unlink jobs in infq_load", infq->name);
+        return INFQ_ERR;
+    }
+
     file_queue_destroy(&infq->file_queue);
     if (file_queue_init(&infq->file_queue, meta->file_path) == INFQ_ERR) {
         INFQ_ERROR_LOG("[%s]failed to init file queue in infq_load", infq->name);
         return INFQ_ERR;
     }
-    for (int i = meta->file_meta.file_range.start;
-            i < meta->file_meta.file_range.end; i++) {
-        if (file_queue_add_block_by_file(&infq->file_queue, i) == INFQ_ERR) {
-            INFQ_ERROR_LOG("[%s]failed to add block by file", infq->name);
-            return INFQ_ERR;
+    file_queue_set_segment(&infq->file_queue, segment_blocks, segment_prealloc);
+    if (file_queue_set_recycle(&infq->file_queue, recycle_max) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to set recycled files in infq_load", infq->name);
+        return INFQ_ERR;
+    }
+    file_queue_set_durability(&infq->file_queue, durability, sync_blocks,
+            (int32_t)(sync_interval_us / 1000));
+    file_queue_set_codec(&infq->file_queue, codec);
+    if (file_queue_set_page_cache(&infq->file_queue, cache_pages) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to set page cache in infq_load", infq->name);
+        return INFQ_ERR;
+    }
+    infq->prefetch_seq = 0;
+
+    // NOTICE: the pop blocks are adopted ahead of the blocks of file queue, so they're
+    //      streamed to pop queue by the loader first, see 'load_pop_queue'
+    if (infq->async_load) {
+        for (int32_t i = meta->popq_meta.file_range.start; i < meta->popq_meta.file_range.end; i++) {
+            if (file_queue_adopt_block(&infq->file_queue, INFQ_POP_BLOCK_PREFIX, i) == INFQ_ERR) {
+                INFQ_ERROR_LOG("[%s]failed to adopt pop block in infq_load, suffix: %d",
+                        infq->name,
+                        i);
+                return INFQ_ERR;
+            }
         }
+        block_num += meta->popq_meta.file_range.end - meta->popq_meta.file_range.start;
+        ele_count += meta->popq_meta.ele_count;
+    }
+
+    // the headers of blocks are loaded lazily when they're popped or accessed
+    if (file_queue_restore_blocks(
+                &infq->file_queue,
+                meta->file_meta.file_range.start,
+                meta->file_meta.file_range.end) == INFQ_ERR) {
+        INFQ_ERROR_LOG("[%s]failed to restore blocks of file queue", infq->name);
+        return INFQ_ERR;
     }
+    file_queue_pin_manifest(&infq->file_queue, meta->file_meta.file_range.start);
 
-    INFQ_ASSERT(infq->file_queue.block_num == meta->file_meta.block_num,
+    INFQ_ASSERT(infq->file_queue.block_num == block_num,
             "[%s]load err, block count not matched, meta: %d, load: %d,",
             infq->name,
-            meta->file_meta.block_num,
+            block_num,
             infq->file_queue.block_num);
-    INFQ_ASSERT(infq->file_queue.ele_count == meta->file_meta.ele_count,
+    INFQ_ASSERT(infq->file_queue.ele_count == ele_count,
             "[%s]load err, element count not matched, meta: %d, load: %d",
             infq->name,
-            meta->file_meta.ele_count,
+            ele_count,
             infq->file_queue.ele_count);
     infq->file_queue.block_suffix = meta->file_meta.file_range.end == INFQ_UNDEF ? 0 :
             meta->file_meta.file_range.end;
@@ -1693,6 +3458,15 @@ load_pop_queue(infq_t *infq, infq_dump_meta_t *meta)
     }
     mem_queue_add_pop_blk_cb(&infq->pop_queue, empty_block_pop_callback, infq);
 
+    // the pop blocks have been adopted by file queue, pop queue is filled by the loader.
+    //      The range of pop queue starts at them, so 'infq_at' finds them in file queue
+    if (infq->async_load) {
+        if (meta->popq_meta.ele_count > 0) {
+            infq->pop_queue.min_idx = infq->pop_queue.max_idx = meta->popq_meta.min_idx;
+        }
+        return INFQ_OK;
+    }
+
     min_idx = max_idx = INFQ_UNDEF;
     for (int i = meta->popq_meta.file_range.start;
             i < meta->popq_meta.file_range.end; i++) {
@@ -1706,12 +3480,17 @@ load_pop_queue(infq_t *infq, infq_dump_meta_t *meta)
             INFQ_ERROR_LOG("[%s]pop queue is full, no enough blocks", infq->name);
             return INFQ_ERR;
         }
-        mblock = last_block(&infq->pop_queue);
-
-        if (file_block_load(&fblock, mblock) == INFQ_ERR) {
+        if (mem_queue_alloc_block(&infq->pop_queue, infq->pop_queue.last_block) == INFQ_ERR) {
+            INFQ_ERROR_LOG("[%s]failed to alloc block of pop queue, suffix: %d", infq->name, i);
+            file_block_destroy(&fblock);
+            return INFQ_ERR;
+        }
+        if (file_block_load(&fblock, &last_block(&infq->pop_queue)) == INFQ_ERR) {
             INFQ_ERROR_LOG("[%s]failed load file in load infq, suffix: %d", infq->name, i);
+            file_block_destroy(&fblock);
             return INFQ_ERR;
         }
+        mblock = last_block(&infq->pop_queue);
 
         int32_t e = mblock->start_index + mblock->ele_count;
         if (max_idx == INFQ_UNDEF || max_idx < e) {
@@ -1723,6 +3502,11 @@ load_pop_queue(infq_t *infq, infq_dump_meta_t *meta)
 
         infq->pop_queue.ele_count += mblock->ele_count;
         infq->pop_queue.last_block = (infq->pop_queue.last_block + 1) % infq->pop_queue.block_num;
+        if (mem_queue_alloc_block(&infq->pop_queue, infq->pop_queue.last_block) == INFQ_ERR) {
+            INFQ_ERROR_LOG("[%s]failed to alloc block of pop queue", infq->name);
+            file_block_destroy(&fblock);
+            return INFQ_ERR;
+        }
 
         // free the memory of the offset array belongs to file block
         file_block_destroy(&fblock);
@@ -1792,24 +3576,41 @@ infq_fetch_stats(infq_t *infq, infq_stats_t *stats)
 
     stats->mem_size = infq_msize(infq);
     stats->file_size = infq_fsize(infq);
-    stats->mem_block_size = first_block(&infq->push_queue)->mem_size;
+    stats->mem_block_size = infq->push_queue.block_size;
     stats->pushq_blocks_num = infq->push_queue.block_num;
     stats->popq_blocks_num = infq->pop_queue.block_num;
     stats->pushq_used_blocks = mem_queue_full_block_num(&infq->push_queue);
-    if (!mem_block_empty(last_block(&infq->push_queue))) {
+    if (last_block(&infq->push_queue) != NULL
+            && !mem_block_empty(last_block(&infq->push_queue))) {
         stats->pushq_used_blocks++;
     }
     stats->popq_used_blocks = mem_queue_full_block_num(&infq->pop_queue);
-    if (!mem_block_empty(last_block(&infq->pop_queue))) {
+    if (last_block(&infq->pop_queue) != NULL
+            && !mem_block_empty(last_block(&infq->pop_queue))) {
         stats->popq_used_blocks++;
     }
     stats->fileq_blocks_num = infq->file_queue.block_num;
+    stats->at_cache_hits = infq->file_queue.page_cache.hits;
+    stats->at_cache_misses = infq->file_queue.page_cache.misses;
+    stats->prefetch_lead = infq->prefetch_lead;
+    stats->consume_rate = infq->consume_rate;
+    stats->block_drain_us = infq->drain_us;
+    stats->block_load_us = infq->load_us;
     stats->dumper.job_num = bg_exec_pending_task_num(&infq->dump_exec);
     stats->loader.job_num = bg_exec_pending_task_num(&infq->load_exec);
     stats->unlinker.job_num = bg_exec_pending_task_num(&infq->unlink_exec);
     stats->dumper.is_suspended = infq->dump_exec.suspended;
     stats->loader.is_suspended = infq->load_exec.suspended;
     stats->unlinker.is_suspended = infq->unlink_exec.suspended;
+    stats->dumper.priority = infq->dump_exec.priority;
+    stats->loader.priority = infq->load_exec.priority;
+    stats->unlinker.priority = infq->unlink_exec.priority;
+    stats->dumper.class_depth = bg_exec_ready_num(&infq->dump_exec);
+    stats->loader.class_depth = bg_exec_ready_num(&infq->load_exec);
+    stats->unlinker.class_depth = bg_exec_ready_num(&infq->unlink_exec);
+    stats->dumper.yield_count = infq->dump_exec.yield_count;
+    stats->loader.yield_count = infq->load_exec.yield_count;
+    stats->unlinker.yield_count = infq->unlink_exec.yield_count;
 
     return INFQ_OK;
 }
@@ -2051,6 +3852,8 @@ empty_block_pop_callback(void *arg, mem_block_t *blk)
     /*    }*/
     /*}*/
 
+    track_consumption(infq);
+
     // check to see if add a loader job
     if (check_and_trigger_loader(infq) == INFQ_ERR) {
         INFQ_ERROR_LOG("[%s]failed to check and trigger load task", infq->name);
@@ -2072,13 +3875,22 @@ full_block_push_callback(void *arg)
     int32_t             full_block_num, block_num, job_dup;
 
     // try to swap mem block with pop queue
-    if (file_queue_empty(&infq->file_queue) && !mem_queue_full(&infq->pop_queue)
+    // NOTICE: when the memory budget of blocks is exceeded, dump instead to free memory.
+    //      File queue must be checked after the dumper is found idle, otherwise a dump
+    //      finished in between is missed. 'load_mu' makes sure that no block is taken
+    //      from file queue but not appended to pop queue yet.
+    if (!block_pool_over_budget()
                 && bg_exec_pending_task_num(&infq->dump_exec) == 0
-                && bg_exec_pending_task_num(&infq->load_exec) == 0) {
-        infq_pthread_mutex_lock(&infq->pop_mu);
-        swap_mem_block(infq);
-        infq_pthread_mutex_unlock(&infq->pop_mu);
-        return INFQ_OK;
+                && bg_exec_pending_task_num(&infq->load_exec) == 0
+                && pthread_mutex_trylock(&infq->load_mu) == 0) {
+        if (file_queue_empty(&infq->file_queue) && !mem_queue_full(&infq->pop_queue)) {
+            infq_pthread_mutex_lock(&infq->pop_mu);
+            swap_mem_block(infq);
+            infq_pthread_mutex_unlock(&infq->pop_mu);
+            pthread_mutex_unlock(&infq->load_mu);
+            return INFQ_OK;
+        }
+        pthread_mutex_unlock(&infq->load_mu);
     }
 
     // add full block to background dumper
@@ -2088,7 +3900,7 @@ full_block_push_callback(void *arg)
     //      1) 当文件队列非空时，保证持久化时尽量少做IO操作，最多只会dump一个内存块
     //      2) 文件队列为空时，push queue的使用率达到阈值。在小于阈值前，会swap到
     //          pop queue，尽量走内存
-    if (!file_queue_empty(&infq->file_queue) ||
+    if (!file_queue_empty(&infq->file_queue) || block_pool_over_budget() ||
             full_block_num >= infq->push_queue.block_num * infq->block_usage_to_dump) {
         job_info = (struct dump_job_t *)malloc(sizeof(struct dump_job_t));
         if (job_info == NULL) {
@@ -2110,6 +3922,15 @@ full_block_push_callback(void *arg)
             return INFQ_ERR;
         }
         if (job_dup == INFQ_FALSE) {
+            // NOTICE: the job may be done and freed by the dumper once it's added
+            INFQ_DEBUG_LOG("[%s]add dump job in background, block num: %d, "
+                    "block index: [%d, %d), element index: [%lld, %lld)",
+                    infq->name,
+                    block_num,
+                    job_info->start_block,
+                    job_info->end_block,
+                    first_block(&infq->push_queue)->start_index,
+                    last_block(&infq->push_queue)->start_index);
             if (bg_exec_add_job(
                         &infq->dump_exec,
                         dump_job,
@@ -2119,20 +3940,13 @@ full_block_push_callback(void *arg)
                 INFQ_ERROR_LOG("[%s]failed to add dump job to bg executor", infq->name);
                 return INFQ_ERR;
             }
-            INFQ_DEBUG_LOG("[%s]add dump job in background, block num: %d, "
-                    "block index: [%lld, %lld), element index: [%lld, %lld)",
-                    infq->name,
-                    block_num,
-                    job_info->start_block,
-                    job_info->end_block,
-                    first_block(&infq->push_queue)->start_index,
-                    last_block(&infq->push_queue)->start_index);
         } else {
             INFQ_DEBUG_LOG("[%s]dup job, [%d, %d], block num: %d",
                     infq->name,
                     job_info->start_block,
                     job_info->end_block,
                     block_num);
+            free(job_info);
         }
     }
 
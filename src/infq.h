@@ -9,6 +9,7 @@
 #define COM_MOMO_INFQ_INFQ_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "logging.h"
 
@@ -26,7 +27,25 @@
 #define INFQ_LOAD_BG_EXEC       2
 #define INFQ_UNLINK_BG_EXEC     3
 
+/* Policies when pushing to a full push queue */
+#define INFQ_OVERFLOW_FAIL      0   /* Fail immediately */
+#define INFQ_OVERFLOW_BLOCK     1   /* Wait until 'Dumper' frees a block */
+#define INFQ_OVERFLOW_SPILL     2   /* Dump the oldest full block on the caller thread */
+
+/* Durability of the blocks dumped to files */
+#define INFQ_DURABILITY_NONE    0   /* Left to the page cache of OS */
+#define INFQ_DURABILITY_BLOCK   1   /* Each block is synced before it's in file queue */
+#define INFQ_DURABILITY_GROUP   2   /* Blocks are synced together by group commit */
+
+/* Codecs compressing the data of file blocks, see codec.h */
+#define INFQ_CODEC_NONE         0
+#define INFQ_CODEC_LZ           1   /* Built-in fast LZ77 */
+#define INFQ_CODEC_LZ4          2   /* Available if lz4 is found at build time */
+#define INFQ_CODEC_ZSTD         3   /* Available if zstd is found at build time */
+#define INFQ_CODEC_USER         16  /* The first id of the codecs registered by users */
+
 typedef struct _infq_t infq_t;
+typedef struct _infq_codec_t infq_codec_t;
 
 typedef struct _infq_config_t {
     const char  *data_path;             /* File path to store files of InfQ */
@@ -36,6 +55,51 @@ typedef struct _infq_config_t {
     float       block_usage_to_dump;    /* When the percentage of used memory blocks in push queue
                                            is greater than this value, 'Dumper' will try to dump the
                                            blocks in push queue */
+    int32_t     inline_load;            /* When the pop queue is empty and data is in file queue,
+                                           consumer loads the head file block by itself instead of
+                                           waiting for 'Loader'. Disabled by default */
+    int32_t     overflow_policy;        /* What to do when the push queue is full, INFQ_OVERFLOW_* */
+    int32_t     overflow_wait_us;       /* The longest time a push waits for free blocks when the
+                                           push queue is full, negative means to wait forever */
+    int32_t     idle_release_ms;        /* Memory blocks are allocated on demand. The unused blocks
+                                           are freed by 'infq_release_idle_blocks' after the infQ is
+                                           drained for such a long time, 0 disables it */
+    int32_t     mmap_load;              /* File blocks are mapped read-only into pop queue instead of
+                                           being read into memory blocks, consumers are served from
+                                           the page cache without copying. Disabled by default */
+    int32_t     io_depth;               /* Number of blocks in flight when 'Dumper' and 'Loader'
+                                           write and read through io_uring. <= 1 or io_uring isn't
+                                           available means synchronous IO, one block at a time */
+    int32_t     segment_blocks;         /* Number of file blocks appended to one segment file
+                                           'segment_<N>', which is removed as a whole after all its
+                                           blocks are consumed. 0 means a file per block */
+    int32_t     recycle_files;          /* Max number of consumed block files kept and renamed for the
+                                           blocks dumped later, which are overwritten instead of being
+                                           created and truncated. 0 means to remove them. It doesn't
+                                           work with 'mmap_load' and 'segment_blocks' */
+    int32_t     durability;             /* How the blocks dumped are synced to disk, INFQ_DURABILITY_*.
+                                           'infq_dump' syncs all the blocks it refers to unless it's
+                                           INFQ_DURABILITY_NONE, the default */
+    int32_t     sync_interval_ms;       /* Under group commit, the blocks dumped are synced together
+                                           when the first of them is dumped so long ago, */
+    int32_t     sync_blocks;            /*      or so many blocks are dumped. Both 0 means to commit
+                                           after each batch of the 'Dumper'. Call 'infq_sync' to
+                                           commit when no more blocks are dumped */
+    int32_t     compression;            /* Codec compressing the data of file blocks, INFQ_CODEC_*.
+                                           The data is compressed by chunks, so random access reads
+                                           only decompress the chunks needed. Blocks are decoded by
+                                           the codec recorded in them. 0 disables it, the default */
+    int32_t     async_load;             /* 'infq_load' returns after the meta is applied, the blocks of
+                                           the dumped pop queue are streamed in by 'Loader' while pushes
+                                           are accepted. Pops wait, or load inline, until the head block
+                                           is read. Disabled by default */
+    int32_t     at_cache_pages;         /* Number of pages of file blocks cached for 'infq_at', so the
+                                           repeated and neighbouring random accesses into the spilled
+                                           part are served from memory. A page is 4KB, 0 disables it */
+    int32_t     max_prefetch_blocks;    /* Max number of file blocks read ahead by 'Loader' before the pop
+                                           queue has room for them. The blocks read ahead follow how fast
+                                           elements are popped against how long a block takes to load,
+                                           at most 32. 0 disables it. Ignored under direct IO */
 } infq_config_t;
 
 typedef struct _file_suffix_range {
@@ -77,6 +141,10 @@ typedef struct _infq_dump_meta_t {
 typedef struct _infq_bg_exec_stats_t {
     int32_t     is_suspended;
     int32_t     job_num;
+    int32_t     priority;       /* 0 is the highest, loader > dumper > unlinker */
+    int32_t     class_depth;    /* Executors of the same priority of all infQs waiting for
+                                   the shared pool, 0 without 'infq_config_bg_pool' */
+    int32_t     yield_count;    /* Times the jobs gave way to executors of higher priority */
 } infq_bg_exec_stats_t;
 
 typedef struct _infq_stats_t {
@@ -88,6 +156,12 @@ typedef struct _infq_stats_t {
     int32_t                 popq_blocks_num;
     int32_t                 popq_used_blocks;
     int32_t                 fileq_blocks_num;
+    int64_t                 at_cache_hits;
+    int64_t                 at_cache_misses;
+    int32_t                 prefetch_lead;      /* Number of file blocks read ahead */
+    int64_t                 consume_rate;       /* Elements popped per second */
+    int64_t                 block_drain_us;     /* Time to drain a block of pop queue */
+    int64_t                 block_load_us;      /* Time to load a file block */
     infq_bg_exec_stats_t    dumper;
     infq_bg_exec_stats_t    loader;
     infq_bg_exec_stats_t    unlinker;
@@ -99,14 +173,156 @@ extern char *INFQ_POP_BLOCK_PREFIX;
 
 infq_t* infq_init(const char *data_path, const char *name);
 infq_t* infq_init_by_conf(const infq_config_t *conf, const char *name);
+
+/**
+ * @brief Push an element. When the push queue is full, it fails, waits or spills a
+ *      block to file according to the overflow policy in config.
+ */
 int32_t infq_push(infq_t *infq, void *data, int32_t size);
+
+/**
+ * @brief Push a batch of elements while holding the lock of push queue once.
+ * @param elems: elements to push, each iovec is an element.
+ * @param n: number of elements.
+ * @param pushed: number of elements pushed. When the push queue becomes full in
+ *      the middle of the batch and the overflow policy can't make room for the rest,
+ *      INFQ_OK is returned and 'pushed' is less than 'n'.
+ *      INFQ_ERR is returned if no element can be pushed.
+ */
+int32_t infq_push_batch(infq_t *infq, const struct iovec *elems, int32_t n, int32_t *pushed);
+
+/**
+ * @brief Reserve space in push queue for an element, so the producer can serialize
+ *      it directly into queue memory instead of copying from its own buffer.
+ * @param size: the max size of the element.
+ * @param dst: output, the memory to write the element to.
+ *
+ * NOTICE: the lock of push queue is held until 'infq_push_commit' or 'infq_push_abort'
+ *      is called by the same thread, so don't call other push functions between them.
+ *      A commit or abort from another thread fails without touching the reservation.
+ */
+int32_t infq_push_reserve(infq_t *infq, int32_t size, void **dst);
+
+/**
+ * @brief Push the element written to the reserved memory.
+ * @param actual_size: the actual size of the element, not greater than the reserved size.
+ *      INFQ_ERR is returned for an invalid size and the reservation is kept.
+ */
+int32_t infq_push_commit(infq_t *infq, int32_t actual_size);
+
+/**
+ * @brief Give up the reservation, nothing is pushed.
+ */
+int32_t infq_push_abort(infq_t *infq);
+
+/**
+ * @brief Push an element gathered from several parts, e.g. a header and a payload.
+ */
+int32_t infq_pushv(infq_t *infq, const struct iovec *iov, int32_t iovcnt);
 int32_t infq_pop(infq_t *infq, void *buf, int32_t buf_size, int32_t *sizeptr);
+
+/**
+ * @brief Pop an element, wait until an element can be popped or timeout. Data in
+ *      file queue doesn't lead to an error, the caller is woken up as soon as the
+ *      loader swaps a block into pop queue or an element is pushed to the empty
+ *      push queue.
+ * @param timeout_us: timeout in microseconds, 0 means not to wait and a negative
+ *      value means to wait forever.
+ * @param sizeptr: size of the element, 0 means timeout.
+ */
+int32_t infq_pop_wait(infq_t *infq, void *buf, int32_t buf_size, int32_t *sizeptr,
+        int64_t timeout_us);
 int32_t infq_at(infq_t *infq, int64_t idx, void *buf, int32_t buf_size, int32_t *sizeptr);
 int32_t infq_top(infq_t *infq, void *buf, int32_t buf_size, int32_t *sizeptr);
 int32_t infq_just_pop(infq_t *infq);
 int32_t infq_size(infq_t *infq);
 int32_t infq_msize(infq_t *infq);
 int32_t infq_fsize(infq_t *infq);
+
+/**
+ * @brief Set the memory budget in bytes of the blocks of all infQs in the process,
+ *      0 means no limit. Blocks are drawn from and returned to a shared pool. When
+ *      the budget is exceeded, infQs dump full blocks to file instead of keeping
+ *      them in memory, and release unused blocks at once.
+ *      The budget is soft, a push never fails because of it.
+ */
+void infq_config_mem_budget(int64_t budget);
+
+/**
+ * @brief Set the max bytes of one read or write syscall when dumping and loading
+ *      file blocks of all infQs in the process. 0 by default, a whole block is
+ *      transferred by one vectored syscall.
+ */
+void infq_config_io_unit(int32_t io_unit);
+
+/**
+ * @brief Dump and load file blocks of all infQs in the process by O_DIRECT, so the
+ *      spilled data doesn't pollute the page cache. Disabled by default. Falls back
+ *      to the buffered IO plus dropping the cached pages if the file system doesn't
+ *      support O_DIRECT, and for the blocks transferred by the io engine.
+ */
+void infq_config_direct_io(int32_t enable);
+
+/**
+ * @brief Verify the CRC32C checksums of file blocks of all infQs in the process when
+ *      they're loaded, by the loader thread unless 'inline_load' is set. A corrupted
+ *      block fails to load. Disabled by default, checksums are always written.
+ */
+void infq_config_verify_checksum(int32_t enable);
+
+/**
+ * @brief Limit the files kept open by file blocks of all infQs in the process, the
+ *      least recently used ones are closed and opened again when accessed. 1024 by
+ *      default, 0 means unlimited. The files being transferred and the segments
+ *      aren't limited.
+ */
+void infq_config_max_open_files(int32_t max_files);
+
+/**
+ * @brief Register a codec for the 'compression' of config, the id of the codec should
+ *      be in [INFQ_CODEC_USER, INFQ_MAX_CODECS). It should be called before any infQ
+ *      is initialized or loaded, see codec.h.
+ */
+int32_t infq_config_codec(const infq_codec_t *codec);
+
+/**
+ * @brief Bytes of memory blocks allocated by all infQs in the process.
+ */
+int64_t infq_mem_used(void);
+
+/**
+ * @brief Run the background jobs(dump, load and unlink) of all infQs initialized
+ *      afterwards on a shared pool of 'thread_num' worker threads, instead of three
+ *      threads for each infQ. Jobs of an infQ are still executed in order, and the
+ *      workers serve infQs in round robin. 0 keeps the per-instance threads.
+ *      It should be called once before any infQ is initialized.
+ */
+int32_t infq_config_bg_pool(int32_t thread_num);
+
+/**
+ * @brief Stop the workers of the shared pool. All infQs using it must have been
+ *      destroyed before.
+ */
+int32_t infq_destroy_bg_pool(void);
+
+/**
+ * @brief Free the memory blocks that aren't in use when the infQ has been drained
+ *      for 'idle_release_ms', or at once when the memory budget is exceeded. It's cheap
+ *      and should be called periodically, such as in the cron of redis. Blocks are
+ *      allocated again when elements come.
+ *
+ * NOTICE: the pointers returned by zero copy pops are invalid after the blocks
+ *      are released.
+ */
+int32_t infq_release_idle_blocks(infq_t *infq);
+
+/**
+ * @brief Group commit the blocks dumped if it's due by 'sync_interval_ms' or 'sync_blocks'.
+ *      'Dumper' checks it only when it dumps blocks, so the blocks dumped last may stay
+ *      unsynced until more blocks come. It should be called periodically, such as in
+ *      the cron of redis. It's a no-op unless the durability is group commit.
+ */
+int32_t infq_sync(infq_t *infq);
 void infq_destroy(infq_t *infq);
 
 /**
@@ -115,6 +331,20 @@ void infq_destroy(infq_t *infq);
 int32_t infq_destroy_completely(infq_t *infq);
 
 int32_t infq_pop_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr);
+
+/**
+ * @brief Pop a batch of elements by zero copy while holding the lock of pop queue once.
+ * @param ptrs: address of each element popped.
+ * @param sizes: size of each element popped.
+ * @param max: capacity of 'ptrs' and 'sizes'.
+ * @param n: number of elements popped, 0 means the queue is empty. It may be less
+ *      than 'max' even if there are more elements, the elements of one batch are
+ *      always in the same memory block.
+ */
+int32_t infq_pop_batch_zero_cp(infq_t *infq, const void **ptrs, int32_t *sizes, int32_t max,
+        int32_t *n);
+int32_t infq_pop_wait_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr,
+        int64_t timeout_us);
 int32_t infq_top_zero_cp(infq_t *infq, const void **dataptr, int32_t *sizeptr);
 int32_t infq_at_zero_cp(infq_t *infq, int64_t idx, const void **dataptr, int32_t *sizeptr);
 
@@ -145,6 +375,8 @@ int32_t infq_dump(infq_t *infq, char *buf, int32_t buf_size, int32_t *data_size)
  * @brief Load the infQ from a buffer. All the files which are belonged to file queue
  *      and pop queue will be opend and read, so this is a slow operation.
  *      Normally, file queue won't be used, noly some pop blocks need to be read.
+ *      With 'async_load', only the headers of pop blocks are read, their data is
+ *      loaded by 'Loader' in background.
  */
 int32_t infq_load(infq_t *infq, const char *buf, int32_t buf_size);
 
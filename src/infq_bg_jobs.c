@@ -10,6 +10,7 @@
 #include <stdio.h>
 
 #include "infq_bg_jobs.h"
+#include "file_queue.h"
 #include "utils.h"
 
 void
@@ -38,6 +39,12 @@ int32_t unlink_job(void *arg)
         return INFQ_ERR;
     }
 
+    if (job_info->file_queue != NULL
+            && file_queue_recycle_file(job_info->file_queue, buf) == INFQ_OK) {
+        INFQ_INFO_LOG("successful to recycle file block: %s", buf);
+        return INFQ_OK;
+    }
+
     if (unlink(buf) == -1) {
         INFQ_ERROR_LOG_BY_ERRNO("failed to unlink file, file path: %s", buf);
         return INFQ_ERR;
@@ -58,11 +65,13 @@ dump_job_dup_checker(void *arg, void *last_job)
     struct dump_job_t  *job = (struct dump_job_t *)arg;
     struct dump_job_t  *last = (struct dump_job_t *)last_job;
 
-    // NOTICE: adjacent job is continuous
+    // NOTICE: the job is dup only if the last job ends at the same block. When
+    //      the last job is still pending, the new one may cover more full blocks,
     //      e.g. mem queue has 5 blocks
     //              job n - 1  => [3, 1)
-    //              job n      => [1, 2)
-    if (last->end_block != job->start_block) {
+    //              job n      => [3, 2)
+    //      and the blocks dumped by job n - 1 are skipped by job n as stale.
+    if (last->end_block == job->end_block) {
         return INFQ_TRUE;
     }
 
@@ -80,7 +89,10 @@ load_job_dup_checker(void *arg, void *last_job)
     struct load_job_t *job = (struct load_job_t *)arg;
     struct load_job_t *last = (struct load_job_t *)last_job;
 
-    if (last->file_end_block != job->file_start_block) {
+    // NOTICE: the suffixes of file blocks are increasing, the job is dup if the
+    //      last job covers all its blocks. The blocks loaded by the last job are
+    //      skipped by the new one.
+    if (job->file_end_block <= last->file_end_block) {
         return INFQ_TRUE;
     }
 
@@ -30,6 +30,7 @@ typedef struct _unlink_job_t {
     int32_t file_block_no;
     char *file_path;
     char *file_prefix;
+    struct _file_queue_t *file_queue;   /* Keep the file in the file queue to be reused if it's not NULL */
 } unlink_job_t;
 
 void job_info_destroy(void *);
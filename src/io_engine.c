@@ -0,0 +1,384 @@
+/**
+ *
+ * @file    io_engine
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef INFQ_HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "io_engine.h"
+#include "utils.h"
+
+static int32_t finish_partial(io_req_t *req);
+static void release_ring(io_engine_t *engine);
+
+#ifdef INFQ_HAVE_IO_URING
+
+static int32_t
+io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int32_t)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int32_t
+io_uring_enter(int32_t ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int32_t)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int32_t
+map_rings(io_engine_t *engine, const struct io_uring_params *params)
+{
+    char    *sq_ring, *cq_ring;
+
+    engine->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    engine->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+#ifdef IORING_FEAT_SINGLE_MMAP
+    // submission queue and completion queue share one mapping
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        if (engine->cq_ring_size > engine->sq_ring_size) {
+            engine->sq_ring_size = engine->cq_ring_size;
+        }
+        engine->cq_ring_size = 0;
+    }
+#endif
+
+    engine->sq_ring = mmap(NULL, engine->sq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, engine->ring_fd, IORING_OFF_SQ_RING);
+    if (engine->sq_ring == MAP_FAILED) {
+        engine->sq_ring = NULL;
+        INFQ_ERROR_LOG_BY_ERRNO("failed to mmap submission queue of io_uring");
+        return INFQ_ERR;
+    }
+
+    if (engine->cq_ring_size == 0) {
+        engine->cq_ring = engine->sq_ring;
+    } else {
+        engine->cq_ring = mmap(NULL, engine->cq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, engine->ring_fd, IORING_OFF_CQ_RING);
+        if (engine->cq_ring == MAP_FAILED) {
+            engine->cq_ring = NULL;
+            INFQ_ERROR_LOG_BY_ERRNO("failed to mmap completion queue of io_uring");
+            return INFQ_ERR;
+        }
+    }
+
+    engine->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    engine->sqes = mmap(NULL, engine->sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, engine->ring_fd, IORING_OFF_SQES);
+    if (engine->sqes == MAP_FAILED) {
+        engine->sqes = NULL;
+        INFQ_ERROR_LOG_BY_ERRNO("failed to mmap submission entries of io_uring");
+        return INFQ_ERR;
+    }
+
+    sq_ring = (char *)engine->sq_ring;
+    engine->sq_head = (unsigned *)(sq_ring + params->sq_off.head);
+    engine->sq_tail = (unsigned *)(sq_ring + params->sq_off.tail);
+    engine->sq_mask = (unsigned *)(sq_ring + params->sq_off.ring_mask);
+    engine->sq_array = (unsigned *)(sq_ring + params->sq_off.array);
+
+    cq_ring = (char *)engine->cq_ring;
+    engine->cq_head = (unsigned *)(cq_ring + params->cq_off.head);
+    engine->cq_tail = (unsigned *)(cq_ring + params->cq_off.tail);
+    engine->cq_mask = (unsigned *)(cq_ring + params->cq_off.ring_mask);
+    engine->cqes = cq_ring + params->cq_off.cqes;
+
+    return INFQ_OK;
+}
+
+/**
+ * Put the queued requests to the submission queue.
+ */
+static void
+fill_sqes(io_engine_t *engine)
+{
+    struct io_uring_sqe     *sqe;
+    io_req_t                *req;
+    unsigned                tail, index;
+
+    tail = *engine->sq_tail;
+    for (int32_t i = 0; i < engine->req_num; i++) {
+        req = &engine->reqs[i];
+        index = tail & *engine->sq_mask;
+        sqe = (struct io_uring_sqe *)engine->sqes + index;
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = req->is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = req->fd;
+        sqe->addr = (unsigned long)req->iov;
+        sqe->len = req->iovcnt;
+        sqe->off = req->offset;
+        sqe->user_data = i;
+
+        engine->sq_array[index] = index;
+        tail++;
+    }
+
+    // make the entries visible to the kernel before the tail
+    __atomic_store_n(engine->sq_tail, tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Reap the completions, return the number of requests completed.
+ */
+static int32_t
+reap_cqes(io_engine_t *engine)
+{
+    struct io_uring_cqe     *cqe;
+    unsigned                head, tail;
+    int32_t                 n = 0;
+
+    head = *engine->cq_head;
+    tail = __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        cqe = (struct io_uring_cqe *)engine->cqes + (head & *engine->cq_mask);
+        if (cqe->user_data < (uint64_t)engine->req_num) {
+            engine->reqs[cqe->user_data].result = cqe->res;
+        }
+        head++;
+        n++;
+    }
+    __atomic_store_n(engine->cq_head, head, __ATOMIC_RELEASE);
+
+    return n;
+}
+
+static int32_t
+submit_and_wait(io_engine_t *engine)
+{
+    int32_t     submitted = 0, completed = 0, failed = INFQ_FALSE, ret;
+
+    fill_sqes(engine);
+
+    // NOTICE: the requests submitted must be waited for even on errors, the kernel
+    //      may still access their buffers
+    while (completed < engine->req_num) {
+        ret = io_uring_enter(engine->ring_fd, failed ? 0 : engine->req_num - submitted, 1,
+                IORING_ENTER_GETEVENTS);
+        if (ret == -1) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            INFQ_ERROR_LOG_BY_ERRNO("failed to enter io_uring, submitted: %d, completed: %d",
+                    submitted,
+                    completed);
+            failed = INFQ_TRUE;
+        } else if (!failed) {
+            submitted += ret;
+        }
+
+        completed += reap_cqes(engine);
+        if (failed && completed == submitted) {
+            return INFQ_ERR;
+        }
+    }
+
+    return INFQ_OK;
+}
+
+#endif
+
+int32_t
+io_engine_init(io_engine_t *engine, int32_t depth)
+{
+    if (engine == NULL || depth < 1) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    memset(engine, 0, sizeof(io_engine_t));
+    engine->ring_fd = INFQ_UNDEF;
+
+#ifdef INFQ_HAVE_IO_URING
+    struct io_uring_params  params;
+
+    engine->depth = depth > INFQ_MAX_IO_DEPTH ? INFQ_MAX_IO_DEPTH : depth;
+    engine->reqs = (io_req_t *)malloc(sizeof(io_req_t) * engine->depth);
+    if (engine->reqs == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for io requests");
+        return INFQ_ERR;
+    }
+
+    memset(&params, 0, sizeof(params));
+    engine->ring_fd = io_uring_setup(engine->depth, &params);
+    if (engine->ring_fd == -1) {
+        engine->ring_fd = INFQ_UNDEF;
+        INFQ_INFO_LOG("io_uring isn't available, errno: %d, %s", errno, strerror(errno));
+        io_engine_destroy(engine);
+        return INFQ_ERR;
+    }
+
+    if (map_rings(engine, &params) == INFQ_ERR) {
+        io_engine_destroy(engine);
+        return INFQ_ERR;
+    }
+
+    INFQ_INFO_LOG("successful to init io engine, depth: %d", engine->depth);
+
+    return INFQ_OK;
+#else
+    INFQ_INFO_LOG("io_uring isn't supported by the build");
+
+    return INFQ_ERR;
+#endif
+}
+
+int32_t
+io_engine_add(io_engine_t *engine, int32_t fd, const struct iovec *iov, int32_t iovcnt,
+        off_t offset, int32_t is_write)
+{
+    if (engine == NULL || fd == INFQ_UNDEF || iov == NULL || iovcnt < 1
+            || iovcnt > INFQ_MAX_IOVCNT) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (engine->req_num >= engine->depth) {
+        INFQ_ERROR_LOG("too many io requests, depth: %d", engine->depth);
+        return INFQ_ERR;
+    }
+
+    io_req_t    *req = &engine->reqs[engine->req_num++];
+
+    req->fd = fd;
+    req->iov = iov;
+    req->iovcnt = iovcnt;
+    req->offset = offset;
+    req->is_write = is_write;
+    req->expected = 0;
+    req->result = 0;
+    for (int32_t i = 0; i < iovcnt; i++) {
+        req->expected += iov[i].iov_len;
+    }
+
+    return INFQ_OK;
+}
+
+int32_t
+io_engine_wait(io_engine_t *engine)
+{
+    if (engine == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     ret = INFQ_OK;
+    io_req_t    *req;
+
+    if (engine->req_num == 0) {
+        return INFQ_OK;
+    }
+
+#ifdef INFQ_HAVE_IO_URING
+    // the entries not submitted are left in the ring, so it's dropped and the
+    //      requests are done synchronously. Repeating a completed one is harmless.
+    if (engine->ring_fd != INFQ_UNDEF && submit_and_wait(engine) == INFQ_ERR) {
+        INFQ_ERROR_LOG("io_uring is broken, fall back to synchronous io");
+        release_ring(engine);
+        for (int32_t i = 0; i < engine->req_num; i++) {
+            engine->reqs[i].result = 0;
+        }
+    }
+#endif
+
+    for (int32_t i = 0; i < engine->req_num; i++) {
+        req = &engine->reqs[i];
+        if (req->result < 0) {
+            INFQ_ERROR_LOG("failed to %s by io_uring, fd: %d, offset: %lld, error: %s",
+                    req->is_write ? "write" : "read",
+                    req->fd,
+                    (long long)req->offset,
+                    strerror((int)-req->result));
+            ret = INFQ_ERR;
+        } else if (req->result < req->expected && finish_partial(req) == INFQ_ERR) {
+            ret = INFQ_ERR;
+        }
+    }
+    engine->req_num = 0;
+
+    return ret;
+}
+
+void
+io_engine_reset(io_engine_t *engine)
+{
+    if (engine != NULL) {
+        engine->req_num = 0;
+    }
+}
+
+void
+io_engine_destroy(io_engine_t *engine)
+{
+    if (engine == NULL) {
+        return;
+    }
+
+    release_ring(engine);
+
+    if (engine->reqs != NULL) {
+        free(engine->reqs);
+        engine->reqs = NULL;
+    }
+}
+
+static void
+release_ring(io_engine_t *engine)
+{
+#ifdef INFQ_HAVE_IO_URING
+    if (engine->sqes != NULL) {
+        munmap(engine->sqes, engine->sqes_size);
+    }
+    if (engine->cq_ring != NULL && engine->cq_ring != engine->sq_ring) {
+        munmap(engine->cq_ring, engine->cq_ring_size);
+    }
+    if (engine->sq_ring != NULL) {
+        munmap(engine->sq_ring, engine->sq_ring_size);
+    }
+#endif
+    engine->sqes = engine->cq_ring = engine->sq_ring = NULL;
+
+    if (engine->ring_fd != INFQ_UNDEF) {
+        if (close(engine->ring_fd) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to close io_uring");
+        }
+        engine->ring_fd = INFQ_UNDEF;
+    }
+}
+
+/**
+ * Transfer the rest of a partial request synchronously.
+ */
+static int32_t
+finish_partial(io_req_t *req)
+{
+    struct iovec    vec[INFQ_MAX_IOVCNT];
+    int64_t         skip = req->result;
+    int32_t         n = 0;
+
+    for (int32_t i = 0; i < req->iovcnt; i++) {
+        if (skip >= (int64_t)req->iov[i].iov_len) {
+            skip -= req->iov[i].iov_len;
+            continue;
+        }
+        vec[n].iov_base = (char *)req->iov[i].iov_base + skip;
+        vec[n].iov_len = req->iov[i].iov_len - skip;
+        skip = 0;
+        n++;
+    }
+
+    if (req->is_write) {
+        return infq_pwritev(req->fd, vec, n, req->offset + req->result, 0);
+    }
+
+    return infq_preadv(req->fd, vec, n, req->offset + req->result, 0);
+}
@@ -0,0 +1,72 @@
+/**
+ *
+ * An asynchronous engine of block I/O based on io_uring, which keeps several
+ * blocks in flight instead of one syscall after another. Requests are queued by
+ * 'io_engine_add' and submitted together by 'io_engine_wait'.
+ *
+ * @file    io_engine
+ */
+
+#ifndef COM_MOMO_INFQ_IO_ENGINE_H
+#define COM_MOMO_INFQ_IO_ENGINE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define INFQ_MAX_IO_DEPTH   64
+
+typedef struct _io_req_t {
+    int32_t             fd;
+    const struct iovec  *iov;           /* The memory must be valid until 'io_engine_wait' returns */
+    int32_t             iovcnt;
+    off_t               offset;
+    int32_t             is_write;
+    int64_t             expected;       /* Bytes to transfer */
+    int64_t             result;         /* Bytes transferred, or -errno */
+} io_req_t;
+
+typedef struct _io_engine_t {
+    int32_t             depth;          /* Max requests in flight */
+    int32_t             req_num;        /* Requests queued */
+    io_req_t            *reqs;
+    int32_t             ring_fd;
+    void                *sq_ring;       /* Mappings of the submission queue, completion queue */
+    void                *cq_ring;       /*      and the entries of submission queue */
+    void                *sqes;
+    size_t              sq_ring_size;
+    size_t              cq_ring_size;
+    size_t              sqes_size;
+    unsigned            *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned            *cq_head, *cq_tail, *cq_mask;
+    void                *cqes;
+} io_engine_t;
+
+/**
+ * Init the engine with 'depth' requests in flight at most. INFQ_ERR is returned if
+ *      io_uring isn't supported by the build or the kernel, the caller should use
+ *      the synchronous I/O instead.
+ */
+int32_t io_engine_init(io_engine_t *engine, int32_t depth);
+
+/**
+ * Queue a vectored read or write of all the bytes of 'iov' at 'offset'. 'iovcnt'
+ *      should be not greater than INFQ_MAX_IOVCNT.
+ */
+int32_t io_engine_add(io_engine_t *engine, int32_t fd, const struct iovec *iov, int32_t iovcnt,
+        off_t offset, int32_t is_write);
+
+/**
+ * Submit the queued requests and wait for all of them. A partial transfer is
+ *      continued synchronously. INFQ_ERR is returned if any request failed, the
+ *      queue is empty after.
+ */
+int32_t io_engine_wait(io_engine_t *engine);
+
+/**
+ * Drop the requests queued but not submitted yet.
+ */
+void io_engine_reset(io_engine_t *engine);
+void io_engine_destroy(io_engine_t *engine);
+
+#endif
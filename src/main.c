@@ -30,7 +30,22 @@ main()
         1024,
         40,
         30,
-        0.4
+        0.4,
+        INFQ_FALSE,
+        INFQ_OVERFLOW_FAIL,
+        0,
+        0,
+        INFQ_FALSE,
+        0,
+        0,
+        0,
+        INFQ_DURABILITY_NONE,
+        0,
+        0,
+        INFQ_CODEC_NONE,
+        INFQ_FALSE,
+        0,
+        0
     };
     /*infq_config_logging(INFQ_DEBUG_LEVEL, NULL, NULL, NULL);*/
     infq_config_logging(INFQ_INFO_LEVEL, NULL, NULL, NULL);
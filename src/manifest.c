@@ -0,0 +1,411 @@
+/**
+ *
+ * @file    manifest
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "manifest.h"
+#include "crc32c.h"
+#include "logging.h"
+#include "utils.h"
+
+#define INFQ_MANIFEST_NAME      "manifest"
+#define INFQ_MANIFEST_TMP_NAME  "manifest.tmp"
+
+#define record_crc(r)   crc32c(0, (r), offsetof(manifest_record_t, crc))
+
+static int32_t manifest_path(const manifest_t *manifest, const char *name, char *buf, int32_t size);
+static int32_t load_records(manifest_t *manifest, manifest_record_t **records_ptr, int32_t *n);
+static int32_t rewrite_records(manifest_t *manifest, const manifest_record_t *records, int32_t n);
+
+int32_t
+manifest_open(manifest_t *manifest, const char *file_path)
+{
+    if (manifest == NULL || file_path == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    char        buf[INFQ_MAX_BUF_SIZE];
+    struct stat finfo;
+
+    manifest->fd = INFQ_UNDEF;
+    manifest->file_path = file_path;
+    manifest->records = manifest->kept = 0;
+    manifest->dirty = INFQ_FALSE;
+    if (pthread_mutex_init(&manifest->mu, NULL) != 0) {
+        INFQ_ERROR_LOG("failed to init mu of manifest");
+        return INFQ_ERR;
+    }
+
+    // NOTICE: the manifest is left dropped if it can't be opened, the file queue is
+    //      restored by the headers of blocks instead
+    if (manifest_path(manifest, INFQ_MANIFEST_NAME, buf, INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to generate path of manifest, drop it, path: %s", file_path);
+        return INFQ_OK;
+    }
+
+    manifest->fd = open(buf, O_CREAT | O_RDWR | O_APPEND, 0644);
+    if (manifest->fd == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to open manifest, drop it, file path: %s", buf);
+        manifest->fd = INFQ_UNDEF;
+        return INFQ_OK;
+    }
+
+    if (fstat(manifest->fd, &finfo) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to fstat manifest, drop it, file path: %s", buf);
+        close(manifest->fd);
+        manifest->fd = INFQ_UNDEF;
+        return INFQ_OK;
+    }
+    manifest->records = (int32_t)(finfo.st_size / sizeof(manifest_record_t));
+
+    // NOTICE: a partial record torn by a crash is cut off, otherwise the records appended
+    //      after it are misaligned and all of them fail their CRC
+    if (finfo.st_size % sizeof(manifest_record_t) != 0) {
+        INFQ_INFO_LOG("truncate torn record of manifest, file path: %s, size: %lld, records: %d",
+                buf, (long long)finfo.st_size, manifest->records);
+        if (ftruncate(manifest->fd,
+                    (off_t)manifest->records * sizeof(manifest_record_t)) == -1) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to truncate manifest, drop it, file path: %s", buf);
+            manifest_drop(manifest);
+            return INFQ_OK;
+        }
+    }
+
+    return INFQ_OK;
+}
+
+void
+manifest_record_init(manifest_record_t *record, const file_block_t *block)
+{
+    memset(record, 0, sizeof(manifest_record_t));
+    record->suffix = block->suffix;
+    record->ele_count = block->ele_count;
+    record->start_index = block->start_index;
+    record->file_offset = block->segment != NULL ? block->file_offset : 0;
+    record->file_size = block->file_size;
+    record->crc = record_crc(record);
+}
+
+int32_t
+manifest_append(manifest_t *manifest, const file_block_t *block)
+{
+    if (manifest == NULL || block == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    manifest_record_t   record;
+
+    manifest_record_init(&record, block);
+
+    pthread_mutex_lock(&manifest->mu);
+    if (manifest->fd == INFQ_UNDEF) {
+        pthread_mutex_unlock(&manifest->mu);
+        return INFQ_OK;
+    }
+
+    // NOTICE: a torn record fails its CRC, it's skipped when the manifest is read
+    if (infq_write(manifest->fd, &record, sizeof(record)) == INFQ_ERR) {
+        pthread_mutex_unlock(&manifest->mu);
+        INFQ_ERROR_LOG("failed to append manifest, path: %s, suffix: %d",
+                manifest->file_path, block->suffix);
+        manifest_drop(manifest);
+        return INFQ_ERR;
+    }
+    manifest->records++;
+    manifest->dirty = INFQ_TRUE;
+    pthread_mutex_unlock(&manifest->mu);
+
+    return INFQ_OK;
+}
+
+int32_t
+manifest_read(manifest_t *manifest, int32_t start, int32_t end, manifest_record_t *records)
+{
+    if (manifest == NULL || records == NULL || start > end) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    manifest_record_t   *all;
+    int32_t             n, found = 0, i;
+
+    for (i = 0; i < end - start; i++) {
+        records[i].suffix = INFQ_UNDEF;
+    }
+
+    pthread_mutex_lock(&manifest->mu);
+    if (load_records(manifest, &all, &n) == INFQ_ERR) {
+        pthread_mutex_unlock(&manifest->mu);
+        return INFQ_ERR;
+    }
+    pthread_mutex_unlock(&manifest->mu);
+
+    for (i = 0; i < n; i++) {
+        if (all[i].suffix < start || all[i].suffix >= end) {
+            continue;
+        }
+        if (records[all[i].suffix - start].suffix == INFQ_UNDEF) {
+            found++;
+        }
+        records[all[i].suffix - start] = all[i];
+    }
+    free(all);
+
+    return found;
+}
+
+int32_t
+manifest_rewrite(manifest_t *manifest, const manifest_record_t *records, int32_t n)
+{
+    if (manifest == NULL || (records == NULL && n > 0)) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    pthread_mutex_lock(&manifest->mu);
+    if (manifest->fd == INFQ_UNDEF) {
+        pthread_mutex_unlock(&manifest->mu);
+        return INFQ_ERR;
+    }
+
+    if (rewrite_records(manifest, records, n) == INFQ_ERR) {
+        pthread_mutex_unlock(&manifest->mu);
+        manifest_drop(manifest);
+        return INFQ_ERR;
+    }
+    pthread_mutex_unlock(&manifest->mu);
+
+    return INFQ_OK;
+}
+
+int32_t
+manifest_compact(manifest_t *manifest, int32_t keep_from)
+{
+    if (manifest == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    manifest_record_t   *all;
+    int32_t             n, kept = 0, i;
+
+    pthread_mutex_lock(&manifest->mu);
+    if (manifest->fd == INFQ_UNDEF) {
+        pthread_mutex_unlock(&manifest->mu);
+        return INFQ_OK;
+    }
+    if (load_records(manifest, &all, &n) == INFQ_ERR) {
+        pthread_mutex_unlock(&manifest->mu);
+        manifest_drop(manifest);
+        return INFQ_ERR;
+    }
+
+    // NOTICE: the suffixes are ascending unless the queue is restarted from a smaller
+    //      suffix, the records after it are stale then. So a record drops the kept
+    //      ones not less than its suffix.
+    for (i = 0; i < n; i++) {
+        if (all[i].suffix < keep_from) {
+            continue;
+        }
+        while (kept > 0 && all[kept - 1].suffix >= all[i].suffix) {
+            kept--;
+        }
+        all[kept++] = all[i];
+    }
+
+    INFQ_INFO_LOG("compact manifest, path: %s, records: %d, kept: %d, keep from: %d",
+            manifest->file_path, n, kept, keep_from);
+
+    if (rewrite_records(manifest, all, kept) == INFQ_ERR) {
+        pthread_mutex_unlock(&manifest->mu);
+        free(all);
+        manifest_drop(manifest);
+        return INFQ_ERR;
+    }
+    pthread_mutex_unlock(&manifest->mu);
+    free(all);
+
+    return INFQ_OK;
+}
+
+int32_t
+manifest_sync(manifest_t *manifest)
+{
+    if (manifest == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    pthread_mutex_lock(&manifest->mu);
+    if (manifest->fd == INFQ_UNDEF || !manifest->dirty) {
+        pthread_mutex_unlock(&manifest->mu);
+        return INFQ_OK;
+    }
+
+    if (fdatasync(manifest->fd) == -1) {
+        pthread_mutex_unlock(&manifest->mu);
+        INFQ_ERROR_LOG_BY_ERRNO("failed to sync manifest, path: %s", manifest->file_path);
+        manifest_drop(manifest);
+        return INFQ_ERR;
+    }
+    manifest->dirty = INFQ_FALSE;
+    pthread_mutex_unlock(&manifest->mu);
+
+    return INFQ_OK;
+}
+
+void
+manifest_drop(manifest_t *manifest)
+{
+    char    buf[INFQ_MAX_BUF_SIZE];
+
+    pthread_mutex_lock(&manifest->mu);
+    if (manifest->fd != INFQ_UNDEF) {
+        INFQ_INFO_LOG("drop manifest, path: %s", manifest->file_path);
+        if (manifest_path(manifest, INFQ_MANIFEST_NAME, buf, INFQ_MAX_BUF_SIZE) == INFQ_OK
+                && unlink(buf) == -1 && errno != ENOENT) {
+            INFQ_ERROR_LOG_BY_ERRNO("failed to remove manifest, file path: %s", buf);
+        }
+        close(manifest->fd);
+        manifest->fd = INFQ_UNDEF;
+    }
+    manifest->records = manifest->kept = 0;
+    manifest->dirty = INFQ_FALSE;
+    pthread_mutex_unlock(&manifest->mu);
+}
+
+void
+manifest_close(manifest_t *manifest)
+{
+    if (manifest->fd != INFQ_UNDEF) {
+        close(manifest->fd);
+        manifest->fd = INFQ_UNDEF;
+    }
+    pthread_mutex_destroy(&manifest->mu);
+}
+
+static int32_t
+manifest_path(const manifest_t *manifest, const char *name, char *buf, int32_t size)
+{
+    int32_t     ret;
+
+    ret = snprintf(buf, size, "%s/%s", manifest->file_path, name);
+    if (ret < 0 || ret >= size) {
+        INFQ_ERROR_LOG("failed to generate path of manifest, path: %s", manifest->file_path);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+/**
+ * Read the valid records of the manifest to an array allocated, the records failing
+ *      their CRC are skipped. It's called with the lock of manifest held.
+ */
+static int32_t
+load_records(manifest_t *manifest, manifest_record_t **records_ptr, int32_t *n)
+{
+    manifest_record_t   *records;
+    struct stat         finfo;
+    int32_t             total, valid = 0, i;
+
+    *records_ptr = NULL;
+    *n = 0;
+    if (manifest->fd == INFQ_UNDEF) {
+        return INFQ_ERR;
+    }
+
+    if (fstat(manifest->fd, &finfo) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to fstat manifest, path: %s", manifest->file_path);
+        return INFQ_ERR;
+    }
+
+    // a partial record at the end is torn by a crash
+    total = (int32_t)(finfo.st_size / sizeof(manifest_record_t));
+    records = (manifest_record_t *)malloc(sizeof(manifest_record_t) * (total > 0 ? total : 1));
+    if (records == NULL) {
+        INFQ_ERROR_LOG("failed to alloc mem for manifest records, records: %d", total);
+        return INFQ_ERR;
+    }
+
+    if (total > 0 && infq_pread(manifest->fd, records, sizeof(manifest_record_t) * total, 0)
+            == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to read manifest, path: %s", manifest->file_path);
+        free(records);
+        return INFQ_ERR;
+    }
+
+    for (i = 0; i < total; i++) {
+        if (records[i].crc != record_crc(&records[i]) || records[i].suffix < 0) {
+            continue;
+        }
+        records[valid++] = records[i];
+    }
+
+    if (valid < total) {
+        INFQ_INFO_LOG("skip invalid records of manifest, path: %s, records: %d, valid: %d",
+                manifest->file_path, total, valid);
+    }
+
+    *records_ptr = records;
+    *n = valid;
+
+    return INFQ_OK;
+}
+
+/**
+ * Write the records to a new manifest and rename it over the old one. It's called
+ *      with the lock of manifest held.
+ */
+static int32_t
+rewrite_records(manifest_t *manifest, const manifest_record_t *records, int32_t n)
+{
+    char    path[INFQ_MAX_BUF_SIZE], tmp_path[INFQ_MAX_BUF_SIZE];
+    int32_t fd;
+
+    if (manifest_path(manifest, INFQ_MANIFEST_NAME, path, INFQ_MAX_BUF_SIZE) == INFQ_ERR
+            || manifest_path(manifest, INFQ_MANIFEST_TMP_NAME, tmp_path,
+                INFQ_MAX_BUF_SIZE) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+
+    fd = open(tmp_path, O_CREAT | O_TRUNC | O_RDWR | O_APPEND, 0644);
+    if (fd == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to open manifest, file path: %s", tmp_path);
+        return INFQ_ERR;
+    }
+
+    // NOTICE: the new manifest is synced before renaming, a crash leaves the old
+    //      or the new one, both are valid
+    if ((n > 0 && infq_write(fd, records, sizeof(manifest_record_t) * n) == INFQ_ERR)
+            || fdatasync(fd) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to write manifest, file path: %s", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        return INFQ_ERR;
+    }
+
+    if (rename(tmp_path, path) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to rename manifest, file path: %s", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        return INFQ_ERR;
+    }
+
+    close(manifest->fd);
+    manifest->fd = fd;
+    manifest->records = manifest->kept = n;
+    manifest->dirty = INFQ_FALSE;
+
+    return INFQ_OK;
+}
@@ -0,0 +1,89 @@
+/**
+ *
+ * The manifest of a file queue is a file of records appended for the file blocks
+ * dumped, so a dumped file queue is restored by reading the manifest only instead
+ * of opening every file block to read its header. A record is:
+ *
+ *  |-- Suffix(4B) --|-- Element count(4B) --|-- Start index(8B) --|-- File offset(8B) --|
+ *  |-- File size(4B) --|-- CRC32C of the record(4B) --|
+ *
+ * A suffix may be dumped again, e.g. after infQ is restarted, the last record of a
+ * suffix wins. The manifest is only an accelerator, it's dropped on any failure and
+ * the headers of the blocks are read instead.
+ *
+ * @file    manifest
+ */
+
+#ifndef COM_MOMO_INFQ_MANIFEST_H
+#define COM_MOMO_INFQ_MANIFEST_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "file_block.h"
+
+typedef struct _manifest_record_t {
+    int32_t             suffix;
+    int32_t             ele_count;
+    int64_t             start_index;
+    int64_t             file_offset;        /* Offset of the block in its segment, 0 for a file per block */
+    int32_t             file_size;
+    uint32_t            crc;
+} manifest_record_t;
+
+typedef struct _manifest_t {
+    int32_t             fd;                 /* INFQ_UNDEF if the manifest is dropped */
+    const char          *file_path;         /* Directory of the file queue */
+    int32_t             records;            /* Number of records in the file */
+    int32_t             kept;               /* Number of records kept by the last rewrite */
+    int32_t             dirty;              /* Records are appended since the last sync */
+    pthread_mutex_t     mu;
+} manifest_t;
+
+/**
+ * @brief Open the manifest in the directory, it's created if it doesn't exist. The
+ *      existing records are kept to restore the file queue. If it can't be opened,
+ *      it's dropped and INFQ_OK is still returned, INFQ_ERR is only returned if the
+ *      manifest can't be used at all.
+ */
+int32_t manifest_open(manifest_t *manifest, const char *file_path);
+
+/**
+ * @brief Fill the record of a file block whose header is known.
+ */
+void manifest_record_init(manifest_record_t *record, const file_block_t *block);
+
+/**
+ * @brief Append the record of a file block written. The manifest is dropped if it fails.
+ */
+int32_t manifest_append(manifest_t *manifest, const file_block_t *block);
+
+/**
+ * @brief Read the records of suffixes [start, end) to 'records', which has the room
+ *      of 'end - start' records. A missing record has the suffix of INFQ_UNDEF.
+ *      The number of records found is returned, INFQ_ERR on failure.
+ */
+int32_t manifest_read(manifest_t *manifest, int32_t start, int32_t end, manifest_record_t *records);
+
+/**
+ * @brief Replace the manifest by the 'n' records, the new file is renamed over it.
+ */
+int32_t manifest_rewrite(manifest_t *manifest, const manifest_record_t *records, int32_t n);
+
+/**
+ * @brief Rewrite the manifest with the last records of suffixes not less than 'keep_from'.
+ */
+int32_t manifest_compact(manifest_t *manifest, int32_t keep_from);
+
+/**
+ * @brief Sync the records appended since the last sync.
+ */
+int32_t manifest_sync(manifest_t *manifest);
+
+/**
+ * @brief Close the manifest and remove the file, nothing in it is trusted afterwards.
+ */
+void manifest_drop(manifest_t *manifest);
+void manifest_close(manifest_t *manifest);
+
+#endif
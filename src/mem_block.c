@@ -8,10 +8,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/mman.h>
 
 #include "mem_block.h"
 #include "infq.h"
-#include "sha1.h"
+#include "crc32c.h"
 
 mem_block_t*
 mem_block_init(int32_t block_size)
@@ -33,6 +34,10 @@ mem_block_init(int32_t block_size)
     mem_block->last_offset = 0;
     mem_block->ele_count = 0;
     mem_block->file_block_no = INFQ_UNDEF;
+    mem_block->mem = mem_block->buf;
+    mem_block->map_addr = NULL;
+    mem_block->map_size = 0;
+    mem_block->crc = 0;
 
     return mem_block;
 
@@ -41,6 +46,25 @@ failed:
     return NULL;
 }
 
+mem_block_t*
+mem_block_resize(mem_block_t *mem_block, int32_t block_size)
+{
+    if (mem_block == NULL || block_size < mem_block->last_offset || mem_block_is_view(mem_block)) {
+        INFQ_ERROR_LOG("invalid param");
+        return NULL;
+    }
+
+    mem_block_t *block = (mem_block_t *)realloc(mem_block, sizeof(mem_block_t) + block_size - 1);
+    if (block == NULL) {
+        INFQ_ERROR_LOG("failed to realloc memory block, size: %d", block_size);
+        return NULL;
+    }
+    block->mem_size = block_size;
+    block->mem = block->buf;
+
+    return block;
+}
+
 int32_t
 mem_block_push(mem_block_t *mem_block, void *data, int32_t size)
 {
@@ -49,7 +73,26 @@ mem_block_push(mem_block_t *mem_block, void *data, int32_t size)
         return INFQ_ERR;
     }
 
-    // TODO: store a large object in two continuous memory blocks.
+    void    *dst;
+
+    if (mem_block_reserve(mem_block, size, &dst) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+
+    // write data
+    memcpy(dst, data, size);
+
+    return mem_block_commit(mem_block, size);
+}
+
+int32_t
+mem_block_reserve(mem_block_t *mem_block, int32_t size, void **dst)
+{
+    if (mem_block == NULL || size < 0 || dst == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
     if (mem_block_ele_size(size) > mem_block_avail(mem_block)) {
         INFQ_ERROR_LOG("no enough memory, data size: %d, mem available: %d",
                 mem_block_ele_size(size),
@@ -57,7 +100,28 @@ mem_block_push(mem_block_t *mem_block, void *data, int32_t size)
         return INFQ_ERR;
     }
 
-    int32_t     *len_ptr, offset;
+    // skip the length prefix, it's written when committing
+    *dst = mem_block->mem + mem_block->last_offset + sizeof(int32_t);
+
+    return INFQ_OK;
+}
+
+int32_t
+mem_block_commit(mem_block_t *mem_block, int32_t size)
+{
+    if (mem_block == NULL || size < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (mem_block_ele_size(size) > mem_block_avail(mem_block)) {
+        INFQ_ERROR_LOG("commit size exceeds the block, data size: %d, mem available: %d",
+                mem_block_ele_size(size),
+                mem_block_avail(mem_block));
+        return INFQ_ERR;
+    }
+
+    int32_t     *len_ptr, offset, start;
 
     // record offset index
     if (offset_array_push(&mem_block->offset_array, mem_block->last_offset) == INFQ_ERR) {
@@ -65,14 +129,11 @@ mem_block_push(mem_block_t *mem_block, void *data, int32_t size)
         return INFQ_ERR;
     }
 
-    // write data len
+    // write data len, the data has been written to the reserved memory
+    start = mem_block->last_offset;
     len_ptr = (int32_t *)(mem_block->mem + mem_block->last_offset);
     *len_ptr = size;
-    mem_block->last_offset += sizeof(int32_t);
-
-    // write data
-    memcpy(mem_block->mem + mem_block->last_offset, data, size);
-    mem_block->last_offset += size;
+    mem_block->last_offset += mem_block_ele_size(size);
 
     // NOTICE: padding by 8 bytes
     offset = (mem_block->last_offset + 7) & (~INFQ_PADDING_MASK);
@@ -80,6 +141,10 @@ mem_block_push(mem_block_t *mem_block, void *data, int32_t size)
         mem_block->last_offset = offset;
     }
 
+    // the element is checksummed while it's still in the cache, the padding is
+    // included to cover all bytes dumped
+    mem_block->crc = crc32c(mem_block->crc, mem_block->mem + start, mem_block->last_offset - start);
+
     mem_block->ele_count++;
 
 #ifdef D_ASSERT
@@ -95,6 +160,76 @@ mem_block_push(mem_block_t *mem_block, void *data, int32_t size)
     return INFQ_OK;
 }
 
+int32_t
+mem_block_push_batch(mem_block_t *mem_block, const struct iovec *elems, int32_t n, int32_t *pushed)
+{
+    if (mem_block == NULL || elems == NULL || pushed == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     count, last_offset, start, end, size, *len_ptr;
+
+    *pushed = 0;
+
+    // count the elements which can be stored in the rest space of the block,
+    // so the copy loop below needn't check boundary for each element
+    last_offset = mem_block->last_offset;
+    for (count = 0; count < n; count++) {
+        end = last_offset + mem_block_ele_size(elems[count].iov_len);
+        if (end > mem_block->mem_size) {
+            break;
+        }
+
+        // NOTICE: padding by 8 bytes, the same as mem_block_push
+        last_offset = (end + 7) & (~INFQ_PADDING_MASK);
+        if (last_offset > mem_block->mem_size) {
+            last_offset = end;
+        }
+    }
+
+    if (count == 0) {
+        return INFQ_OK;
+    }
+
+    if (offset_array_reserve(&mem_block->offset_array, count) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to reserve offset array, count: %d", count);
+        return INFQ_ERR;
+    }
+
+    start = mem_block->last_offset;
+    for (int32_t i = 0; i < count; i++) {
+        size = (int32_t)elems[i].iov_len;
+
+        mem_block->offset_array.offsets[mem_block->offset_array.size++] = mem_block->last_offset;
+
+        len_ptr = (int32_t *)(mem_block->mem + mem_block->last_offset);
+        *len_ptr = size;
+        memcpy(mem_block->mem + mem_block->last_offset + sizeof(int32_t), elems[i].iov_base, size);
+
+        end = mem_block->last_offset + mem_block_ele_size(size);
+        mem_block->last_offset = (end + 7) & (~INFQ_PADDING_MASK);
+        if (mem_block->last_offset > mem_block->mem_size) {
+            mem_block->last_offset = end;
+        }
+    }
+    mem_block->crc = crc32c(mem_block->crc, mem_block->mem + start, mem_block->last_offset - start);
+    mem_block->ele_count += count;
+    *pushed = count;
+
+#ifdef D_ASSERT
+    INFQ_ASSERT(mem_block->ele_count == offset_array_size(&mem_block->offset_array),
+            "block and offset array aren't consistency, count: %d, offset size: %d"
+            ", offset start: %lld, offset end: %d",
+            mem_block->ele_count,
+            offset_array_size(&mem_block->offset_array),
+            mem_block->offset_array.start_idx,
+            mem_block->offset_array.size);
+#endif
+
+    return INFQ_OK;
+}
+
 int32_t
 mem_block_at(mem_block_t *mem_block, int64_t global_idx, void *buf, int32_t buf_size, int32_t *sizeptr)
 {
@@ -283,6 +418,73 @@ mem_block_pop_zero_cp(mem_block_t *mem_block, const void **dataptr, int32_t *siz
     return INFQ_OK;
 }
 
+int32_t
+mem_block_pop_batch_zero_cp(mem_block_t *mem_block, const void **ptrs, int32_t *sizes,
+        int32_t max, int32_t *n)
+{
+    if (mem_block == NULL || ptrs == NULL || sizes == NULL || n == NULL || max < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     count, first_offset, *len_ptr;
+
+    // walk 'first_offset' forward, the states of block and offset array are
+    // updated once after the loop
+    first_offset = mem_block->first_offset;
+    for (count = 0; count < max && first_offset < mem_block->last_offset; count++) {
+        len_ptr = (int32_t *)(mem_block->mem + first_offset);
+
+        // check offset is valid, <= last offset
+        if (first_offset + (int32_t)sizeof(int32_t) + *len_ptr > mem_block->last_offset) {
+            INFQ_ERROR_LOG("data offset is invalid, beyong the boundary of block->last_offset, "
+                    "offset: %d, last offset: %d, data size: %d",
+                    first_offset,
+                    mem_block->last_offset,
+                    *len_ptr);
+            return INFQ_ERR;
+        }
+
+        sizes[count] = *len_ptr;
+        ptrs[count] = mem_block->mem + first_offset + sizeof(int32_t);
+
+        // NOTICE: padding by 8 bytes
+        first_offset = (first_offset + mem_block_ele_size(*len_ptr) + 7) & (~INFQ_PADDING_MASK);
+    }
+
+    *n = count;
+    if (count == 0) {
+        return INFQ_OK;
+    }
+
+    // NOTICE: update offset array, make sure that block and offset array are consistency
+    if (offset_array_incr_start_by(&mem_block->offset_array, count) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to incr start index, ele count: %d, start index: %lld, "
+                "popped: %d, fileno: %d",
+                mem_block->ele_count,
+                mem_block->start_index,
+                count,
+                mem_block->file_block_no);
+        return INFQ_ERR;
+    }
+
+    mem_block->first_offset = first_offset;
+    mem_block->ele_count -= count;
+    mem_block->start_index += count;
+
+#ifdef D_ASSERT
+    INFQ_ASSERT(mem_block->ele_count == offset_array_size(&mem_block->offset_array),
+            "block and offset array aren't consistency, count: %d, offset size: %d"
+            ", offset start: %d, offset end: %d",
+            mem_block->ele_count,
+            offset_array_size(&mem_block->offset_array),
+            mem_block->offset_array.start_idx,
+            mem_block->offset_array.size);
+#endif
+
+    return INFQ_OK;
+}
+
 int32_t
 mem_block_just_pop(mem_block_t *mem_block)
 {
@@ -378,16 +580,55 @@ mem_block_reset(mem_block_t *mem_block, int64_t start_index)
         return INFQ_ERR;
     }
 
+    mem_block_unmap(mem_block);
+
     mem_block->start_index = start_index;
     mem_block->first_offset = mem_block->last_offset = 0;
     mem_block->ele_count = 0;
     mem_block->file_block_no = INFQ_UNDEF;
+    mem_block->crc = 0;
 
     offset_array_reset(&mem_block->offset_array);
 
     return INFQ_OK;
 }
 
+int32_t
+mem_block_map(mem_block_t *mem_block, void *map_addr, int32_t map_size, char *data, int32_t size)
+{
+    if (mem_block == NULL || map_addr == NULL || data == NULL || size < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    mem_block_unmap(mem_block);
+
+    mem_block->map_addr = map_addr;
+    mem_block->map_size = map_size;
+    mem_block->mem = data;
+    mem_block->last_offset = size;
+
+    return INFQ_OK;
+}
+
+void
+mem_block_unmap(mem_block_t *mem_block)
+{
+    if (mem_block == NULL || !mem_block_is_view(mem_block)) {
+        return;
+    }
+
+    if (munmap(mem_block->map_addr, mem_block->map_size) == -1) {
+        INFQ_ERROR_LOG_BY_ERRNO("failed to unmap view of memory block, start index: %lld",
+                mem_block->start_index);
+    }
+    mem_block->map_addr = NULL;
+    mem_block->map_size = 0;
+    mem_block->mem = mem_block->buf;
+    mem_block->first_offset = mem_block->last_offset = 0;
+    mem_block->crc = 0;
+}
+
 void
 mem_block_destroy(mem_block_t *mem_block)
 {
@@ -396,6 +637,7 @@ mem_block_destroy(mem_block_t *mem_block)
         return;
     }
 
+    mem_block_unmap(mem_block);
     offset_array_destroy(&mem_block->offset_array);
     free(mem_block);
 }
@@ -434,36 +676,38 @@ mem_block_debug_info(mem_block_t *mem_block, char *buf, int32_t size)
 }
 
 int32_t
-mem_block_signature(mem_block_t *mem_block, unsigned char digest[20])
+mem_block_signature(mem_block_t *mem_block, unsigned char digest[INFQ_SIGNATURE_LEN])
 {
     if (mem_block == NULL || digest == NULL) {
         INFQ_ERROR_LOG("invalid param");
         return INFQ_ERR;
     }
 
-    char        buf[INFQ_MAX_BUF_SIZE];
-    int         ret;
-    SHA1_CTX    ctx;
-
-    ret = snprintf(buf, INFQ_MAX_BUF_SIZE, "si=%lld;fo=%d;lo=%d;ec=%d",
+    mem_block_make_signature(
             mem_block->start_index,
-            mem_block->first_offset,
+            mem_block->ele_count,
+            mem_block->offset_array.offsets + mem_block->offset_array.start_idx,
+            mem_block->crc,
             mem_block->last_offset,
-            mem_block->ele_count);
-    if (ret < 0) {
-        INFQ_ERROR_LOG_BY_ERRNO("failed to format signature string");
-        return INFQ_ERR;
-    } else if (ret >= INFQ_MAX_BUF_SIZE) {
-        INFQ_ERROR_LOG("failed to format signature string, buffer is too small, "
-                "buf size: %d, expected: %d",
-                INFQ_MAX_BUF_SIZE,
-                ret);
-        return INFQ_ERR;
-    }
-
-    SHA1Init(&ctx);
-    SHA1Update(&ctx, (unsigned char *)buf, ret);
-    SHA1Final(digest, &ctx);
+            digest);
 
     return INFQ_OK;
 }
+
+void
+mem_block_make_signature(int64_t start_index, int32_t ele_count, const int32_t *offsets,
+        uint32_t data_crc, int32_t data_size, unsigned char digest[INFQ_SIGNATURE_LEN])
+{
+    int64_t     header[2] = {start_index, ele_count};
+    uint32_t    crc;
+
+    crc = crc32c(0, header, sizeof(header));
+    if (ele_count > 0) {
+        crc = crc32c(crc, offsets, sizeof(int32_t) * ele_count);
+    }
+
+    memcpy(digest, INFQ_SIGNATURE_TAG, INFQ_SIGNATURE_TAG_LEN);
+    memcpy(digest + INFQ_SIGNATURE_TAG_LEN, &data_crc, sizeof(uint32_t));
+    memcpy(digest + INFQ_SIGNATURE_TAG_LEN + 4, &crc, sizeof(uint32_t));
+    memcpy(digest + INFQ_SIGNATURE_TAG_LEN + 8, &data_size, sizeof(int32_t));
+}
@@ -9,6 +9,7 @@
 #define COM_MOMO_INFQ_MEM_BLOCK_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "offset_array.h"
 
@@ -18,9 +19,14 @@
 #define mem_block_min_index(blk)    (blk)->start_index
 #define mem_block_max_index(blk)    ((blk)->start_index + (blk)->ele_count - 1)
 #define mem_block_file_blk_no(blk)  (blk)->file_block_no
+#define mem_block_is_view(blk)      ((blk)->map_addr != NULL)
 
 #define INFQ_PADDING_MASK   0x07
 
+#define INFQ_SIGNATURE_LEN  20
+#define INFQ_SIGNATURE_TAG  "crc32c\0"  // 8 bytes with the terminating '\0'
+#define INFQ_SIGNATURE_TAG_LEN  8
+
 typedef struct _mem_block_t {
     volatile int64_t    start_index;    /* Global index of the first element in the block */
     int32_t             mem_size;       /* Size of the block */
@@ -31,25 +37,97 @@ typedef struct _mem_block_t {
     int32_t             file_block_no;  /* When memory block is loaded from a file block, 'file_block_no'
                                            specifies the file descriptor of the file block */
     offset_array_t      offset_array;   /* Mapping the offset of element by index */
-    char                mem[1];
+    char                *mem;           /* Data of the block. It points to 'buf', or to the
+                                           read-only mapping of a file block when the block is
+                                           a view, see 'mem_block_map' */
+    void                *map_addr;      /* Start of the mapping of a view, NULL otherwise */
+    int32_t             map_size;       /* Size of the mapping */
+    uint32_t            crc;            /* CRC32C of [0, last_offset), extended as elements are
+                                           pushed */
+    char                buf[1];
 } mem_block_t;
 
 mem_block_t* mem_block_init(int32_t block_size);
+
+/**
+ * Change the memory size of the block, the data in [0, last_offset) is kept.
+ *      The block may be moved, so the new block is returned. NULL is returned
+ *      on failure and the original block is untouched.
+ */
+mem_block_t* mem_block_resize(mem_block_t *mem_block, int32_t block_size);
 int32_t mem_block_push(mem_block_t *mem_block, void *data, int32_t size);
+
+/**
+ * Reserve space for an element of at most 'size' bytes. 'dst' points to the
+ *      memory just after the length prefix, the element is visible only after
+ *      'mem_block_commit' is called.
+ */
+int32_t mem_block_reserve(mem_block_t *mem_block, int32_t size, void **dst);
+
+/**
+ * Commit the element written to the reserved memory, 'size' is the actual size
+ *      of the element and must not exceed the reserved size.
+ */
+int32_t mem_block_commit(mem_block_t *mem_block, int32_t size);
+
+/**
+ * Push as many elements of 'elems' as the block can hold. The number of elements
+ *      stored is returned by 'pushed', it's less than 'n' when the block is full.
+ */
+int32_t mem_block_push_batch(mem_block_t *mem_block, const struct iovec *elems, int32_t n,
+        int32_t *pushed);
 int32_t mem_block_pop(mem_block_t *mem_block, void *buf, int32_t buf_size, int32_t *sizeptr);
 int32_t mem_block_just_pop(mem_block_t *mem_block);
 int32_t mem_block_at(mem_block_t *mem_block, int64_t global_idx, void *buf, int32_t buf_size, int32_t *sizeptr);
 int32_t mem_block_top(mem_block_t *mem_block, void *buf, int32_t buf_size, int32_t *sizeptr);
+
+/**
+ * Reset the block to be empty. The mapping of a view is released and the block
+ *      uses its own memory again.
+ */
 int32_t mem_block_reset(mem_block_t *mem_block, int64_t start_index);
 
 /**
- * Fetch the signature of the memory block. Used to check the consistency of
- *      memory block and file block.
+ * Make the block a read-only view of 'size' bytes at 'data', which is in the
+ *      mapping [map_addr, map_addr + map_size). The block takes the ownership of
+ *      the mapping, and its own memory is kept for later use. Elements of a view
+ *      can only be read or popped. 'crc' of the view is set by the caller.
+ */
+int32_t mem_block_map(mem_block_t *mem_block, void *map_addr, int32_t map_size, char *data,
+        int32_t size);
+
+/**
+ * Release the mapping of a view, the pointers to its elements are invalid after.
  */
-int32_t mem_block_signature(mem_block_t *mem_block, unsigned char digest[20]);
+void mem_block_unmap(mem_block_t *mem_block);
+
+/**
+ * Fetch the signature of the memory block, which is the trailer of the file block
+ *      dumped from it. Used to check the consistency of memory block and file block,
+ *      and the integrity of file block.
+ *
+ *  |-- Tag(8B) --|-- CRC32C of data(4B) --|-- CRC32C of header(4B) --|-- Data size(4B) --|
+ *
+ *      The header is the start index and element count as 8 bytes integers, followed
+ *      by the offsets of elements.
+ */
+int32_t mem_block_signature(mem_block_t *mem_block, unsigned char digest[INFQ_SIGNATURE_LEN]);
+
+/**
+ * Build the signature from the header and the CRC32C of 'data_size' bytes of data.
+ */
+void mem_block_make_signature(int64_t start_index, int32_t ele_count, const int32_t *offsets,
+        uint32_t data_crc, int32_t data_size, unsigned char digest[INFQ_SIGNATURE_LEN]);
 void mem_block_destroy(mem_block_t *mem_block);
 
 int32_t mem_block_pop_zero_cp(mem_block_t *mem_block, const void **dataptr, int32_t *sizeptr);
+
+/**
+ * Pop at most 'max' elements of the block by zero copy. The number of elements
+ *      popped is returned by 'n', 0 means the block is empty.
+ */
+int32_t mem_block_pop_batch_zero_cp(mem_block_t *mem_block, const void **ptrs, int32_t *sizes,
+        int32_t max, int32_t *n);
 int32_t mem_block_at_zero_cp(mem_block_t *mem_block, int64_t global_idx, const void **dataptr, int32_t *sizeptr);
 int32_t mem_block_top_zero_cp(mem_block_t *mem_block, const void **dataptr, int32_t *sizeptr);
 int32_t mem_block_debug_info(mem_block_t *mem_block, char *buf, int32_t size);
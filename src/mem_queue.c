@@ -9,12 +9,15 @@
 #include <string.h>
 
 #include "mem_queue.h"
+#include "block_pool.h"
 #include "infq.h"
 
 #define idx_in_mblock(mb, idx)      ((idx) >= (mb)->start_index && \
                                              (idx) < (mb)->start_index + (mb)->ele_count)
 
 mem_block_t* search_block_by_idx(mem_queue_t *mem_queue, int64_t idx);
+static int32_t mem_queue_next_block(mem_queue_t *mem_queue, int64_t ele_idx);
+static int32_t mem_queue_grow_last_block(mem_queue_t *mem_queue, int32_t size);
 
 int32_t
 mem_queue_init(mem_queue_t *mem_queue, int32_t block_num, int32_t block_size)
@@ -35,23 +38,18 @@ mem_queue_init(mem_queue_t *mem_queue, int32_t block_num, int32_t block_size)
 
     // make sure that mem block size can be exactly divided by 8.
     block_size = (block_size + 7) & (~INFQ_PADDING_MASK);
+    mem_queue->block_size = block_size;
 
+    // NOTICE: blocks are allocated when the queue advances into the slot, even the
+    //      first one is allocated by the first push or load
     for (int32_t i = 0; i < block_num; i++) {
-        mem_queue->blocks[i] = mem_block_init(block_size);
-        if (mem_queue->blocks[i] == NULL) {
-            INFQ_ERROR_LOG("failed to init and alloc memory block");
-            goto failed;
-        }
+        mem_queue->blocks[i] = NULL;
     }
 
     mem_queue->min_idx = INFQ_UNDEF;
     mem_queue->max_idx = INFQ_UNDEF;
 
     return INFQ_OK;
-
-failed:
-    mem_queue_destroy(mem_queue);
-    return INFQ_ERR;
 }
 
 int32_t
@@ -62,6 +60,30 @@ mem_queue_push(mem_queue_t *mem_queue, int64_t ele_idx, void *data, int32_t size
         return INFQ_ERR;
     }
 
+    void    *dst;
+
+    if (mem_queue_push_reserve(mem_queue, ele_idx, size, &dst) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+
+    memcpy(dst, data, size);
+
+    return mem_queue_push_commit(mem_queue, ele_idx, size);
+}
+
+int32_t
+mem_queue_push_reserve(mem_queue_t *mem_queue, int64_t ele_idx, int32_t size, void **dst)
+{
+    if (mem_queue == NULL || dst == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (size < 0 || size > INFQ_MAX_ELE_SIZE) {
+        INFQ_ERROR_LOG("invalid element size: %d", size);
+        return INFQ_ERR;
+    }
+
 #ifdef D_ASSERT
     INFQ_ASSERT(mem_queue->max_idx - mem_queue->min_idx == mem_queue->ele_count,
             "index range and count of queue aren't match, min: %lld,"
@@ -74,8 +96,10 @@ mem_queue_push(mem_queue_t *mem_queue, int64_t ele_idx, void *data, int32_t size
 #endif
 
     // double check
+    // NOTICE: a full queue is expected by the overflow policies, the caller decides
+    //      whether it's an error
     if (mem_queue_full(mem_queue)) {
-        INFQ_ERROR_LOG("queue is full, block idx: [%d, %d], ele idx: [%d, %d]",
+        INFQ_DEBUG_LOG("queue is full, block idx: [%d, %d], ele idx: [%d, %d]",
                 mem_queue->first_block,
                 mem_queue->last_block,
                 mem_queue->min_idx,
@@ -83,12 +107,11 @@ mem_queue_push(mem_queue_t *mem_queue, int64_t ele_idx, void *data, int32_t size
         return INFQ_ERR;
     }
 
-    // fetch the last block
-    mem_block_t *block = last_block(mem_queue);
-    if (block == NULL) {
-        INFQ_ERROR_LOG("block is NULL, last index: %d", mem_queue->last_block);
+    // fetch the last block, it may be released when the queue is idle
+    if (mem_queue_alloc_block(mem_queue, mem_queue->last_block) == INFQ_ERR) {
         return INFQ_ERR;
     }
+    mem_block_t *block = last_block(mem_queue);
 
     // init start index of block
     if (block->start_index == INFQ_UNDEF) {
@@ -96,32 +119,43 @@ mem_queue_push(mem_queue_t *mem_queue, int64_t ele_idx, void *data, int32_t size
     }
 
     // make sure the block has enough space
-    if (mem_block_avail(block) < mem_block_ele_size(size)) {
-        // TODO: make sure the next block is not in the dumping state
-
-        mem_queue->last_block = (mem_queue->last_block + 1) % mem_queue->block_num;
+    if (mem_block_avail(block) < mem_block_ele_size(size) && block->last_offset > 0) {
+        if (mem_queue_next_block(mem_queue, ele_idx) == INFQ_ERR) {
+            return INFQ_ERR;
+        }
         block = last_block(mem_queue);
-        mem_block_reset(block, ele_idx);
+    }
 
-        // one block full, call the callback function
-        if (mem_queue->push_blk_cb != NULL && mem_queue->push_blk_cb_arg != NULL) {
-            mem_queue->push_blk_cb(mem_queue->push_blk_cb_arg);
-        }
+    if (mem_block_avail(block) < mem_block_ele_size(size)
+            && mem_queue_grow_last_block(mem_queue, size) == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+    block = last_block(mem_queue);
 
-        // the block queue is full
-        if (mem_queue_full(mem_queue)) {
-            INFQ_ERROR_LOG("queue is full, first block: %d, last block: %d, block num: %d"
-                    ", min: %lld, max: %lld",
-                    mem_queue->first_block,
-                    mem_queue->last_block,
-                    mem_queue->block_num,
-                    mem_queue->min_idx,
-                    mem_queue->max_idx);
-            return INFQ_ERR;
-        }
+    if (mem_block_reserve(block, size, dst) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to reserve memory block, data size: %d, avail size: %d, "
+                "first block: %d, last block: %d",
+                size,
+                mem_block_avail(block),
+                mem_queue->first_block,
+                mem_queue->last_block);
+        return INFQ_ERR;
     }
 
-    if (mem_block_push(block, data, size) == INFQ_ERR) {
+    return INFQ_OK;
+}
+
+int32_t
+mem_queue_push_commit(mem_queue_t *mem_queue, int64_t ele_idx, int32_t size)
+{
+    if (mem_queue == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    mem_block_t *block = last_block(mem_queue);
+
+    if (mem_block_commit(block, size) == INFQ_ERR) {
         INFQ_ERROR_LOG("failed to push data to memory block, data size: %d, avail size: %d, "
                 "first block: %d, last block: %d",
                 size,
@@ -143,6 +177,143 @@ mem_queue_push(mem_queue_t *mem_queue, int64_t ele_idx, void *data, int32_t size
     return INFQ_OK;
 }
 
+int32_t
+mem_queue_push_batch(
+        mem_queue_t *mem_queue,
+        int64_t ele_idx,
+        const struct iovec *elems,
+        int32_t n,
+        int32_t *pushed)
+{
+    if (mem_queue == NULL || elems == NULL || pushed == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    mem_block_t     *block;
+    int32_t         count, i;
+
+    *pushed = 0;
+
+    // NOTICE: the lengths are narrowed to int32_t when they're stored, so all of them
+    //      are checked before any element is pushed
+    for (i = 0; i < n; i++) {
+        if (elems[i].iov_len > (size_t)INFQ_MAX_ELE_SIZE) {
+            INFQ_ERROR_LOG("element is too large, idx in batch: %d, size: %zu",
+                    i,
+                    elems[i].iov_len);
+            return INFQ_ERR;
+        }
+    }
+
+    if (mem_queue_full(mem_queue)) {
+        return INFQ_OK;
+    }
+
+    while (*pushed < n) {
+        if (mem_queue_alloc_block(mem_queue, mem_queue->last_block) == INFQ_ERR) {
+            return INFQ_ERR;
+        }
+        block = last_block(mem_queue);
+
+        if (block->start_index == INFQ_UNDEF) {
+            block->start_index = ele_idx + *pushed;
+        }
+
+        // fill the current block as much as possible
+        if (mem_block_push_batch(block, elems + *pushed, n - *pushed, &count) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to push batch to memory block, first block: %d, last block: %d",
+                    mem_queue->first_block,
+                    mem_queue->last_block);
+            return INFQ_ERR;
+        }
+
+        if (count > 0) {
+            if (mem_queue->min_idx == INFQ_UNDEF) {
+                mem_queue->min_idx = ele_idx + *pushed;
+            }
+            *pushed += count;
+            mem_queue->ele_count += count;
+            mem_queue->max_idx = ele_idx + *pushed;
+            continue;
+        }
+
+        // an empty block can't hold the element
+        if (block->last_offset == 0) {
+            if (mem_queue_grow_last_block(mem_queue, (int32_t)elems[*pushed].iov_len) == INFQ_ERR) {
+                return INFQ_ERR;
+            }
+            continue;
+        }
+
+        // NOTICE: the queue is full, stop and report the elements already pushed
+        if (mem_queue_next_block(mem_queue, ele_idx + *pushed) == INFQ_ERR) {
+            if (!mem_queue_full(mem_queue)) {
+                return INFQ_ERR;
+            }
+            break;
+        }
+    }
+
+    return INFQ_OK;
+}
+
+/**
+ * Make the push queue jump to the next block when the last block is full.
+ * The callback for a full block is called once each block.
+ */
+static int32_t
+mem_queue_next_block(mem_queue_t *mem_queue, int64_t ele_idx)
+{
+    mem_block_t     *block;
+    int32_t         drained;
+
+    // TODO: make sure the next block is not in the dumping state
+
+    if (mem_queue_alloc_block(mem_queue, (mem_queue->last_block + 1) % mem_queue->block_num)
+            == INFQ_ERR) {
+        return INFQ_ERR;
+    }
+
+    // NOTICE: a block drained with the queue stays the first block, e.g. a jumbo block
+    //      which is full once its element is pushed. The first block moves on with the
+    //      last one, otherwise the next pop finds it empty and fails
+    drained = mem_queue_empty(mem_queue);
+    mem_queue->last_block = (mem_queue->last_block + 1) % mem_queue->block_num;
+    if (drained) {
+        mem_queue->first_block = mem_queue->last_block;
+    }
+    block = last_block(mem_queue);
+    mem_block_reset(block, ele_idx);
+
+    // release the memory of a jumbo block when it's reused
+    if (block->mem_size > mem_queue->block_size) {
+        block = block_pool_resize(block, mem_queue->block_size);
+        if (block != NULL) {
+            last_block(mem_queue) = block;
+        }
+    }
+
+    // one block full, call the callback function
+    if (mem_queue->push_blk_cb != NULL && mem_queue->push_blk_cb_arg != NULL) {
+        mem_queue->push_blk_cb(mem_queue->push_blk_cb_arg);
+    }
+
+    // the block queue is full
+    if (mem_queue_full(mem_queue)) {
+        INFQ_DEBUG_LOG("queue is full, first block: %d, last block: %d, block num: %d"
+                ", min: %lld, max: %lld",
+                mem_queue->first_block,
+                mem_queue->last_block,
+                mem_queue->block_num,
+                mem_queue->min_idx,
+                mem_queue->max_idx);
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
 int32_t
 mem_queue_pop(mem_queue_t *mem_queue, void *buf, int32_t buf_size, int32_t *sizeptr)
 {
@@ -286,6 +457,69 @@ mem_queue_pop_zero_cp(mem_queue_t *mem_queue, const void **dataptr, int32_t *siz
     return INFQ_OK;
 }
 
+int32_t
+mem_queue_pop_batch_zero_cp(mem_queue_t *mem_queue, const void **ptrs, int32_t *sizes,
+        int32_t max, int32_t *n)
+{
+    if (mem_queue == NULL || ptrs == NULL || sizes == NULL || n == NULL || max < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    *n = 0;
+
+    // queue is empty
+    if (mem_queue_empty(mem_queue) || max == 0) {
+        return INFQ_OK;
+    }
+
+    mem_block_t *block = first_block(mem_queue);
+    if (block == NULL) {
+        INFQ_ERROR_LOG("memory block is NULL");
+        return INFQ_ERR;
+    }
+
+    if (mem_block_pop_batch_zero_cp(block, ptrs, sizes, max, n) == INFQ_ERR) {
+        INFQ_ERROR_LOG("failed to pop batch from memory block");
+        return INFQ_ERR;
+    }
+
+    if (*n == 0 && mem_queue->ele_count > 0) {
+        INFQ_ERROR_LOG("queue has elements, but pop from block empty, min: %lld, max: %lld"
+                ", count: %d",
+                mem_queue->min_idx,
+                mem_queue->max_idx,
+                mem_queue->ele_count);
+        return INFQ_ERR;
+    }
+
+    if (mem_queue->min_idx + *n > mem_queue->max_idx) {
+        INFQ_ERROR_LOG("unexpect index range, min idx: %lld, max idx: %lld, ele count: %d"
+                ", popped: %d",
+                mem_queue->min_idx,
+                mem_queue->max_idx,
+                mem_queue->ele_count,
+                *n);
+        return INFQ_ERR;
+    }
+
+    mem_queue->min_idx += *n;
+    mem_queue->ele_count -= *n;
+
+    // the block is drained, call the callback function once
+    if (mem_block_empty(block) && mem_queue->pop_blk_cb != NULL
+            && mem_queue->pop_blk_cb_arg != NULL) {
+        mem_queue->pop_blk_cb(mem_queue->pop_blk_cb_arg, block);
+    }
+
+    // make 'first_block' point to the next block
+    if (mem_block_empty(block) && !mem_queue_empty(mem_queue)) {
+        mem_queue->first_block = (mem_queue->first_block + 1) % mem_queue->block_num;
+    }
+
+    return INFQ_OK;
+}
+
 int32_t
 mem_queue_just_pop(mem_queue_t *mem_queue)
 {
@@ -457,14 +691,14 @@ mem_queue_jump(mem_queue_t *mem_queue)
     // check current last block to see if it's an empty mem block,
     // quit the jump if it's empty
     mem_block_t *block = last_block(mem_queue);
-    if (mem_block_empty(block)) {
+    if (block == NULL || mem_block_empty(block)) {
         INFQ_DEBUG_LOG("mem block is empty, quit the mem queue jump");
         return INFQ_OK;
     }
 
     // check the memory queue to see if it's already full
     if (mem_queue_full(mem_queue)) {
-        INFQ_ERROR_LOG("queue is full, first block: %d, last block: %d, block num: %d"
+        INFQ_DEBUG_LOG("queue is full, first block: %d, last block: %d, block num: %d"
                 ", min: %lld, max: %lld",
                 mem_queue->first_block,
                 mem_queue->last_block,
@@ -474,6 +708,10 @@ mem_queue_jump(mem_queue_t *mem_queue)
         return INFQ_ERR;
     }
     // jump to next memory block
+    if (mem_queue_alloc_block(mem_queue, (mem_queue->last_block + 1) % mem_queue->block_num)
+            == INFQ_ERR) {
+        return INFQ_ERR;
+    }
     mem_queue->last_block = (mem_queue->last_block + 1) % mem_queue->block_num;
 
     // reset the last block
@@ -501,9 +739,10 @@ mem_queue_destroy(mem_queue_t *mem_queue)
         if (mem_queue->blocks[i] == NULL) {
             continue;
         }
-        mem_block_destroy(mem_queue->blocks[i]);
+        block_pool_put(mem_queue->blocks[i]);
         mem_queue->blocks[i] = NULL;
     }
+    mem_queue->alloc_block_num = 0;
 
     if (mem_queue->blocks != NULL) {
         free(mem_queue->blocks);
@@ -524,6 +763,75 @@ mem_queue_reset(mem_queue_t *mem_queue)
     mem_queue->min_idx = mem_queue->max_idx = INFQ_UNDEF;
 }
 
+int32_t
+mem_queue_alloc_block(mem_queue_t *mem_queue, int32_t idx)
+{
+    if (mem_queue == NULL || idx < 0 || idx >= mem_queue->block_num) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (mem_queue->blocks[idx] != NULL) {
+        return INFQ_OK;
+    }
+
+    mem_queue->blocks[idx] = block_pool_get(mem_queue->block_size);
+    if (mem_queue->blocks[idx] == NULL) {
+        INFQ_ERROR_LOG("failed to alloc memory block, idx: %d, block size: %d",
+                idx,
+                mem_queue->block_size);
+        return INFQ_ERR;
+    }
+    mem_queue->alloc_block_num++;
+
+    return INFQ_OK;
+}
+
+int32_t
+mem_queue_release_free_blocks(mem_queue_t *mem_queue)
+{
+    if (mem_queue == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    int32_t     i, released;
+
+    // the blocks in (last_block, first_block) are unused
+    released = 0;
+    for (i = (mem_queue->last_block + 1) % mem_queue->block_num; i != mem_queue->first_block;
+            i = (i + 1) % mem_queue->block_num) {
+        if (mem_queue->blocks[i] == NULL) {
+            continue;
+        }
+        block_pool_put(mem_queue->blocks[i]);
+        mem_queue->blocks[i] = NULL;
+        mem_queue->alloc_block_num--;
+        released++;
+    }
+
+    return released;
+}
+
+int32_t
+mem_queue_release_empty_block(mem_queue_t *mem_queue)
+{
+    if (mem_queue == NULL) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (!mem_queue_empty(mem_queue) || last_block(mem_queue) == NULL) {
+        return 0;
+    }
+
+    block_pool_put(last_block(mem_queue));
+    last_block(mem_queue) = NULL;
+    mem_queue->alloc_block_num--;
+
+    return 1;
+}
+
 mem_block_t*
 search_block_by_idx(mem_queue_t *mem_queue, int64_t idx)
 {
@@ -538,7 +846,7 @@ search_block_by_idx(mem_queue_t *mem_queue, int64_t idx)
     b = mem_queue->first_block;
     // NOTICE: for pop queue the last block is always empty.
     //      for push queue the last block may be not empty.
-    if (last_block(mem_queue)->ele_count == 0) {
+    if (last_block(mem_queue) == NULL || last_block(mem_queue)->ele_count == 0) {
         e = (mem_queue->last_block - 1) % mem_queue->block_num;
     } else {
         e = mem_queue->last_block;
@@ -570,3 +878,32 @@ search_block_by_idx(mem_queue_t *mem_queue, int64_t idx)
     INFQ_ERROR_LOG("block contains value indexed by '%lld' not found", idx);
     return NULL;
 }
+
+/**
+ * Grow the empty last block to hold an element larger than the block size.
+ *      The jumbo block holds only this element, and it's shrunk to the normal
+ *      size when it's reused by 'mem_queue_next_block'.
+ */
+static int32_t
+mem_queue_grow_last_block(mem_queue_t *mem_queue, int32_t size)
+{
+    mem_block_t     *block;
+
+    // NOTICE: keep the size divided by 8, the same as the normal block
+    block = block_pool_resize(last_block(mem_queue),
+            (mem_block_ele_size(size) + 7) & (~INFQ_PADDING_MASK));
+    if (block == NULL) {
+        INFQ_ERROR_LOG("failed to grow memory block for a large element, data size: %d, "
+                "block size: %d",
+                size,
+                mem_queue->block_size);
+        return INFQ_ERR;
+    }
+    last_block(mem_queue) = block;
+
+    INFQ_DEBUG_LOG("grow memory block for a large element, data size: %d, start index: %lld",
+            size,
+            block->start_index);
+
+    return INFQ_OK;
+}
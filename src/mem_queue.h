@@ -15,11 +15,14 @@
 #define mem_queue_full(q)           ((q)->first_block == ((q)->last_block + 1) % (q)->block_num)
 #define mem_queue_has_full_block(q) ((q)->first_block != (q)->last_block)
 
+// the largest element, which is stored in a jumbo block padded by 8 bytes
+#define INFQ_MAX_ELE_SIZE           (INT32_MAX - (int32_t)sizeof(int32_t) - INFQ_PADDING_MASK)
+
 // the last block is not used
 #define mem_queue_full_block_num(q) ((q)->last_block - (q)->first_block + (q)->block_num) % (q)->block_num
 #define mem_queue_free_block_num(q) (q)->block_num - 1 - mem_queue_full_block_num(q)
 #define mem_queue_empty(q)          ((q)->first_block == (q)->last_block && \
-        mem_block_empty(first_block( (q) )))
+        (first_block( (q) ) == NULL || mem_block_empty(first_block( (q) ))))
 
 // add callback funtion and argument
 #define mem_queue_add_pop_blk_cb(q,cb,arg)  do { (q)->pop_blk_cb = (cb); (q)->pop_blk_cb_arg = (arg); } while(0)
@@ -32,6 +35,8 @@ typedef struct _mem_queue_t {
     // circle queue
     mem_block_t             **blocks;
     int32_t                 block_num;
+    int32_t                 block_size;     // a block holding a jumbo element is larger than it
+    volatile int32_t        alloc_block_num;    // blocks are allocated on demand
     volatile int32_t        first_block;
     volatile int32_t        last_block;
     volatile int32_t        ele_count;
@@ -47,6 +52,21 @@ typedef struct _mem_queue_t {
 
 int32_t mem_queue_init(mem_queue_t *mem_queue, int32_t block_num, int32_t block_size);
 int32_t mem_queue_push(mem_queue_t *mem_queue, int64_t ele_idx, void *data, int32_t size);
+
+/**
+ * Reserve space in the last block for an element of at most 'size' bytes, it jumps
+ *      to the next block if the last one hasn't enough space. The element is
+ *      pushed after 'mem_queue_push_commit' with its actual size.
+ */
+int32_t mem_queue_push_reserve(mem_queue_t *mem_queue, int64_t ele_idx, int32_t size, void **dst);
+int32_t mem_queue_push_commit(mem_queue_t *mem_queue, int64_t ele_idx, int32_t size);
+
+/**
+ * Push a batch of elements, the index of the first element is 'ele_idx'. When the
+ *      queue becomes full, INFQ_OK is returned and 'pushed' is less than 'n'.
+ */
+int32_t mem_queue_push_batch(mem_queue_t *mem_queue, int64_t ele_idx, const struct iovec *elems,
+        int32_t n, int32_t *pushed);
 int32_t mem_queue_pop(mem_queue_t *mem_queue, void *buf, int32_t buf_size, int32_t *sizeptr);
 int32_t mem_queue_just_pop(mem_queue_t *mem_queue);
 int32_t mem_queue_top(mem_queue_t *mem_queue, void *buf, int32_t buf_size, int32_t *sizeptr);
@@ -55,7 +75,33 @@ int32_t mem_queue_jump(mem_queue_t *mem_queue); //only used by push queue
 void mem_queue_destroy(mem_queue_t *mem_queue);
 void mem_queue_reset(mem_queue_t *mem_queue);
 
+/**
+ * Allocate the block of slot 'idx' if it isn't allocated yet. The slots in
+ *      [first_block, last_block] are allocated, the others may be NULL. The only
+ *      exception is the last block of an empty queue, which is allocated lazily.
+ */
+int32_t mem_queue_alloc_block(mem_queue_t *mem_queue, int32_t idx);
+
+/**
+ * Free the blocks of unused slots, the number of blocks released is returned.
+ */
+int32_t mem_queue_release_free_blocks(mem_queue_t *mem_queue);
+
+/**
+ * Free the last block if the queue is empty, it's allocated again by the next
+ *      push or load. 1 is returned if it's released, otherwise 0.
+ */
+int32_t mem_queue_release_empty_block(mem_queue_t *mem_queue);
+
 int32_t mem_queue_pop_zero_cp(mem_queue_t *mem_queue, const void **dataptr, int32_t *sizeptr);
+
+/**
+ * Pop at most 'max' elements from the first block by zero copy, the number of
+ *      elements popped is returned by 'n'. It stops at the end of the first block,
+ *      so the elements returned by one call always come from the same block.
+ */
+int32_t mem_queue_pop_batch_zero_cp(mem_queue_t *mem_queue, const void **ptrs, int32_t *sizes,
+        int32_t max, int32_t *n);
 int32_t mem_queue_top_zero_cp(mem_queue_t *mem_queue, const void **dataptr, int32_t *sizeptr);
 int32_t mem_queue_at_zero_cp(mem_queue_t *mem_queue, int64_t idx, const void **dataptr, int32_t *sizeptr);
 
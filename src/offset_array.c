@@ -80,6 +80,26 @@ offset_array_push(offset_array_t *offset_array, uint32_t offset)
     return INFQ_OK;
 }
 
+int32_t
+offset_array_reserve(offset_array_t *offset_array, int32_t n)
+{
+    if (offset_array == NULL || n < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    while (offset_array->size + n > offset_array->capacity) {
+        if (offset_array_expand(offset_array) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to expand space, current capacity: %d, expected: %d",
+                    offset_array->capacity,
+                    offset_array->size + n);
+            return INFQ_ERR;
+        }
+    }
+
+    return INFQ_OK;
+}
+
 int32_t
 offset_array_cp(offset_array_t *dist, const offset_array_t *src)
 {
@@ -151,6 +171,30 @@ offset_array_incr_start(offset_array_t *offset_array)
     return INFQ_OK;
 }
 
+int32_t
+offset_array_incr_start_by(offset_array_t *offset_array, int32_t n)
+{
+    if (offset_array == NULL || n < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    if (offset_array->start_idx + n > offset_array->size) {
+        INFQ_ERROR_LOG("failed to increase start index, must not larger than size, "
+                "start: %d, n: %d, size: %d",
+                offset_array->start_idx,
+                n,
+                offset_array->size);
+        return INFQ_ERR;
+    }
+
+    // NOTICE: the skipped offsets are not marked as INFQ_UNDEF one by one, they
+    //      are out of [start_idx, size) and never be read
+    offset_array->start_idx += n;
+
+    return INFQ_OK;
+}
+
 int32_t
 offset_array_size(const offset_array_t *offset_array)
 {
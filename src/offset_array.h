@@ -24,6 +24,11 @@ typedef struct _offset_array_t {
 
 int32_t offset_array_init(offset_array_t *offset_array);
 int32_t offset_array_push(offset_array_t *offset_array, uint32_t offset);
+
+/**
+ * make sure that 'n' more offsets can be pushed without expanding the array
+ */
+int32_t offset_array_reserve(offset_array_t *offset_array, int32_t n);
 int32_t offset_array_cp(offset_array_t *dist, const offset_array_t *src);
 
 /**
@@ -32,6 +37,11 @@ int32_t offset_array_cp(offset_array_t *dist, const offset_array_t *src);
  */
 int32_t offset_array_get(const offset_array_t *offset_array, int32_t idx, int32_t *offset);
 int32_t offset_array_incr_start(offset_array_t *offset_array);
+
+/**
+ * skip 'n' offsets at the start of the array at once, used by batched pop
+ */
+int32_t offset_array_incr_start_by(offset_array_t *offset_array, int32_t n);
 int32_t offset_array_size(const offset_array_t *offset_array);
 void offset_array_destroy(offset_array_t *offset_array);
 void offset_array_reset(offset_array_t *offset_array);
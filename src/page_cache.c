@@ -0,0 +1,236 @@
+/**
+ *
+ * @file    page_cache
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "page_cache.h"
+#include "infq.h"
+
+#define PAGE_CACHE_MIN_BUCKETS  16
+#define page_hash(cache, key, no)   \
+    (int32_t)((((uint64_t)(key) * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)(no)) \
+            & (uint64_t)((cache)->bucket_num - 1))
+
+static page_t* find_page(page_cache_t *cache, int64_t key, int64_t no);
+static void remove_page(page_cache_t *cache, page_t *page);
+static void push_page(page_cache_t *cache, page_t *page);
+
+int32_t
+page_cache_init(page_cache_t *cache, int32_t capacity)
+{
+    if (cache == NULL || capacity < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    memset(cache, 0, sizeof(page_cache_t));
+    cache->capacity = capacity;
+    if (capacity > 0) {
+        cache->bucket_num = PAGE_CACHE_MIN_BUCKETS;
+        while (cache->bucket_num < capacity) {
+            cache->bucket_num <<= 1;
+        }
+
+        cache->buckets = (page_t **)calloc(cache->bucket_num, sizeof(page_t *));
+        if (cache->buckets == NULL) {
+            INFQ_ERROR_LOG("failed to alloc mem for buckets of page cache, capacity: %d",
+                    capacity);
+            return INFQ_ERR;
+        }
+    }
+
+    if (pthread_mutex_init(&cache->mu, NULL) != 0) {
+        INFQ_ERROR_LOG("failed to init mu for page cache");
+        free(cache->buckets);
+        cache->buckets = NULL;
+        return INFQ_ERR;
+    }
+
+    return INFQ_OK;
+}
+
+void
+page_cache_destroy(page_cache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    page_t  *page, *next;
+
+    for (page = cache->head; page != NULL; page = next) {
+        next = page->next;
+        free(page);
+    }
+    free(cache->buckets);
+    cache->buckets = NULL;
+    cache->head = cache->tail = NULL;
+    cache->page_num = 0;
+    pthread_mutex_destroy(&cache->mu);
+}
+
+int32_t
+page_cache_read(
+        page_cache_t *cache,
+        int64_t key,
+        int64_t limit,
+        int64_t pos,
+        char *buf,
+        int32_t len,
+        page_fill_func fill,
+        void *arg)
+{
+    if (cache == NULL || buf == NULL || fill == NULL || pos < 0 || pos + len > limit) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    page_t      *page, *cached;
+    int64_t     no;
+    int32_t     off, n;
+
+    if (cache->capacity == 0) {
+        return fill(arg, pos, buf, len);
+    }
+
+    while (len > 0) {
+        no = pos / INFQ_PAGE_SIZE;
+        off = (int32_t)(pos % INFQ_PAGE_SIZE);
+        n = INFQ_PAGE_SIZE - off < len ? INFQ_PAGE_SIZE - off : len;
+
+        pthread_mutex_lock(&cache->mu);
+        page = find_page(cache, key, no);
+        if (page != NULL) {
+            remove_page(cache, page);
+            push_page(cache, page);
+            memcpy(buf, page->data + off, n);
+            cache->hits++;
+            pthread_mutex_unlock(&cache->mu);
+            goto next;
+        }
+        cache->misses++;
+        pthread_mutex_unlock(&cache->mu);
+
+        // NOTICE: the page is read without the lock, it may be read by others meanwhile
+        page = (page_t *)malloc(sizeof(page_t));
+        if (page == NULL) {
+            INFQ_ERROR_LOG("failed to alloc mem for page");
+            return INFQ_ERR;
+        }
+        page->key = key;
+        page->no = no;
+        page->len = limit - no * INFQ_PAGE_SIZE < INFQ_PAGE_SIZE
+            ? (int32_t)(limit - no * INFQ_PAGE_SIZE) : INFQ_PAGE_SIZE;
+        if (fill(arg, no * INFQ_PAGE_SIZE, page->data, page->len) == INFQ_ERR) {
+            INFQ_ERROR_LOG("failed to fill page, key: %lld, page: %lld", key, no);
+            free(page);
+            return INFQ_ERR;
+        }
+        memcpy(buf, page->data + off, n);
+
+        pthread_mutex_lock(&cache->mu);
+        cached = find_page(cache, key, no);
+        if (cached != NULL) {
+            free(page);
+        } else {
+            push_page(cache, page);
+            while (cache->page_num > cache->capacity) {
+                cached = cache->tail;
+                remove_page(cache, cached);
+                free(cached);
+            }
+        }
+        pthread_mutex_unlock(&cache->mu);
+
+next:
+        buf += n;
+        pos += n;
+        len -= n;
+    }
+
+    return INFQ_OK;
+}
+
+void
+page_cache_drop(page_cache_t *cache, int64_t key, int64_t limit)
+{
+    if (cache == NULL || cache->capacity == 0) {
+        return;
+    }
+
+    page_t      *page;
+    int64_t     no;
+
+    pthread_mutex_lock(&cache->mu);
+    for (no = 0; no * INFQ_PAGE_SIZE < limit && cache->page_num > 0; no++) {
+        if ((page = find_page(cache, key, no)) != NULL) {
+            remove_page(cache, page);
+            free(page);
+        }
+    }
+    pthread_mutex_unlock(&cache->mu);
+}
+
+static page_t*
+find_page(page_cache_t *cache, int64_t key, int64_t no)
+{
+    page_t  *page;
+
+    for (page = cache->buckets[page_hash(cache, key, no)]; page != NULL; page = page->hash_next) {
+        if (page->key == key && page->no == no) {
+            return page;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Unlink the page from its bucket and the LRU list.
+ */
+static void
+remove_page(page_cache_t *cache, page_t *page)
+{
+    page_t  **pp;
+
+    for (pp = &cache->buckets[page_hash(cache, page->key, page->no)]; *pp != page;
+            pp = &(*pp)->hash_next);
+    *pp = page->hash_next;
+
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        cache->head = page->next;
+    }
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    } else {
+        cache->tail = page->prev;
+    }
+    cache->page_num--;
+}
+
+/**
+ * Link the page to its bucket and the head of the LRU list.
+ */
+static void
+push_page(page_cache_t *cache, page_t *page)
+{
+    int32_t     h = page_hash(cache, page->key, page->no);
+
+    page->hash_next = cache->buckets[h];
+    cache->buckets[h] = page;
+
+    page->prev = NULL;
+    page->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = page;
+    } else {
+        cache->tail = page;
+    }
+    cache->head = page;
+    cache->page_num++;
+}
@@ -0,0 +1,69 @@
+/**
+ *
+ * A cache of the pages recently read from file blocks by random access, so the
+ * repeated and neighbouring reads of 'infq_at' into the spilled part of infQ are
+ * served from memory. A page is INFQ_PAGE_SIZE bytes of the data of a block, the
+ * data decompressed for a compressed block. Pages are keyed by the owner, e.g. the
+ * start index of the block, and the page number, the least recently used ones are
+ * evicted beyond the capacity.
+ *
+ * @file    page_cache
+ */
+
+#ifndef COM_MOMO_INFQ_PAGE_CACHE_H
+#define COM_MOMO_INFQ_PAGE_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define INFQ_PAGE_SIZE  4096
+
+/**
+ * Read 'len' bytes at 'pos' of the owner to 'page' when a page is missed.
+ */
+typedef int32_t (*page_fill_func)(void *arg, int64_t pos, char *page, int32_t len);
+
+typedef struct _page_t {
+    int64_t             key;                /* Owner of the page */
+    int64_t             no;                 /* Page number in the owner */
+    int32_t             len;                /* The last page of the owner may be short */
+    struct _page_t      *hash_next;
+    struct _page_t      *prev, *next;       /* LRU list, the most recently used one is at the head */
+    char                data[INFQ_PAGE_SIZE];
+} page_t;
+
+typedef struct _page_cache_t {
+    page_t              **buckets;
+    int32_t             bucket_num;         /* Power of 2 */
+    page_t              *head, *tail;
+    int32_t             page_num;
+    int32_t             capacity;           /* Max number of pages, 0 disables the cache */
+    int64_t             hits;
+    int64_t             misses;
+    pthread_mutex_t     mu;
+} page_cache_t;
+
+int32_t page_cache_init(page_cache_t *cache, int32_t capacity);
+void page_cache_destroy(page_cache_t *cache);
+
+/**
+ * @brief Read [pos, pos + len) of the owner 'key' whose size is 'limit', the pages
+ *      missed are filled by 'fill' and cached. It's thread-safe, the pages are filled
+ *      without holding the lock.
+ */
+int32_t page_cache_read(
+        page_cache_t *cache,
+        int64_t key,
+        int64_t limit,
+        int64_t pos,
+        char *buf,
+        int32_t len,
+        page_fill_func fill,
+        void *arg);
+
+/**
+ * @brief Evict the pages of the owner 'key' whose size is 'limit'.
+ */
+void page_cache_drop(page_cache_t *cache, int64_t key, int64_t limit);
+
+#endif
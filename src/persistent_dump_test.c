@@ -25,7 +25,22 @@ main(int argc, char* argv[])
         1024,
         30,
         30,
-        0.4
+        0.4,
+        INFQ_FALSE,
+        INFQ_OVERFLOW_FAIL,
+        0,
+        0,
+        INFQ_FALSE,
+        0,
+        0,
+        0,
+        INFQ_DURABILITY_NONE,
+        0,
+        0,
+        INFQ_CODEC_NONE,
+        INFQ_FALSE,
+        0,
+        0
     };
 
     if (argc < 4) {
@@ -39,7 +39,7 @@ infq_write(int32_t fd, const void *buf, int32_t size)
 }
 
 int32_t
-infq_pwrite(int32_t fd, const void *buf, int32_t size, int32_t offset)
+infq_pwrite(int32_t fd, const void *buf, int32_t size, off_t offset)
 {
     if (fd == -1 || buf == NULL) {
         INFQ_ERROR_LOG("invalid param");
@@ -85,7 +85,7 @@ infq_read(int32_t fd, void *buf, int32_t rlen)
 }
 
 int32_t
-infq_pread(int32_t fd, void *buf, int32_t rlen, int32_t offset)
+infq_pread(int32_t fd, void *buf, int32_t rlen, off_t offset)
 {
     if (fd == -1 || buf == NULL) {
         INFQ_ERROR_LOG("invalid param");
@@ -107,6 +107,95 @@ infq_pread(int32_t fd, void *buf, int32_t rlen, int32_t offset)
     return INFQ_OK;
 }
 
+/**
+ * Transfer 'iov' from 'offset' by pwritev or preadv, the progress is tracked by the
+ *      index of the current vector and the bytes done of it.
+ */
+static int32_t
+infq_prwv(int32_t fd, const struct iovec *iov, int32_t iovcnt, off_t offset, int32_t io_unit,
+        int32_t is_write)
+{
+    if (fd == -1 || iov == NULL || iovcnt < 0 || iovcnt > INFQ_MAX_IOVCNT || io_unit < 0) {
+        INFQ_ERROR_LOG("invalid param");
+        return INFQ_ERR;
+    }
+
+    struct iovec    vec[INFQ_MAX_IOVCNT];
+    int32_t         idx = 0, n, i;
+    size_t          skip = 0, len, part;
+    ssize_t         ret;
+
+    for (;;) {
+        // skip the vectors done
+        while (idx < iovcnt && skip == iov[idx].iov_len) {
+            idx++;
+            skip = 0;
+        }
+        if (idx == iovcnt) {
+            break;
+        }
+
+        // collect the rest, at most 'io_unit' bytes
+        n = 0;
+        len = 0;
+        for (i = idx; i < iovcnt && (io_unit == 0 || len < (size_t)io_unit); i++) {
+            part = iov[i].iov_len - (i == idx ? skip : 0);
+            if (io_unit > 0 && len + part > (size_t)io_unit) {
+                part = io_unit - len;
+            }
+            vec[n].iov_base = (char *)iov[i].iov_base + (i == idx ? skip : 0);
+            vec[n].iov_len = part;
+            n++;
+            len += part;
+        }
+
+        ret = is_write ? pwritev(fd, vec, n, offset) : preadv(fd, vec, n, offset);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            INFQ_ERROR_LOG_BY_ERRNO("failed to %s, offset: %lld, len: %lld",
+                    is_write ? "pwritev" : "preadv",
+                    (long long)offset,
+                    (long long)len);
+            return INFQ_ERR;
+        } else if (ret == 0) {
+            INFQ_ERROR_LOG("failed to %s, unexpected end of file, offset: %lld, len: %lld",
+                    is_write ? "pwritev" : "preadv",
+                    (long long)offset,
+                    (long long)len);
+            return INFQ_ERR;
+        }
+        offset += ret;
+
+        // advance to the first byte not transferred
+        while (ret > 0) {
+            part = iov[idx].iov_len - skip;
+            if ((size_t)ret < part) {
+                skip += ret;
+                break;
+            }
+            ret -= part;
+            idx++;
+            skip = 0;
+        }
+    }
+
+    return INFQ_OK;
+}
+
+int32_t
+infq_pwritev(int32_t fd, const struct iovec *iov, int32_t iovcnt, off_t offset, int32_t io_unit)
+{
+    return infq_prwv(fd, iov, iovcnt, offset, io_unit, INFQ_TRUE);
+}
+
+int32_t
+infq_preadv(int32_t fd, const struct iovec *iov, int32_t iovcnt, off_t offset, int32_t io_unit)
+{
+    return infq_prwv(fd, iov, iovcnt, offset, io_unit, INFQ_FALSE);
+}
+
 long long
 time_us()
 {
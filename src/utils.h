@@ -11,10 +11,14 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #include "infq.h"
 #include "logging.h"
 
+#define INFQ_MAX_IOVCNT     8
+
 #define infq_pthread_mutex_lock(mu) \
     do {    \
         switch (pthread_mutex_lock(mu)) {   \
@@ -41,8 +45,18 @@
 
 int32_t infq_write(int32_t fd, const void *buf, int32_t size);
 int32_t infq_read(int32_t fd, void *buf, int32_t rlen);
-int32_t infq_pwrite(int32_t fd, const void *buf, int32_t size, int32_t offset);
-int32_t infq_pread(int32_t fd, void *buf, int32_t rlen, int32_t offset);
+int32_t infq_pwrite(int32_t fd, const void *buf, int32_t size, off_t offset);
+int32_t infq_pread(int32_t fd, void *buf, int32_t rlen, off_t offset);
+
+/**
+ * Write or read all the bytes of 'iov' at 'offset' by vectored IO, partial IO is
+ *      continued. Each syscall transfers at most 'io_unit' bytes, 0 means no limit.
+ *      'iovcnt' should be not greater than INFQ_MAX_IOVCNT.
+ */
+int32_t infq_pwritev(int32_t fd, const struct iovec *iov, int32_t iovcnt, off_t offset,
+        int32_t io_unit);
+int32_t infq_preadv(int32_t fd, const struct iovec *iov, int32_t iovcnt, off_t offset,
+        int32_t io_unit);
 
 long long time_us();
 
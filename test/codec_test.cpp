@@ -0,0 +1,430 @@
+/**
+ *
+ * @file    codec_test
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include "codec.h"
+#include "file_block.h"
+#include "mem_block.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+// see file_block.c
+#define CHUNK_SIZE      (64 * 1024)
+
+#define BLOCK_SIZE      (512 * 1024)
+#define ELE_SIZE        3000        // elements straddle the chunks
+
+const char *CODEC_FILE_PATH = "./codec_blocks";
+
+static void
+fill_random(char *buf, int64_t len, unsigned seed)
+{
+    srand(seed);
+    for (int64_t i = 0; i < len; i++) {
+        buf[i] = (char)rand();
+    }
+}
+
+/**
+ * Text-like data, repeated words with some noise so matches have many lengths.
+ */
+static void
+fill_words(char *buf, int64_t len, unsigned seed)
+{
+    const char  *words[] = {"infq ", "block ", "chunk ", "spill ", "queue ", "a ", "load "};
+
+    srand(seed);
+    for (int64_t i = 0; i < len; ) {
+        const char  *w = words[rand() % 7];
+
+        for (; *w != '\0' && i < len; w++, i++) {
+            buf[i] = rand() % 50 == 0 ? (char)rand() : *w;
+        }
+    }
+}
+
+class CodecTest: public testing::Test {
+protected:
+    CodecTest() {}
+    virtual ~CodecTest() {}
+
+    virtual void SetUp() {
+        codec = codec_find(INFQ_CODEC_LZ);
+        ASSERT_TRUE(codec != NULL);
+        ASSERT_EQ(codec->id, INFQ_CODEC_LZ);
+    }
+
+    /**
+     * Compress and decompress 'len' bytes of 'src', the compressed size is returned.
+     */
+    int64_t RoundTrip(const char *src, int64_t len) {
+        int64_t     cap = codec->bound(len), clen, n;
+        char        *dst = (char *)malloc(cap), *out = (char *)malloc(len + 1);
+
+        EXPECT_TRUE(dst != NULL && out != NULL);
+        clen = codec->compress(src, len, dst, cap);
+        EXPECT_GT(clen, 0) << "len: " << len;
+        EXPECT_LE(clen, cap) << "len: " << len;
+
+        n = codec->decompress(dst, clen, out, len);
+        EXPECT_EQ(n, len);
+        EXPECT_EQ(memcmp(out, src, len), 0) << "len: " << len;
+
+        free(dst);
+        free(out);
+
+        return clen;
+    }
+
+    const infq_codec_t  *codec;
+};
+
+TEST_F(CodecTest, round_trip_short)
+{
+    char    buf[64];
+
+    fill_words(buf, sizeof(buf), 1);
+    // all the data of short inputs is in the last literals
+    for (int64_t len = 0; len <= (int64_t)sizeof(buf); len++) {
+        RoundTrip(buf, len);
+    }
+}
+
+TEST_F(CodecTest, round_trip_incompressible)
+{
+    int64_t     len = 256 * 1024;
+    char        *buf = (char *)malloc(len);
+
+    fill_random(buf, len, 2);
+    ASSERT_LE(RoundTrip(buf, len), codec->bound(len));
+    ASSERT_GT(RoundTrip(buf, len), len);
+
+    free(buf);
+}
+
+TEST_F(CodecTest, round_trip_overlapping_matches)
+{
+    int64_t     len = 100000;
+    char        *buf = (char *)malloc(len);
+
+    // offsets shorter than matches, the output overlaps the match copied
+    for (int32_t period = 1; period <= 17; period++) {
+        fill_random(buf, period, period);
+        for (int64_t i = period; i < len; i++) {
+            buf[i] = buf[i - period];
+        }
+        ASSERT_LT(RoundTrip(buf, len), len / 50) << "period: " << period;
+    }
+
+    free(buf);
+}
+
+TEST_F(CodecTest, round_trip_lengths)
+{
+    int64_t     len = 200000;
+    char        *buf = (char *)malloc(len);
+    int32_t     lens[] = {14, 15, 16, 17, 18, 19, 269, 270, 271, 525, 70000};
+
+    // literal and match lengths around the extended lengths
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        for (size_t j = 0; j < sizeof(lens) / sizeof(lens[0]); j++) {
+            int32_t lit = lens[i], match = lens[j];
+
+            if (2 * lit + match > len) {
+                continue;
+            }
+            fill_random(buf, lit, i);
+            for (int64_t k = lit; k < lit + match; k++) {
+                buf[k] = buf[k - lit];
+            }
+            fill_random(buf + lit + match, lit, j + 100);
+            RoundTrip(buf, 2 * lit + match);
+        }
+    }
+
+    // repeats beyond the max offset
+    fill_random(buf, 70000, 3);
+    for (int64_t k = 70000; k < len; k++) {
+        buf[k] = buf[k - 70000];
+    }
+    RoundTrip(buf, len);
+
+    fill_words(buf, len, 4);
+    ASSERT_LT(RoundTrip(buf, len), len / 2);
+
+    free(buf);
+}
+
+TEST_F(CodecTest, truncated_rejected)
+{
+    int64_t     len = 50000, cap = codec->bound(len), clen;
+    char        *buf = (char *)malloc(len), *dst = (char *)malloc(cap), *out = (char *)malloc(len);
+
+    fill_words(buf, len, 5);
+    clen = codec->compress(buf, len, dst, cap);
+    ASSERT_GT(clen, 0);
+
+    // the tail is always literals, so no prefix decodes to the whole data
+    for (int64_t n = 0; n < clen; n++) {
+        ASSERT_NE(codec->decompress(dst, n, out, len), len) << "truncated to: " << n;
+    }
+
+    // the output doesn't fit
+    ASSERT_EQ(codec->decompress(dst, clen, out, len - 1), -1);
+
+    free(buf);
+    free(dst);
+    free(out);
+}
+
+TEST_F(CodecTest, corrupted_rejected)
+{
+    char    out[64];
+
+    // zero offset
+    const char  zero_off[] = {0x40, 'a', 'b', 'c', 'd', 0x00, 0x00, 0x00};
+    ASSERT_EQ(codec->decompress(zero_off, sizeof(zero_off), out, sizeof(out)), -1);
+
+    // offset before the start of output
+    const char  far_off[] = {0x40, 'a', 'b', 'c', 'd', 0x05, 0x00, 0x00};
+    ASSERT_EQ(codec->decompress(far_off, sizeof(far_off), out, sizeof(out)), -1);
+
+    // literals beyond the input
+    const char  long_lit[] = {0x50, 'a'};
+    ASSERT_EQ(codec->decompress(long_lit, sizeof(long_lit), out, sizeof(out)), -1);
+
+    // extended length missing
+    const char  no_ext[] = {(char)0xf0};
+    ASSERT_EQ(codec->decompress(no_ext, sizeof(no_ext), out, sizeof(out)), -1);
+
+    // offset cut
+    const char  half_off[] = {0x40, 'a', 'b', 'c', 'd', 0x01};
+    ASSERT_EQ(codec->decompress(half_off, sizeof(half_off), out, sizeof(out)), -1);
+
+    // match longer than the output
+    const char  long_match[] = {0x4f, 'a', 'b', 'c', 'd', 0x01, 0x00, 0x7f};
+    ASSERT_EQ(codec->decompress(long_match, sizeof(long_match), out, sizeof(out)), -1);
+}
+
+TEST_F(CodecTest, corrupted_never_overflows)
+{
+    int64_t     len = 20000, cap = codec->bound(len), clen, n;
+    char        *buf = (char *)malloc(len), *dst = (char *)malloc(cap), *out = (char *)malloc(len);
+
+    fill_words(buf, len, 6);
+    clen = codec->compress(buf, len, dst, cap);
+    ASSERT_GT(clen, 0);
+
+    // random bytes flipped, the output is bounded whatever it decodes to
+    srand(7);
+    for (int32_t i = 0; i < 2000; i++) {
+        int64_t pos = rand() % clen;
+        char    org = dst[pos];
+
+        dst[pos] ^= (char)(1 + rand() % 255);
+        n = codec->decompress(dst, clen, out, len);
+        ASSERT_TRUE(n == -1 || (n >= 0 && n <= len));
+        dst[pos] = org;
+    }
+
+    free(buf);
+    free(dst);
+    free(out);
+}
+
+class CodecBlockTest: public testing::Test {
+protected:
+    CodecBlockTest() {}
+    virtual ~CodecBlockTest() {}
+
+    virtual void SetUp() {
+        mkdir(CODEC_FILE_PATH, 0755);
+        ASSERT_EQ(file_block_init(&file_block, CODEC_FILE_PATH, NULL), OK);
+        file_block.codec = INFQ_CODEC_LZ;
+
+        mem_block = mem_block_init(BLOCK_SIZE);
+        ASSERT_TRUE(mem_block != NULL);
+        mem_block->start_index = 0;
+        loaded = mem_block_init(BLOCK_SIZE);
+        ASSERT_TRUE(loaded != NULL);
+        element = (char *)malloc(ELE_SIZE);
+        ASSERT_TRUE(element != NULL);
+    }
+
+    virtual void TearDown() {
+        free(element);
+        mem_block_destroy(mem_block);
+        mem_block_destroy(loaded);
+        file_block_file_delete(&file_block);
+        file_block_destroy(&file_block);
+        rmdir(CODEC_FILE_PATH);
+    }
+
+    /**
+     * Push 'count' elements, the ones of odd index are incompressible if 'mixed'.
+     */
+    void PushElements(int32_t count, int32_t mixed) {
+        for (int32_t i = 0; i < count; i++) {
+            FillElement(i, mixed);
+            ASSERT_EQ(mem_block_push(mem_block, element, ELE_SIZE), OK);
+        }
+    }
+
+    void FillElement(int32_t i, int32_t mixed) {
+        if (mixed && i % 2 == 1) {
+            fill_random(element, ELE_SIZE, i);
+        } else {
+            fill_words(element, ELE_SIZE, i);
+        }
+    }
+
+    void BlockFilePath(char *path, int32_t size) {
+        snprintf(path, size, "%s/%s_%d", CODEC_FILE_PATH, file_block.file_prefix,
+                file_block.suffix);
+    }
+
+    file_block_t    file_block;
+    mem_block_t     *mem_block, *loaded;
+    char            *element;
+};
+
+TEST_F(CodecBlockTest, load_round_trip)
+{
+    char        buf[ELE_SIZE];
+    int32_t     size, count = 100;      // 300KB, the last chunk is partial
+    struct stat st;
+    char        path[256];
+
+    PushElements(count, 0);
+    ASSERT_EQ(file_block_write(&file_block, 0, mem_block), OK);
+    BlockFilePath(path, sizeof(path));
+    ASSERT_EQ(stat(path, &st), 0);
+    ASSERT_LT(st.st_size, count * ELE_SIZE / 2);
+
+    ASSERT_EQ(file_block_load(&file_block, &loaded), OK);
+    ASSERT_EQ(loaded->ele_count, count);
+    for (int32_t i = 0; i < count; i++) {
+        FillElement(i, 0);
+        ASSERT_EQ(mem_block_pop(loaded, buf, sizeof(buf), &size), OK);
+        ASSERT_EQ(size, ELE_SIZE);
+        ASSERT_EQ(memcmp(buf, element, ELE_SIZE), 0) << "element: " << i;
+    }
+}
+
+TEST_F(CodecBlockTest, at_across_chunks)
+{
+    char        buf[ELE_SIZE], expect[64];
+    int32_t     size, count = 100;
+    int64_t     first = mem_block->first_offset;
+
+    // incompressible chunks are stored as they are
+    PushElements(count, 1);
+    ASSERT_EQ(file_block_write(&file_block, 0, mem_block), OK);
+
+    for (int32_t i = 0; i < count; i++) {
+        FillElement(i, 1);
+        ASSERT_EQ(file_block_at(&file_block, i, buf, sizeof(buf), &size), OK);
+        ASSERT_EQ(size, ELE_SIZE);
+        ASSERT_EQ(memcmp(buf, element, ELE_SIZE), 0) << "element: " << i;
+    }
+    ASSERT_EQ(file_block_at(&file_block, count, buf, sizeof(buf), &size), ERR);
+
+    // reads straddling the edges of chunks
+    for (int64_t edge = CHUNK_SIZE; edge < count * ELE_SIZE; edge += CHUNK_SIZE) {
+        memcpy(expect, mem_block->mem + first + edge - 32, sizeof(expect));
+        ASSERT_EQ(file_block_read(&file_block, first + edge - 32, buf, sizeof(expect)), OK);
+        ASSERT_EQ(memcmp(buf, expect, sizeof(expect)), 0) << "edge: " << edge;
+    }
+}
+
+TEST_F(CodecBlockTest, truncated_frame_rejected)
+{
+    file_block_t    reopened;
+    struct stat     st;
+    char            path[256];
+
+    PushElements(100, 0);
+    ASSERT_EQ(file_block_write(&file_block, 0, mem_block), OK);
+    BlockFilePath(path, sizeof(path));
+    ASSERT_EQ(stat(path, &st), 0);
+    ASSERT_EQ(truncate(path, st.st_size - 100), 0);
+
+    ASSERT_EQ(file_block_init(&reopened, CODEC_FILE_PATH, NULL), OK);
+    reopened.suffix = file_block.suffix;
+    ASSERT_EQ(file_block_load_header(&reopened), ERR);
+    file_block_destroy(&reopened);
+}
+
+TEST_F(CodecBlockTest, corrupted_chunk_table_rejected)
+{
+    file_block_t    reopened;
+    char            path[256], *file;
+    uint32_t        frame[4], *ends = NULL;
+    FILE            *fp;
+    long            fsize;
+
+    PushElements(100, 0);
+    ASSERT_EQ(file_block_write(&file_block, 0, mem_block), OK);
+    ASSERT_GT(file_block.chunk_num, 1);
+
+    BlockFilePath(path, sizeof(path));
+    fp = fopen(path, "rb");
+    ASSERT_TRUE(fp != NULL);
+    fseek(fp, 0, SEEK_END);
+    fsize = ftell(fp);
+    file = (char *)malloc(fsize);
+    fseek(fp, 0, SEEK_SET);
+    ASSERT_EQ(fread(file, 1, fsize, fp), (size_t)fsize);
+    fclose(fp);
+
+    // the chunk ends follow the frame header
+    frame[0] = file_block.data_size;
+    frame[1] = CHUNK_SIZE;
+    frame[2] = file_block.chunk_num;
+    frame[3] = INFQ_CODEC_LZ;
+    for (long pos = 0; pos + (long)sizeof(frame) <= fsize; pos += sizeof(uint32_t)) {
+        if (memcmp(file + pos, frame, sizeof(frame)) == 0) {
+            ends = (uint32_t *)(file + pos + sizeof(frame));
+            break;
+        }
+    }
+    ASSERT_TRUE(ends != NULL);
+    ASSERT_EQ(ends[0], file_block.chunk_ends[0]);
+
+    // the chunks don't add up to the file
+    ends[file_block.chunk_num - 1] += 7;
+    fp = fopen(path, "wb");
+    ASSERT_EQ(fwrite(file, 1, fsize, fp), (size_t)fsize);
+    fclose(fp);
+
+    ASSERT_EQ(file_block_init(&reopened, CODEC_FILE_PATH, NULL), OK);
+    reopened.suffix = file_block.suffix;
+    ASSERT_EQ(file_block_load_header(&reopened), ERR);
+    file_block_destroy(&reopened);
+
+    // the first chunk takes bytes of the second one, they fail to decode
+    ends[file_block.chunk_num - 1] -= 7;
+    ends[0] += 7;
+    fp = fopen(path, "wb");
+    ASSERT_EQ(fwrite(file, 1, fsize, fp), (size_t)fsize);
+    fclose(fp);
+
+    ASSERT_EQ(file_block_init(&reopened, CODEC_FILE_PATH, NULL), OK);
+    reopened.suffix = file_block.suffix;
+    ASSERT_EQ(file_block_load_header(&reopened), OK);
+    ASSERT_EQ(file_block_load(&reopened, &loaded), ERR);
+    file_block_destroy(&reopened);
+
+    free(file);
+}
@@ -0,0 +1,191 @@
+/**
+ *
+ * @file    crc32c_test
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include "crc32c.h"
+#include "file_block.h"
+#include "mem_block.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+// bytes of 3 streams interleaved by the instruction, see crc32c.c
+#define STREAMS_LEN     (8192 * 3)
+
+#define BLOCK_SIZE      (64 * 1024)
+#define ELE_COUNT       40
+#define ELE_SIZE        1000
+
+const char *CRC32C_FILE_PATH = "./crc32c_blocks";
+
+/**
+ * Bit by bit CRC32C, the reference of both implementations.
+ */
+static uint32_t
+crc32c_bitwise(uint32_t crc, const unsigned char *p, size_t len)
+{
+    crc = ~crc;
+    while (len-- > 0) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+static void
+fill_random(unsigned char *buf, size_t len, unsigned seed)
+{
+    srand(seed);
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (unsigned char)rand();
+    }
+}
+
+TEST(Crc32cTest, check_vector)
+{
+    ASSERT_EQ(crc32c(0, "123456789", 9), 0xE3069283u);
+    ASSERT_EQ(crc32c_soft(0, "123456789", 9), 0xE3069283u);
+    ASSERT_EQ(crc32c(0, "", 0), 0u);
+}
+
+TEST(Crc32cTest, hw_sw_parity)
+{
+    size_t          size = STREAMS_LEN * 2 + 4096;
+    unsigned char   *buf = (unsigned char *)malloc(size);
+    size_t          lens[] = {0, 1, 7, 8, 63, 4096, STREAMS_LEN - 1, STREAMS_LEN,
+        STREAMS_LEN + 1, STREAMS_LEN + 8, STREAMS_LEN * 2, STREAMS_LEN * 2 + 7};
+
+    ASSERT_TRUE(buf != NULL);
+    fill_random(buf, size, 20);
+
+    // unaligned starts and lengths around the interleaved rounds
+    for (size_t off = 0; off < 8; off++) {
+        for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            uint32_t    ref = crc32c_bitwise(0, buf + off, lens[i]);
+
+            ASSERT_EQ(crc32c(0, buf + off, lens[i]), ref) << "off: " << off << ", len: " << lens[i];
+            ASSERT_EQ(crc32c_soft(0, buf + off, lens[i]), ref) << "off: " << off << ", len: " << lens[i];
+        }
+    }
+
+    free(buf);
+}
+
+TEST(Crc32cTest, extend_piece_by_piece)
+{
+    size_t          size = STREAMS_LEN * 2 + 100;
+    unsigned char   *buf = (unsigned char *)malloc(size);
+    size_t          splits[] = {1, 100, STREAMS_LEN - 3, STREAMS_LEN, STREAMS_LEN + 5, size - 1};
+
+    ASSERT_TRUE(buf != NULL);
+    fill_random(buf, size, 21);
+
+    uint32_t    whole = crc32c(0, buf, size);
+
+    for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); i++) {
+        size_t  n = splits[i];
+
+        ASSERT_EQ(crc32c(crc32c(0, buf, n), buf + n, size - n), whole) << "split: " << n;
+        ASSERT_EQ(crc32c_soft(crc32c_soft(0, buf, n), buf + n, size - n), whole) << "split: " << n;
+    }
+
+    free(buf);
+}
+
+class Crc32cBlockTest: public testing::Test {
+protected:
+    Crc32cBlockTest() {}
+    virtual ~Crc32cBlockTest() {}
+
+    virtual void SetUp() {
+        mkdir(CRC32C_FILE_PATH, 0755);
+        ASSERT_EQ(file_block_init(&file_block, CRC32C_FILE_PATH, NULL), OK);
+
+        // more data than the interleaved streams
+        mem_block = mem_block_init(BLOCK_SIZE);
+        ASSERT_TRUE(mem_block != NULL);
+        mem_block->start_index = 0;
+        for (int i = 0; i < ELE_COUNT; i++) {
+            fill_random(elements[i], ELE_SIZE, i);
+            ASSERT_EQ(mem_block_push(mem_block, elements[i], ELE_SIZE), OK);
+        }
+        ASSERT_EQ(mem_block->crc, crc32c(0, mem_block->mem, mem_block->last_offset));
+
+        loaded = mem_block_init(BLOCK_SIZE);
+        ASSERT_TRUE(loaded != NULL);
+    }
+
+    virtual void TearDown() {
+        file_block_set_verify_checksum(0);
+        mem_block_destroy(mem_block);
+        mem_block_destroy(loaded);
+        file_block_file_delete(&file_block);
+        file_block_destroy(&file_block);
+        rmdir(CRC32C_FILE_PATH);
+    }
+
+    void CorruptData() {
+        char    path[256];
+        FILE    *fp;
+        int     c;
+
+        snprintf(path, sizeof(path), "%s/%s_%d", CRC32C_FILE_PATH, file_block.file_prefix,
+                file_block.suffix);
+        fp = fopen(path, "r+b");
+        ASSERT_TRUE(fp != NULL);
+        // the middle of the file is in the data, past the header
+        fseek(fp, 0, SEEK_END);
+        fseek(fp, ftell(fp) / 2, SEEK_SET);
+        c = fgetc(fp);
+        fseek(fp, -1, SEEK_CUR);
+        fputc(c ^ 0x5a, fp);
+        fclose(fp);
+    }
+
+    file_block_t    file_block;
+    mem_block_t     *mem_block, *loaded;
+    unsigned char   elements[ELE_COUNT][ELE_SIZE];
+};
+
+TEST_F(Crc32cBlockTest, round_trip_verified)
+{
+    unsigned char   buf[ELE_SIZE];
+    int32_t         size;
+
+    file_block_set_verify_checksum(1);
+    ASSERT_EQ(file_block_write(&file_block, 0, mem_block), OK);
+    ASSERT_EQ(file_block_load(&file_block, &loaded), OK);
+    ASSERT_EQ(loaded->crc, mem_block->crc);
+    ASSERT_EQ(loaded->ele_count, ELE_COUNT);
+
+    for (int i = 0; i < ELE_COUNT; i++) {
+        ASSERT_EQ(mem_block_pop(loaded, buf, sizeof(buf), &size), OK);
+        ASSERT_EQ(size, ELE_SIZE);
+        ASSERT_EQ(memcmp(buf, elements[i], ELE_SIZE), 0);
+    }
+}
+
+TEST_F(Crc32cBlockTest, corrupted_data_rejected)
+{
+    ASSERT_EQ(file_block_write(&file_block, 0, mem_block), OK);
+    CorruptData();
+
+    // the checksum is taken from the signature without verification
+    ASSERT_EQ(file_block_load(&file_block, &loaded), OK);
+
+    file_block_set_verify_checksum(1);
+    mem_block_reset(loaded, INFQ_UNDEF);
+    ASSERT_EQ(file_block_load(&file_block, &loaded), ERR);
+}
@@ -0,0 +1,169 @@
+/**
+ *
+ * @file    fd_lru_test
+ */
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include "file_queue.h"
+#include "file_block.h"
+#include "mem_block.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+#define BLOCK_SIZE              1024
+#define BLOCK_NUM               5
+#define ELE_PER_BLOCK           10
+#define MAX_OPEN_FILES          2
+#define DEFAULT_MAX_OPEN_FILES  1024
+
+const char *FD_LRU_FILE_PATH = "./fd_lru_blocks";
+
+static void
+remove_dir(const char *path)
+{
+    DIR             *dir;
+    struct dirent   *ent;
+    char            buf[512];
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%s/%s", path, ent->d_name);
+        unlink(buf);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+class FdLruTest: public testing::Test {
+protected:
+    FdLruTest() {}
+    virtual ~FdLruTest() {}
+
+    virtual void SetUp() {
+        mem_block_t     *mem_block;
+        int             v;
+
+        remove_dir(FD_LRU_FILE_PATH);
+        mkdir(FD_LRU_FILE_PATH, 0755);
+        file_block_set_max_open_files(MAX_OPEN_FILES);
+        ASSERT_EQ(file_queue_init(&file_queue, FD_LRU_FILE_PATH), OK);
+
+        mem_block = mem_block_init(BLOCK_SIZE);
+        ASSERT_TRUE(mem_block != NULL);
+        for (int i = 0; i < BLOCK_NUM; i++) {
+            ASSERT_EQ(mem_block_reset(mem_block, (int64_t)i * ELE_PER_BLOCK), OK);
+            for (int j = 0; j < ELE_PER_BLOCK; j++) {
+                v = i * ELE_PER_BLOCK + j;
+                ASSERT_EQ(mem_block_push(mem_block, &v, sizeof(v)), OK);
+            }
+            ASSERT_EQ(file_queue_dump_block(&file_queue, mem_block), OK);
+        }
+        mem_block_destroy(mem_block);
+    }
+
+    virtual void TearDown() {
+        file_queue_destroy(&file_queue);
+        file_block_set_max_open_files(DEFAULT_MAX_OPEN_FILES);
+        remove_dir(FD_LRU_FILE_PATH);
+    }
+
+    file_block_t* Block(int i) {
+        file_block_t    *block = file_queue.block_head;
+
+        while (i-- > 0 && block != NULL) {
+            block = block->next;
+        }
+        return block;
+    }
+
+    int OpenedFiles() {
+        int     n = 0;
+
+        for (file_block_t *block = file_queue.block_head; block != NULL; block = block->next) {
+            if (block->fd != INFQ_UNDEF) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    void ExpectAt(int64_t idx) {
+        int     v, size;
+
+        ASSERT_EQ(file_queue_at(&file_queue, idx, &v, sizeof(v), &size), OK);
+        ASSERT_EQ(size, (int)sizeof(v));
+        ASSERT_EQ(v, idx);
+    }
+
+    file_queue_t    file_queue;
+};
+
+TEST_F(FdLruTest, closed_beyond_limit)
+{
+    // only the most recently dumped files are left opened
+    ASSERT_EQ(OpenedFiles(), MAX_OPEN_FILES);
+    ASSERT_EQ(Block(0)->fd, INFQ_UNDEF);
+    ASSERT_NE(Block(BLOCK_NUM - 1)->fd, INFQ_UNDEF);
+}
+
+TEST_F(FdLruTest, reopened_when_accessed)
+{
+    for (int64_t i = 0; i < BLOCK_NUM * ELE_PER_BLOCK; i++) {
+        ExpectAt(i);
+        ASSERT_LE(OpenedFiles(), MAX_OPEN_FILES);
+    }
+
+    // the block read last is the most recently used one
+    ExpectAt(0);
+    ASSERT_NE(Block(0)->fd, INFQ_UNDEF);
+    ASSERT_NE(Block(BLOCK_NUM - 1)->fd, INFQ_UNDEF);
+    ASSERT_EQ(Block(BLOCK_NUM - 2)->fd, INFQ_UNDEF);
+}
+
+TEST_F(FdLruTest, pinned_kept_opened)
+{
+    for (int i = 0; i < BLOCK_NUM; i++) {
+        ASSERT_EQ(file_block_pin_fd(Block(i)), OK);
+    }
+
+    // the files in use exceed the limit
+    ASSERT_EQ(OpenedFiles(), BLOCK_NUM);
+    ExpectAt(0);
+
+    for (int i = 0; i < BLOCK_NUM; i++) {
+        file_block_unpin_fd(Block(i));
+    }
+    ASSERT_EQ(OpenedFiles(), MAX_OPEN_FILES);
+
+    // the unpinned files are closed in the order they're used
+    ASSERT_NE(Block(BLOCK_NUM - 1)->fd, INFQ_UNDEF);
+    ASSERT_NE(Block(BLOCK_NUM - 2)->fd, INFQ_UNDEF);
+}
+
+TEST_F(FdLruTest, limit_changed)
+{
+    file_block_set_max_open_files(1);
+    ASSERT_EQ(OpenedFiles(), 1);
+
+    // no limit
+    file_block_set_max_open_files(0);
+    for (int i = 0; i < BLOCK_NUM; i++) {
+        ExpectAt((int64_t)i * ELE_PER_BLOCK);
+    }
+    ASSERT_EQ(OpenedFiles(), BLOCK_NUM);
+}
@@ -0,0 +1,133 @@
+/**
+ *
+ * @file    jumbo_block_test
+ */
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+extern "C" {
+#include "mem_queue.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+// 8 elements of int fit in a block
+#define BLOCK_SIZE      64
+#define BLOCK_NUM       4
+#define ELE_PER_BLOCK   8
+#define JUMBO_SIZE      200
+
+class JumboBlockTest: public testing::Test {
+protected:
+    JumboBlockTest() {}
+    virtual ~JumboBlockTest() {}
+
+    virtual void SetUp() {
+        ASSERT_EQ(mem_queue_init(&mem_queue, BLOCK_NUM, BLOCK_SIZE), OK);
+        for (int i = 0; i < JUMBO_SIZE; i++) {
+            jumbo[i] = (char)i;
+        }
+        id = 0;
+    }
+
+    virtual void TearDown() {
+        mem_queue_destroy(&mem_queue);
+    }
+
+    void ExpectPopJumbo() {
+        char    buf[JUMBO_SIZE];
+        int     size;
+
+        ASSERT_EQ(mem_queue_pop(&mem_queue, buf, sizeof(buf), &size), OK);
+        ASSERT_EQ(size, JUMBO_SIZE);
+        ASSERT_EQ(memcmp(buf, jumbo, JUMBO_SIZE), 0);
+    }
+
+    void ExpectPopInt(int expect) {
+        int     v, size;
+
+        ASSERT_EQ(mem_queue_pop(&mem_queue, &v, sizeof(v), &size), OK);
+        ASSERT_EQ(size, (int)sizeof(v));
+        ASSERT_EQ(v, expect);
+    }
+
+    mem_queue_t     mem_queue;
+    char            jumbo[JUMBO_SIZE];
+    int             id;
+};
+
+TEST_F(JumboBlockTest, empty_block_grown)
+{
+    ASSERT_EQ(mem_queue_push(&mem_queue, id++, jumbo, JUMBO_SIZE), OK);
+    ASSERT_EQ(mem_queue.last_block, 0);
+    ASSERT_GE(mem_queue.blocks[0]->mem_size, mem_block_ele_size(JUMBO_SIZE));
+    ASSERT_EQ(mem_queue.blocks[0]->mem_size % 8, 0);
+    ASSERT_EQ(mem_queue.blocks[0]->ele_count, 1);
+
+    ExpectPopJumbo();
+    ASSERT_TRUE(mem_queue_empty(&mem_queue));
+}
+
+TEST_F(JumboBlockTest, holds_only_the_element)
+{
+    int     v = 7;
+
+    // the jumbo element goes to the next block instead of growing a used one
+    ASSERT_EQ(mem_queue_push(&mem_queue, id++, &v, sizeof(v)), OK);
+    ASSERT_EQ(mem_queue_push(&mem_queue, id++, jumbo, JUMBO_SIZE), OK);
+    ASSERT_EQ(mem_queue.last_block, 1);
+    ASSERT_EQ(mem_queue.blocks[0]->mem_size, BLOCK_SIZE);
+    ASSERT_GT(mem_queue.blocks[1]->mem_size, BLOCK_SIZE);
+
+    // and the next element goes to a new block
+    ASSERT_EQ(mem_queue_push(&mem_queue, id++, &v, sizeof(v)), OK);
+    ASSERT_EQ(mem_queue.last_block, 2);
+    ASSERT_EQ(mem_queue.blocks[2]->start_index, 2);
+
+    ExpectPopInt(7);
+    ExpectPopJumbo();
+    ExpectPopInt(7);
+}
+
+TEST_F(JumboBlockTest, shrunk_when_reused)
+{
+    int     i;
+
+    ASSERT_EQ(mem_queue_push(&mem_queue, id++, jumbo, JUMBO_SIZE), OK);
+    ASSERT_GT(mem_queue.blocks[0]->mem_size, BLOCK_SIZE);
+    ExpectPopJumbo();
+
+    // the drained jumbo block is skipped, then the queue wraps around to its slot
+    for (i = 0; i < (BLOCK_NUM - 1) * ELE_PER_BLOCK; i++) {
+        ASSERT_EQ(mem_queue_push(&mem_queue, id, &i, sizeof(i)), OK);
+        id++;
+    }
+    ASSERT_EQ(mem_queue.first_block, 1);
+    ASSERT_EQ(mem_queue_push(&mem_queue, id, &i, sizeof(i)), ERR);
+    ASSERT_TRUE(mem_queue_full(&mem_queue));
+
+    ASSERT_EQ(mem_queue.last_block, 0);
+    ASSERT_EQ(mem_queue.blocks[0]->mem_size, BLOCK_SIZE);
+    ASSERT_TRUE(mem_block_empty(mem_queue.blocks[0]));
+
+    for (i = 0; i < (BLOCK_NUM - 1) * ELE_PER_BLOCK; i++) {
+        ExpectPopInt(i);
+    }
+}
+
+TEST_F(JumboBlockTest, pop_after_drained)
+{
+    int     v = 7;
+
+    // the drained jumbo block is full, the next element goes to a new block
+    ASSERT_EQ(mem_queue_push(&mem_queue, id++, jumbo, JUMBO_SIZE), OK);
+    ExpectPopJumbo();
+    ASSERT_EQ(mem_queue_push(&mem_queue, id++, &v, sizeof(v)), OK);
+    ASSERT_EQ(mem_queue.first_block, 1);
+    ASSERT_EQ(mem_queue.last_block, 1);
+
+    ExpectPopInt(7);
+    ASSERT_TRUE(mem_queue_empty(&mem_queue));
+}
@@ -0,0 +1,147 @@
+/**
+ *
+ * @file    manifest_test
+ */
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include "manifest.h"
+#include "file_block.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+#define ELE_COUNT       100
+
+const char *MANIFEST_FILE_PATH = "./manifest_blocks";
+
+class ManifestTest: public testing::Test {
+protected:
+    ManifestTest() {}
+    virtual ~ManifestTest() {}
+
+    virtual void SetUp() {
+        mkdir(MANIFEST_FILE_PATH, 0755);
+        snprintf(path, sizeof(path), "%s/manifest", MANIFEST_FILE_PATH);
+        unlink(path);
+        ASSERT_EQ(manifest_open(&manifest, MANIFEST_FILE_PATH), OK);
+        ASSERT_NE(manifest.fd, -1);
+    }
+
+    virtual void TearDown() {
+        manifest_close(&manifest);
+        unlink(path);
+        rmdir(MANIFEST_FILE_PATH);
+    }
+
+    void Append(int32_t suffix, int64_t start_index) {
+        file_block_t    block;
+
+        memset(&block, 0, sizeof(block));
+        block.suffix = suffix;
+        block.start_index = start_index;
+        block.ele_count = ELE_COUNT;
+        block.file_size = 4096 + suffix;
+        ASSERT_EQ(manifest_append(&manifest, &block), OK);
+    }
+
+    off_t FileSize() {
+        struct stat     finfo;
+
+        if (stat(path, &finfo) == -1) {
+            return -1;
+        }
+        return finfo.st_size;
+    }
+
+    manifest_t  manifest;
+    char        path[256];
+};
+
+TEST_F(ManifestTest, read_records)
+{
+    manifest_record_t   records[5];
+
+    for (int i = 0; i < 4; i++) {
+        Append(i, (int64_t)i * ELE_COUNT);
+    }
+    // the last record of a suffix wins
+    Append(2, 1000);
+
+    ASSERT_EQ(manifest_read(&manifest, 1, 6, records), 3);
+    ASSERT_EQ(records[0].suffix, 1);
+    ASSERT_EQ(records[0].start_index, ELE_COUNT);
+    ASSERT_EQ(records[0].ele_count, ELE_COUNT);
+    ASSERT_EQ(records[0].file_size, 4097);
+    ASSERT_EQ(records[1].suffix, 2);
+    ASSERT_EQ(records[1].start_index, 1000);
+    ASSERT_EQ(records[2].suffix, 3);
+    ASSERT_EQ(records[3].suffix, INFQ_UNDEF);
+    ASSERT_EQ(records[4].suffix, INFQ_UNDEF);
+}
+
+TEST_F(ManifestTest, compact_records)
+{
+    manifest_record_t   records[6];
+
+    for (int i = 0; i < 6; i++) {
+        Append(i, (int64_t)i * ELE_COUNT);
+    }
+    // restarted from a smaller suffix, the records after it are stale
+    Append(3, 5000);
+
+    ASSERT_EQ(manifest_compact(&manifest, 1), OK);
+    ASSERT_EQ(manifest.records, 3);
+    ASSERT_EQ(FileSize(), (off_t)(3 * sizeof(manifest_record_t)));
+
+    ASSERT_EQ(manifest_read(&manifest, 0, 6, records), 3);
+    ASSERT_EQ(records[0].suffix, INFQ_UNDEF);
+    ASSERT_EQ(records[1].suffix, 1);
+    ASSERT_EQ(records[2].suffix, 2);
+    ASSERT_EQ(records[3].suffix, 3);
+    ASSERT_EQ(records[3].start_index, 5000);
+    ASSERT_EQ(records[4].suffix, INFQ_UNDEF);
+    ASSERT_EQ(records[5].suffix, INFQ_UNDEF);
+
+    // appended after the rewrite
+    Append(4, 6000);
+    ASSERT_EQ(manifest_read(&manifest, 4, 5, records), 1);
+    ASSERT_EQ(records[0].start_index, 6000);
+}
+
+TEST_F(ManifestTest, torn_record_truncated)
+{
+    manifest_record_t   records[3];
+    int                 fd;
+
+    Append(0, 0);
+    Append(1, ELE_COUNT);
+    manifest_close(&manifest);
+
+    // a crash in the middle of appending the third record
+    fd = open(path, O_WRONLY | O_APPEND);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(write(fd, "torn", 4), 4);
+    close(fd);
+
+    ASSERT_EQ(manifest_open(&manifest, MANIFEST_FILE_PATH), OK);
+    ASSERT_NE(manifest.fd, -1);
+    ASSERT_EQ(manifest.records, 2);
+    ASSERT_EQ(FileSize(), (off_t)(2 * sizeof(manifest_record_t)));
+
+    Append(2, 2 * ELE_COUNT);
+    ASSERT_EQ(FileSize(), (off_t)(3 * sizeof(manifest_record_t)));
+
+    ASSERT_EQ(manifest_read(&manifest, 0, 3, records), 3);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(records[i].suffix, i);
+        ASSERT_EQ(records[i].start_index, (int64_t)i * ELE_COUNT);
+    }
+}
@@ -0,0 +1,152 @@
+/**
+ *
+ * @file    mem_queue_batch_test
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+extern "C" {
+#include "mem_queue.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+// 8 elements of int fit in a block, each is padded to 8 bytes with its length
+#define BLOCK_SIZE      64
+#define BLOCK_NUM       3
+#define ELE_PER_BLOCK   8
+#define MAX_ELE         32
+
+class MemQueueBatchTest: public testing::Test {
+protected:
+    MemQueueBatchTest() {}
+    virtual ~MemQueueBatchTest() {}
+
+    virtual void SetUp() {
+        ASSERT_EQ(mem_queue_init(&mem_queue, BLOCK_NUM, BLOCK_SIZE), OK);
+        for (int i = 0; i < MAX_ELE; i++) {
+            values[i] = i;
+            elems[i].iov_base = &values[i];
+            elems[i].iov_len = sizeof(int);
+        }
+    }
+
+    virtual void TearDown() {
+        mem_queue_destroy(&mem_queue);
+    }
+
+    mem_queue_t     mem_queue;
+    int             values[MAX_ELE];
+    struct iovec    elems[MAX_ELE];
+};
+
+TEST_F(MemQueueBatchTest, push_batch_across_blocks)
+{
+    int32_t     pushed;
+
+    ASSERT_EQ(mem_queue_push_batch(&mem_queue, 0, elems, 10, &pushed), OK);
+    ASSERT_EQ(pushed, 10);
+    ASSERT_EQ(mem_queue.ele_count, 10);
+    ASSERT_EQ(mem_queue.min_idx, 0);
+    ASSERT_EQ(mem_queue.max_idx, 10);
+    ASSERT_EQ(mem_queue.first_block, 0);
+    ASSERT_EQ(mem_queue.last_block, 1);
+    ASSERT_EQ(mem_queue.blocks[0]->ele_count, ELE_PER_BLOCK);
+    ASSERT_EQ(mem_queue.blocks[1]->ele_count, 10 - ELE_PER_BLOCK);
+    ASSERT_EQ(mem_queue.blocks[1]->start_index, ELE_PER_BLOCK);
+}
+
+TEST_F(MemQueueBatchTest, push_batch_partial_when_full)
+{
+    int32_t     pushed;
+    int         v, size;
+
+    // the last block is left unused when the queue is full
+    ASSERT_EQ(mem_queue_push_batch(&mem_queue, 0, elems, MAX_ELE, &pushed), OK);
+    ASSERT_EQ(pushed, (BLOCK_NUM - 1) * ELE_PER_BLOCK);
+    ASSERT_TRUE(mem_queue_full(&mem_queue));
+    ASSERT_EQ(mem_queue.ele_count, pushed);
+    ASSERT_EQ(mem_queue.max_idx, pushed);
+
+    ASSERT_EQ(mem_queue_push_batch(&mem_queue, pushed, elems + pushed, MAX_ELE - pushed,
+                &pushed), OK);
+    ASSERT_EQ(pushed, 0);
+
+    for (int i = 0; i < (BLOCK_NUM - 1) * ELE_PER_BLOCK; i++) {
+        ASSERT_EQ(mem_queue_pop(&mem_queue, &v, sizeof(v), &size), OK);
+        ASSERT_EQ(size, (int)sizeof(v));
+        ASSERT_EQ(v, i);
+    }
+}
+
+TEST_F(MemQueueBatchTest, push_batch_reject_too_large)
+{
+    int32_t     pushed;
+
+    // rejected before anything is copied, so the base isn't read
+    elems[3].iov_len = (size_t)INT32_MAX + 1;
+    ASSERT_EQ(mem_queue_push_batch(&mem_queue, 0, elems, 5, &pushed), ERR);
+    ASSERT_EQ(pushed, 0);
+    ASSERT_EQ(mem_queue.ele_count, 0);
+
+    elems[3].iov_len = (size_t)INFQ_MAX_ELE_SIZE + 1;
+    ASSERT_EQ(mem_queue_push_batch(&mem_queue, 0, elems, 5, &pushed), ERR);
+    ASSERT_EQ(pushed, 0);
+    ASSERT_TRUE(mem_queue_empty(&mem_queue));
+}
+
+TEST_F(MemQueueBatchTest, pop_batch_stops_at_block_end)
+{
+    const void  *ptrs[MAX_ELE];
+    int32_t     sizes[MAX_ELE], pushed, n;
+
+    ASSERT_EQ(mem_queue_push_batch(&mem_queue, 0, elems, 10, &pushed), OK);
+    ASSERT_EQ(pushed, 10);
+
+    // the elements returned by one call come from the same block
+    ASSERT_EQ(mem_queue_pop_batch_zero_cp(&mem_queue, ptrs, sizes, MAX_ELE, &n), OK);
+    ASSERT_EQ(n, ELE_PER_BLOCK);
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(sizes[i], (int32_t)sizeof(int));
+        ASSERT_EQ(*(const int *)ptrs[i], i);
+    }
+    ASSERT_EQ(mem_queue.first_block, 1);
+    ASSERT_EQ(mem_queue.min_idx, ELE_PER_BLOCK);
+    ASSERT_EQ(mem_queue.ele_count, 10 - ELE_PER_BLOCK);
+
+    ASSERT_EQ(mem_queue_pop_batch_zero_cp(&mem_queue, ptrs, sizes, MAX_ELE, &n), OK);
+    ASSERT_EQ(n, 10 - ELE_PER_BLOCK);
+    ASSERT_EQ(*(const int *)ptrs[0], ELE_PER_BLOCK);
+    ASSERT_EQ(*(const int *)ptrs[1], ELE_PER_BLOCK + 1);
+
+    ASSERT_EQ(mem_queue_pop_batch_zero_cp(&mem_queue, ptrs, sizes, MAX_ELE, &n), OK);
+    ASSERT_EQ(n, 0);
+    ASSERT_TRUE(mem_queue_empty(&mem_queue));
+}
+
+TEST_F(MemQueueBatchTest, pop_batch_partial)
+{
+    const void  *ptrs[MAX_ELE];
+    int32_t     sizes[MAX_ELE], pushed, n;
+
+    ASSERT_EQ(mem_queue_push_batch(&mem_queue, 0, elems, 5, &pushed), OK);
+
+    ASSERT_EQ(mem_queue_pop_batch_zero_cp(&mem_queue, ptrs, sizes, 3, &n), OK);
+    ASSERT_EQ(n, 3);
+    ASSERT_EQ(*(const int *)ptrs[2], 2);
+    ASSERT_EQ(mem_queue.min_idx, 3);
+    ASSERT_EQ(mem_queue.ele_count, 2);
+
+    ASSERT_EQ(mem_queue_pop_batch_zero_cp(&mem_queue, ptrs, sizes, 0, &n), OK);
+    ASSERT_EQ(n, 0);
+
+    ASSERT_EQ(mem_queue_pop_batch_zero_cp(&mem_queue, ptrs, sizes, 3, &n), OK);
+    ASSERT_EQ(n, 2);
+    ASSERT_EQ(*(const int *)ptrs[0], 3);
+    ASSERT_EQ(*(const int *)ptrs[1], 4);
+    ASSERT_TRUE(mem_queue_empty(&mem_queue));
+}
@@ -0,0 +1,193 @@
+/**
+ *
+ * @file    overflow_policy_test
+ */
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+extern "C" {
+#include "infq.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+#define BLOCK_SIZE      1024
+#define BLOCK_NUM       4
+#define MAX_PUSHES      100000
+
+const char *OVERFLOW_FILE_PATH = "./overflow_blocks";
+
+static int64_t
+now_ms()
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/**
+ * The files of consumed blocks are kept until the next 'infq_dump', remove them.
+ */
+static void
+remove_dir(const char *path)
+{
+    DIR             *dir;
+    struct dirent   *ent;
+    char            buf[512];
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%s/%s", path, ent->d_name);
+        unlink(buf);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+static void*
+continue_dumper(void *arg)
+{
+    usleep(50 * 1000);
+    infq_continue_bg_exec((infq_t *)arg, INFQ_DUMP_BG_EXEC);
+    return NULL;
+}
+
+class OverflowPolicyTest: public testing::Test {
+protected:
+    OverflowPolicyTest() {}
+    virtual ~OverflowPolicyTest() {}
+
+    virtual void SetUp() {
+        remove_dir(OVERFLOW_FILE_PATH);
+        mkdir(OVERFLOW_FILE_PATH, 0755);
+        memset(&conf, 0, sizeof(conf));
+        conf.data_path = OVERFLOW_FILE_PATH;
+        conf.mem_block_size = BLOCK_SIZE;
+        conf.pushq_blocks_num = BLOCK_NUM;
+        conf.popq_blocks_num = BLOCK_NUM;
+        conf.block_usage_to_dump = 0.5;
+        infq = NULL;
+        next = 0;
+    }
+
+    virtual void TearDown() {
+        if (infq != NULL) {
+            infq_continue_bg_exec(infq, INFQ_DUMP_BG_EXEC);
+            ASSERT_EQ(infq_destroy_completely(infq), OK);
+        }
+        remove_dir(OVERFLOW_FILE_PATH);
+    }
+
+    void Init(int32_t policy, int32_t wait_us) {
+        conf.overflow_policy = policy;
+        conf.overflow_wait_us = wait_us;
+        infq = infq_init_by_conf(&conf, "overflow");
+        ASSERT_TRUE(infq != NULL);
+
+        // nothing is dumped until the dumper continues
+        ASSERT_EQ(infq_suspend_bg_exec(infq, INFQ_DUMP_BG_EXEC), OK);
+    }
+
+    // push until the queue is full, the number of elements pushed is returned
+    int FillUp() {
+        while (next < MAX_PUSHES && infq_push(infq, &next, sizeof(next)) == OK) {
+            next++;
+        }
+        return next;
+    }
+
+    void PopAll() {
+        int     v, size;
+
+        for (int i = 0; i < next; i++) {
+            ASSERT_EQ(infq_pop_wait(infq, &v, sizeof(v), &size, 1000 * 1000), OK);
+            ASSERT_EQ(size, (int)sizeof(v));
+            ASSERT_EQ(v, i);
+        }
+        ASSERT_EQ(infq_size(infq), 0);
+    }
+
+    infq_config_t   conf;
+    infq_t          *infq;
+    int             next;
+};
+
+TEST_F(OverflowPolicyTest, fail_at_once)
+{
+    int64_t     start;
+
+    Init(INFQ_OVERFLOW_FAIL, 0);
+    ASSERT_GT(FillUp(), 0);
+    ASSERT_LT(next, MAX_PUSHES);
+
+    start = now_ms();
+    ASSERT_EQ(infq_push(infq, &next, sizeof(next)), ERR);
+    ASSERT_LT(now_ms() - start, 20);
+
+    PopAll();
+}
+
+TEST_F(OverflowPolicyTest, block_until_timeout)
+{
+    int64_t     start;
+
+    Init(INFQ_OVERFLOW_BLOCK, 20 * 1000);
+    ASSERT_GT(FillUp(), 0);
+    ASSERT_LT(next, MAX_PUSHES);
+
+    start = now_ms();
+    ASSERT_EQ(infq_push(infq, &next, sizeof(next)), ERR);
+    ASSERT_GE(now_ms() - start, 15);
+
+    PopAll();
+}
+
+TEST_F(OverflowPolicyTest, block_until_dumped)
+{
+    pthread_t   tid;
+    int64_t     start;
+
+    // wait forever, the pushes go on after the dumper frees blocks
+    Init(INFQ_OVERFLOW_BLOCK, -1);
+    ASSERT_EQ(pthread_create(&tid, NULL, continue_dumper, infq), 0);
+
+    start = now_ms();
+    for (next = 0; next < 10 * BLOCK_NUM * BLOCK_SIZE / 8; next++) {
+        ASSERT_EQ(infq_push(infq, &next, sizeof(next)), OK);
+    }
+    ASSERT_GE(now_ms() - start, 40);
+    pthread_join(tid, NULL);
+
+    PopAll();
+}
+
+TEST_F(OverflowPolicyTest, spill_by_pusher)
+{
+    infq_stats_t    stats;
+
+    Init(INFQ_OVERFLOW_SPILL, 0);
+
+    // the pushers dump the full blocks by themselves while the dumper is suspended
+    for (next = 0; next < 10 * BLOCK_NUM * BLOCK_SIZE / 8; next++) {
+        ASSERT_EQ(infq_push(infq, &next, sizeof(next)), OK);
+    }
+    ASSERT_EQ(infq_fetch_stats(infq, &stats), OK);
+    ASSERT_GT(stats.fileq_blocks_num, 0);
+
+    PopAll();
+}
@@ -0,0 +1,170 @@
+/**
+ *
+ * @file    page_cache_test
+ */
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+extern "C" {
+#include "page_cache.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+#define OWNER_SIZE      (3 * INFQ_PAGE_SIZE + 100)
+#define CAPACITY        2
+
+struct owner_t {
+    int64_t     key;
+    int32_t     fills;
+    int32_t     fail;
+};
+
+static char
+owner_byte(int64_t key, int64_t pos)
+{
+    return (char)(key * 31 + pos % 251);
+}
+
+static int32_t
+fill_page(void *arg, int64_t pos, char *page, int32_t len)
+{
+    struct owner_t  *owner = (struct owner_t *)arg;
+
+    owner->fills++;
+    if (owner->fail) {
+        return ERR;
+    }
+    for (int32_t i = 0; i < len; i++) {
+        page[i] = owner_byte(owner->key, pos + i);
+    }
+    return OK;
+}
+
+class PageCacheTest: public testing::Test {
+protected:
+    PageCacheTest() {}
+    virtual ~PageCacheTest() {}
+
+    virtual void SetUp() {
+        ASSERT_EQ(page_cache_init(&cache, CAPACITY), OK);
+        memset(owners, 0, sizeof(owners));
+        for (int i = 0; i < 2; i++) {
+            owners[i].key = i * 1000;
+        }
+    }
+
+    virtual void TearDown() {
+        page_cache_destroy(&cache);
+    }
+
+    void ExpectRead(struct owner_t *owner, int64_t pos, int32_t len) {
+        char    buf[2 * INFQ_PAGE_SIZE];
+
+        ASSERT_LE(len, (int32_t)sizeof(buf));
+        ASSERT_EQ(page_cache_read(&cache, owner->key, OWNER_SIZE, pos, buf, len,
+                    fill_page, owner), OK);
+        for (int32_t i = 0; i < len; i++) {
+            ASSERT_EQ(buf[i], owner_byte(owner->key, pos + i));
+        }
+    }
+
+    page_cache_t    cache;
+    struct owner_t  owners[2];
+};
+
+TEST_F(PageCacheTest, read_across_pages)
+{
+    // two pages are filled for the read across the boundary
+    ExpectRead(&owners[0], INFQ_PAGE_SIZE - 10, 20);
+    ASSERT_EQ(owners[0].fills, 2);
+    ASSERT_EQ(cache.misses, 2);
+    ASSERT_EQ(cache.page_num, 2);
+
+    ExpectRead(&owners[0], INFQ_PAGE_SIZE - 100, 200);
+    ExpectRead(&owners[0], 0, 8);
+    ASSERT_EQ(owners[0].fills, 2);
+    ASSERT_EQ(cache.hits, 3);
+}
+
+TEST_F(PageCacheTest, short_last_page)
+{
+    char    buf[8];
+
+    ExpectRead(&owners[0], OWNER_SIZE - 50, 50);
+    ASSERT_EQ(cache.page_num, 1);
+    ASSERT_EQ(cache.head->len, 100);
+
+    // beyond the size of the owner
+    ASSERT_EQ(page_cache_read(&cache, owners[0].key, OWNER_SIZE, OWNER_SIZE - 4, buf, 8,
+                fill_page, &owners[0]), ERR);
+}
+
+TEST_F(PageCacheTest, least_recently_used_evicted)
+{
+    ExpectRead(&owners[0], 0, 8);
+    ExpectRead(&owners[0], INFQ_PAGE_SIZE, 8);
+
+    // page 0 is used again, page 1 is the least recently used one
+    ExpectRead(&owners[0], 16, 8);
+    ExpectRead(&owners[0], 2 * INFQ_PAGE_SIZE, 8);
+    ASSERT_EQ(cache.page_num, CAPACITY);
+    ASSERT_EQ(owners[0].fills, 3);
+
+    ExpectRead(&owners[0], 24, 8);
+    ASSERT_EQ(owners[0].fills, 3);
+    ExpectRead(&owners[0], INFQ_PAGE_SIZE + 8, 8);
+    ASSERT_EQ(owners[0].fills, 4);
+    ASSERT_EQ(cache.page_num, CAPACITY);
+}
+
+TEST_F(PageCacheTest, drop_owner)
+{
+    ExpectRead(&owners[0], 0, 8);
+    ExpectRead(&owners[1], 0, 8);
+
+    // only the pages of the owner are evicted
+    page_cache_drop(&cache, owners[0].key, OWNER_SIZE);
+    ASSERT_EQ(cache.page_num, 1);
+    ASSERT_EQ(cache.head->key, owners[1].key);
+
+    ExpectRead(&owners[1], 8, 8);
+    ASSERT_EQ(owners[1].fills, 1);
+    ExpectRead(&owners[0], 8, 8);
+    ASSERT_EQ(owners[0].fills, 2);
+
+    page_cache_drop(&cache, owners[0].key, OWNER_SIZE);
+    page_cache_drop(&cache, owners[1].key, OWNER_SIZE);
+    ASSERT_EQ(cache.page_num, 0);
+    ASSERT_TRUE(cache.head == NULL);
+    ASSERT_TRUE(cache.tail == NULL);
+}
+
+TEST_F(PageCacheTest, fill_failed)
+{
+    char    buf[8];
+
+    owners[0].fail = 1;
+    ASSERT_EQ(page_cache_read(&cache, owners[0].key, OWNER_SIZE, 0, buf, 8,
+                fill_page, &owners[0]), ERR);
+    ASSERT_EQ(cache.page_num, 0);
+
+    owners[0].fail = 0;
+    ExpectRead(&owners[0], 0, 8);
+    ASSERT_EQ(owners[0].fills, 2);
+}
+
+TEST_F(PageCacheTest, disabled)
+{
+    page_cache_destroy(&cache);
+    ASSERT_EQ(page_cache_init(&cache, 0), OK);
+
+    // every read goes to the owner
+    ExpectRead(&owners[0], 0, 8);
+    ExpectRead(&owners[0], 0, 8);
+    ASSERT_EQ(owners[0].fills, 2);
+    ASSERT_EQ(cache.page_num, 0);
+    page_cache_drop(&cache, owners[0].key, OWNER_SIZE);
+}
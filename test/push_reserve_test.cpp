@@ -0,0 +1,190 @@
+/**
+ *
+ * @file    push_reserve_test
+ */
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+extern "C" {
+#include "infq.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+#define BLOCK_SIZE      1024
+#define BLOCK_NUM       4
+
+const char *RESERVE_FILE_PATH = "./reserve_blocks";
+
+static void
+remove_dir(const char *path)
+{
+    DIR             *dir;
+    struct dirent   *ent;
+    char            buf[512];
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%s/%s", path, ent->d_name);
+        unlink(buf);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+struct other_thread_t {
+    infq_t  *infq;
+    int     commit_ret;
+    int     abort_ret;
+};
+
+static void*
+commit_and_abort(void *arg)
+{
+    struct other_thread_t   *other = (struct other_thread_t *)arg;
+
+    other->commit_ret = infq_push_commit(other->infq, 1);
+    other->abort_ret = infq_push_abort(other->infq);
+    return NULL;
+}
+
+class PushReserveTest: public testing::Test {
+protected:
+    PushReserveTest() {}
+    virtual ~PushReserveTest() {}
+
+    virtual void SetUp() {
+        infq_config_t   conf;
+
+        remove_dir(RESERVE_FILE_PATH);
+        mkdir(RESERVE_FILE_PATH, 0755);
+        memset(&conf, 0, sizeof(conf));
+        conf.data_path = RESERVE_FILE_PATH;
+        conf.mem_block_size = BLOCK_SIZE;
+        conf.pushq_blocks_num = BLOCK_NUM;
+        conf.popq_blocks_num = BLOCK_NUM;
+        conf.block_usage_to_dump = 0.5;
+        infq = infq_init_by_conf(&conf, "reserve");
+        ASSERT_TRUE(infq != NULL);
+    }
+
+    virtual void TearDown() {
+        ASSERT_EQ(infq_destroy_completely(infq), OK);
+        remove_dir(RESERVE_FILE_PATH);
+    }
+
+    void ExpectPop(const char *expect, int size) {
+        char    buf[BLOCK_SIZE];
+        int     actual;
+
+        ASSERT_EQ(infq_pop(infq, buf, sizeof(buf), &actual), OK);
+        ASSERT_EQ(actual, size);
+        ASSERT_EQ(memcmp(buf, expect, size), 0);
+    }
+
+    infq_t  *infq;
+};
+
+TEST_F(PushReserveTest, commit_actual_size)
+{
+    void    *dst;
+
+    ASSERT_EQ(infq_push_reserve(infq, 16, &dst), OK);
+    memcpy(dst, "hello", 5);
+    ASSERT_EQ(infq_push_commit(infq, 5), OK);
+    ASSERT_EQ(infq_size(infq), 1);
+
+    ExpectPop("hello", 5);
+    ASSERT_EQ(infq_size(infq), 0);
+}
+
+TEST_F(PushReserveTest, commit_invalid_size_kept)
+{
+    void    *dst;
+
+    ASSERT_EQ(infq_push_reserve(infq, 4, &dst), OK);
+    memcpy(dst, "abcd", 4);
+
+    // the reservation is kept for a valid commit
+    ASSERT_EQ(infq_push_commit(infq, 5), ERR);
+    ASSERT_EQ(infq_push_commit(infq, -1), ERR);
+    ASSERT_EQ(infq_push_commit(infq, 4), OK);
+
+    ExpectPop("abcd", 4);
+}
+
+TEST_F(PushReserveTest, abort_nothing_pushed)
+{
+    void    *dst;
+
+    ASSERT_EQ(infq_push_reserve(infq, 8, &dst), OK);
+    memcpy(dst, "aborted", 7);
+    ASSERT_EQ(infq_push_abort(infq), OK);
+    ASSERT_EQ(infq_size(infq), 0);
+
+    ASSERT_EQ(infq_push(infq, (void *)"pushed", 6), OK);
+    ExpectPop("pushed", 6);
+}
+
+TEST_F(PushReserveTest, reject_without_reservation)
+{
+    void    *dst;
+
+    ASSERT_EQ(infq_push_commit(infq, 0), ERR);
+    ASSERT_EQ(infq_push_abort(infq), ERR);
+
+    // a reservation isn't opened twice by the same thread
+    ASSERT_EQ(infq_push_reserve(infq, 8, &dst), OK);
+    ASSERT_EQ(infq_push_reserve(infq, 8, &dst), ERR);
+    ASSERT_EQ(infq_push_abort(infq), OK);
+}
+
+TEST_F(PushReserveTest, reject_other_thread)
+{
+    struct other_thread_t   other;
+    pthread_t               tid;
+    void                    *dst;
+
+    ASSERT_EQ(infq_push_reserve(infq, 8, &dst), OK);
+    memcpy(dst, "owner", 5);
+
+    other.infq = infq;
+    ASSERT_EQ(pthread_create(&tid, NULL, commit_and_abort, &other), 0);
+    pthread_join(tid, NULL);
+    ASSERT_EQ(other.commit_ret, ERR);
+    ASSERT_EQ(other.abort_ret, ERR);
+    ASSERT_EQ(infq_size(infq), 0);
+
+    // untouched by the other thread
+    ASSERT_EQ(infq_push_commit(infq, 5), OK);
+    ExpectPop("owner", 5);
+}
+
+TEST_F(PushReserveTest, pushv_gathered)
+{
+    struct iovec    iov[3];
+
+    iov[0].iov_base = (void *)"head:";
+    iov[0].iov_len = 5;
+    iov[1].iov_base = (void *)"";
+    iov[1].iov_len = 0;
+    iov[2].iov_base = (void *)"payload";
+    iov[2].iov_len = 7;
+    ASSERT_EQ(infq_pushv(infq, iov, 3), OK);
+
+    ExpectPop("head:payload", 12);
+}
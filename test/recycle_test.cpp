@@ -0,0 +1,198 @@
+/**
+ *
+ * @file    recycle_test
+ */
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include "file_queue.h"
+#include "mem_block.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+#define BLOCK_SIZE      1024
+#define RECYCLE_MAX     2
+
+const char *RECYCLE_FILE_PATH = "./recycle_blocks";
+
+static void
+remove_dir(const char *path)
+{
+    DIR             *dir;
+    struct dirent   *ent;
+    char            buf[512];
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%s/%s", path, ent->d_name);
+        unlink(buf);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+class RecycleTest: public testing::Test {
+protected:
+    RecycleTest() {}
+    virtual ~RecycleTest() {}
+
+    virtual void SetUp() {
+        remove_dir(RECYCLE_FILE_PATH);
+        mkdir(RECYCLE_FILE_PATH, 0755);
+        ASSERT_EQ(file_queue_init(&file_queue, RECYCLE_FILE_PATH), OK);
+    }
+
+    virtual void TearDown() {
+        file_queue_destroy(&file_queue);
+        remove_dir(RECYCLE_FILE_PATH);
+    }
+
+    const char* Path(const char *name) {
+        snprintf(path, sizeof(path), "%s/%s", RECYCLE_FILE_PATH, name);
+        return path;
+    }
+
+    void Create(const char *name) {
+        int     fd;
+
+        fd = open(Path(name), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        ASSERT_NE(fd, -1);
+        ASSERT_EQ(write(fd, name, strlen(name)), (ssize_t)strlen(name));
+        close(fd);
+    }
+
+    bool Exists(const char *name) {
+        return access(Path(name), F_OK) == 0;
+    }
+
+    file_queue_t    file_queue;
+    char            path[512];
+};
+
+TEST_F(RecycleTest, leftover_removed)
+{
+    // kept by a crashed run, they aren't tracked anymore
+    Create("recycle_0");
+    Create("recycle_7");
+    Create("file_block_3");
+
+    ASSERT_EQ(file_queue_set_recycle(&file_queue, RECYCLE_MAX), OK);
+    ASSERT_FALSE(Exists("recycle_0"));
+    ASSERT_FALSE(Exists("recycle_7"));
+    ASSERT_TRUE(Exists("file_block_3"));
+    ASSERT_EQ(file_queue.recycle_num, 0);
+}
+
+TEST_F(RecycleTest, disabled)
+{
+    Create("a");
+    ASSERT_EQ(file_queue_set_recycle(&file_queue, 0), OK);
+    ASSERT_EQ(file_queue_recycle_file(&file_queue, Path("a")), ERR);
+    ASSERT_TRUE(Exists("a"));
+    ASSERT_EQ(file_queue_reuse_file(&file_queue, Path("b")), ERR);
+}
+
+TEST_F(RecycleTest, keep_and_reuse)
+{
+    ASSERT_EQ(file_queue_set_recycle(&file_queue, RECYCLE_MAX), OK);
+    Create("a");
+    Create("b");
+    Create("c");
+
+    ASSERT_EQ(file_queue_recycle_file(&file_queue, Path("a")), OK);
+    ASSERT_EQ(file_queue_recycle_file(&file_queue, Path("b")), OK);
+    ASSERT_EQ(file_queue.recycle_num, RECYCLE_MAX);
+    ASSERT_FALSE(Exists("a"));
+    ASSERT_TRUE(Exists("recycle_0"));
+    ASSERT_TRUE(Exists("recycle_1"));
+
+    // enough files are kept, the caller removes it
+    ASSERT_EQ(file_queue_recycle_file(&file_queue, Path("c")), ERR);
+    ASSERT_TRUE(Exists("c"));
+
+    // the file kept last is reused first
+    ASSERT_EQ(file_queue_reuse_file(&file_queue, Path("x")), OK);
+    ASSERT_FALSE(Exists("recycle_1"));
+    ASSERT_TRUE(Exists("x"));
+    ASSERT_EQ(file_queue_reuse_file(&file_queue, Path("y")), OK);
+    ASSERT_FALSE(Exists("recycle_0"));
+    ASSERT_EQ(file_queue.recycle_num, 0);
+
+    ASSERT_EQ(file_queue_reuse_file(&file_queue, Path("z")), ERR);
+    ASSERT_FALSE(Exists("z"));
+}
+
+TEST_F(RecycleTest, linked_file_not_kept)
+{
+    char    link_path[512];
+
+    ASSERT_EQ(file_queue_set_recycle(&file_queue, RECYCLE_MAX), OK);
+    Create("a");
+    snprintf(link_path, sizeof(link_path), "%s/a_link", RECYCLE_FILE_PATH);
+    ASSERT_EQ(link(Path("a"), link_path), 0);
+
+    // still referred by the other link
+    ASSERT_EQ(file_queue_recycle_file(&file_queue, Path("a")), ERR);
+    ASSERT_TRUE(Exists("a"));
+    ASSERT_EQ(file_queue.recycle_num, 0);
+
+    ASSERT_EQ(file_queue_recycle_file(&file_queue, Path("missing")), ERR);
+}
+
+TEST_F(RecycleTest, reused_by_dump)
+{
+    mem_block_t     *mem_block;
+    char            name[64];
+    int             i, v, size;
+
+    ASSERT_EQ(file_queue_set_recycle(&file_queue, RECYCLE_MAX), OK);
+    Create("a");
+    ASSERT_EQ(file_queue_recycle_file(&file_queue, Path("a")), OK);
+
+    mem_block = mem_block_init(BLOCK_SIZE);
+    ASSERT_TRUE(mem_block != NULL);
+    ASSERT_EQ(mem_block_reset(mem_block, 0), OK);
+    for (i = 0; i < 10; i++) {
+        ASSERT_EQ(mem_block_push(mem_block, &i, sizeof(i)), OK);
+    }
+    snprintf(name, sizeof(name), "file_block_%d", file_queue.block_suffix);
+    ASSERT_EQ(file_queue_dump_block(&file_queue, mem_block), OK);
+    mem_block_destroy(mem_block);
+
+    // the file kept is overwritten by the block
+    ASSERT_EQ(file_queue.recycle_num, 0);
+    ASSERT_FALSE(Exists("recycle_0"));
+    ASSERT_TRUE(Exists(name));
+    for (i = 0; i < 10; i++) {
+        ASSERT_EQ(file_queue_at(&file_queue, i, &v, sizeof(v), &size), OK);
+        ASSERT_EQ(size, (int)sizeof(v));
+        ASSERT_EQ(v, i);
+    }
+}
+
+TEST_F(RecycleTest, removed_by_destroy)
+{
+    ASSERT_EQ(file_queue_set_recycle(&file_queue, RECYCLE_MAX), OK);
+    Create("a");
+    ASSERT_EQ(file_queue_recycle_file(&file_queue, Path("a")), OK);
+    ASSERT_TRUE(Exists("recycle_0"));
+
+    file_queue_destroy(&file_queue);
+    ASSERT_FALSE(Exists("recycle_0"));
+    ASSERT_EQ(file_queue_init(&file_queue, RECYCLE_FILE_PATH), OK);
+}
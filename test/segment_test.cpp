@@ -0,0 +1,139 @@
+/**
+ *
+ * @file    segment_test
+ */
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include "infq.h"
+}
+
+#define ERR     -1
+#define OK      0
+
+#define BLOCK_SIZE      1024
+#define BLOCK_NUM       4
+#define SEGMENT_BLOCKS  4
+#define ELE_NUM         (10 * BLOCK_NUM * BLOCK_SIZE / 8)
+
+const char *SEGMENT_FILE_PATH = "./segment_blocks";
+
+/**
+ * The files of consumed blocks are kept until the next 'infq_dump', remove them.
+ */
+static void
+remove_dir(const char *path)
+{
+    DIR             *dir;
+    struct dirent   *ent;
+    char            buf[512];
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%s/%s", path, ent->d_name);
+        unlink(buf);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+/**
+ * Count the files in 'path' which name starts with 'prefix'.
+ */
+static int
+count_files(const char *path, const char *prefix)
+{
+    DIR             *dir;
+    struct dirent   *ent;
+    int             n = 0;
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, prefix, strlen(prefix)) == 0) {
+            n++;
+        }
+    }
+    closedir(dir);
+    return n;
+}
+
+class SegmentTest: public testing::Test {
+protected:
+    SegmentTest() {}
+    virtual ~SegmentTest() {}
+
+    virtual void SetUp() {
+        infq_config_t   conf;
+
+        remove_dir(SEGMENT_FILE_PATH);
+        mkdir(SEGMENT_FILE_PATH, 0755);
+        memset(&conf, 0, sizeof(conf));
+        conf.data_path = SEGMENT_FILE_PATH;
+        conf.mem_block_size = BLOCK_SIZE;
+        conf.pushq_blocks_num = BLOCK_NUM;
+        conf.popq_blocks_num = BLOCK_NUM;
+        conf.block_usage_to_dump = 0.5;
+        conf.segment_blocks = SEGMENT_BLOCKS;
+
+        // the pushers dump the full blocks by themselves while the dumper is suspended
+        conf.overflow_policy = INFQ_OVERFLOW_SPILL;
+        infq = infq_init_by_conf(&conf, "segment");
+        ASSERT_TRUE(infq != NULL);
+        ASSERT_EQ(infq_suspend_bg_exec(infq, INFQ_DUMP_BG_EXEC), OK);
+    }
+
+    virtual void TearDown() {
+        infq_continue_bg_exec(infq, INFQ_DUMP_BG_EXEC);
+        ASSERT_EQ(infq_destroy_completely(infq), OK);
+        remove_dir(SEGMENT_FILE_PATH);
+    }
+
+    infq_t  *infq;
+};
+
+TEST_F(SegmentTest, blocks_appended_to_segments)
+{
+    infq_stats_t    stats;
+    int             i, v, size;
+
+    for (i = 0; i < ELE_NUM; i++) {
+        ASSERT_EQ(infq_push(infq, &i, sizeof(i)), OK);
+    }
+    ASSERT_EQ(infq_fetch_stats(infq, &stats), OK);
+    ASSERT_GT(stats.fileq_blocks_num, SEGMENT_BLOCKS);
+
+    // several blocks share a segment file, no file is created for a block
+    ASSERT_GE(count_files(SEGMENT_FILE_PATH, "segment_"), 2);
+    ASSERT_LE(count_files(SEGMENT_FILE_PATH, "segment_"),
+            (stats.fileq_blocks_num + SEGMENT_BLOCKS - 1) / SEGMENT_BLOCKS + 1);
+    ASSERT_EQ(count_files(SEGMENT_FILE_PATH, "file_block_"), 0);
+
+    // read from the blocks in the segments
+    for (i = 0; i < ELE_NUM; i += ELE_NUM / 16) {
+        ASSERT_EQ(infq_at(infq, i, &v, sizeof(v), &size), OK);
+        ASSERT_EQ(size, (int)sizeof(v));
+        ASSERT_EQ(v, i);
+    }
+
+    for (i = 0; i < ELE_NUM; i++) {
+        ASSERT_EQ(infq_pop_wait(infq, &v, sizeof(v), &size, 1000 * 1000), OK);
+        ASSERT_EQ(size, (int)sizeof(v));
+        ASSERT_EQ(v, i);
+    }
+    ASSERT_EQ(infq_size(infq), 0);
+}